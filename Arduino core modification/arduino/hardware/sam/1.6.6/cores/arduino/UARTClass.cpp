@@ -31,6 +31,14 @@ UARTClass::UARTClass( Uart *pUart, IRQn_Type dwIrq, uint32_t dwId, RingBuffer *p
   _pUart=pUart;
   _dwIrq=dwIrq;
   _dwId=dwId;
+
+  rx_callback = NULL;
+  rx_ctx_callback = NULL;
+  rx_ctx = NULL;
+
+  _tx_block_busy = false;
+  tx_block_done = NULL;
+  tx_block_ctx = NULL;
 }
 
 // Public Methods //////////////////////////////////////////////////////////////
@@ -136,6 +144,7 @@ int UARTClass::read( void )
 
 void UARTClass::flush( void )
 {
+  while (_tx_block_busy); //wait for the PDC block to be sent
   while (_tx_buffer->_iHead != _tx_buffer->_iTail); //wait for transmit data to be sent
   // Wait for transmission to complete
   while ((_pUart->UART_SR & UART_SR_TXRDY) != UART_SR_TXRDY)
@@ -146,7 +155,8 @@ size_t UARTClass::write( const uint8_t uc_data )
 {
   // Is the hardware currently busy?
   if (((_pUart->UART_SR & UART_SR_TXRDY) != UART_SR_TXRDY) |
-      (_tx_buffer->_iTail != _tx_buffer->_iHead))
+      (_tx_buffer->_iTail != _tx_buffer->_iHead) |
+      _tx_block_busy)
   {
     // If busy we buffer
     unsigned int l = (_tx_buffer->_iHead + 1) % SERIAL_BUFFER_SIZE;
@@ -171,6 +181,33 @@ void UARTClass::setRxIrqCallback(void (*clbk)(uint8_t))
     rx_callback = clbk;
 }
 
+void UARTClass::setRxIrqCallback(void (*clbk)(uint8_t, void *), void *ctx)
+{
+    rx_ctx_callback = NULL;  // never call the new callback with the old context
+    rx_ctx = ctx;
+    rx_ctx_callback = clbk;
+}
+
+bool UARTClass::writeBlock(const uint8_t *buffer, size_t size, void (*done)(void *ctx), void *ctx)
+{
+  if (_tx_block_busy || (_tx_buffer->_iTail != _tx_buffer->_iHead) || (size == 0) || (size > 0xFFFF))
+    return false;
+
+  // Wait for a character written directly to THR
+  while ((_pUart->UART_SR & UART_SR_TXRDY) != UART_SR_TXRDY)
+    ;
+
+  tx_block_done = done;
+  tx_block_ctx = ctx;
+  _tx_block_busy = true;
+
+  _pUart->UART_TPR = (uint32_t)(uintptr_t)buffer;  // 32 bit address, also on the host register mock
+  _pUart->UART_TCR = size;
+  _pUart->UART_PTCR = UART_PTCR_TXTEN;
+  _pUart->UART_IER = UART_IER_ENDTX;
+  return true;
+}
+
 void UARTClass::IrqHandler( void )
 {
   uint32_t status = _pUart->UART_SR;
@@ -181,12 +218,40 @@ void UARTClass::IrqHandler( void )
     uint8_t ch = _pUart->UART_RHR;
     _rx_buffer->store_char(ch);
     if (rx_callback) rx_callback(ch);
+    if (rx_ctx_callback) rx_ctx_callback(ch, rx_ctx);
+  }
+
+  // Has the PDC block been sent?
+  if (_tx_block_busy)
+  {
+    uint32_t mask = _pUart->UART_IMR;
+    if (((mask & UART_IMR_ENDTX) == UART_IMR_ENDTX) && ((status & UART_SR_ENDTX) == UART_SR_ENDTX))
+    {
+      // The PDC is done, wait for the last character to leave the shift register
+      _pUart->UART_IDR = UART_IDR_ENDTX;
+      _pUart->UART_IER = UART_IER_TXEMPTY;
+    }
+    else if (((mask & UART_IMR_TXEMPTY) == UART_IMR_TXEMPTY) && ((status & UART_SR_TXEMPTY) == UART_SR_TXEMPTY))
+    {
+      _pUart->UART_IDR = UART_IDR_TXEMPTY;
+      _pUart->UART_PTCR = UART_PTCR_TXTDIS;
+      _tx_block_busy = false;
+      // Send characters buffered meanwhile
+      if (_tx_buffer->_iTail != _tx_buffer->_iHead)
+        _pUart->UART_IER = UART_IER_TXRDY;
+      if (tx_block_done)
+        tx_block_done(tx_block_ctx);
+    }
   }
 
   // Do we need to keep sending data?
   if ((status & UART_SR_TXRDY) == UART_SR_TXRDY) 
   {
-    if (_tx_buffer->_iTail != _tx_buffer->_iHead) {
+    if (_tx_block_busy) {
+      // The PDC owns the transmitter, continue after the block
+      _pUart->UART_IDR = UART_IDR_TXRDY;
+    }
+    else if (_tx_buffer->_iTail != _tx_buffer->_iHead) {
       _pUart->UART_THR = _tx_buffer->_aucBuffer[_tx_buffer->_iTail];
       _tx_buffer->_iTail = (unsigned int)(_tx_buffer->_iTail + 1) % SERIAL_BUFFER_SIZE;
     }
@@ -63,6 +63,14 @@ class UARTClass : public HardwareSerial
     operator bool() { return true; }; // UART always active
     
     void setRxIrqCallback(void (*clbk)(uint8_t ch));
+    // Callback with the context of one receiver, e.g. one of several serial ports
+    void setRxIrqCallback(void (*clbk)(uint8_t ch, void *ctx), void *ctx);
+
+    // Transmits a block by the PDC without copying it. The buffer must be kept
+    // until done(ctx) is called from the interrupt after the last stop bit.
+    // Returns false while a block or buffered characters are being sent.
+    bool writeBlock(const uint8_t *buffer, size_t size, void (*done)(void *ctx), void *ctx);
+    bool isBlockBusy(void) { return _tx_block_busy; }
 
   protected:
     void init(const uint32_t dwBaudRate, const uint32_t config);
@@ -75,6 +83,12 @@ class UARTClass : public HardwareSerial
     uint32_t _dwId;
     
     void (*rx_callback)(uint8_t);
+    void (*rx_ctx_callback)(uint8_t, void *);
+    void *rx_ctx;
+
+    volatile bool _tx_block_busy;
+    void (*tx_block_done)(void *);
+    void *tx_block_ctx;
 
 };
 
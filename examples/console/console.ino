@@ -270,25 +270,24 @@ void cmdScanI()
 
 void cmdInfo()
 {
+    // all device queries in one burst
+    QSource3Cmd cmds[3] = {
+        {"#N", false},  // serial number
+        {"#G", false},  // frequency
+        {"#U", false}   // excitation current
+    };
+    if (!_qSource3.pipeline(cmds, 3))
+    {
+        printErrorCommunication();
+        return;
+    }
     {
-        char buffer[64];
-        if (!_qSource3.readSerialNo(buffer, 64))
-        {
-            printErrorCommunication();
-            return;
-        }
         Serial.print("   Serial number: ");
-        Serial.println(buffer);
+        Serial.println(cmds[0].response);
     }
     {
-        int x = _qSource3.readFreq();
-        if (x < 0)
-        {
-            printErrorCommunication();
-            return;
-        }
         Serial.print("   Frequency [kHz]: ");
-        Serial.println((float)x / 10.0);
+        Serial.println((float)atoi(cmds[1].response) / 10.0);
     }
     {
         Serial.print("   Frequency range: ");
@@ -299,14 +298,8 @@ void cmdInfo()
         Serial.println(msfq.getActualMSFilter()->calcMaxMz());
     }
     {
-        int x = _qSource3.readCurrent();
-        if (x < 0)
-        {
-            printErrorCommunication();
-            return;
-        }
         Serial.print("   Current [mA]: ");
-        Serial.println((float)x / 10.0);
+        Serial.println((float)atoi(cmds[2].response) / 10.0);
     }
 	
 	// MS filter info
@@ -343,25 +336,27 @@ void cmdInfo()
 	}
 	{
 		Serial.print("RF calib pnts (mz:pnt): ");
-		const StateTuneParRecords* r = msfq.getActualMSFilter()->getCalibPntsRF();
-		for (int i; i < r->_numberTuneParRecs; ++i)
+		static StateTuneParRecords r;  // off the stack
+		msfq.getActualMSFilter()->getCalibPntsRF(&r);
+		for (int i = 0; i < r._numberTuneParRecs; ++i)
 		{
-			Serial.print(r->_tuneParMZ[i]);
+			Serial.print(r._tuneParMZ[i]);
 			Serial.print(":");
-			Serial.print(r->_tuneParVal[i]);
-			if (i < r->_numberTuneParRecs - 1) Serial.print(", ");
+			Serial.print(r._tuneParVal[i]);
+			if (i < r._numberTuneParRecs - 1) Serial.print(", ");
 		}
 		Serial.println();
 	}
 	{
 		Serial.print("DC calib pnts (mz:pnt): ");
-		const StateTuneParRecords* r = msfq.getActualMSFilter()->getCalibPntsDC();
-		for (int i; i < r->_numberTuneParRecs; ++i)
+		static StateTuneParRecords r;  // off the stack
+		msfq.getActualMSFilter()->getCalibPntsDC(&r);
+		for (int i = 0; i < r._numberTuneParRecs; ++i)
 		{
-			Serial.print(r->_tuneParMZ[i]);
+			Serial.print(r._tuneParMZ[i]);
 			Serial.print(" :");
-			Serial.print(r->_tuneParVal[i]);
-			if (i < r->_numberTuneParRecs - 1) Serial.print(" ,");
+			Serial.print(r._tuneParVal[i]);
+			if (i < r._numberTuneParRecs - 1) Serial.print(" ,");
 		}
 		Serial.println();
 	}
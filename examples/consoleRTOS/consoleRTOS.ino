@@ -45,18 +45,22 @@ void scanI();
 
 // Low priority numbers denote low priority tasks.
 const int PRIORITY_TASK_QSOURCE3_TX = 3;
+const int PRIORITY_TASK_QSOURCE3_DEVICE = 2;
 const int PRIORITY_TASK_TERMINAL = 1;
 const int PRIORITY_TASK_UPDATE_DISPLAY = 2;
 
 const size_t STACK_SIZE_TASK_TERMINAL = 512;
 const size_t STACK_SIZE_TASK_UPDATE_DISPLAY = 512;
 const size_t STACK_SIZE_TASK_QSOURCE3_TX = 512;
+const size_t STACK_SIZE_TASK_QSOURCE3_DEVICE = 512;
 
 static_assert(STACK_SIZE_TASK_TERMINAL >= Q_SOURCE3_MIN_STACK_SIZE, "STACK_SIZE_TASK_TERMINAL too small");
+static_assert(STACK_SIZE_TASK_QSOURCE3_DEVICE >= Q_SOURCE3_MIN_STACK_SIZE, "STACK_SIZE_TASK_QSOURCE3_DEVICE too small");
 
 void taskTerminal(void *pvParameters);
 void taskUpdateDisplay(void *pvParameters);
 void taskQsource3Tx(void *pvParameters);
+void taskQsource3Device(void *pvParameters);
 
 
 static RTOS_Stream streamQSource3 = RTOS_Stream(&Serial2, 100);  // 100 ms timeout
@@ -98,6 +102,7 @@ void setup()
 
     streamQSource3.init();
     _qSource3.init(1000);  // 1000 ms timeout for write-read
+    _qSource3.initAsync();
     initCommJanasCardQSource3(0);
 
     // Initialize the built-in LED
@@ -131,6 +136,15 @@ void setup()
         NULL  // pxCreatedTask
     );
 
+    xTaskCreate(
+        taskQsource3Device,  // pvTaskCode
+        (const portCHAR *)"QSource3 device",  // pcName
+        STACK_SIZE_TASK_QSOURCE3_DEVICE,  // usStackDepth
+        NULL,  // pvParameters
+        PRIORITY_TASK_QSOURCE3_DEVICE,  // uxPriority
+        NULL  // pxCreatedTask
+    );
+
     vTaskStartScheduler();
 
     Serial.println("Failed to start FreeRTOS scheduler");
@@ -299,29 +313,25 @@ void cmdScanI()
 void cmdInfo()
 {
     TRACE_ME( printf("cmdInfo\r\n"); )
+    // all device queries in one burst
+    QSource3Cmd cmds[3] = {
+        {"#N", false},  // serial number
+        {"#G", false},  // frequency
+        {"#U", false}   // excitation current
+    };
+    if (!_qSource3.pipeline(cmds, 3))
+    {
+        TRACE_ME( printf("... COMMUNICATION ERROR\r\n"); )
+        printErrorCommunication();
+        return;
+    }
     {
-        TRACE_ME( printf("... reading serial number ...\r\n"); )
-        char buffer[64];
-        if (!_qSource3.readSerialNo(buffer, 64))
-        {
-            TRACE_ME( printf("... COMMUNICATION ERROR\r\n"); )
-            printErrorCommunication();
-            return;
-        }
         Serial.print("   Serial number: ");
-        Serial.println(buffer);
+        Serial.println(cmds[0].response);
     }
     {
-        TRACE_ME( printf("... reading frequency ...\r\n"); )
-        int x = _qSource3.readFreq();
-        if (x < 0)
-        {
-            TRACE_ME( printf("... COMMUNICATION ERROR\r\n"); )
-            printErrorCommunication();
-            return;
-        }
         Serial.print("   Frequency [kHz]: ");
-        Serial.println((float)x / 10.0);
+        Serial.println((float)atoi(cmds[1].response) / 10.0);
     }
     {
         Serial.print("   Frequency range: ");
@@ -332,15 +342,8 @@ void cmdInfo()
         Serial.println(msfq.getActualMSFilter()->calcMaxMz());
     }
     {
-        int x = _qSource3.readCurrent();
-        if (x < 0)
-        {
-            TRACE_ME( printf("... COMMUNICATION ERROR\r\n"); )
-            printErrorCommunication();
-            return;
-        }
         Serial.print("   Current [mA]: ");
-        Serial.println((float)x / 10.0);
+        Serial.println((float)atoi(cmds[2].response) / 10.0);
     }
 
 	// MS filter info
@@ -377,25 +380,27 @@ void cmdInfo()
 	}
 	{
 		Serial.print("RF calib pnts (mz:pnt): ");
-		const StateTuneParRecords* r = msfq.getActualMSFilter()->getCalibPntsRF();
-		for (int i; i < r->_numberTuneParRecs; ++i)
+		static StateTuneParRecords r;  // off the stack of the task
+		msfq.getActualMSFilter()->getCalibPntsRF(&r);
+		for (int i = 0; i < r._numberTuneParRecs; ++i)
 		{
-			Serial.print(r->_tuneParMZ[i]);
+			Serial.print(r._tuneParMZ[i]);
 			Serial.print(":");
-			Serial.print(r->_tuneParVal[i]);
-			if (i < r->_numberTuneParRecs - 1) Serial.print(", ");
+			Serial.print(r._tuneParVal[i]);
+			if (i < r._numberTuneParRecs - 1) Serial.print(", ");
 		}
 		Serial.println();
 	}
 	{
 		Serial.print("DC calib pnts (mz:pnt): ");
-		const StateTuneParRecords* r = msfq.getActualMSFilter()->getCalibPntsDC();
-		for (int i; i < r->_numberTuneParRecs; ++i)
+		static StateTuneParRecords r;  // off the stack of the task
+		msfq.getActualMSFilter()->getCalibPntsDC(&r);
+		for (int i = 0; i < r._numberTuneParRecs; ++i)
 		{
-			Serial.print(r->_tuneParMZ[i]);
+			Serial.print(r._tuneParMZ[i]);
 			Serial.print(" :");
-			Serial.print(r->_tuneParVal[i]);
-			if (i < r->_numberTuneParRecs - 1) Serial.print(" ,");
+			Serial.print(r._tuneParVal[i]);
+			if (i < r._numberTuneParRecs - 1) Serial.print(" ,");
 		}
 		Serial.println();
 	}
@@ -405,14 +410,23 @@ void cmdInfo()
 
 void scanI()
 {
-    int x = _qSource3.readCurrent();
-    if (x < 0)
+    // print the result of the previous request and ask for the next one,
+    // the display task does not wait for the device
+    static QSource3Request req = {NULL, NULL};
+    if (!JanasCardQSource3::isDone(&req))
     {
-        printErrorCommunication();
         return;
     }
-    Serial.print("   Current [mA]: ");
-    Serial.println((float)x / 10.0);
+    if (req.state == Q_SOURCE3_CMD_DONE)
+    {
+        Serial.print("   Current [mA]: ");
+        Serial.println((float)req.value / 10.0);
+    }
+    else if (req.state == Q_SOURCE3_CMD_ERROR)
+    {
+        printErrorCommunication();
+    }
+    _qSource3.readCurrentAsync(&req);
 }
 
 void cmdCalc()
@@ -482,3 +496,12 @@ void taskQsource3Tx(void *pvParameters)
 #else
 #error Oops! RTOS mode must be activated!
 #endif
+
+
+void taskQsource3Device(void *pvParameters)
+{
+    for(;;)
+    {
+        _qSource3.workAsync(portMAX_DELAY);
+    }
+}
@@ -0,0 +1,69 @@
+// QSource3 emulator on a second Arduino DUE.
+//
+// Serial1 (RX1, TX1) behind an RS422 transceiver replaces the JanasCard supply,
+// wire it to the Serial2 transceiver of the controlling board. The emulator
+// answers with the latency, jitter and faults configured below, so throughput
+// and latency of the library can be measured without the supply.
+// Statistics are printed when any character comes over the programming port,
+// printing them periodically would delay the responses.
+
+#include <QSource3Emulator.h>
+
+#define EMULATOR_BAUD_RATE 1500000
+#define EMULATOR_LATENCY_US 50
+#define EMULATOR_JITTER_US 20
+#define EMULATOR_DROP_EVERY 0      // e.g. 10000 loses every 10000th received byte on average
+#define EMULATOR_GARBLE_EVERY 0    // e.g. 1000 garbles every 1000th response on average
+#define EMULATOR_SEED 1
+
+const QSource3EmulatorConfig emulatorConfig = {
+	EMULATOR_BAUD_RATE,
+	EMULATOR_LATENCY_US,
+	EMULATOR_JITTER_US,
+	EMULATOR_DROP_EVERY,
+	EMULATOR_GARBLE_EVERY,
+	EMULATOR_SEED
+};
+
+QSource3Emulator emulator(&emulatorConfig);
+
+
+void setup() {
+	Serial.begin(115200);
+	Serial1.begin(EMULATOR_BAUD_RATE);
+	Serial.println("QSource3 emulator on Serial1.");
+}
+
+
+void printStats() {
+	const QSource3EmulatorStats& s = emulator.getStats();
+	Serial.print("commands = "); Serial.print(s.commands);
+	Serial.print(", rejected = "); Serial.print(s.rejected);
+	Serial.print(", busy = "); Serial.print(s.busy);
+	Serial.print(", collisions = "); Serial.print(s.collisions);
+	Serial.print(", dropped = "); Serial.print(s.dropped);
+	Serial.print(", garbled = "); Serial.print(s.garbled);
+	Serial.print(", overflows = "); Serial.println(s.overflows);
+	Serial.print("RS485 = "); Serial.print(emulator.isRS485());
+	Serial.print(", DC1 = "); Serial.print(emulator.getDC1());
+	Serial.print(", DC2 = "); Serial.print(emulator.getDC2());
+	Serial.print(", AC = "); Serial.print(emulator.getAC());
+	Serial.print(", range = "); Serial.print(emulator.getFreqRange());
+	Serial.print(", freq = "); Serial.println(emulator.getFreq(emulator.getFreqRange()));
+}
+
+
+void loop() {
+	while (Serial1.available() > 0) {
+		emulator.receive(Serial1.read(), micros());
+	}
+	int ch;
+	while ((ch = emulator.transmit(micros())) >= 0) {
+		Serial1.write((uint8_t)ch);
+	}
+
+	if (Serial.available() > 0) {
+		while (Serial.available() > 0) Serial.read();
+		printStats();
+	}
+}
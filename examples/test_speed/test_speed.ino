@@ -1,9 +1,28 @@
 #include <MSFilterQuad.h>
 #include <JanasCardQSource3.h>
+#include <MSFilterScan.h>
+#include <MSFilterCalib.h>
+#include <QSource3Encoder.h>
+#include <QSource3Parser.h>
 
 StateTuneParRecords tuneParRecordsAC;
 StateTuneParRecords tuneParRecordsDC;
 
+// compiled setpoint table of the middle frequency range
+#define SETPOINT_TABLE_STEP 0.25
+#define SETPOINT_TABLE_SIZE 2500
+MSFQSetpoint setpointTable[SETPOINT_TABLE_SIZE];
+
+// scan method prepared by calcUVBatch()
+#define METHOD_SIZE 500
+float methodMZ[METHOD_SIZE];
+int32_t methodDC1[METHOD_SIZE];
+int32_t methodDC2[METHOD_SIZE];
+uint32_t methodAC[METHOD_SIZE];
+
+#define SCAN_DWELL_US 1000
+MSFQTimerTimeSource timeSource;  // sleeps on a timer compare instead of spinning
+
 	
 JanasCardQSource3 _qSource3 = JanasCardQSource3();
 
@@ -18,10 +37,12 @@ static MSFilterQuad3 _msfq = MSFilterQuad3(
 void setup(){
 	
 	Serial.begin(115200);
+	timeSource.begin();
 	while (!Serial) {
 		; // wait for serial port to connect. Needed for native USB port only
 	}
 	Serial.println("Test MSFilterQuad speed.");
+	printFootprint();
 	
 	// tuneParRecordsAC._numberTuneParRecs = 1;
 	// tuneParRecordsAC._tuneParMZ[0] = 0;
@@ -95,7 +116,76 @@ void setup(){
 }
 
 
-void loop() {
+// static RAM used by the mass filter objects, nothing is allocated on heap
+void printFootprint() {
+	Serial.print("RAM [B]: calibration table = "); Serial.print(sizeof(StateTuneParRecords));
+	Serial.print(" (capacity "); Serial.print(MAX_NUMBER_OF_TUNE_PAR_RECORDS);
+	Serial.print("), spline = "); Serial.print(sizeof(MSFQSpline));
+	Serial.print(", MSFilterQuad = "); Serial.print(sizeof(MSFilterQuad));
+	Serial.print(", MSFilterQuad3 = "); Serial.print(sizeof(MSFilterQuad3));
+	Serial.print(", MSFQCalibBuffer = "); Serial.println(sizeof(MSFQCalibBuffer));
+}
+
+
+void measureEncoder() {
+	const long N = 1000;
+	char buff[QSOURCE3_ENCODE_SIZE];
+	long t0 = micros();
+	for (long i = 0; i < N; ++i) {
+		qsource3EncodeVoltages(buff, methodDC1[i % METHOD_SIZE], methodDC2[i % METHOD_SIZE], methodAC[i % METHOD_SIZE]);
+	}
+	long t1 = micros();
+	for (long i = 0; i < N; ++i) {
+		snprintf(buff, sizeof(buff), "#C %d %d %d\r", methodDC1[i % METHOD_SIZE], methodDC2[i % METHOD_SIZE], methodAC[i % METHOD_SIZE]);
+	}
+	long t2 = micros();
+	Serial.print("encode: mean per frame [us] = "); Serial.print((float)(t1 - t0) / N);
+	Serial.print(", snprintf = "); Serial.println((float)(t2 - t1) / N);
+}
+
+
+// a stream of "OK" and value responses as the device sends them
+#define PARSE_STREAM_SIZE 2048
+char parseStream[PARSE_STREAM_SIZE];
+
+void measureParser() {
+	size_t len = 0;
+	size_t frames = 0;
+	while (len + QSOURCE3_ENCODE_SIZE < PARSE_STREAM_SIZE) {
+		if (frames % 3 == 0) {
+			memcpy(parseStream + len, "OK", 2);
+			len += 2;
+		}
+		else {
+			len += qsource3EncodeInt(parseStream + len, methodAC[frames % METHOD_SIZE]);
+		}
+		parseStream[len++] = '\r';
+		++frames;
+	}
+
+	long sum = 0;
+	long t0 = micros();
+	QSource3Parser parser(QSOURCE3_EXPECT_VALUE);
+	for (size_t i = 0; i < len; ++i) {
+		if (parser.feed(parseStream[i]) == QSOURCE3_REPLY_VALUE) sum += parser.value();
+	}
+	long t1 = micros();
+	char buff[16];
+	for (size_t i = 0; i < len;) {
+		size_t n = 0;
+		while ((parseStream[i] != '\r') && (n < sizeof(buff) - 1)) buff[n++] = parseStream[i++];
+		++i;
+		buff[n] = '\0';
+		if (!((buff[0] == 'O') && (buff[1] == 'K'))) sum -= strtol(buff, NULL, 10);
+	}
+	long t2 = micros();
+	Serial.print("parse: mean per response [us] = "); Serial.print((float)(t1 - t0) / frames);
+	Serial.print(", copy and strtol = "); Serial.print((float)(t2 - t1) / frames);
+	Serial.print(", difference = "); Serial.println(sum);
+}
+
+
+float measureSetMZ() {
 	long N = 1000;
 	long acc = 0;
 	for (int i = 0; i < N; ++i) {
@@ -105,9 +195,103 @@ void loop() {
 		long t1 = micros();
 		acc += (t1 - t0);
 	}
-	float mean = (float)acc / N;
-	
-	Serial.print("mean [us] = ");
-	Serial.println(mean);
+	return (float)acc / N;
+}
+
+
+float measureCalc() {
+	MSFilterQuad* m = _msfq.getActualMSFilter();
+	long t0 = micros();
+	for (int i = 0; i < METHOD_SIZE; ++i) {
+		methodDC1[i] = (int32_t)(m->calcDC(methodMZ[i]) * 1000);
+		methodAC[i] = (uint32_t)(m->calcRF(methodMZ[i]) * 2000);
+	}
+	long t1 = micros();
+	return (float)(t1 - t0) / METHOD_SIZE;
+}
+
+
+// m/z error of a kernel relative to the spline, from RF amplitude over methodMZ
+float maxMZError(MSFQInterp interp) {
+	MSFilterQuad* m = _msfq.getActualMSFilter();
+	float maxErr = 0.0;
+	for (int i = 1; i < METHOD_SIZE; ++i) {
+		m->setInterpolation(MSFQ_INTERP_SPLINE);
+		float ref = m->calcRF(methodMZ[i]);
+		m->setInterpolation(interp);
+		float err = fabs(methodMZ[i] * (m->calcRF(methodMZ[i]) - ref) / ref);
+		if (err > maxErr) maxErr = err;
+	}
+	return maxErr;
+}
+
+
+void measureKernels() {
+	const char* names[] = {"spline", "linear", "monotone"};
+	MSFilterQuad* m = _msfq.getActualMSFilter();
+	for (int k = MSFQ_INTERP_SPLINE; k <= MSFQ_INTERP_MONOTONE; ++k) {
+		float err = maxMZError((MSFQInterp)k);
+		m->setInterpolation((MSFQInterp)k);
+		Serial.print("kernel "); Serial.print(names[k]);
+		Serial.print(": mean [us] = "); Serial.print(measureSetMZ());
+		Serial.print(", max m/z error = "); Serial.println(err, 4);
+	}
+	m->setInterpolation(MSFQ_INTERP_DEFAULT);
+}
+
+
+float measureBatch() {
+	long t0 = micros();
+	_msfq.getActualMSFilter()->calcUVBatch(methodMZ, METHOD_SIZE, methodDC1, methodDC2, methodAC);
+	long t1 = micros();
+	return (float)(t1 - t0) / METHOD_SIZE;
+}
+
+
+void loop() {
+	MSFilterQuad* m = _msfq.getActualMSFilter();
+
+	m->attachSetpointTable(NULL, 0);
+	Serial.print("spline: mean [us] = ");
+	Serial.println(measureSetMZ());
+
+	for (int i = 0; i < METHOD_SIZE; ++i) {
+		methodMZ[i] = 0.5 * i;
+	}
+	Serial.print("calc:   mean per point [us] = ");
+	Serial.println(measureCalc());
+	Serial.print("batch:  mean per point [us] = ");
+	Serial.println(measureBatch());
+	measureKernels();
+	measureEncoder();
+	measureParser();
+
+	MSFilterScan scan(m, &timeSource, methodDC1, methodDC2, methodAC, METHOD_SIZE);
+	if (scan.prepare(0.0, 0.5 * (METHOD_SIZE - 1), 0.5, SCAN_DWELL_US)) {
+		bool rc = scan.run();
+		const MSFQScanStats& s = scan.getStats();
+		Serial.print("scan:   "); Serial.print(rc ? "OK" : "ERROR");
+		Serial.print(", dwell [us] requested = "); Serial.print(SCAN_DWELL_US);
+		Serial.print(", mean = "); Serial.print(scan.getMeanDwell());
+		Serial.print(", min = "); Serial.print(s.minDwell);
+		Serial.print(", max = "); Serial.print(s.maxDwell);
+		Serial.print(", overruns = "); Serial.println(s.overruns);
+	}
+
+	m->attachSetpointTable(setpointTable, SETPOINT_TABLE_SIZE);
+	if (m->buildSetpointTable(SETPOINT_TABLE_STEP)) {
+		Serial.print("table:  mean [us] = ");
+		Serial.println(measureSetMZ());
+	}
+	else {
+		Serial.println("table:  too small");
+	}
+
+	const QSource3WriteStats& w = _qSource3.getWriteStats();
+	Serial.print("writes: frames = "); Serial.print(w.frames);
+	Serial.print(", bytes = "); Serial.print(w.bytes);
+	Serial.print(", unchanged frames skipped = "); Serial.print(w.framesSkipped);
+	Serial.print(", bytes = "); Serial.println(w.bytesSkipped);
+	_qSource3.resetWriteStats();
 	delay(1000);
 }
@@ -0,0 +1,180 @@
+// Minimal Arduino DUE core for the host build, see CMakeLists.txt.
+//
+// Time comes from CLOCK_MONOTONIC. Print and Stream follow the Arduino classes
+// as far as the library uses them. USARTClass (usart_host.cpp) needs the
+// FreeRTOS POSIX port or the FreeRTOS API of extras/host/freertos: its
+// "interrupt" is the highest priority task, which
+// clocks the bytes between the port and a QSource3Emulator at line speed.
+// The USART and PIO registers are plain variables, so initCommJanasCardQSource3()
+// compiles and runs without effect.
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#ifdef USE_RTOS
+#include <FreeRTOS.h>
+extern "C" BaseType_t xPortIsInsideInterrupt(void);
+#endif
+
+#define LED_BUILTIN 13
+
+uint32_t micros(void);
+uint32_t millis(void);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+// lets other tasks run while the caller polls, a no-op without scheduler
+void yield(void);
+
+
+// interrupt controller
+
+enum IRQn_Type {
+    UOTGHS_IRQn = 40
+};
+
+inline void NVIC_DisableIRQ(IRQn_Type) {}
+inline void NVIC_EnableIRQ(IRQn_Type) {}
+
+
+// registers touched by initCommJanasCardQSource3()
+
+struct Usart {
+    volatile uint32_t US_MR;
+    volatile uint32_t US_TTGR;
+    volatile uint32_t US_BRGR;
+    volatile uint32_t US_WPMR;
+};
+
+extern Usart* const USART0;
+extern Usart* const USART1;
+
+#define US_MR_USART_MODE_RS485 (0x1u << 0)
+#define US_MR_OVER (0x1u << 19)
+#define US_BRGR_CD(value) ((0xffffu << 0) & ((value) << 0))
+
+extern volatile uint32_t REG_PIOA_ABSR;
+extern volatile uint32_t REG_PIOA_PDR;
+extern volatile uint32_t REG_PIOB_ABSR;
+extern volatile uint32_t REG_PIOB_PDR;
+
+#define PIO_ABSR_P14 (0x1u << 14)
+#define PIO_PDR_P14 (0x1u << 14)
+#define PIO_ABSR_P25 (0x1u << 25)
+#define PIO_PDR_P25 (0x1u << 25)
+
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size);
+    size_t write(const char* str) { return (str == NULL) ? 0 : write((const uint8_t*)str, strlen(str)); }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+};
+
+
+class Stream : public Print {
+protected:
+    unsigned long _timeout = 1000;  // ms
+    int timedRead();
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+    unsigned long getTimeout() const { return _timeout; }
+
+    size_t readBytes(char* buffer, size_t length);
+
+    /// <returns>number of bytes without the terminator</returns>
+    size_t readBytesUntil(char terminator, char* buffer, size_t length);
+};
+
+
+class QSource3Emulator;
+
+/// <summary>
+/// USART of the DUE with the block transmission and receive callbacks of the
+/// modified core (Arduino core modification/), connected to a QSource3Emulator.
+/// </summary>
+class USARTClass : public Stream {
+private:
+    QSource3Emulator* _peer = NULL;
+    uint32_t _byteTime = 7;  // us at 1.5 Mbaud, 10 bits
+
+    void* _xWake = NULL;  // SemaphoreHandle_t, given when there is something to clock
+    void* _task = NULL;   // TaskHandle_t of the peripheral
+
+    // transmitter: characters of write(), then the block of writeBlock()
+    static const uint32_t TX_SIZE = 256;
+    uint8_t _tx[TX_SIZE];
+    volatile uint32_t _txHead = 0;
+    volatile uint32_t _txTail = 0;
+    const uint8_t* volatile _block = NULL;
+    volatile size_t _blockPos = 0;
+    size_t _blockSize = 0;
+    void (*_blockDone)(void* ctx) = NULL;
+    void* _blockCtx = NULL;
+    volatile bool _loseBlockDone = false;
+    uint32_t _lineFree = 0;  // micros() when the last clocked byte has left
+
+    // receiver, used without callback
+    static const uint32_t RX_SIZE = 128;
+    uint8_t _rx[RX_SIZE];
+    volatile uint32_t _rxHead = 0;
+    volatile uint32_t _rxTail = 0;
+
+    void (*_rxCallback)(uint8_t ch) = NULL;
+    void (*_rxCtxCallback)(uint8_t ch, void* ctx) = NULL;
+    void* _rxCtx = NULL;
+
+    static void _run(void* self);
+    bool _step(uint32_t now);
+    void _wake(void);
+
+public:
+    /// <summary>
+    /// Host only: connects the port to an emulator and starts the peripheral task.
+    /// Call before the scheduler is started.
+    /// </summary>
+    bool connect(QSource3Emulator* peer);
+
+    /// <summary>
+    /// Host only: the next block is sent without calling its done(), a lost interrupt.
+    /// </summary>
+    void loseNextBlockDone(void) { _loseBlockDone = true; }
+
+    void begin(uint32_t baud);
+    void end(void) {}
+    void setInterruptPriority(uint32_t) {}
+
+    int available(void);
+    int availableForWrite(void);
+    int peek(void);
+    int read(void);
+    void flush(void);
+    size_t write(uint8_t c);
+    size_t write(const uint8_t* buffer, size_t size);
+    using Print::write;
+
+    void setRxIrqCallback(void (*clbk)(uint8_t ch));
+    void setRxIrqCallback(void (*clbk)(uint8_t ch, void* ctx), void* ctx);
+
+    bool writeBlock(const uint8_t* buffer, size_t size, void (*done)(void* ctx), void* ctx);
+    bool isBlockBusy(void) { return _block != NULL; }
+};
+
+extern USARTClass Serial1;
+extern USARTClass Serial2;
+
+#endif
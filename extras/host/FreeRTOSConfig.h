@@ -0,0 +1,48 @@
+// FreeRTOS configuration of the host build, GCC_POSIX port of FreeRTOS-Kernel.
+
+#ifndef FREERTOS_CONFIG_H
+#define FREERTOS_CONFIG_H
+
+#define configUSE_PREEMPTION                    1
+#define configUSE_TIME_SLICING                  1
+#define configTICK_RATE_HZ                      1000
+#define configMAX_PRIORITIES                    8
+#define configMINIMAL_STACK_SIZE                ( ( unsigned short ) PTHREAD_STACK_MIN )
+#define configTOTAL_HEAP_SIZE                   ( ( size_t ) ( 1024 * 1024 ) )
+#define configMAX_TASK_NAME_LEN                 16
+#define configUSE_16_BIT_TICKS                  0
+#define configIDLE_SHOULD_YIELD                 1
+
+#define configSUPPORT_DYNAMIC_ALLOCATION        1
+#define configSUPPORT_STATIC_ALLOCATION         0
+#define configUSE_MUTEXES                       1
+#define configUSE_RECURSIVE_MUTEXES             0
+#define configUSE_COUNTING_SEMAPHORES           1
+#define configUSE_TASK_NOTIFICATIONS            1
+#define configUSE_QUEUE_SETS                    0
+#define configQUEUE_REGISTRY_SIZE               0
+
+#define configUSE_IDLE_HOOK                     0
+#define configUSE_TICK_HOOK                     0
+#define configUSE_MALLOC_FAILED_HOOK            0
+#define configCHECK_FOR_STACK_OVERFLOW          0
+#define configUSE_TRACE_FACILITY                0
+#define configGENERATE_RUN_TIME_STATS           0
+#define configUSE_CO_ROUTINES                   0
+#define configUSE_TIMERS                        0
+
+#define INCLUDE_vTaskDelay                      1
+#define INCLUDE_vTaskDelayUntil                 1
+#define INCLUDE_vTaskDelete                     1
+#define INCLUDE_vTaskSuspend                    1
+#define INCLUDE_xTaskGetCurrentTaskHandle       1
+#define INCLUDE_xTaskGetSchedulerState          1
+#define INCLUDE_uxTaskPriorityGet               1
+
+#ifndef __ASSEMBLER__
+#include <assert.h>
+#include <limits.h>
+#define configASSERT( x ) assert( x )
+#endif
+
+#endif /* FREERTOS_CONFIG_H */
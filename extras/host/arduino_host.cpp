@@ -0,0 +1,98 @@
+#include "Arduino.h"
+#include <time.h>
+
+static Usart _usart0;
+static Usart _usart1;
+Usart* const USART0 = &_usart0;
+Usart* const USART1 = &_usart1;
+
+volatile uint32_t REG_PIOA_ABSR;
+volatile uint32_t REG_PIOA_PDR;
+volatile uint32_t REG_PIOB_ABSR;
+volatile uint32_t REG_PIOB_PDR;
+
+
+uint32_t micros(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+}
+
+
+uint32_t millis(void)
+{
+    return micros() / 1000;
+}
+
+
+// busy like on the DUE, a task that must sleep uses vTaskDelay()
+void delay(uint32_t ms)
+{
+    uint32_t t0 = millis();
+    while (millis() - t0 < ms) yield();
+}
+
+
+void delayMicroseconds(uint32_t us)
+{
+    uint32_t t0 = micros();
+    while (micros() - t0 < us);
+}
+
+
+// replaced by usart_host.cpp in the RTOS build
+__attribute__((weak)) void yield(void)
+{
+}
+
+
+size_t Print::write(const uint8_t* buffer, size_t size)
+{
+    size_t n = 0;
+    while (size-- > 0)
+    {
+        if (write(*buffer++) == 0) break;
+        ++n;
+    }
+    return n;
+}
+
+
+int Stream::timedRead()
+{
+    uint32_t t0 = millis();
+    do
+    {
+        int c = read();
+        if (c >= 0) return c;
+        yield();
+    } while (millis() - t0 < _timeout);
+    return -1;
+}
+
+
+size_t Stream::readBytes(char* buffer, size_t length)
+{
+    size_t n = 0;
+    while (n < length)
+    {
+        int c = timedRead();
+        if (c < 0) break;
+        buffer[n++] = (char)c;
+    }
+    return n;
+}
+
+
+size_t Stream::readBytesUntil(char terminator, char* buffer, size_t length)
+{
+    size_t n = 0;
+    while (n < length)
+    {
+        int c = timedRead();
+        if (c < 0 || c == terminator) break;
+        buffer[n++] = (char)c;
+    }
+    return n;
+}
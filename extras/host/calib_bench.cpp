@@ -0,0 +1,131 @@
+// Editing one calibration point of MSFilterQuad on the host: moveCalibPnt(),
+// insertCalibPnt() and deleteCalibPnt() against the full rebuild they replace,
+// an edit of the records followed by initSplineRF() and initSplineDC(), for
+// tables of 3 to MAX_NUMBER_OF_TUNE_PAR_RECORDS points. With "table" true a
+// setpoint table is valid before each edit and rebuilt by it, the full
+// rebuild then calls buildSetpointTable() as well.
+//
+// Usage: calib_bench [edits] [repeats] > calib.json
+//
+// Prints one JSON document, times are ns per edit: min, median and max over
+// the repeats of a batch of edits.
+
+#include "MSFilterQuad.h"
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+#define BENCH_R0 6e-3
+#define BENCH_MAX_CALIB_MZ 500.0
+#define BENCH_TABLE_STEP 1.0
+#define BENCH_TABLE_SIZE 4000
+
+static int _edits = 200;
+static int _repeats = 11;
+static bool _first = true;
+
+static const char* const _ops[] = {"move", "insert_delete", "rebuild"};
+
+static JanasCardQSource3 _device(NULL);
+static StateTuneParRecords _rf;
+static StateTuneParRecords _dc;
+static MSFQSetpoint _table[BENCH_TABLE_SIZE];
+
+
+static uint64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static void fillCalib(StateTuneParRecords* records, size_t size)
+{
+    records->_numberTuneParRecs = size;
+    for (size_t i = 0; i < size; ++i)
+    {
+        records->_tuneParMZ[i] = BENCH_MAX_CALIB_MZ * i / size;
+        records->_tuneParVal[i] = 0.01f * (i % 5);
+    }
+}
+
+
+// one edit of the middle point of the RF table, k alternates the value
+static void edit(MSFilterQuad* filter, int op, int k, bool table)
+{
+    size_t mid = _rf._numberTuneParRecs / 2;
+    float mz = _rf._tuneParMZ[mid];
+    float val = (k & 1) ? 0.02f : -0.02f;
+
+    switch (op)
+    {
+    case 0:
+        filter->moveCalibPnt(MSFQ_CALIB_RF, mid, mz, val);
+        break;
+    case 1:
+        // a new point between mid and its neighbour, and away again
+        filter->insertCalibPnt(MSFQ_CALIB_RF, mz + 1.0f, val);
+        filter->deleteCalibPnt(MSFQ_CALIB_RF, mid + 1);
+        break;
+    default:
+        _rf._tuneParVal[mid] = val;
+        filter->initSplineRF();
+        filter->initSplineDC();
+        if (table) filter->buildSetpointTable(BENCH_TABLE_STEP);
+        break;
+    }
+}
+
+
+static void bench(int op, size_t size, bool table)
+{
+    fillCalib(&_rf, size);
+    fillCalib(&_dc, size);
+    MSFilterQuad filter(BENCH_R0, &_device, &_rf, &_dc);
+    filter.initRFFactor(480000.0);
+    if (table)
+    {
+        filter.attachSetpointTable(_table, BENCH_TABLE_SIZE);
+        filter.buildSetpointTable(BENCH_TABLE_STEP);
+    }
+
+    // the full table has no room for the inserted point
+    if ((op == 1) && (size >= MAX_NUMBER_OF_TUNE_PAR_RECORDS)) return;
+
+    std::vector<double> ns(_repeats);
+    for (int r = 0; r < _repeats; ++r)
+    {
+        uint64_t t0 = nowNs();
+        for (int k = 0; k < _edits; ++k) edit(&filter, op, k, table);
+        ns[r] = (double)(nowNs() - t0) / _edits;
+    }
+    std::sort(ns.begin(), ns.end());
+    if (op == 1) for (int r = 0; r < _repeats; ++r) ns[r] /= 2;  // per edit
+
+    printf("%s\n    {\"op\": \"%s\", \"points\": %zu, \"table\": %s, \"min_ns\": %.1f, \"median_ns\": %.1f, \"max_ns\": %.1f}",
+        _first ? "" : ",", _ops[op], size, table ? "true" : "false", ns[0], ns[_repeats / 2], ns[_repeats - 1]);
+    _first = false;
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc > 1) _edits = atoi(argv[1]);
+    if (argc > 2) _repeats = atoi(argv[2]);
+
+    _device.writeRSMode(0);
+    _device.setGuardTime(0);
+
+    printf("{\n  \"benchmark\": \"calib\",\n  \"max_points\": %d,\n  \"edits\": %d,\n  \"repeats\": %d,\n  \"results\": [",
+        MAX_NUMBER_OF_TUNE_PAR_RECORDS, _edits, _repeats);
+    for (int table = 0; table < 2; ++table)
+    {
+        for (size_t size = 3; size <= MAX_NUMBER_OF_TUNE_PAR_RECORDS; ++size)
+        {
+            for (int op = 0; op < 3; ++op) bench(op, size, table != 0);
+        }
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,30 @@
+// Static RAM of the mass filter classes in this build, the host counterpart of
+// printFootprint() of examples/test_speed. Nothing is allocated on heap, so the
+// RAM of a filter is its object and the calibration tables it points to.
+// The capacity is MAX_NUMBER_OF_TUNE_PAR_RECORDS of MSFilterQuadConfig.h.
+//
+// Usage: msfq_footprint
+//
+// Sizes are those of the host (64-bit pointers); on the DUE the pointer and
+// size_t members take 4 bytes, the tables are the same.
+
+#include "MSFilterQuad.h"
+#include "MSFilterCalib.h"
+
+int main()
+{
+    size_t table = sizeof(StateTuneParRecords);
+    size_t perFilter = sizeof(MSFilterQuad) + 2 * table;
+    size_t perFilter3 = sizeof(MSFilterQuad3) + 6 * table;
+    printf("capacity = %d points\n", MAX_NUMBER_OF_TUNE_PAR_RECORDS);
+    printf("StateTuneParRecords = %zu B\n", table);
+    printf("MSFQSpline = %zu B\n", sizeof(MSFQSpline));
+    printf("MSFilterQuad = %zu B, with its 2 tables %zu B\n", sizeof(MSFilterQuad), perFilter);
+    printf("MSFilterQuad3 = %zu B, with its 6 tables %zu B\n", sizeof(MSFilterQuad3), perFilter3);
+    printf("MSFQCalibBuffer = %zu B (optional, per filter)\n", sizeof(MSFQCalibBuffer));
+
+    // a point costs 8 bytes in its table and 4 in the spline of the table
+    size_t perPoint = sizeof(StateTuneParRecords::_tuneParMZ[0]) + sizeof(StateTuneParRecords::_tuneParVal[0]) + sizeof(MSFQSpline::y2[0]);
+    printf("per point and table = %zu B\n", perPoint);
+    return (perPoint == 12) ? 0 : 1;
+}
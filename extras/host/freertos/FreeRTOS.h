@@ -0,0 +1,36 @@
+// FreeRTOS API of the library on std::thread, for host builds without
+// FreeRTOS-Kernel, see CMakeLists.txt. Only what the library, the tests and
+// the benchmarks call is provided, with the FreeRTOS semantics of the values
+// and timeouts. It is not a scheduler: every task is a thread and they run in
+// parallel, priorities are ignored and an "interrupt" is any thread for which
+// xPortIsInsideInterrupt() is true. A tick is 1 ms of CLOCK_MONOTONIC.
+
+#ifndef INC_FREERTOS_H
+#define INC_FREERTOS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "FreeRTOSConfig.h"
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFFUL)
+#define pdMS_TO_TICKS(xTimeInMs) ((TickType_t)(((uint64_t)(xTimeInMs) * (uint64_t)configTICK_RATE_HZ) / (uint64_t)1000U))
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+
+// the woken task runs at once anyway
+#define portYIELD_FROM_ISR(x) ((void)(x))
+
+void vPortEnterCritical(void);
+void vPortExitCritical(void);
+
+#endif
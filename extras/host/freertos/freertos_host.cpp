@@ -0,0 +1,326 @@
+// The std::thread FreeRTOS API, see FreeRTOS.h.
+
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+#include "message_buffer.h"
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct tskTaskControlBlock {
+    TaskFunction_t code = NULL;
+    void* parameters = NULL;
+    std::mutex mutex;
+    std::condition_variable cv;
+    uint32_t notification = 0;
+};
+
+struct QueueDefinition {
+    std::mutex mutex;
+    std::condition_variable cv;
+    UBaseType_t length;
+    UBaseType_t itemSize;  // 0 for semaphores
+    UBaseType_t count = 0;
+    UBaseType_t head = 0;
+    std::vector<uint8_t> items;
+};
+
+struct MessageBufferDef_t {
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t size;
+    size_t used = 0;  // messages and their lengths
+    std::deque<std::vector<uint8_t> > messages;
+};
+
+static const std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+
+static std::mutex _schedulerMutex;
+static std::condition_variable _schedulerStarted;
+static bool _running = false;
+
+static std::recursive_mutex _critical;
+
+static thread_local tskTaskControlBlock* _current = NULL;
+
+
+// waits for pred under lock, ticks as in FreeRTOS, returns pred()
+template <class Pred>
+static bool waitTicks(std::unique_lock<std::mutex>& lock, std::condition_variable& cv, TickType_t ticks, Pred pred)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        cv.wait(lock, pred);
+        return true;
+    }
+    return cv.wait_for(lock, std::chrono::milliseconds((uint64_t)ticks * portTICK_PERIOD_MS), pred);
+}
+
+
+void vPortEnterCritical(void)
+{
+    _critical.lock();
+}
+
+
+void vPortExitCritical(void)
+{
+    _critical.unlock();
+}
+
+
+void vPortYield(void)
+{
+    std::this_thread::yield();
+}
+
+
+// tasks
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char*, uint32_t, void* pvParameters, UBaseType_t,
+    TaskHandle_t* pxCreatedTask)
+{
+    tskTaskControlBlock* tcb = new tskTaskControlBlock;
+    tcb->code = pxTaskCode;
+    tcb->parameters = pvParameters;
+    std::thread([tcb] {
+        {
+            std::unique_lock<std::mutex> lock(_schedulerMutex);
+            _schedulerStarted.wait(lock, [] { return _running; });
+        }
+        _current = tcb;
+        tcb->code(tcb->parameters);
+    }).detach();
+    if (pxCreatedTask != NULL) *pxCreatedTask = tcb;
+    return pdPASS;
+}
+
+
+void vTaskStartScheduler(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(_schedulerMutex);
+        _running = true;
+    }
+    _schedulerStarted.notify_all();
+    for (;;)
+    {
+        std::this_thread::sleep_for(std::chrono::hours(1));  // the tasks end the program
+    }
+}
+
+
+BaseType_t xTaskGetSchedulerState(void)
+{
+    std::lock_guard<std::mutex> lock(_schedulerMutex);
+    return _running ? taskSCHEDULER_RUNNING : taskSCHEDULER_NOT_STARTED;
+}
+
+
+TickType_t xTaskGetTickCount(void)
+{
+    uint64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - _start).count();
+    return (TickType_t)(ms / portTICK_PERIOD_MS);
+}
+
+
+TickType_t xTaskGetTickCountFromISR(void)
+{
+    return xTaskGetTickCount();
+}
+
+
+void vTaskDelay(TickType_t xTicksToDelay)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds((uint64_t)xTicksToDelay * portTICK_PERIOD_MS));
+}
+
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (_current == NULL) _current = new tskTaskControlBlock;  // a thread not created by xTaskCreate()
+    return _current;
+}
+
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify)
+{
+    {
+        std::lock_guard<std::mutex> lock(xTaskToNotify->mutex);
+        ++xTaskToNotify->notification;
+    }
+    xTaskToNotify->cv.notify_all();
+    return pdPASS;
+}
+
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t*)
+{
+    xTaskNotifyGive(xTaskToNotify);
+}
+
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    tskTaskControlBlock* tcb = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(tcb->mutex);
+    waitTicks(lock, tcb->cv, xTicksToWait, [tcb] { return tcb->notification > 0; });
+    uint32_t value = tcb->notification;
+    if (value > 0)
+    {
+        tcb->notification = xClearCountOnExit ? 0 : value - 1;
+    }
+    return value;
+}
+
+
+// queues and semaphores
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize)
+{
+    if (uxQueueLength == 0) return NULL;
+    QueueDefinition* q = new QueueDefinition;
+    q->length = uxQueueLength;
+    q->itemSize = uxItemSize;
+    q->items.resize(uxQueueLength * uxItemSize);
+    return q;
+}
+
+
+QueueHandle_t xQueueCreateCountingSemaphore(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount)
+{
+    if (uxInitialCount > uxMaxCount) return NULL;
+    QueueDefinition* q = xQueueCreate(uxMaxCount, 0);
+    if (q != NULL) q->count = uxInitialCount;
+    return q;
+}
+
+
+void vQueueDelete(QueueHandle_t xQueue)
+{
+    delete xQueue;
+}
+
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void* pvItemToQueue, TickType_t xTicksToWait)
+{
+    QueueDefinition* q = xQueue;
+    {
+        std::unique_lock<std::mutex> lock(q->mutex);
+        if (!waitTicks(lock, q->cv, xTicksToWait, [q] { return q->count < q->length; })) return pdFALSE;
+        if (q->itemSize > 0)
+        {
+            UBaseType_t i = (q->head + q->count) % q->length;
+            memcpy(&(q->items[i * q->itemSize]), pvItemToQueue, q->itemSize);
+        }
+        ++q->count;
+    }
+    q->cv.notify_all();
+    return pdTRUE;
+}
+
+
+BaseType_t xQueueSendFromISR(QueueHandle_t xQueue, const void* pvItemToQueue, BaseType_t*)
+{
+    return xQueueSend(xQueue, pvItemToQueue, 0);
+}
+
+
+BaseType_t xQueueGiveFromISR(QueueHandle_t xQueue, BaseType_t*)
+{
+    return xQueueSend(xQueue, NULL, 0);
+}
+
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void* pvBuffer, TickType_t xTicksToWait)
+{
+    QueueDefinition* q = xQueue;
+    {
+        std::unique_lock<std::mutex> lock(q->mutex);
+        if (!waitTicks(lock, q->cv, xTicksToWait, [q] { return q->count > 0; })) return pdFALSE;
+        if (q->itemSize > 0)
+        {
+            memcpy(pvBuffer, &(q->items[q->head * q->itemSize]), q->itemSize);
+        }
+        q->head = (q->head + 1) % q->length;
+        --q->count;
+    }
+    q->cv.notify_all();
+    return pdTRUE;
+}
+
+
+BaseType_t xQueueSemaphoreTake(QueueHandle_t xQueue, TickType_t xTicksToWait)
+{
+    return xQueueReceive(xQueue, NULL, xTicksToWait);
+}
+
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue)
+{
+    std::lock_guard<std::mutex> lock(xQueue->mutex);
+    return xQueue->count;
+}
+
+
+// message buffers
+
+MessageBufferHandle_t xMessageBufferCreate(size_t xBufferSizeBytes)
+{
+    MessageBufferDef_t* mb = new MessageBufferDef_t;
+    mb->size = xBufferSizeBytes;
+    return mb;
+}
+
+
+void vMessageBufferDelete(MessageBufferHandle_t xMessageBuffer)
+{
+    delete xMessageBuffer;
+}
+
+
+size_t xMessageBufferSend(MessageBufferHandle_t xMessageBuffer, const void* pvTxData, size_t xDataLengthBytes, TickType_t xTicksToWait)
+{
+    MessageBufferDef_t* mb = xMessageBuffer;
+    size_t need = xDataLengthBytes + sizeof(size_t);
+    if (need > mb->size) return 0;
+    {
+        std::unique_lock<std::mutex> lock(mb->mutex);
+        if (!waitTicks(lock, mb->cv, xTicksToWait, [mb, need] { return mb->size - mb->used >= need; })) return 0;
+        const uint8_t* data = (const uint8_t*)pvTxData;
+        mb->messages.push_back(std::vector<uint8_t>(data, data + xDataLengthBytes));
+        mb->used += need;
+    }
+    mb->cv.notify_all();
+    return xDataLengthBytes;
+}
+
+
+size_t xMessageBufferSendFromISR(MessageBufferHandle_t xMessageBuffer, const void* pvTxData, size_t xDataLengthBytes, BaseType_t*)
+{
+    return xMessageBufferSend(xMessageBuffer, pvTxData, xDataLengthBytes, 0);
+}
+
+
+size_t xMessageBufferReceive(MessageBufferHandle_t xMessageBuffer, void* pvRxData, size_t xBufferLengthBytes, TickType_t xTicksToWait)
+{
+    MessageBufferDef_t* mb = xMessageBuffer;
+    size_t n;
+    {
+        std::unique_lock<std::mutex> lock(mb->mutex);
+        if (!waitTicks(lock, mb->cv, xTicksToWait, [mb] { return !mb->messages.empty(); })) return 0;
+        n = mb->messages.front().size();
+        if (n > xBufferLengthBytes) return 0;  // the message stays, as in FreeRTOS
+        memcpy(pvRxData, mb->messages.front().data(), n);
+        mb->messages.pop_front();
+        mb->used -= n + sizeof(size_t);
+    }
+    mb->cv.notify_all();
+    return n;
+}
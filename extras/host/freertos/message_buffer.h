@@ -0,0 +1,18 @@
+// Message buffers of the std::thread FreeRTOS API, see FreeRTOS.h. A message
+// takes its length plus sizeof(size_t) bytes of the buffer, as in FreeRTOS.
+
+#ifndef FREERTOS_MESSAGE_BUFFER_H
+#define FREERTOS_MESSAGE_BUFFER_H
+
+#include "FreeRTOS.h"
+
+struct MessageBufferDef_t;
+typedef struct MessageBufferDef_t* MessageBufferHandle_t;
+
+MessageBufferHandle_t xMessageBufferCreate(size_t xBufferSizeBytes);
+void vMessageBufferDelete(MessageBufferHandle_t xMessageBuffer);
+size_t xMessageBufferSend(MessageBufferHandle_t xMessageBuffer, const void* pvTxData, size_t xDataLengthBytes, TickType_t xTicksToWait);
+size_t xMessageBufferSendFromISR(MessageBufferHandle_t xMessageBuffer, const void* pvTxData, size_t xDataLengthBytes, BaseType_t* pxHigherPriorityTaskWoken);
+size_t xMessageBufferReceive(MessageBufferHandle_t xMessageBuffer, void* pvRxData, size_t xBufferLengthBytes, TickType_t xTicksToWait);
+
+#endif
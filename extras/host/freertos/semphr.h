@@ -0,0 +1,23 @@
+// Semaphores of the std::thread FreeRTOS API, see FreeRTOS.h. The mutex has
+// no priority inheritance, there are no priorities.
+
+#ifndef SEMAPHORE_H
+#define SEMAPHORE_H
+
+#include "queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+QueueHandle_t xQueueCreateCountingSemaphore(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount);
+BaseType_t xQueueSemaphoreTake(QueueHandle_t xQueue, TickType_t xTicksToWait);
+BaseType_t xQueueGiveFromISR(QueueHandle_t xQueue, BaseType_t* pxHigherPriorityTaskWoken);
+
+#define xSemaphoreCreateBinary() xQueueCreateCountingSemaphore(1, 0)
+#define xSemaphoreCreateMutex() xQueueCreateCountingSemaphore(1, 1)
+#define xSemaphoreCreateCounting(uxMaxCount, uxInitialCount) xQueueCreateCountingSemaphore((uxMaxCount), (uxInitialCount))
+#define xSemaphoreTake(xSemaphore, xBlockTime) xQueueSemaphoreTake((xSemaphore), (xBlockTime))
+#define xSemaphoreGive(xSemaphore) xQueueSend((QueueHandle_t)(xSemaphore), NULL, 0)
+#define xSemaphoreGiveFromISR(xSemaphore, pxHigherPriorityTaskWoken) xQueueGiveFromISR((QueueHandle_t)(xSemaphore), (pxHigherPriorityTaskWoken))
+#define vSemaphoreDelete(xSemaphore) vQueueDelete((QueueHandle_t)(xSemaphore))
+
+#endif
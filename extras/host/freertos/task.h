@@ -0,0 +1,42 @@
+// Tasks of the std::thread FreeRTOS API, see FreeRTOS.h.
+
+#ifndef INC_TASK_H
+#define INC_TASK_H
+
+#include "FreeRTOS.h"
+
+struct tskTaskControlBlock;
+typedef struct tskTaskControlBlock* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define tskIDLE_PRIORITY ((UBaseType_t)0U)
+
+#define taskSCHEDULER_SUSPENDED ((BaseType_t)0)
+#define taskSCHEDULER_NOT_STARTED ((BaseType_t)1)
+#define taskSCHEDULER_RUNNING ((BaseType_t)2)
+
+#define taskENTER_CRITICAL() vPortEnterCritical()
+#define taskEXIT_CRITICAL() vPortExitCritical()
+#define taskYIELD() vPortYield()
+
+// the thread of a task starts with vTaskStartScheduler() or at once when it runs
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char* pcName, uint32_t usStackDepth,
+    void* pvParameters, UBaseType_t uxPriority, TaskHandle_t* pxCreatedTask);
+
+// starts the created tasks, does not return
+void vTaskStartScheduler(void);
+
+BaseType_t xTaskGetSchedulerState(void);
+TickType_t xTaskGetTickCount(void);
+TickType_t xTaskGetTickCountFromISR(void);
+void vTaskDelay(TickType_t xTicksToDelay);
+void vPortYield(void);
+
+// any thread has a handle, also the one of main()
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify);
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t* pxHigherPriorityTaskWoken);
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait);
+
+#endif
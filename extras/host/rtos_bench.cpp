@@ -0,0 +1,211 @@
+// JanasCardQSource3 on the FreeRTOS POSIX port: every transport and lock policy
+// against a QSource3Emulator, with the real RTOS_Stream, message buffer, mutex,
+// async queues and task notifications. Built by the host build (CMakeLists.txt).
+//
+// Usage: rtos_bench [queries] [latency us] [jitter us]
+// Returns non-zero when a request failed, ctest runs it with a few queries.
+
+#include "JanasCardQSource3Impl.h"
+#include <task.h>
+#include <algorithm>
+#include <vector>
+
+// the combinations not instantiated by JanasCardQSource3.cpp
+template class JanasCardQSource3T<QSource3DeadlineTransport<RTOS_Stream>, QSource3NoLock>;
+template class JanasCardQSource3T<QSource3StreamTransport, QSource3IrqLock>;
+template class JanasCardQSource3T<QSource3LoopbackTransport, QSource3MutexLock>;
+
+#define BENCH_TIMEOUT_MS 100
+#define BENCH_PRIORITY (tskIDLE_PRIORITY + 1)
+#define BENCH_OWNER_PRIORITY (tskIDLE_PRIORITY + 2)
+#define BENCH_TX_PRIORITY (tskIDLE_PRIORITY + 3)
+#define BENCH_STACK_SIZE (configMINIMAL_STACK_SIZE * 4)
+
+static int _queries = 2000;
+static int _failed = 0;  // of all benchmarks, the exit code
+static QSource3EmulatorConfig _config = {Q_SOURCE3_SERIAL_BAUD_RATE, 50, 20, 0, 0, 1};
+
+static QSource3Emulator _emulatorRTOS;  // on Serial2 behind RTOS_Stream
+static QSource3Emulator _emulatorBare;  // on Serial1, polled
+static QSource3Emulator _emulatorLoop;  // in memory
+
+static RTOS_Stream _stream(&Serial2, BENCH_TIMEOUT_MS);
+
+static JanasCardQSource3 _device(&_stream);
+static JanasCardQSource3T<QSource3DeadlineTransport<RTOS_Stream>, QSource3NoLock> _deviceNoLock(&_stream);
+static JanasCardQSource3T<QSource3StreamTransport, QSource3IrqLock> _deviceBare(&Serial1);
+static JanasCardQSource3Loopback _deviceLoop(&_emulatorLoop);
+static JanasCardQSource3T<QSource3LoopbackTransport, QSource3MutexLock> _deviceLoopMutex(&_emulatorLoop);
+
+
+static void report(const char* name, std::vector<uint32_t>& t, int failed)
+{
+    _failed += failed;
+    std::sort(t.begin(), t.end());
+    size_t n = t.size();
+    if (n == 0)
+    {
+        printf("  %-16s no responses, %d failed\n", name, failed);
+        return;
+    }
+    printf("  %-16s n %zu  min %u  median %u  p99 %u  max %u us  failed %d\n",
+        name, n, t[0], t[n / 2], t[n * 99 / 100], t[n - 1], failed);
+}
+
+
+template <class D>
+static void bench(const char* name, D* device)
+{
+    printf("%s\n", name);
+    device->init(pdMS_TO_TICKS(BENCH_TIMEOUT_MS));
+    if (!device->writeRSMode(0) || !device->measureGuardTime())
+    {
+        printf("  no connection\n");
+        ++_failed;
+        return;
+    }
+
+    std::vector<uint32_t> t;
+    int failed = 0;
+    for (int i = 0; i < _queries; ++i)
+    {
+        uint32_t t0 = micros();
+        if (device->readFreq() >= 0) t.push_back(micros() - t0); else ++failed;
+    }
+    report("readFreq", t, failed);
+
+    // every frame is sent, each one waits for the guard time of the previous one
+    device->setSuppressUnchanged(false);
+    t.clear();
+    failed = 0;
+    for (int i = 0; i < _queries; ++i)
+    {
+        uint32_t t0 = micros();
+        if (device->writeVoltages(i, -i, 100000 + i)) t.push_back(micros() - t0); else ++failed;
+    }
+    report("writeVoltages", t, failed);
+    device->setSuppressUnchanged(true);
+
+    QSource3Cmd cmds[Q_SOURCE3_PIPELINE_DEPTH];
+    for (int k = 0; k < Q_SOURCE3_PIPELINE_DEPTH; ++k)
+    {
+        cmds[k].cmd = "#G";
+        cmds[k].expectOK = false;
+        cmds[k].callback = NULL;
+        cmds[k].ctx = NULL;
+    }
+    t.clear();
+    failed = 0;
+    for (int i = 0; i < _queries; ++i)
+    {
+        uint32_t t0 = micros();
+        if (device->pipeline(cmds, Q_SOURCE3_PIPELINE_DEPTH)) t.push_back(micros() - t0); else ++failed;
+    }
+    report("pipeline x4 #G", t, failed);
+}
+
+
+static void taskOwner(void* pvParameters)
+{
+    (void)pvParameters;
+    for (;;)
+    {
+        _device.workAsync(portMAX_DELAY);
+    }
+}
+
+
+// submit to completion through the device-owner task
+static void benchAsync(void)
+{
+    printf("JanasCardQSource3 async, RTOS_Stream, QSource3MutexLock\n");
+    if (!_device.initAsync() ||
+        xTaskCreate(taskOwner, "owner", BENCH_STACK_SIZE, NULL, BENCH_OWNER_PRIORITY, NULL) != pdPASS)
+    {
+        printf("  no async queues\n");
+        ++_failed;
+        return;
+    }
+    QSource3Request req;
+    req.callback = NULL;
+    req.ctx = NULL;
+
+    std::vector<uint32_t> t;
+    int failed = 0;
+    for (int i = 0; i < _queries; ++i)
+    {
+        uint32_t t0 = micros();
+        if (_device.readFreqAsync(&req) && _device.wait(&req, pdMS_TO_TICKS(BENCH_TIMEOUT_MS)))
+        {
+            t.push_back(micros() - t0);
+        }
+        else ++failed;
+    }
+    report("readFreqAsync", t, failed);
+
+    t.clear();
+    failed = 0;
+    for (int i = 0; i < _queries; ++i)
+    {
+        uint32_t t0 = micros();
+        if (_device.writeVoltagesAsync(&req, i, -i, 100000 + i) && _device.wait(&req, pdMS_TO_TICKS(BENCH_TIMEOUT_MS)))
+        {
+            t.push_back(micros() - t0);
+        }
+        else ++failed;
+    }
+    report("writeVoltagesAsync", t, failed);
+
+    const QSource3QueueStats& stats = _device.getQueueStats(Q_SOURCE3_PRIO_REALTIME);
+    printf("  realtime queue: %u requests, max delay %u us, max lock wait %u us\n",
+        stats.requests, stats.maxDelay, stats.maxLockWait);
+}
+
+
+static void taskTx(void* pvParameters)
+{
+    (void)pvParameters;
+    for (;;)
+    {
+        _stream.workTx(portMAX_DELAY);
+    }
+}
+
+
+static void taskBench(void* pvParameters)
+{
+    (void)pvParameters;
+    printf("emulator: %u baud, latency %u us, jitter %u us\n", _config.baud, _config.latencyUs, _config.jitterUs);
+    bench("JanasCardQSource3, RTOS_Stream, QSource3MutexLock", &_device);
+    bench("RTOS_Stream, QSource3NoLock", &_deviceNoLock);
+    bench("Stream (Serial1), QSource3IrqLock", &_deviceBare);
+    bench("loopback, QSource3NoLock", &_deviceLoop);
+    bench("loopback, QSource3MutexLock", &_deviceLoopMutex);
+    benchAsync();
+    fflush(stdout);
+    exit((_failed > 0) ? 1 : 0);
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc > 1) _queries = atoi(argv[1]);
+    if (argc > 2) _config.latencyUs = atoi(argv[2]);
+    if (argc > 3) _config.jitterUs = atoi(argv[3]);
+    _emulatorRTOS.setConfig(&_config);
+    _emulatorBare.setConfig(&_config);
+    _emulatorLoop.setConfig(&_config);
+
+    Serial1.begin(Q_SOURCE3_SERIAL_BAUD_RATE);
+    Serial1.setTimeout(BENCH_TIMEOUT_MS);
+    Serial2.begin(Q_SOURCE3_SERIAL_BAUD_RATE);
+    if (!Serial1.connect(&_emulatorBare) || !Serial2.connect(&_emulatorRTOS) || !_stream.init())
+    {
+        printf("init failed\n");
+        return 1;
+    }
+    xTaskCreate(taskTx, "tx", BENCH_STACK_SIZE, NULL, BENCH_TX_PRIORITY, NULL);
+    xTaskCreate(taskBench, "bench", BENCH_STACK_SIZE, NULL, BENCH_PRIORITY, NULL);
+    vTaskStartScheduler();
+    return 1;
+}
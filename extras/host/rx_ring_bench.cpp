@@ -0,0 +1,185 @@
+// The receive path of RTOS_Stream on the host: a producer thread in place of
+// the USART interrupt pushes responses, the consumer thread reads them.
+// "ring" is RxRing with the wake-up of pushNotify(), one semaphore give per
+// response; "queue" is the former path, a locked queue with one give and one
+// take per byte like xQueueSendFromISR() and xQueueReceive(). Responses of
+// 4 to 64 bytes including '\r'.
+//
+// Usage: rx_ring_bench [responses] [repeats] > rx_ring.json
+//
+// Prints one JSON document: ns per byte (min, median and max over the
+// repeats) and semaphore takes of the consumer per response of the median run.
+
+#include "rx_ring.h"
+#include <time.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+static int _responses = 2000;
+static int _repeats = 7;
+static bool _first = true;
+
+static const size_t _sizes[] = {4, 8, 16, 32, 64};
+static const char* const _variants[] = {"ring", "queue"};
+
+
+static uint64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+// a counting semaphore, binary for the ring
+class Semaphore {
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    size_t _count = 0;
+    size_t _max;
+public:
+    uint32_t takes = 0;
+
+    Semaphore(size_t max): _max(max) {}
+
+    void give()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_count < _max) ++_count;
+        _cv.notify_one();
+    }
+
+    void take()
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [this] { return _count > 0; });
+        --_count;
+        ++takes;
+    }
+};
+
+
+static uint8_t byteOf(size_t i, size_t size)
+{
+    return (i % size == size - 1) ? '\r' : (uint8_t)('0' + i % 10);
+}
+
+
+// one run of the ring, returns ns
+static uint64_t runRing(size_t size, uint32_t* takes)
+{
+    RxRing ring;
+    Semaphore event(1);
+    size_t total = (size_t)_responses * size;
+
+    uint64_t t0 = nowNs();
+    std::thread producer([&] {
+        for (size_t i = 0; i < total; ++i)
+        {
+            while (ring.available() >= RX_BUFFER_LENGTH) std::this_thread::yield();
+            if (ring.pushNotify(byteOf(i, size), '\r')) event.give();
+        }
+    });
+
+    char buffer[RX_BUFFER_LENGTH];
+    size_t received = 0;
+    while (received < total)
+    {
+        // RTOS_Stream::readBytesUntil()
+        size_t idx = 0;
+        for (;;)
+        {
+            bool found;
+            idx += ring.read('\r', buffer + idx, sizeof(buffer) - idx, &found);
+            if (found || (idx >= sizeof(buffer))) break;
+            size_t missing = sizeof(buffer) - idx;
+            size_t level = missing < RX_NOTIFY_THRESHOLD ? missing : RX_NOTIFY_THRESHOLD;
+            ring.arm(level);
+            if (ring.available() >= level) continue;
+            event.take();
+        }
+        received += idx;
+    }
+    producer.join();
+    *takes = event.takes;
+    return nowNs() - t0;
+}
+
+
+// one run of the queue with a give and a take per byte, returns ns
+static uint64_t runQueue(size_t size, uint32_t* takes)
+{
+    std::mutex mutex;
+    std::deque<uint8_t> queue;
+    Semaphore items(RX_BUFFER_LENGTH);
+    size_t total = (size_t)_responses * size;
+
+    uint64_t t0 = nowNs();
+    std::thread producer([&] {
+        for (size_t i = 0; i < total; ++i)
+        {
+            for (;;)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (queue.size() < RX_BUFFER_LENGTH)
+                {
+                    queue.push_back(byteOf(i, size));
+                    break;
+                }
+            }
+            items.give();
+        }
+    });
+
+    size_t received = 0;
+    while (received < total)
+    {
+        items.take();
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.pop_front();
+        ++received;
+    }
+    producer.join();
+    *takes = items.takes;
+    return nowNs() - t0;
+}
+
+
+static void bench(int variant, size_t size)
+{
+    std::vector<double> ns(_repeats);
+    std::vector<uint32_t> takes(_repeats);
+    for (int r = 0; r < _repeats; ++r)
+    {
+        uint64_t t = (variant == 0) ? runRing(size, &takes[r]) : runQueue(size, &takes[r]);
+        ns[r] = (double)t / ((double)_responses * size);
+    }
+    std::vector<double> sorted(ns);
+    std::sort(sorted.begin(), sorted.end());
+    int median = std::find(ns.begin(), ns.end(), sorted[_repeats / 2]) - ns.begin();
+
+    printf("%s\n    {\"variant\": \"%s\", \"response_bytes\": %zu, \"min_ns_per_byte\": %.1f, \"median_ns_per_byte\": %.1f, \"max_ns_per_byte\": %.1f, \"takes_per_response\": %.2f}",
+        _first ? "" : ",", _variants[variant], size, sorted[0], sorted[_repeats / 2], sorted[_repeats - 1],
+        (double)takes[median] / _responses);
+    _first = false;
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc > 1) _responses = atoi(argv[1]);
+    if (argc > 2) _repeats = atoi(argv[2]);
+
+    printf("{\n  \"benchmark\": \"rx_ring\",\n  \"ring_bytes\": %d,\n  \"responses\": %d,\n  \"repeats\": %d,\n  \"cpus\": %u,\n  \"results\": [",
+        RX_BUFFER_LENGTH, _responses, _repeats, std::thread::hardware_concurrency());
+    for (size_t s = 0; s < sizeof(_sizes) / sizeof(_sizes[0]); ++s)
+    {
+        for (int variant = 0; variant < 2; ++variant) bench(variant, _sizes[s]);
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,12 @@
+// HardwareSerial of the DUE core for the UART register mock, see chip.h.
+
+#ifndef HardwareSerial_h
+#define HardwareSerial_h
+
+#include "Arduino.h"
+
+class HardwareSerial : public Stream
+{
+};
+
+#endif
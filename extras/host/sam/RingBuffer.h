@@ -0,0 +1,22 @@
+// RingBuffer of the DUE core for the UART register mock, see chip.h.
+
+#ifndef _RING_BUFFER_
+#define _RING_BUFFER_
+
+#include <stdint.h>
+
+#define SERIAL_BUFFER_SIZE 128
+
+class RingBuffer
+{
+  public:
+    volatile uint8_t _aucBuffer[SERIAL_BUFFER_SIZE];
+    volatile int _iHead;
+    volatile int _iTail;
+
+  public:
+    RingBuffer(void);
+    void store_char(uint8_t c);
+};
+
+#endif
@@ -0,0 +1,157 @@
+// Register-level mock of the SAM3X UART and its PDC channel for the host,
+// so that UARTClass.cpp of the modified core (Arduino core modification/)
+// compiles unchanged and its interrupt handler runs against a model of the
+// peripheral, see extras/test/test_uart_pdc.cpp.
+//
+// Every register is an object: reading or writing it calls the model in
+// Uart. The transmitter is clocked by the test with tick(), one character
+// time per call: the shift register sends its character, takes the one of the
+// holding register (THR) and the PDC refills THR from memory. The status
+// bits follow the SAM3X datasheet: TXRDY with THR empty, TXEMPTY with THR and
+// the shift register empty, ENDTX while the PDC counter TCR is zero.
+// The handler is called while an unmasked status bit is set (level interrupt).
+
+#ifndef chip_h
+#define chip_h
+
+#include "Arduino.h"
+#include <string>
+
+extern uint32_t SystemCoreClock;
+
+inline void pmc_enable_periph_clk(uint32_t) {}
+inline void pmc_disable_periph_clk(uint32_t) {}
+inline void NVIC_SetPriority(IRQn_Type, uint32_t) {}
+inline uint32_t NVIC_GetPriority(IRQn_Type) { return 0; }
+
+#define UART_IRQn ((IRQn_Type)8)
+#define ID_UART 8
+
+// UART_CR
+#define UART_CR_RSTRX (0x1u << 2)
+#define UART_CR_RSTTX (0x1u << 3)
+#define UART_CR_RXEN (0x1u << 4)
+#define UART_CR_RXDIS (0x1u << 5)
+#define UART_CR_TXEN (0x1u << 6)
+#define UART_CR_TXDIS (0x1u << 7)
+#define UART_CR_RSTSTA (0x1u << 8)
+
+// UART_MR
+#define UART_MR_PAR_EVEN (0x0u << 9)
+#define UART_MR_PAR_ODD (0x1u << 9)
+#define UART_MR_PAR_SPACE (0x2u << 9)
+#define UART_MR_PAR_MARK (0x3u << 9)
+#define UART_MR_PAR_NO (0x4u << 9)
+#define UART_MR_CHMODE_NORMAL (0x0u << 14)
+#define US_MR_CHRL_8_BIT (0x3u << 6)
+#define US_MR_NBSTOP_1_BIT (0x0u << 12)
+
+// UART_SR, UART_IER, UART_IDR and UART_IMR share the bits
+#define UART_SR_RXRDY (0x1u << 0)
+#define UART_SR_TXRDY (0x1u << 1)
+#define UART_SR_ENDTX (0x1u << 4)
+#define UART_SR_OVRE (0x1u << 5)
+#define UART_SR_FRAME (0x1u << 6)
+#define UART_SR_TXEMPTY (0x1u << 9)
+#define UART_IER_RXRDY UART_SR_RXRDY
+#define UART_IER_TXRDY UART_SR_TXRDY
+#define UART_IER_ENDTX UART_SR_ENDTX
+#define UART_IER_OVRE UART_SR_OVRE
+#define UART_IER_FRAME UART_SR_FRAME
+#define UART_IER_TXEMPTY UART_SR_TXEMPTY
+#define UART_IDR_RXRDY UART_SR_RXRDY
+#define UART_IDR_TXRDY UART_SR_TXRDY
+#define UART_IDR_ENDTX UART_SR_ENDTX
+#define UART_IDR_TXEMPTY UART_SR_TXEMPTY
+#define UART_IMR_RXRDY UART_SR_RXRDY
+#define UART_IMR_TXRDY UART_SR_TXRDY
+#define UART_IMR_ENDTX UART_SR_ENDTX
+#define UART_IMR_TXEMPTY UART_SR_TXEMPTY
+
+// UART_PTCR
+#define UART_PTCR_RXTEN (0x1u << 0)
+#define UART_PTCR_RXTDIS (0x1u << 1)
+#define UART_PTCR_TXTEN (0x1u << 8)
+#define UART_PTCR_TXTDIS (0x1u << 9)
+
+
+struct Uart;
+
+enum UartRegisterId {
+    UART_REG_CR, UART_REG_MR, UART_REG_IER, UART_REG_IDR, UART_REG_IMR, UART_REG_SR,
+    UART_REG_RHR, UART_REG_THR, UART_REG_BRGR, UART_REG_TPR, UART_REG_TCR, UART_REG_PTCR
+};
+
+// one register, the accesses go to the model
+class UartRegister {
+    Uart* _uart;
+    UartRegisterId _id;
+public:
+    UartRegister(Uart* uart, UartRegisterId id): _uart(uart), _id(id) {}
+    UartRegister(const UartRegister&) = delete;
+    operator uint32_t() const;
+    UartRegister& operator=(uint32_t v);
+    UartRegister& operator|=(uint32_t v) { return *this = (uint32_t)*this | v; }
+};
+
+
+struct Uart {
+    UartRegister UART_CR{this, UART_REG_CR};
+    UartRegister UART_MR{this, UART_REG_MR};
+    UartRegister UART_IER{this, UART_REG_IER};
+    UartRegister UART_IDR{this, UART_REG_IDR};
+    UartRegister UART_IMR{this, UART_REG_IMR};
+    UartRegister UART_SR{this, UART_REG_SR};
+    UartRegister UART_RHR{this, UART_REG_RHR};
+    UartRegister UART_THR{this, UART_REG_THR};
+    UartRegister UART_BRGR{this, UART_REG_BRGR};
+    UartRegister UART_TPR{this, UART_REG_TPR};
+    UartRegister UART_TCR{this, UART_REG_TCR};
+    UartRegister UART_PTCR{this, UART_REG_PTCR};
+
+    // the model
+    uint32_t mr = 0;
+    uint32_t brgr = 0;
+    uint32_t imr = 0;
+    uint32_t errors = 0;  // OVRE and FRAME until RSTSTA
+    bool rxEnabled = false;
+    bool txEnabled = false;
+    int rhr = -1;         // received character, -1 none
+    int thr = -1;         // holding register, -1 empty
+    int shift = -1;       // shift register, -1 empty
+    uint32_t tpr = 0;
+    uint32_t tcr = 0;
+    bool pdcEnabled = false;
+    uintptr_t addressHigh = 0;  // the 32 bit PDC address is in the 4 GB of this base
+
+    std::string line;         // characters that left the shift register
+    uint32_t thrOverruns = 0; // THR written while full, a driver error
+    uint32_t accesses = 0;    // register accesses of the driver
+
+    uint32_t read(UartRegisterId id);
+    void write(UartRegisterId id, uint32_t v);
+    uint32_t status(void) const;
+
+    /// <summary>
+    /// Lets the PDC read memory near base, e.g. a buffer of the test.
+    /// </summary>
+    void setAddressSpace(const void* base) { addressHigh = (uintptr_t)base & ~(uintptr_t)0xFFFFFFFFu; }
+
+    /// <summary>
+    /// One character time of the transmitter.
+    /// </summary>
+    void tick(void);
+
+    /// <summary>
+    /// A character arrives at the receiver, an unread one is overrun.
+    /// </summary>
+    void receive(uint8_t ch);
+
+    /// <returns>true while the interrupt is pending</returns>
+    bool irq(void) const { return (status() & imr) != 0; }
+
+    /// <returns>true when nothing is being sent</returns>
+    bool idle(void) const { return (thr < 0) && (shift < 0) && (!pdcEnabled || (tcr == 0)); }
+};
+
+#endif
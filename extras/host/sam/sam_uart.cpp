@@ -0,0 +1,143 @@
+// The UART and PDC model of chip.h and the RingBuffer of the DUE core.
+
+#include "chip.h"
+#include "RingBuffer.h"
+
+uint32_t SystemCoreClock = 84000000;
+
+
+UartRegister::operator uint32_t() const
+{
+    return _uart->read(_id);
+}
+
+
+UartRegister& UartRegister::operator=(uint32_t v)
+{
+    _uart->write(_id, v);
+    return *this;
+}
+
+
+uint32_t Uart::status(void) const
+{
+    uint32_t sr = errors;
+    if (rhr >= 0) sr |= UART_SR_RXRDY;
+    if (txEnabled && (thr < 0)) sr |= UART_SR_TXRDY;
+    if (txEnabled && (thr < 0) && (shift < 0)) sr |= UART_SR_TXEMPTY;
+    if (tcr == 0) sr |= UART_SR_ENDTX;
+    return sr;
+}
+
+
+// the PDC refills THR as soon as it is empty
+static void pdcRefill(Uart* u)
+{
+    if (u->txEnabled && u->pdcEnabled && (u->tcr > 0) && (u->thr < 0))
+    {
+        u->thr = *(const uint8_t*)(u->addressHigh | u->tpr);
+        ++u->tpr;
+        --u->tcr;
+    }
+}
+
+
+uint32_t Uart::read(UartRegisterId id)
+{
+    ++accesses;
+    switch (id)
+    {
+    case UART_REG_MR: return mr;
+    case UART_REG_IMR: return imr;
+    case UART_REG_SR: return status();
+    case UART_REG_RHR:
+    {
+        uint32_t v = (rhr < 0) ? 0 : (uint32_t)rhr;
+        rhr = -1;
+        return v;
+    }
+    case UART_REG_BRGR: return brgr;
+    case UART_REG_TPR: return tpr;
+    case UART_REG_TCR: return tcr;
+    default: return 0;  // write-only
+    }
+}
+
+
+void Uart::write(UartRegisterId id, uint32_t v)
+{
+    ++accesses;
+    switch (id)
+    {
+    case UART_REG_CR:
+        if (v & UART_CR_RSTRX) rhr = -1;
+        if (v & UART_CR_RSTTX) thr = shift = -1;
+        if (v & UART_CR_RXEN) rxEnabled = true;
+        if (v & UART_CR_RXDIS) rxEnabled = false;
+        if (v & UART_CR_TXEN) txEnabled = true;
+        if (v & UART_CR_TXDIS) txEnabled = false;
+        if (v & UART_CR_RSTSTA) errors = 0;
+        break;
+    case UART_REG_MR: mr = v; break;
+    case UART_REG_IER: imr |= v; break;
+    case UART_REG_IDR: imr &= ~v; break;
+    case UART_REG_THR:
+        if (!txEnabled) break;
+        if (thr >= 0) ++thrOverruns;
+        thr = v & 0xFF;
+        break;
+    case UART_REG_BRGR: brgr = v; break;
+    case UART_REG_TPR: tpr = v; break;
+    case UART_REG_TCR: tcr = v; break;
+    case UART_REG_PTCR:
+        if (v & UART_PTCR_TXTEN) pdcEnabled = true;
+        if (v & UART_PTCR_TXTDIS) pdcEnabled = false;
+        break;
+    default: break;  // read-only
+    }
+    pdcRefill(this);
+}
+
+
+void Uart::tick(void)
+{
+    if (!txEnabled) return;
+    if (shift >= 0)
+    {
+        line += (char)shift;
+        shift = -1;
+    }
+    if (thr >= 0)
+    {
+        shift = thr;
+        thr = -1;
+    }
+    pdcRefill(this);
+}
+
+
+void Uart::receive(uint8_t ch)
+{
+    if (!rxEnabled) return;
+    if (rhr >= 0) errors |= UART_SR_OVRE;
+    rhr = ch;
+}
+
+
+RingBuffer::RingBuffer(void)
+{
+    memset((void*)_aucBuffer, 0, SERIAL_BUFFER_SIZE);
+    _iHead = 0;
+    _iTail = 0;
+}
+
+
+void RingBuffer::store_char(uint8_t c)
+{
+    int i = (uint32_t)(_iHead + 1) % SERIAL_BUFFER_SIZE;
+    if (i != _iTail)
+    {
+        _aucBuffer[_iHead] = c;
+        _iHead = i;
+    }
+}
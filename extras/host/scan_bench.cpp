@@ -0,0 +1,115 @@
+// MSFilterScan::run() on Linux in real time: the dwell accuracy and the CPU
+// spent waiting by MSFQMicrosTimeSource, which spins, against a timer-driven
+// time source, the host counterpart of MSFQTimerTimeSource: it sleeps until
+// shortly before the step by clock_nanosleep() and spins only the rest.
+// The device is JanasCardQSource3 on QSource3NullTransport, so the steps cost
+// the encoding only.
+//
+// Usage: scan_bench [spin_us] > scan.json
+//
+// Prints one JSON document, times in us, cpu is the CPU time of the run divided
+// by its wall time.
+
+#include "MSFilterScan.h"
+#include <time.h>
+
+#define BENCH_R0 6e-3
+#define BENCH_RUN_US 200000  // wall time of a run
+#define BENCH_MIN_STEPS 50
+
+static const uint32_t _dwells[] = {20, 50, 100, 500, 1000, 5000};
+
+static JanasCardQSource3 _device(NULL);
+static StateTuneParRecords _rf;
+static StateTuneParRecords _dc;
+static int32_t _dc1[BENCH_RUN_US / 20];
+static int32_t _dc2[BENCH_RUN_US / 20];
+static uint32_t _ac[BENCH_RUN_US / 20];
+static uint32_t _achieved[BENCH_RUN_US / 20];
+static bool _first = true;
+
+
+// sleeps on CLOCK_MONOTONIC, the clock of micros() in the host build
+class LinuxTimerTimeSource : public MSFQTimeSource
+{
+private:
+    uint32_t _spin;
+
+public:
+    LinuxTimerTimeSource(uint32_t spin): _spin(spin) {}
+    uint32_t now(void) { return micros(); }
+
+    void waitUntil(uint32_t t)
+    {
+        int32_t remaining = (int32_t)(t - micros()) - (int32_t)_spin;
+        if (remaining > 0)
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            ts.tv_nsec += (long)remaining * 1000;
+            ts.tv_sec += ts.tv_nsec / 1000000000L;
+            ts.tv_nsec %= 1000000000L;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+        }
+        while ((int32_t)(t - micros()) > 0);
+    }
+};
+
+
+static uint64_t clockNs(clockid_t clock)
+{
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static void bench(const char* source, MSFilterQuad* filter, MSFQTimeSource* time, uint32_t dwell)
+{
+    size_t steps = BENCH_RUN_US / dwell;
+    if (steps < BENCH_MIN_STEPS) steps = BENCH_MIN_STEPS;
+    MSFilterScan scan(filter, time, _dc1, _dc2, _ac, steps);
+    scan.prepare(0.0, (steps - 1) * 0.1, 0.1, dwell);
+
+    uint64_t wall0 = clockNs(CLOCK_MONOTONIC);
+    uint64_t cpu0 = clockNs(CLOCK_THREAD_CPUTIME_ID);
+    bool rc = scan.run(_achieved);
+    double cpu = (double)(clockNs(CLOCK_THREAD_CPUTIME_ID) - cpu0) / (clockNs(CLOCK_MONOTONIC) - wall0);
+
+    // jitter of the single steps, the schedule keeps the mean anyway
+    const MSFQScanStats& s = scan.getStats();
+    double sumSq = 0.0;
+    for (size_t i = 0; i < s.steps; ++i) sumSq += ((double)_achieved[i] - dwell) * ((double)_achieved[i] - dwell);
+
+    printf("%s\n    {\"source\": \"%s\", \"dwell_us\": %u, \"steps\": %zu, \"ok\": %s, \"mean_us\": %u, "
+        "\"min_us\": %u, \"max_us\": %u, \"rms_error_us\": %.2f, \"overruns\": %zu, \"max_lateness_us\": %u, "
+        "\"cpu\": %.3f}",
+        _first ? "" : ",", source, dwell, s.steps, rc ? "true" : "false", scan.getMeanDwell(),
+        s.minDwell, s.maxDwell, s.steps ? sqrt(sumSq / s.steps) : 0.0, s.overruns, s.maxLateness, cpu);
+    _first = false;
+}
+
+
+int main(int argc, char** argv)
+{
+    uint32_t spin = (argc > 1) ? (uint32_t)atoi(argv[1]) : 50;
+
+    _device.writeRSMode(0);
+    _device.setGuardTime(0);
+    _rf._numberTuneParRecs = 0;
+    _dc._numberTuneParRecs = 0;
+    MSFilterQuad filter(BENCH_R0, &_device, &_rf, &_dc);
+    filter.initRFFactor(480000.0);
+
+    MSFQMicrosTimeSource spinning;
+    LinuxTimerTimeSource timer(spin);
+
+    printf("{\n  \"benchmark\": \"scan\",\n  \"timer_spin_us\": %u,\n  \"results\": [", spin);
+    for (size_t d = 0; d < sizeof(_dwells) / sizeof(_dwells[0]); ++d)
+    {
+        bench("micros", &filter, &spinning, _dwells[d]);
+        bench("timer", &filter, &timer, _dwells[d]);
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,228 @@
+// MSFilterQuad::setMZ() on the host, the scenarios of examples/test_speed without
+// the board: calibration table size, interpolation kernel, m/z access pattern
+// and frequency range. calcRF(), calcDC(), setUV(), setMZ() and calcUVBatch()
+// (against calcRF() + calcDC() of each point, op calcUV) are timed against
+// JanasCardQSource3 on QSource3NullTransport, so every frame is encoded and
+// "sent" but no time is spent on the line. Built by the host build (CMakeLists.txt)
+// with and without MSFQ_FIXED_POINT.
+//
+// Usage: setmz_bench [points] [repeats] > setmz.json
+//
+// Prints one JSON document, times are ns per call: min, median and max over
+// the repeats of a batch of points calls.
+
+#include "MSFilterQuad.h"
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+#define BENCH_R0 6e-3
+#define BENCH_MAX_CALIB_MZ 500.0  // m/z range of the calibration points, see test_speed
+#define BENCH_TABLE_STEP 0.25
+#define BENCH_TABLE_SIZE 20000
+#define BENCH_SIM_IONS 4
+
+static int _points = 1000;
+static int _repeats = 21;
+static bool _first = true;
+
+// frequency ranges of the emulator, Hz
+static const float _freqs[] = {1050000.0, 480000.0, 240000.0};
+
+static const char* const _patterns[] = {"sequential", "random", "sim"};
+static const char* const _interpNames[] = {"spline", "linear", "monotone"};
+
+static JanasCardQSource3 _device(NULL);
+static StateTuneParRecords _rf;
+static StateTuneParRecords _dc;
+static MSFQSetpoint _table[BENCH_TABLE_SIZE];
+
+static volatile float _sink;
+
+
+static uint64_t nowNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+// deterministic, the same tables and m/z on every run
+static uint32_t _seed;
+
+static float rnd(void)
+{
+    _seed = _seed * 1664525UL + 1013904223UL;
+    return (float)(_seed >> 8) / 16777216.0;
+}
+
+
+// size points evenly over 0 .. BENCH_MAX_CALIB_MZ with random corrections,
+// the random full table of test_speed for size == MAX_NUMBER_OF_TUNE_PAR_RECORDS
+static void fillCalib(StateTuneParRecords* records, size_t size, uint32_t seed)
+{
+    _seed = seed;
+    records->_numberTuneParRecs = size;
+    for (size_t i = 0; i < size; ++i)
+    {
+        records->_tuneParMZ[i] = BENCH_MAX_CALIB_MZ * i / size;
+        records->_tuneParVal[i] = rnd();
+    }
+}
+
+
+static void makePattern(int pattern, float maxMZ, std::vector<float>& mz)
+{
+    mz.resize(_points);
+    _seed = 100;
+    float sim[BENCH_SIM_IONS];
+    for (int k = 0; k < BENCH_SIM_IONS; ++k) sim[k] = maxMZ * rnd();
+    for (int i = 0; i < _points; ++i)
+    {
+        switch (pattern)
+        {
+        case 0: mz[i] = maxMZ * i / _points; break;         // scan
+        case 1: mz[i] = maxMZ * rnd(); break;               // random m/z
+        default: mz[i] = sim[i % BENCH_SIM_IONS]; break;    // selected ion monitoring
+        }
+    }
+}
+
+
+static void report(const char* op, const char* interp, size_t tableSize, int pattern, int range,
+    std::vector<uint64_t>& t)
+{
+    std::sort(t.begin(), t.end());
+    printf("%s\n    {\"op\": \"%s\", \"interp\": \"%s\", \"table_size\": %zu, \"pattern\": \"%s\", "
+        "\"range\": %d, \"freq_hz\": %.0f, \"ns_min\": %.1f, \"ns_median\": %.1f, \"ns_max\": %.1f}",
+        _first ? "" : ",", op, interp, tableSize, _patterns[pattern], range, _freqs[range],
+        (double)t[0] / _points, (double)t[t.size() / 2] / _points, (double)t[t.size() - 1] / _points);
+    _first = false;
+}
+
+
+// times one operation over the m/z of the pattern
+template <class F>
+static void bench(const char* op, const char* interp, size_t tableSize, int pattern, int range,
+    const std::vector<float>& mz, F f)
+{
+    std::vector<uint64_t> t;
+    for (int r = 0; r < _repeats; ++r)
+    {
+        uint64_t t0 = nowNs();
+        for (int i = 0; i < _points; ++i) f(mz[i], i);
+        t.push_back(nowNs() - t0);
+    }
+    report(op, interp, tableSize, pattern, range, t);
+}
+
+
+// times calcUVBatch() over all m/z of the pattern, reported per point like the scalar ops
+static void benchBatch(MSFilterQuad* filter, const char* op, const char* interp, size_t tableSize, int pattern,
+    int range, const std::vector<float>& mz)
+{
+    std::vector<int32_t> dc1(_points), dc2(_points);
+    std::vector<uint32_t> ac(_points);
+    std::vector<uint64_t> t;
+    for (int r = 0; r < _repeats; ++r)
+    {
+        uint64_t t0 = nowNs();
+        filter->calcUVBatch(mz.data(), _points, dc1.data(), dc2.data(), ac.data());
+        t.push_back(nowNs() - t0);
+    }
+    report(op, interp, tableSize, pattern, range, t);
+}
+
+
+static void benchFilter(MSFilterQuad* filter, const char* interp, size_t tableSize, int range)
+{
+    float maxMZ = filter->calcMaxMz();
+    std::vector<float> mz;
+    std::vector<float> u(_points);
+    std::vector<float> v(_points);
+
+    for (int pattern = 0; pattern < 3; ++pattern)
+    {
+        makePattern(pattern, maxMZ, mz);
+        for (int i = 0; i < _points; ++i)
+        {
+            u[i] = filter->calcDC(mz[i]);
+            v[i] = filter->calcRF(mz[i]);
+        }
+
+        bench("calcRF", interp, tableSize, pattern, range, mz, [&](float m, int) { _sink = filter->calcRF(m); });
+        bench("calcDC", interp, tableSize, pattern, range, mz, [&](float m, int) { _sink = filter->calcDC(m); });
+        bench("setUV", interp, tableSize, pattern, range, mz, [&](float, int i) { filter->setUV(u[i], v[i]); });
+        bench("setMZ", interp, tableSize, pattern, range, mz, [&](float m, int) { filter->setMZ(m); });
+        // the batch against the scalar calcRF() + calcDC() of each point
+        bench("calcUV", interp, tableSize, pattern, range, mz, [&](float m, int) {
+            _sink = filter->calcRF(m);
+            _sink = filter->calcDC(m);
+        });
+        benchBatch(filter, "calcUVBatch", interp, tableSize, pattern, range, mz);
+
+        // the compiled setpoint table of test_speed, only where it fits
+        if (filter->buildSetpointTable(BENCH_TABLE_STEP))
+        {
+            bench("setMZ_table", interp, tableSize, pattern, range, mz, [&](float m, int) { filter->setMZ(m); });
+            benchBatch(filter, "calcUVBatch_table", interp, tableSize, pattern, range, mz);
+            filter->attachSetpointTable(_table, BENCH_TABLE_SIZE);  // invalidates the table
+        }
+    }
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc > 1) _points = atoi(argv[1]);
+    if (argc > 2) _repeats = atoi(argv[2]);
+    if ((_points <= 0) || (_repeats <= 0))
+    {
+        fprintf(stderr, "usage: setmz_bench [points] [repeats]\n");
+        return 1;
+    }
+
+    _device.writeRSMode(0);
+    _device.setGuardTime(0);
+    _device.setSuppressUnchanged(false);  // every call encodes and writes its frame
+
+    // 0, 1, 2, 3 and then doubling up to the capacity of the tables
+    std::vector<size_t> sizes;
+    for (size_t n = 0; n <= 3; ++n) sizes.push_back(n);
+    for (size_t n = 4; n < MAX_NUMBER_OF_TUNE_PAR_RECORDS; n *= 2) sizes.push_back(n);
+    if (sizes.back() < MAX_NUMBER_OF_TUNE_PAR_RECORDS) sizes.push_back(MAX_NUMBER_OF_TUNE_PAR_RECORDS);
+
+#ifdef MSFQ_FIXED_POINT
+    const char* fixedPoint = "true";
+#else
+    const char* fixedPoint = "false";
+#endif
+    printf("{\n  \"benchmark\": \"setmz\",\n  \"fixed_point\": %s,\n  \"max_table_size\": %d,\n"
+        "  \"points\": %d,\n  \"repeats\": %d,\n  \"results\": [",
+        fixedPoint, (int)MAX_NUMBER_OF_TUNE_PAR_RECORDS, _points, _repeats);
+
+    for (int range = 0; range < 3; ++range)
+    {
+        for (size_t s = 0; s < sizes.size(); ++s)
+        {
+            fillCalib(&_rf, sizes[s], 1);
+            fillCalib(&_dc, sizes[s], 2);
+            // tables with less than 3 points do not depend on the kernel
+            int kernels = (sizes[s] < 3) ? 1 : 3;
+            for (int k = 0; k < kernels; ++k)
+            {
+                MSFilterQuad filter(BENCH_R0, &_device, &_rf, &_dc);
+                filter.setInterpolation((MSFQInterp)k);
+                filter.initRFFactor(_freqs[range]);
+                filter.initSplineRF();
+                filter.initSplineDC();
+                filter.attachSetpointTable(_table, BENCH_TABLE_SIZE);
+                benchFilter(&filter, (sizes[s] < 3) ? "any" : _interpNames[k], sizes[s], range);
+            }
+        }
+    }
+
+    printf("\n  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,235 @@
+// USARTClass of the host build on the FreeRTOS POSIX port or the FreeRTOS API
+// on std::thread (extras/host/freertos), see Arduino.h.
+//
+// The peripheral task has the highest priority and stands for the USART
+// interrupt: it sleeps until a byte is written, then clocks the bytes to the
+// emulator at line speed and hands the due response bytes to the receive
+// callback, until the exchange is over. Callbacks run with
+// xPortIsInsideInterrupt() true, so the ...FromISR paths are taken.
+
+#include "Arduino.h"
+#include "QSource3Emulator.h"
+#include <FreeRTOS.h>
+#include <semphr.h>
+#include <task.h>
+
+#define USART_HOST_STACK_SIZE (configMINIMAL_STACK_SIZE * 2)
+
+static thread_local volatile bool _insideIrq = false;  // of the thread running the interrupt
+
+USARTClass Serial1;
+USARTClass Serial2;
+
+
+extern "C" BaseType_t xPortIsInsideInterrupt(void)
+{
+    return _insideIrq ? pdTRUE : pdFALSE;
+}
+
+
+void yield(void)
+{
+    if (!_insideIrq && (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING))
+    {
+        taskYIELD();
+    }
+}
+
+
+bool USARTClass::connect(QSource3Emulator* peer)
+{
+    _peer = peer;
+    if (_xWake == NULL)
+    {
+        _xWake = xSemaphoreCreateBinary();
+        if (_xWake == NULL) return false;
+    }
+    if (_task == NULL)
+    {
+        TaskHandle_t task;
+        if (xTaskCreate(_run, "usart", USART_HOST_STACK_SIZE, this, configMAX_PRIORITIES - 1, &task) != pdPASS)
+        {
+            return false;
+        }
+        _task = task;
+    }
+    return true;
+}
+
+
+void USARTClass::begin(uint32_t baud)
+{
+    _byteTime = (baud > 0) ? 10 * 1000000UL / baud : 7;
+}
+
+
+void USARTClass::_run(void* self)
+{
+    USARTClass* usart = static_cast<USARTClass*>(self);
+    for (;;)
+    {
+        xSemaphoreTake((SemaphoreHandle_t)usart->_xWake, portMAX_DELAY);
+        while (usart->_step(micros()));
+    }
+}
+
+
+void USARTClass::_wake(void)
+{
+    if (_xWake != NULL) xSemaphoreGive((SemaphoreHandle_t)_xWake);
+}
+
+
+// one pass of the interrupt, returns true while bytes are on the way
+bool USARTClass::_step(uint32_t now)
+{
+    if (_peer == NULL) return false;
+
+    // transmitter: buffered characters first, then the block, one byte per byte time
+    if ((int32_t)(now - _lineFree) >= 0)
+    {
+        int ch = -1;
+        if (_txTail != _txHead)
+        {
+            ch = _tx[_txTail % TX_SIZE];
+            ++_txTail;
+        }
+        else if ((_block != NULL) && (_blockPos < _blockSize))
+        {
+            ch = _block[_blockPos];
+            ++_blockPos;
+        }
+
+        if (ch >= 0)
+        {
+            // back-to-back unless the line was idle
+            uint32_t start = (now - _lineFree < _byteTime) ? _lineFree : now;
+            _lineFree = start + _byteTime;
+            _peer->receive((char)ch, _lineFree);
+        }
+        else if (_block != NULL)
+        {
+            // the last stop bit has left
+            void (*done)(void* ctx) = _blockDone;
+            void* ctx = _blockCtx;
+            _block = NULL;
+            if (_loseBlockDone)
+            {
+                _loseBlockDone = false;
+            }
+            else
+            {
+                _insideIrq = true;
+                done(ctx);
+                _insideIrq = false;
+            }
+        }
+    }
+
+    // receiver
+    int ch;
+    while ((ch = _peer->transmit(now)) >= 0)
+    {
+        uint32_t next = _rxHead + 1;
+        if (next - _rxTail <= RX_SIZE)
+        {
+            _rx[_rxHead % RX_SIZE] = (uint8_t)ch;
+            _rxHead = next;
+        }
+        _insideIrq = true;
+        if (_rxCallback != NULL) _rxCallback((uint8_t)ch);
+        if (_rxCtxCallback != NULL) _rxCtxCallback((uint8_t)ch, _rxCtx);
+        _insideIrq = false;
+    }
+
+    return (_txTail != _txHead) || (_block != NULL) || _peer->isTransmitting() ||
+        ((int32_t)(now - _lineFree) < 0);
+}
+
+
+int USARTClass::available(void)
+{
+    return (int)(_rxHead - _rxTail);
+}
+
+
+int USARTClass::availableForWrite(void)
+{
+    return (int)(TX_SIZE - 1 - (_txHead - _txTail));
+}
+
+
+int USARTClass::peek(void)
+{
+    if (_rxHead == _rxTail) return -1;
+    return _rx[_rxTail % RX_SIZE];
+}
+
+
+int USARTClass::read(void)
+{
+    if (_rxHead == _rxTail) return -1;
+    uint8_t ch = _rx[_rxTail % RX_SIZE];
+    ++_rxTail;
+    return ch;
+}
+
+
+// the peripheral task runs first, so the bytes have left when it sleeps again
+void USARTClass::flush(void)
+{
+    while ((_block != NULL) || (_txTail != _txHead) || ((int32_t)(micros() - _lineFree) < 0))
+    {
+        yield();
+    }
+}
+
+
+size_t USARTClass::write(uint8_t c)
+{
+    return write(&c, 1);
+}
+
+
+size_t USARTClass::write(const uint8_t* buffer, size_t size)
+{
+    size_t n = 0;
+    for (; n < size; ++n)
+    {
+        while (_txHead - _txTail >= TX_SIZE - 1) yield();  // spin like the DUE core
+        _tx[_txHead % TX_SIZE] = buffer[n];
+        ++_txHead;
+    }
+    _wake();  // once per string, a command is not split into single wakes
+    return n;
+}
+
+
+void USARTClass::setRxIrqCallback(void (*clbk)(uint8_t ch))
+{
+    _rxCallback = clbk;
+}
+
+
+void USARTClass::setRxIrqCallback(void (*clbk)(uint8_t ch, void* ctx), void* ctx)
+{
+    _rxCtxCallback = NULL;  // never call the new callback with the old context
+    _rxCtx = ctx;
+    _rxCtxCallback = clbk;
+}
+
+
+bool USARTClass::writeBlock(const uint8_t* buffer, size_t size, void (*done)(void* ctx), void* ctx)
+{
+    if ((_block != NULL) || (_txTail != _txHead) || (size == 0) || (size > 0xFFFF))
+    {
+        return false;
+    }
+    _blockDone = done;
+    _blockCtx = ctx;
+    _blockSize = size;
+    _blockPos = 0;
+    _block = buffer;
+    _wake();
+    return true;
+}
@@ -0,0 +1,168 @@
+// Round trip latency of the library over a pty loopback, Linux only.
+//
+// The emulator serves the master side of a pseudo terminal in a thread. The
+// client is the whole stack of a PC with a USB-RS485 adapter: MSFilterQuad
+// over JanasCardQSource3 on QSource3DeadlineTransport<Linux_Stream>, the
+// slave side of the pty. Built by the host build (CMakeLists.txt) against
+// msfilterquad_linux, Q_SOURCE3_BARE and USE_LINUX_STREAM.
+//
+// The setMZ() frames per second are compared for the guard time measured by
+// JanasCardQSource3::measureGuardTime() and the fixed Q_SOURCE3_GUARD_TIME_US.
+//
+// Usage: pty_latency [queries] [latency us] [jitter us] [baud]
+
+#include "MSFilterQuad.h"
+#include <algorithm>
+#include <atomic>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#define PTY_R0 6e-3
+#define PTY_RATE_FRAMES 400  // at most, 2 s with the fixed guard time
+
+struct Device {
+    int fd;
+    QSource3Emulator* emulator;
+    std::atomic<bool> stop;
+};
+
+// the emulator side: receives, then sends the response bytes when they are due
+static void* serve(void* arg)
+{
+    Device* d = static_cast<Device*>(arg);
+    char buff[256];
+    while (!d->stop)
+    {
+        int32_t wait = 10000;
+        if (d->emulator->isTransmitting())
+        {
+            wait = (int32_t)(d->emulator->nextDue() - micros());
+            if (wait < 0) wait = 0;
+        }
+        struct timespec timeout = {0, wait * 1000L};
+        struct pollfd p = {d->fd, POLLIN, 0};
+        if (ppoll(&p, 1, &timeout, NULL) > 0)
+        {
+            ssize_t n = read(d->fd, buff, sizeof(buff));
+            uint32_t now = micros();
+            for (ssize_t i = 0; i < n; ++i) d->emulator->receive(buff[i], now);
+        }
+        size_t n = 0;
+        int ch;
+        while ((n < sizeof(buff)) && ((ch = d->emulator->transmit(micros())) >= 0)) buff[n++] = ch;
+        if (n > 0 && write(d->fd, buff, n) < 0) break;
+    }
+    return NULL;
+}
+
+static void report(const char* name, std::vector<uint32_t>& t, int failed)
+{
+    std::sort(t.begin(), t.end());
+    size_t n = t.size();
+    if (n == 0)
+    {
+        printf("%-12s no responses, %d failed\n", name, failed);
+        return;
+    }
+    printf("%-12s n %zu  min %u  median %u  p99 %u  max %u us  failed %d\n",
+        name, n, t[0], t[n / 2], t[n * 99 / 100], t[n - 1], failed);
+}
+
+int main(int argc, char** argv)
+{
+    int queries = (argc > 1) ? atoi(argv[1]) : 10000;
+    QSource3EmulatorConfig config = {1500000, 50, 20, 0, 0, 1};
+    if (argc > 2) config.latencyUs = atoi(argv[2]);
+    if (argc > 3) config.jitterUs = atoi(argv[3]);
+    if (argc > 4) config.baud = atoi(argv[4]);
+
+    int master, slave;
+    if (!Linux_Stream::openPty(&master, &slave))
+    {
+        perror("openPty");
+        return 1;
+    }
+    QSource3Emulator emulator(&config);
+    Device device = {master, &emulator, {false}};
+    pthread_t thread;
+    pthread_create(&thread, NULL, serve, &device);
+
+    Linux_Stream stream(slave, 100);
+    if (!stream.init())
+    {
+        perror("init");
+        return 1;
+    }
+    JanasCardQSource3 qSource3(&stream);
+    qSource3.init(100);
+    if (!qSource3.writeRSMode(0) || !qSource3.measureGuardTime())
+    {
+        printf("no response from the emulator\n");
+        return 1;
+    }
+    int32_t freq = qSource3.readFreq();  // hundreds of Hz
+
+    StateTuneParRecords rf, dc;
+    rf._numberTuneParRecs = 0;
+    dc._numberTuneParRecs = 0;
+    MSFilterQuad filter(PTY_R0, &qSource3, &rf, &dc);
+    filter.initRFFactor(freq * 100.0f);
+
+    printf("emulator: %u baud, latency %u us, jitter %u us; guard time %u us\n",
+        config.baud, config.latencyUs, config.jitterUs, qSource3.getGuardTime());
+
+    static const char* const cases[] = {"readTest", "readFreq", "writeAC", "setMZ"};
+    for (int c = 0; c < 4; ++c)
+    {
+        std::vector<uint32_t> t;
+        int failed = 0;
+        for (int i = 0; i < queries; ++i)
+        {
+            uint32_t t0 = micros();
+            bool ok;
+            switch (c)
+            {
+            case 0: ok = qSource3.readTest(); break;
+            case 1: ok = qSource3.readFreq() >= 0; break;
+            case 2: ok = qSource3.writeAC(100000 + (i & 1) * 1000); break;
+            default: ok = filter.setMZ((i & 1) ? 100.0f : 200.0f); break;  // no response, waits for the guard time of the last frame
+            }
+            if (ok) t.push_back(micros() - t0); else ++failed;
+        }
+        report(cases[c], t, failed);
+    }
+
+    // every frame waits for the guard time of the previous one
+    const uint32_t guards[2] = {qSource3.getGuardTime(), Q_SOURCE3_GUARD_TIME_US};
+    static const char* const modes[2] = {"measured", "fixed"};
+    int frames = std::min(queries, PTY_RATE_FRAMES);
+    for (int g = 0; g < 2; ++g)
+    {
+        qSource3.setGuardTime(guards[g]);
+        int failed = 0;
+        uint32_t t0 = micros();
+        for (int i = 0; i < frames; ++i)
+        {
+            if (!filter.setMZ((i & 1) ? 100.0f : 200.0f)) ++failed;
+        }
+        uint32_t t = micros() - t0;
+        printf("%-12s guard %u us: %d frames, %.0f commands/s  failed %d\n",
+            modes[g], guards[g], frames, (t > 0) ? frames * 1e6 / t : 0.0, failed);
+    }
+    qSource3.setGuardTime(guards[0]);
+
+    const QSource3ParseStats& ps = qSource3.getParseStats();
+    printf("responses: %u ok, %u values, %u none, %u unexpected, %u malformed\n",
+        ps.ok, ps.values, ps.none, ps.unexpected, ps.malformed);
+
+    device.stop = true;
+    pthread_join(thread, NULL);
+    close(master);
+    close(slave);
+    return 0;
+}
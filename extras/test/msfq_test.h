@@ -0,0 +1,49 @@
+// Checks of the host tests, see CMakeLists.txt. Every test is an executable
+// that runs all its checks and returns non-zero when any of them failed;
+// ctest runs them. No test framework is needed on the host.
+
+#ifndef msfq_test_h
+#define msfq_test_h
+
+#include <stdio.h>
+#include <math.h>
+
+static int _msfqFailed = 0;
+static int _msfqChecked = 0;
+
+#define CHECK(cond_) do { \
+    ++_msfqChecked; \
+    if (!(cond_)) { \
+        ++_msfqFailed; \
+        printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond_); \
+    } \
+} while (0)
+
+#define CHECK_EQ(a_, b_) do { \
+    long long a__ = (long long)(a_); \
+    long long b__ = (long long)(b_); \
+    ++_msfqChecked; \
+    if (a__ != b__) { \
+        ++_msfqFailed; \
+        printf("%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a_, #b_, a__, b__); \
+    } \
+} while (0)
+
+#define CHECK_NEAR(a_, b_, tol_) do { \
+    double a__ = (double)(a_); \
+    double b__ = (double)(b_); \
+    ++_msfqChecked; \
+    if (!(fabs(a__ - b__) <= (double)(tol_))) { \
+        ++_msfqFailed; \
+        printf("%s:%d: CHECK_NEAR(%s, %s, %s) failed: %.9g, %.9g\n", __FILE__, __LINE__, #a_, #b_, #tol_, a__, b__); \
+    } \
+} while (0)
+
+// the exit code of main()
+static inline int msfqTestResult(const char* name)
+{
+    printf("%s: %d checks, %d failed\n", name, _msfqChecked, _msfqFailed);
+    return (_msfqFailed == 0) ? 0 : 1;
+}
+
+#endif
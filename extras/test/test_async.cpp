@@ -0,0 +1,157 @@
+// The asynchronous API of JanasCardQSource3T on a single-threaded lock with
+// std::deque queues: the highest priority class first, telemetry dropped
+// while held, queued and blocking, callbacks with their context, queueing
+// statistics and rejected requests of full queues.
+
+#include "JanasCardQSource3Impl.h"
+#include "msfq_test.h"
+#include <deque>
+
+#define TEST_QUEUE_LENGTH 2
+
+// the queue interface of QSource3Lock.h without scheduler
+class DequeLock {
+    std::deque<void*> _queue[Q_SOURCE3_QUEUE_CLASSES];
+    size_t _classes = 0;
+    size_t _length = 0;
+public:
+    uint32_t notified = 0;
+
+    bool init() { return true; }
+    bool take(uint32_t) { return true; }
+    void give() {}
+    void sleep(uint32_t) {}
+    void enterCritical() {}
+    void exitCritical() {}
+
+    bool initQueue(size_t classes, size_t length) { _classes = classes; _length = length; return true; }
+
+    bool send(size_t cls, void* item)
+    {
+        if ((cls >= _classes) || (_queue[cls].size() >= _length)) return false;
+        _queue[cls].push_back(item);
+        return true;
+    }
+
+    void* receive(uint32_t)
+    {
+        for (size_t i = 0; i < _classes; ++i)
+        {
+            if (_queue[i].empty()) continue;
+            void* item = _queue[i].front();
+            _queue[i].pop_front();
+            return item;
+        }
+        return NULL;
+    }
+
+    void* self() { return this; }
+    void notify(void*) { ++notified; }
+    void waitNotify(uint32_t) {}
+    uint32_t getTickCount() { return millis(); }
+};
+
+typedef JanasCardQSource3T<QSource3NullTransport, DequeLock> AsyncDevice;
+template class JanasCardQSource3T<QSource3NullTransport, DequeLock>;
+
+static AsyncDevice _device(NULL);
+static QSource3Op _order[8];
+static size_t _done = 0;
+
+
+static void onDone(QSource3Request* req, void* ctx)
+{
+    CHECK(ctx == (void*)&_done);
+    CHECK(AsyncDevice::isDone(req));
+    if (_done < 8) _order[_done] = req->op;
+    ++_done;
+}
+
+
+static void initReq(QSource3Request* req)
+{
+    req->callback = onDone;
+    req->ctx = &_done;
+}
+
+
+static void testPriority(void)
+{
+    QSource3Request telemetry, control, setpoint;
+    initReq(&telemetry);
+    initReq(&control);
+    initReq(&setpoint);
+    CHECK(_device.readCurrentAsync(&telemetry));
+    CHECK(_device.readTestAsync(&control));
+    CHECK(_device.writeVoltagesAsync(&setpoint, 1000, -1000, 2000));
+    CHECK_EQ(setpoint.state, Q_SOURCE3_CMD_PENDING);
+
+    _done = 0;
+    while (_device.workAsync(0));
+    CHECK_EQ(_done, 3);
+    CHECK_EQ(_order[0], Q_SOURCE3_OP_VOLTAGES);
+    CHECK_EQ(_order[1], Q_SOURCE3_OP_TEST);
+    CHECK_EQ(_order[2], Q_SOURCE3_OP_READ_CURRENT);
+    CHECK(_device.wait(&setpoint, 0));
+    CHECK_EQ(control.state, Q_SOURCE3_CMD_DONE);
+    CHECK_EQ(_device.getQueueStats(Q_SOURCE3_PRIO_REALTIME).requests, 1);
+}
+
+
+static void testHold(void)
+{
+    QSource3Request telemetry;
+    initReq(&telemetry);
+    _device.holdTelemetry();
+    CHECK(_device.readFreqAsync(&telemetry));
+    CHECK(_device.workAsync(0));
+    _device.releaseTelemetry();
+    CHECK_EQ(telemetry.state, Q_SOURCE3_CMD_DROPPED);
+    CHECK(!_device.wait(&telemetry, 0));
+    CHECK_EQ(_device.getQueueStats(Q_SOURCE3_PRIO_TELEMETRY).dropped, 1);
+
+    // blocking telemetry gives way as well, setpoints do not
+    uint32_t accesses = _device.getQueueStats(Q_SOURCE3_PRIO_TELEMETRY).accesses;
+    _device.holdTelemetry();
+    CHECK_EQ(_device.readFreq(), -1);
+    CHECK_EQ(_device.readCurrent(), -1);
+    CHECK(_device.writeVoltages(2000, -1000, 2000));
+    _device.releaseTelemetry();
+    CHECK_EQ(_device.getQueueStats(Q_SOURCE3_PRIO_TELEMETRY).dropped, 3);
+    CHECK_EQ(_device.getQueueStats(Q_SOURCE3_PRIO_TELEMETRY).accesses, accesses);
+
+    CHECK(_device.readFreqAsync(&telemetry));
+    CHECK(_device.workAsync(0));
+    CHECK_EQ(telemetry.state, Q_SOURCE3_CMD_ERROR);  // sent, the null device answers "OK" instead of a frequency
+    CHECK_EQ(_device.getQueueStats(Q_SOURCE3_PRIO_TELEMETRY).requests, 2);
+}
+
+
+static void testFull(void)
+{
+    QSource3Request req[TEST_QUEUE_LENGTH + 1];
+    for (size_t i = 0; i < TEST_QUEUE_LENGTH + 1; ++i) initReq(&req[i]);
+    for (size_t i = 0; i < TEST_QUEUE_LENGTH; ++i) CHECK(_device.storeFreqAsync(&req[i]));
+    CHECK(!_device.storeFreqAsync(&req[TEST_QUEUE_LENGTH]));
+    CHECK_EQ(req[TEST_QUEUE_LENGTH].state, Q_SOURCE3_CMD_ERROR);
+    CHECK_EQ(_device.getQueueStats(Q_SOURCE3_PRIO_CONTROL).rejected, 1);
+    while (_device.workAsync(0));
+    CHECK_EQ(req[0].state, Q_SOURCE3_CMD_DONE);
+
+    _device.resetQueueStats();
+    CHECK_EQ(_device.getQueueStats(Q_SOURCE3_PRIO_CONTROL).rejected, 0);
+}
+
+
+int main()
+{
+    _device.init(0);
+    CHECK(_device.writeRSMode(0));
+    _device.setGuardTime(0);
+    CHECK(_device.initAsync(TEST_QUEUE_LENGTH));
+
+    testPriority();
+    testHold();
+    testFull();
+    return msfqTestResult("test_async");
+}
@@ -0,0 +1,124 @@
+// MSFilterQuad::calcUVBatch() against setMZ() point by point: the same voltages
+// in every m/z order, with and without the setpoint table, for every kernel,
+// both polarities, DC off and a DC offset, which setMZ() must keep.
+
+#include "MSFilterQuad.h"
+#include "msfq_test.h"
+#include <vector>
+#include <algorithm>
+
+#define TEST_R0 6e-3
+#define TEST_MAX_CALIB_MZ 500.0
+#define TEST_POINTS 2000
+
+static JanasCardQSource3 _device(NULL);
+static StateTuneParRecords _rf;
+static StateTuneParRecords _dc;
+static MSFQSetpoint _table[20000];
+
+// deterministic, the same tables and m/z on every run
+static uint32_t _seed = 1;
+
+static float rnd(void)
+{
+    _seed = _seed * 1664525UL + 1013904223UL;
+    return (float)(_seed >> 8) / 16777216.0f;
+}
+
+static void fillCalib(StateTuneParRecords* records, size_t n, float amp)
+{
+    records->_numberTuneParRecs = n;
+    for (size_t i = 0; i < n; ++i)
+    {
+        records->_tuneParMZ[i] = TEST_MAX_CALIB_MZ * i / n + 3.0f * rnd();
+        records->_tuneParVal[i] = amp * (2.0f * rnd() - 1.0f);
+    }
+}
+
+// the voltages as written by setMZ(), the getters return Volts
+static int32_t toMV(float v)
+{
+    return (int32_t)lroundf(v * 1000.0f);
+}
+
+
+// the batch of one order against setMZ() of each point
+static void compare(MSFilterQuad* filter, const std::vector<float>& mz, long* maxErr)
+{
+    size_t n = mz.size();
+    std::vector<int32_t> dc1(n), dc2(n);
+    std::vector<uint32_t> ac(n);
+    filter->calcUVBatch(mz.data(), n, dc1.data(), dc2.data(), ac.data());
+
+    long bad = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        filter->setMZ(mz[i]);
+        long err = labs((long)dc1[i] - toMV(filter->getDC1()));
+        err = std::max(err, labs((long)dc2[i] - toMV(filter->getDC2())));
+        err = std::max(err, labs((long)ac[i] - (long)lroundf(filter->getRFAmp() * 2000.0f)));
+        if (err > *maxErr) *maxErr = err;
+        if (err > 0) ++bad;
+    }
+    CHECK_EQ(bad, 0);
+}
+
+
+static void testOrders(void)
+{
+    const size_t sizes[] = {0, 2, 3, 8, MAX_NUMBER_OF_TUNE_PAR_RECORDS};
+    long maxErr = 0;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+    {
+        fillCalib(&_rf, sizes[s], 0.3f);
+        fillCalib(&_dc, sizes[s], 0.05f);
+        for (int k = 0; k < 3; ++k)
+        {
+            MSFilterQuad filter(TEST_R0, &_device, &_rf, &_dc);
+            filter.setInterpolation((MSFQInterp)k);
+            filter.initRFFactor(480000.0);
+            filter.attachSetpointTable(_table, sizeof(_table) / sizeof(_table[0]));
+
+            // ascending over the range and beyond it, descending, random
+            float maxMZ = filter.calcMaxMz();
+            std::vector<float> up(TEST_POINTS);
+            for (size_t i = 0; i < up.size(); ++i) up[i] = -5.0f + (maxMZ + 10.0f) * i / TEST_POINTS;
+            std::vector<float> down(up.rbegin(), up.rend());
+            std::vector<float> random(TEST_POINTS);
+            for (size_t i = 0; i < random.size(); ++i) random[i] = maxMZ * rnd();
+
+            for (int mode = 0; mode < 4; ++mode)
+            {
+                filter.setRodPolarityPos(mode != 1);
+                filter.setDCOn(mode != 2);
+                if (mode == 3)
+                {
+                    filter.setDCOffst(-12.5f);
+                }
+                compare(&filter, up, &maxErr);
+                compare(&filter, down, &maxErr);
+                compare(&filter, random, &maxErr);
+                CHECK_NEAR(filter.getDCOffst(), (mode == 3) ? -12.5 : 0.0, 1e-6);
+
+                // setMZ() and the batch look up the same table
+                CHECK(filter.buildSetpointTable(0.25f));
+                compare(&filter, up, &maxErr);
+                compare(&filter, random, &maxErr);
+                filter.attachSetpointTable(_table, sizeof(_table) / sizeof(_table[0]));
+                filter.setDCOffst(0.0f);
+            }
+        }
+    }
+    printf("batch: max difference to setMZ() %ld mV\n", maxErr);
+}
+
+
+int main()
+{
+    _device.writeRSMode(0);
+    _device.setGuardTime(0);
+    _device.setSuppressUnchanged(false);
+
+    testOrders();
+    return msfqTestResult("test_batch");
+}
@@ -0,0 +1,171 @@
+// MSFQCalibBuffer under load: a writer thread publishes calibrations as fast as
+// it can while the reader thread, through acquire() and through an attached
+// MSFilterQuad, checks that every table and spline it sees belongs to exactly
+// one published version. Every version has its own pattern of points, so a
+// torn read (parts of two versions, or a buffer rewritten while in use) shows
+// up as a mismatch. Both threads yield inside their critical windows now and
+// then, so the interleavings happen on a single core as well. The checks run
+// in the main thread after the join, the counters of msfq_test.h are not
+// thread-safe.
+
+#include "MSFilterCalib.h"
+#include "MSFilterInterp.h"
+#include "msfq_test.h"
+#include <atomic>
+#include <thread>
+
+#define TEST_R0 6e-3
+#define TEST_READS 200000
+#define TEST_MAX_STEPS 4000000  // k + i * i stays exact in float
+
+static JanasCardQSource3 _device(NULL);
+static StateTuneParRecords _rf;
+static StateTuneParRecords _dc;
+
+static std::atomic<bool> _stop(false);
+static uint32_t _published = 0;
+static uint32_t _retries = 0;
+
+// the reader's findings
+static long _reads = 0;
+static long _torn = 0;
+static long _tornSpline = 0;
+static long _tornCopy = 0;
+static long _backwards = 0;
+static uint32_t _versionsSeen = 0;
+
+
+// the calibration of writer step k, version k + 1
+static void fill(StateTuneParRecords* rf, StateTuneParRecords* dc, uint32_t k)
+{
+    size_t n = 3 + k % (MAX_NUMBER_OF_TUNE_PAR_RECORDS - 2);
+    rf->_numberTuneParRecs = n;
+    dc->_numberTuneParRecs = n;
+    for (size_t i = 0; i < n; ++i)
+    {
+        rf->_tuneParMZ[i] = 10.0f * i + (k % 7);
+        rf->_tuneParVal[i] = (float)(k + i * i);
+        dc->_tuneParMZ[i] = rf->_tuneParMZ[i];
+        dc->_tuneParVal[i] = -(float)(k + i);
+    }
+}
+
+
+// the step k of a table or 0xFFFFFFFF if its points do not match one step
+static uint32_t stepOf(const StateTuneParRecords* records, MSFQCalib calib)
+{
+    size_t n = records->_numberTuneParRecs;
+    if ((n < 3) || (n > MAX_NUMBER_OF_TUNE_PAR_RECORDS)) return 0xFFFFFFFF;
+    float v = records->_tuneParVal[0];
+    uint32_t k = (uint32_t)((calib == MSFQ_CALIB_RF) ? v : -v);
+    StateTuneParRecords rf, dc;
+    fill(&rf, &dc, k);
+    const StateTuneParRecords* ref = (calib == MSFQ_CALIB_RF) ? &rf : &dc;
+    if (ref->_numberTuneParRecs != n) return 0xFFFFFFFF;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if ((ref->_tuneParMZ[i] != records->_tuneParMZ[i]) || (ref->_tuneParVal[i] != records->_tuneParVal[i])) return 0xFFFFFFFF;
+    }
+    return k;
+}
+
+
+static bool sameSpline(const StateTuneParRecords* records, const MSFQSpline* spline)
+{
+    MSFQSpline ref;
+    msfqSplineInit(records, &ref);
+    for (size_t i = 0; i < records->_numberTuneParRecs; ++i)
+    {
+        if (ref.y2[i] != spline->y2[i]) return false;
+    }
+    return true;
+}
+
+
+static void writer(MSFQCalibBuffer* buffer)
+{
+    uint32_t k = 0;
+    while (!_stop.load(std::memory_order_relaxed) && (k < TEST_MAX_STEPS))
+    {
+        MSFQCalibSnapshot* s = buffer->beginUpdate();
+        if (s == NULL)
+        {
+            ++_retries;
+            std::this_thread::yield();
+            continue;
+        }
+        ++k;
+        if (k % 8 == 0)
+        {
+            // the reader runs while the back buffer holds RF of k and DC of k - 1
+            StateTuneParRecords dc;
+            fill(&(s->rf), &dc, k);
+            std::this_thread::yield();
+        }
+        fill(&(s->rf), &(s->dc), k);
+        buffer->publish();
+        _published = k;
+    }
+}
+
+
+static void reader(MSFQCalibBuffer* buffer, MSFilterQuad* filter)
+{
+    uint32_t last = 0;
+    uint32_t lastVersion = 0;
+    StateTuneParRecords rf, dc;
+    for (long r = 0; r < TEST_READS; ++r)
+    {
+        // the snapshot directly, the tables, their splines and version
+        MSFQCalibSnapshot* s = buffer->acquire();
+        if (r % 8 == 0) std::this_thread::yield();  // the writer runs while the snapshot is in use
+        uint32_t k = stepOf(&(s->rf), MSFQ_CALIB_RF);
+        if ((k == 0xFFFFFFFF) || (stepOf(&(s->dc), MSFQ_CALIB_DC) != k) || (s->version != k + 1)) ++_torn;
+        else if (!sameSpline(&(s->rf), &(s->splineRF)) || !sameSpline(&(s->dc), &(s->splineDC))) ++_tornSpline;
+        if (s->version < lastVersion) ++_backwards;
+        if (s->version != lastVersion) ++_versionsSeen;
+        lastVersion = s->version;
+        buffer->release();
+
+        // the copies of the filter, each of one published version
+        filter->getCalibPntsRF(&rf);
+        filter->getCalibPntsDC(&dc);
+        // the DC copy is taken later, from the same or a newer version
+        k = stepOf(&rf, MSFQ_CALIB_RF);
+        uint32_t kd = stepOf(&dc, MSFQ_CALIB_DC);
+        if ((k == 0xFFFFFFFF) || (kd == 0xFFFFFFFF) || (k < last) || (kd < k)) ++_tornCopy;
+        last = k;
+        filter->calcRF(100.0f);
+        ++_reads;
+    }
+    _stop = true;
+}
+
+
+int main()
+{
+    _device.writeRSMode(0);
+    _device.setGuardTime(0);
+    fill(&_rf, &_dc, 0);
+
+    MSFQCalibBuffer buffer(&_rf, &_dc);
+    MSFilterQuad filter(TEST_R0, &_device, &_rf, &_dc);
+    filter.initRFFactor(480000.0);
+    filter.attachCalibBuffer(&buffer);
+
+    std::thread w(writer, &buffer);
+    std::thread r(reader, &buffer, &filter);
+    r.join();
+    w.join();
+
+    printf("calib buffer: %ld reads, %u versions published, %u seen, %u writer retries\n",
+        _reads, _published, _versionsSeen, _retries);
+    CHECK_EQ(_reads, TEST_READS);
+    CHECK_EQ(_torn, 0);
+    CHECK_EQ(_tornSpline, 0);
+    CHECK_EQ(_tornCopy, 0);
+    CHECK_EQ(_backwards, 0);
+    CHECK(_published > 1);
+    CHECK(_versionsSeen > 1);
+    return msfqTestResult("test_calib_buffer");
+}
@@ -0,0 +1,168 @@
+// The composite setters of MSFilterQuad and MSFQTransaction against
+// QSource3Emulator: every operation is one command at the device, which ends
+// with the voltages cached by the filter. An odd DC1 - DC2 survives offset
+// changes, the offset survives difference changes, Volts are rounded to mV
+// by every setter, setMZ() included.
+
+#include "MSFilterQuad.h"
+#include "msfq_test.h"
+
+#define TEST_R0 6e-3
+
+static QSource3Emulator _emu;
+static JanasCardQSource3 _device(&_emu);
+static StateTuneParRecords _rf;
+static StateTuneParRecords _dc;
+
+
+// commands executed by the device since the last call
+static uint32_t commands(void)
+{
+    static uint32_t last = 0;
+    uint32_t n = _emu.getStats().commands;
+    uint32_t d = n - last;
+    last = n;
+    return d;
+}
+
+// the device holds what the filter reports
+static void checkDevice(MSFilterQuad* filter)
+{
+    CHECK_EQ(_emu.getDC1(), lroundf(filter->getDC1() * 1000.0f));
+    CHECK_EQ(_emu.getDC2(), lroundf(filter->getDC2() * 1000.0f));
+    CHECK_EQ(_emu.getAC(), lroundf(filter->getRFAmp() * 2000.0f));
+}
+
+
+static void testFrames(MSFilterQuad* filter)
+{
+    CHECK(filter->setMZ(100.0f));
+    commands();
+
+    CHECK(filter->setDCOffst(5.0f));
+    CHECK_EQ(commands(), 1);
+    checkDevice(filter);
+
+    CHECK(filter->setDCDiff(2.0f));
+    CHECK_EQ(commands(), 1);
+    checkDevice(filter);
+    CHECK_NEAR(filter->getDCOffst(), 5.0, 1e-6);
+
+    CHECK(filter->setRodPolarityPos(false));
+    CHECK_EQ(commands(), 1);
+    checkDevice(filter);
+    CHECK_NEAR(filter->getDCDiff(), -2.0, 1e-6);
+
+    CHECK(filter->setRodPolarityPos(true));
+    CHECK_EQ(commands(), 1);
+
+    // all of it in one frame
+    MSFQTransaction t(filter);
+    t.setDCOffst(-3.0f);
+    t.setRFAmp(100.0f);
+    t.setRodPolarityPos(false);
+    t.setDCOn(false);
+    CHECK_EQ(commands(), 0);  // nothing before the commit
+    CHECK(t.commit());
+    CHECK_EQ(commands(), 1);
+    checkDevice(filter);
+    CHECK_NEAR(filter->getDCOffst(), -3.0, 1e-6);
+    CHECK_EQ(_emu.getDC1(), _emu.getDC2());  // DC off
+
+    t.setDCOn(true);
+    t.setRodPolarityPos(true);
+    t.setDCOffst(0.0f);
+    CHECK(t.commit());
+    CHECK_EQ(commands(), 1);
+    checkDevice(filter);
+}
+
+
+static void testRounding(MSFilterQuad* filter)
+{
+    // DC1 - DC2 = 2003 mV
+    MSFQTransaction t(filter);
+    t.setDC1(1.003f);
+    t.setDC2(-1.000f);
+    CHECK(t.commit());
+    CHECK_EQ(_emu.getDC1() - _emu.getDC2(), 2003);
+    CHECK_EQ(filter->getDCOffstMV(), 1);
+
+    // the odd difference is kept, the extra mV on DC1
+    CHECK(filter->setDCOffst(5.0f));
+    CHECK_EQ(_emu.getDC1(), 6002);
+    CHECK_EQ(_emu.getDC2(), 3999);
+    CHECK_EQ(filter->getDCOffstMV(), 5000);
+    CHECK(filter->setDCOffst(-5.0f));
+    CHECK_EQ(_emu.getDC1(), -3998);
+    CHECK_EQ(_emu.getDC2(), -6001);
+    CHECK_EQ(filter->getDCOffstMV(), -5000);
+
+    // a negative odd difference as well
+    CHECK(filter->setRodPolarityPos(false));
+    CHECK_EQ(_emu.getDC1() - _emu.getDC2(), -2003);
+    CHECK_EQ(filter->getDCOffstMV(), -5000);
+    CHECK(filter->setDCOffst(7.0f));
+    CHECK_EQ(_emu.getDC1() - _emu.getDC2(), -2003);
+    CHECK_EQ(filter->getDCOffstMV(), 7000);
+    CHECK(filter->setRodPolarityPos(true));
+
+    // the offset of an odd difference is kept by a new difference
+    CHECK(filter->setDCDiff(0.5f));
+    CHECK_EQ(_emu.getDC1(), 7500);
+    CHECK_EQ(_emu.getDC2(), 6500);
+
+    // Volts are rounded to mV, -2.6 mV is not truncated to -2 mV
+    CHECK(filter->setDCOffst(-0.0026f));
+    CHECK_EQ(filter->getDCOffstMV(), -3);
+    CHECK(filter->setDC1(0.0119f));
+    CHECK_EQ(_emu.getDC1(), 12);
+    CHECK(filter->setDCOffst(0.0f));
+}
+
+
+// every float setter rounds, none truncates
+static void testRoundingSetters(MSFilterQuad* filter)
+{
+    CHECK(filter->setVoltages(0.0509f, 0.0119f, -0.0026f));
+    CHECK_EQ(_emu.getAC(), 102);  // 101.8 mV(p-p)
+    CHECK_EQ(_emu.getDC1(), 12);
+    CHECK_EQ(_emu.getDC2(), -3);
+    checkDevice(filter);
+
+    CHECK(filter->setRFAmp(0.0509f));
+    CHECK_EQ(_emu.getAC(), 102);
+    CHECK(filter->setRFAmp(0.0f));
+
+    MSFQTransaction t(filter);
+    t.setRFAmp(0.0509f);
+    CHECK(t.commit());
+    CHECK_EQ(_emu.getAC(), 102);
+
+    // setMZ() rounds its setpoint as well
+    CHECK(filter->setVoltages(0.0f, 0.0f, 0.0f));
+    for (int i = 0; i < 50; ++i)
+    {
+        float mz = 100.0f + 0.37f * i;
+        CHECK(filter->setMZ(mz));
+        CHECK_EQ(_emu.getAC(), lroundf(filter->calcRF(mz) * 2000.0f));
+        CHECK_EQ(_emu.getDC1() - _emu.getDC2(), 2 * lroundf(filter->calcDC(mz) * 1000.0f));
+        checkDevice(filter);
+    }
+}
+
+
+int main()
+{
+    CHECK(_device.writeRSMode(0));
+    _device.setSuppressUnchanged(false);
+    _rf._numberTuneParRecs = 0;
+    _dc._numberTuneParRecs = 0;
+    MSFilterQuad filter(TEST_R0, &_device, &_rf, &_dc);
+    filter.initRFFactor(480000.0);
+
+    testFrames(&filter);
+    testRounding(&filter);
+    testRoundingSetters(&filter);
+    return msfqTestResult("test_composite");
+}
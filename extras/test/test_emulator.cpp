@@ -0,0 +1,242 @@
+// QSource3Emulator: commands, limits, stored frequencies, timing and faults.
+// The emulator keeps no clock of its own, so the test drives it with its own time.
+
+#include "QSource3Emulator.h"
+#include "msfq_test.h"
+#include <string.h>
+#include <string>
+
+#define BYTE_US 7  // a byte at 1.5 Mbaud, rounded up
+
+static uint32_t _now = 1000;
+
+// sends the command with '\r' at line speed
+static void send(QSource3Emulator* emu, const char* cmd)
+{
+    for (const char* p = cmd; *p != '\0'; ++p)
+    {
+        _now += BYTE_US;
+        emu->receive(*p, _now);
+    }
+    _now += BYTE_US;
+    emu->receive('\r', _now);
+}
+
+// takes the response bytes up to '\r' whenever they are due, "" without response
+static std::string response(QSource3Emulator* emu)
+{
+    std::string r;
+    while (emu->isTransmitting())
+    {
+        if ((int32_t)(emu->nextDue() - _now) > 0) _now = emu->nextDue();
+        int ch = emu->transmit(_now);
+        if (ch < 0) break;
+        if (ch == '\r') return r;
+        r += (char)ch;
+    }
+    return r;
+}
+
+static std::string query(QSource3Emulator* emu, const char* cmd)
+{
+    send(emu, cmd);
+    return response(emu);
+}
+
+
+static void testCommands(void)
+{
+    QSource3Emulator emu;
+    CHECK(query(&emu, "#Q") == "OK");
+    CHECK(query(&emu, "#N") == "E01");
+    emu.setSerialNo("X42");
+    CHECK(query(&emu, "#N") == "X42");
+
+    CHECK(query(&emu, "#DC1 -1234") == "OK");
+    CHECK(query(&emu, "#DC2 75000") == "OK");
+    CHECK(query(&emu, "#AC 650000") == "OK");
+    CHECK_EQ(emu.getDC1(), -1234);
+    CHECK_EQ(emu.getDC2(), 75000);
+    CHECK_EQ(emu.getAC(), 650000);
+
+    // #C has no response
+    send(&emu, "#C 100 -200 300");
+    CHECK(!emu.isTransmitting());
+    CHECK_EQ(emu.getDC1(), 100);
+    CHECK_EQ(emu.getDC2(), -200);
+    CHECK_EQ(emu.getAC(), 300);
+
+    CHECK(query(&emu, "#R1") == "OK");
+    CHECK(emu.isRS485());
+    CHECK(query(&emu, "#R0") == "OK");
+    CHECK(!emu.isRS485());
+    CHECK_EQ(emu.getStats().commands, 9);
+    CHECK_EQ(emu.getStats().rejected, 0);
+}
+
+
+static void testLimits(void)
+{
+    QSource3Emulator emu;
+    const char* rejected[] = {
+        "#DC1 75001", "#DC2 -75001", "#AC -1", "#AC 650001", "#DC1 12a", "#DC1",
+        "#B 3", "#F 1999", "#F 28001", "#X", "#Q1", "#C 1 2", "#C 1 2 3 4", "#C 1 2 650001"
+    };
+    size_t n = sizeof(rejected) / sizeof(rejected[0]);
+    for (size_t i = 0; i < n; ++i)
+    {
+        send(&emu, rejected[i]);
+        std::string r = response(&emu);
+        // #C is rejected silently like it is accepted
+        CHECK(r == ((strncmp(rejected[i], "#C ", 3) == 0) ? "" : QSOURCE3_EMULATOR_ERROR));
+    }
+    CHECK_EQ(emu.getStats().rejected, n);
+    CHECK_EQ(emu.getDC1(), 0);
+    CHECK_EQ(emu.getDC2(), 0);
+    CHECK_EQ(emu.getAC(), 0);
+    CHECK_EQ(emu.getFreqRange(), 0);
+
+    // too long for the receive buffer
+    std::string longCmd = "#DC1 " + std::string(QSOURCE3_EMULATOR_CMD_SIZE, '1');
+    CHECK(query(&emu, longCmd.c_str()) == QSOURCE3_EMULATOR_ERROR);
+    CHECK(query(&emu, "#Q") == "OK");
+}
+
+
+static void testFrequencies(void)
+{
+    QSource3Emulator emu;
+    CHECK(query(&emu, "#G") == "10500");
+    CHECK(query(&emu, "#B 1") == "OK");
+    CHECK(query(&emu, "#G") == "4800");
+    CHECK(query(&emu, "#F 5000") == "OK");
+    CHECK(query(&emu, "#G") == "5000");
+
+    // not stored, lost by a power cycle
+    emu.powerOn();
+    CHECK_EQ(emu.getFreqRange(), 0);
+    CHECK_EQ(emu.getFreq(1), 4800);
+
+    CHECK(query(&emu, "#B 2") == "OK");
+    CHECK(query(&emu, "#F 2500") == "OK");
+    CHECK(query(&emu, "#S") == "OK");
+    emu.powerOn();
+    CHECK_EQ(emu.getFreq(2), 2500);
+    CHECK_EQ(emu.getStoredFreq(2), 2500);
+    CHECK(query(&emu, "#B 2") == "OK");
+    CHECK(query(&emu, "#G") == "2500");
+}
+
+
+static void testCurrent(void)
+{
+    QSource3Emulator emu;
+    CHECK(query(&emu, "#U") == "0");
+    CHECK(query(&emu, "#AC 650000") == "OK");
+    CHECK(query(&emu, "#U") == "3300");
+    emu.setCurrent(1234);
+    CHECK(query(&emu, "#U") == "1234");
+    emu.setCurrent(3301);
+    CHECK(query(&emu, "#U") == "9999");
+    emu.setCurrent(-1);
+    CHECK(query(&emu, "#U") == "3300");
+}
+
+
+static void testTiming(void)
+{
+    QSource3EmulatorConfig config = {1500000, 50, 0, 0, 0, 1};
+    QSource3Emulator emu(&config);
+    send(&emu, "#Q");
+    uint32_t terminator = _now;
+
+    // "OK\r" starts after the latency, a byte takes 6.67 us
+    CHECK(emu.isTransmitting());
+    CHECK_EQ(emu.transmit(terminator + 50), -1);
+    CHECK_EQ(emu.nextDue(), terminator + 50 + 6);
+    CHECK_EQ(emu.transmit(terminator + 56), 'O');
+    CHECK_EQ(emu.transmit(terminator + 56), -1);
+    CHECK_EQ(emu.transmit(terminator + 63), 'K');
+    CHECK_EQ(emu.transmit(terminator + 70), '\r');
+    CHECK(!emu.isTransmitting());
+
+    // a command before the device has processed the previous one
+    send(&emu, "#C 1 2 3");
+    send(&emu, "#Q");
+    CHECK_EQ(emu.getStats().busy, 1);
+    CHECK(response(&emu) == "OK");
+
+    // a second response is queued behind the first one
+    send(&emu, "#Q");
+    _now += 100;
+    send(&emu, "#G");
+    CHECK(response(&emu) == "OK");
+    CHECK(response(&emu) == "10500");
+}
+
+
+static void testCollision(void)
+{
+    QSource3Emulator emu;
+    CHECK(query(&emu, "#R1") == "OK");
+    send(&emu, "#Q");
+    CHECK(emu.isTransmitting());
+    // half duplex: sending while the device answers destroys the answer
+    send(&emu, "#G");
+    CHECK_EQ(emu.getStats().collisions, 1);
+    CHECK(response(&emu) == "10500");
+    CHECK(!emu.isTransmitting());
+
+    // full duplex keeps both
+    CHECK(query(&emu, "#R0") == "OK");
+    send(&emu, "#Q");
+    send(&emu, "#G");
+    CHECK_EQ(emu.getStats().collisions, 1);
+    CHECK(response(&emu) == "OK");
+    CHECK(response(&emu) == "10500");
+}
+
+
+// the same seed gives the same faults
+static void faults(uint32_t seed, QSource3EmulatorStats* stats, std::string* all)
+{
+    QSource3EmulatorConfig config = {1500000, 10, 5, 50, 20, seed};
+    QSource3Emulator emu(&config);
+    for (int i = 0; i < 1000; ++i)
+    {
+        *all += query(&emu, "#G") + "|";
+        _now += 100;  // a lost terminator is not answered
+        emu.receive('\r', _now);
+        *all += response(&emu) + "|";
+    }
+    *stats = emu.getStats();
+}
+
+
+static void testFaults(void)
+{
+    QSource3EmulatorStats a, b, c;
+    std::string ra, rb, rc;
+    faults(7, &a, &ra);
+    faults(7, &b, &rb);
+    faults(8, &c, &rc);
+    CHECK(a.dropped > 0);
+    CHECK(a.garbled > 0);
+    CHECK_EQ(a.dropped, b.dropped);
+    CHECK_EQ(a.garbled, b.garbled);
+    CHECK(ra == rb);
+    CHECK(ra != rc);
+}
+
+
+int main()
+{
+    testCommands();
+    testLimits();
+    testFrequencies();
+    testCurrent();
+    testTiming();
+    testCollision();
+    testFaults();
+    return msfqTestResult("test_emulator");
+}
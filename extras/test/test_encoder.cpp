@@ -0,0 +1,121 @@
+// QSource3Encoder against snprintf, exhaustively over the DC, AC and frequency
+// ranges of the device and at the ends of the integer range. Formerly
+// checkEncoder() of examples/test_speed, run on the board at every start.
+
+#include "QSource3Encoder.h"
+#include "msfq_test.h"
+#include <string.h>
+#include <limits.h>
+
+// the limits of JanasCardQSource3.h, this test does not need Arduino.h
+#define TEST_MAX_DC 75000
+#define TEST_MIN_DC -75000
+#define TEST_MAX_AC 650000
+#define TEST_MAX_FREQ 28000
+#define TEST_MIN_FREQ 2000
+
+static long _compared = 0;
+static long _mismatches = 0;
+
+static void compare(const char* a, size_t len, const char* b)
+{
+    ++_compared;
+    if ((strcmp(a, b) != 0) || (len != strlen(b)))
+    {
+        if (++_mismatches <= 10) printf("\"%s\" (%zu) != \"%s\"\n", a, len, b);
+    }
+}
+
+
+static void testVoltages(void)
+{
+    char a[QSOURCE3_ENCODE_SIZE];
+    char b[QSOURCE3_ENCODE_SIZE];
+    for (int32_t v = TEST_MIN_DC; v <= TEST_MAX_DC; ++v)
+    {
+        uint32_t ac = (uint32_t)(v - TEST_MIN_DC) * 4;
+        size_t len = qsource3EncodeVoltages(a, v, -v, ac);
+        snprintf(b, sizeof(b), "#C %d %d %u\r", v, -v, ac);
+        compare(a, len, b);
+
+        len = qsource3EncodeDC(a, 1, v);
+        snprintf(b, sizeof(b), "#DC1 %d", v);
+        compare(a, len, b);
+
+        len = qsource3EncodeDC(a, 2, v);
+        snprintf(b, sizeof(b), "#DC2 %d", v);
+        compare(a, len, b);
+    }
+    CHECK_EQ(qsource3EncodeDC(a, 3, 0), 0);
+}
+
+
+static void testAC(void)
+{
+    char a[QSOURCE3_ENCODE_SIZE];
+    char b[QSOURCE3_ENCODE_SIZE];
+    for (uint32_t v = 0; v <= TEST_MAX_AC; ++v)
+    {
+        size_t len = qsource3EncodeAC(a, v);
+        snprintf(b, sizeof(b), "#AC %u", v);
+        compare(a, len, b);
+    }
+}
+
+
+static void testFreq(void)
+{
+    char a[QSOURCE3_ENCODE_SIZE];
+    char b[QSOURCE3_ENCODE_SIZE];
+    for (uint32_t v = TEST_MIN_FREQ; v <= TEST_MAX_FREQ; ++v)
+    {
+        size_t len = qsource3EncodeFreq(a, v);
+        snprintf(b, sizeof(b), "#F %u", v);
+        compare(a, len, b);
+    }
+    for (uint32_t r = 0; r < 3; ++r)
+    {
+        size_t len = qsource3EncodeFreqRange(a, r);
+        snprintf(b, sizeof(b), "#B %u", r);
+        compare(a, len, b);
+    }
+}
+
+
+// every digit count and sign, the longest frame fits QSOURCE3_ENCODE_SIZE
+static void testIntegers(void)
+{
+    char a[QSOURCE3_ENCODE_SIZE];
+    char b[QSOURCE3_ENCODE_SIZE];
+    const int32_t values[] = {
+        0, 1, -1, 9, 10, -10, 99, 100, 999, 1000, 99999, 100000, 999999999, 1000000000,
+        -999999999, -1000000000, INT_MAX, INT_MIN
+    };
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i)
+    {
+        int32_t v = values[i];
+        size_t len = qsource3EncodeInt(a, v);
+        a[len] = '\0';
+        snprintf(b, sizeof(b), "%d", v);
+        compare(a, len, b);
+        CHECK_EQ(qsource3IntLength(v), strlen(b));
+    }
+
+    size_t len = qsource3EncodeVoltages(a, INT_MIN, INT_MIN, UINT_MAX);
+    snprintf(b, sizeof(b), "#C %d %d %u\r", INT_MIN, INT_MIN, UINT_MAX);
+    compare(a, len, b);
+    CHECK(len + 1 <= QSOURCE3_ENCODE_SIZE);
+}
+
+
+int main()
+{
+    testVoltages();
+    testAC();
+    testFreq();
+    testIntegers();
+    printf("encoder: commands compared = %ld, mismatches = %ld\n", _compared, _mismatches);
+    CHECK(_compared > 1000000);
+    CHECK_EQ(_mismatches, 0);
+    return msfqTestResult("test_encoder");
+}
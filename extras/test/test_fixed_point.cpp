@@ -0,0 +1,312 @@
+// The integer pipeline of MSFQ_FIXED_POINT against the float one: conversion of
+// floats without floating point operations, the Q24 kernels and the setpoints,
+// which must agree within one DAC LSB (2.3 mV DC, 9.4 mV AC, see JanasCardQSource3.h)
+// over 0 .. calcMaxMz() of all three frequency ranges. Built against the library
+// with MSFQ_FIXED_POINT; calcRF() and calcDC() stay float there and are the reference.
+
+#include "MSFilterQuad.h"
+#include "MSFilterInterp.h"
+#include "msfq_test.h"
+#include <limits.h>
+#include <string.h>
+
+#define TEST_R0 6e-3
+#define TEST_MAX_CALIB_MZ 500.0
+#define TEST_STEPS 20000
+#define TEST_LSB_DC 2  // mV, 2.3 mV
+#define TEST_LSB_AC 9  // mV, 9.4 mV
+
+// frequency ranges of the emulator, Hz
+static const float _freqs[] = {1050000.0, 480000.0, 240000.0};
+
+static JanasCardQSource3 _device(NULL);
+static StateTuneParRecords _rf;
+static StateTuneParRecords _dc;
+static MSFQSetpoint _table[40000];
+
+// deterministic, the same tables on every run
+static uint32_t _seed = 1;
+
+static float rnd(void)
+{
+    _seed = _seed * 1664525UL + 1013904223UL;
+    return (float)(_seed >> 8) / 16777216.0f;
+}
+
+
+// the exact product in double, truncated and saturated like msfqFloatToFixed()
+static int32_t referenceFixed(float v, uint32_t mul, int shift)
+{
+    if (v != v) return 0;
+    double p = trunc((double)v * mul * ldexp(1.0, shift));
+    if (p >= 2147483647.0) return INT32_MAX;
+    if (p <= -2147483648.0) return INT32_MIN;
+    return (int32_t)p;
+}
+
+
+static void testFloatToFixed(void)
+{
+    const float values[] = {
+        0.0f, -0.0f, 1.0f, -1.0f, 0.5f, 1e-30f, -1e-30f, 1.17549435e-38f, 75.0f, -75.0f, 0.0015f,
+        325.0f, 1234.5678f, 32767.99f, 32768.0f, -32768.0f, 1e10f, -1e10f, INFINITY, -INFINITY
+    };
+    const uint32_t muls[] = {1, 1000, 2000};
+    const int shifts[] = {0, 16, 24};
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i)
+    {
+        for (size_t m = 0; m < 3; ++m)
+        {
+            for (size_t s = 0; s < 3; ++s)
+            {
+                CHECK_EQ(msfqFloatToFixed(values[i], muls[m], shifts[s]), referenceFixed(values[i], muls[m], shifts[s]));
+            }
+        }
+    }
+    CHECK_EQ(msfqFloatToFixed(NAN, 1, 16), 0);
+
+    // random bit patterns cover every exponent and both signs
+    long bad = 0;
+    for (long i = 0; i < 1000000; ++i)
+    {
+        uint32_t bits = (uint32_t)(rnd() * 65536.0f) << 16 | (uint32_t)(rnd() * 65536.0f);
+        float v;
+        memcpy(&v, &bits, sizeof(v));
+        uint32_t mul = muls[i % 3];
+        int shift = shifts[(i / 3) % 3];
+        if (msfqFloatToFixed(v, mul, shift) != referenceFixed(v, mul, shift)) ++bad;
+    }
+    CHECK_EQ(bad, 0);
+}
+
+
+// n points over 0 .. TEST_MAX_CALIB_MZ, corrections within +-amp
+static void fillCalib(StateTuneParRecords* records, size_t n, float amp)
+{
+    records->_numberTuneParRecs = n;
+    for (size_t i = 0; i < n; ++i)
+    {
+        records->_tuneParMZ[i] = TEST_MAX_CALIB_MZ * i / n + 3.0f * rnd();
+        records->_tuneParVal[i] = amp * (2.0f * rnd() - 1.0f);
+    }
+}
+
+
+// the Q24 kernels against the float ones, inside and outside the table
+static void testKernels(void)
+{
+    MSFQSpline spline;
+    MSFQCalibQ q;
+    fillCalib(&_rf, MAX_NUMBER_OF_TUNE_PAR_RECORDS, 0.2f);
+    msfqSplineInit(&_rf, &spline);
+    for (int k = 0; k < 3; ++k)
+    {
+        msfqCalibQInit(&_rf, &spline, (MSFQInterp)k, &q);
+        double maxErr = 0.0;
+        for (int i = 0; i <= TEST_STEPS; ++i)
+        {
+            float mz = -50.0f + 650.0f * i / TEST_STEPS;
+            float ref;
+            switch (k)
+            {
+            case MSFQ_INTERP_LINEAR: ref = msfqInterpLinear(&_rf, mz); break;
+            case MSFQ_INTERP_MONOTONE: ref = msfqInterpMonotone(&_rf, mz); break;
+            default: ref = msfqInterpSpline(&_rf, &spline, mz); break;
+            }
+            double err = fabs(msfqInterpQ(&q, msfqFloatToFixed(mz, 1, 16)) / (double)MSFQ_Q24_ONE - ref);
+            if (err > maxErr) maxErr = err;
+        }
+        printf("kernel %d: max error %.3g\n", k, maxErr);
+        CHECK(maxErr < 1e-5);
+    }
+
+    // tables with 0, 1 and 2 points
+    for (size_t n = 0; n < 3; ++n)
+    {
+        fillCalib(&_rf, n, 0.2f);
+        msfqSplineInit(&_rf, &spline);
+        msfqCalibQInit(&_rf, &spline, MSFQ_INTERP_SPLINE, &q);
+        float want = (n == 0) ? 0.0f : _rf._tuneParVal[0];
+        if (n == 2)
+        {
+            want += (_rf._tuneParVal[1] - _rf._tuneParVal[0]) / (_rf._tuneParMZ[1] - _rf._tuneParMZ[0]) * (100.0f - _rf._tuneParMZ[0]);
+        }
+        CHECK_NEAR(msfqInterpQ(&q, 100 << 16) / (double)MSFQ_Q24_ONE, want, 1e-5);
+    }
+}
+
+
+// DC1 of the DC difference u at zero offset
+static int32_t limitDC(int32_t u)
+{
+    return (u < Q_SOURCE3_MIN_DC) ? Q_SOURCE3_MIN_DC : (u > Q_SOURCE3_MAX_DC) ? Q_SOURCE3_MAX_DC : u;
+}
+
+
+// the setpoint of the float pipeline, as the float setMZ() writes it
+static void referenceSetpoint(MSFilterQuad* filter, float mz, int32_t* u, uint32_t* ac)
+{
+    float v = filter->calcRF(mz);
+    if (v < 0.0f) v = 0.0f;
+    else if (v > MAX_RF_AMP) v = MAX_RF_AMP;
+    *ac = (uint32_t)(v * 2000);
+    *u = filter->isDCOn() ? (int32_t)(filter->calcDC(mz) * 1000) : 0;
+    if (!filter->isRodPolarityPos()) *u = -*u;
+    *u = limitDC(*u);
+}
+
+
+// calcUVBatch() without table runs the integer pipeline of setMZ()
+static void testOneLsb(void)
+{
+    const size_t sizes[] = {0, 1, 2, 3, 8, MAX_NUMBER_OF_TUNE_PAR_RECORDS};
+    static float mz[TEST_STEPS + 3];
+    static int32_t dc1[TEST_STEPS + 3];
+    static int32_t dc2[TEST_STEPS + 3];
+    static uint32_t ac[TEST_STEPS + 3];
+    long compared = 0;
+    long maxDC = 0;
+    long maxAC = 0;
+
+    for (int range = 0; range < 3; ++range)
+    {
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+        {
+            fillCalib(&_rf, sizes[s], 0.3f);
+            fillCalib(&_dc, sizes[s], 0.05f);
+            for (int k = 0; k < 3; ++k)
+            {
+                MSFilterQuad filter(TEST_R0, &_device, &_rf, &_dc);
+                filter.setInterpolation((MSFQInterp)k);
+                filter.initRFFactor(_freqs[range]);
+                filter.setRodPolarityPos((k & 1) == 0);
+
+                // the whole range and beyond it, clamped
+                float maxMZ = filter.calcMaxMz();
+                size_t n = 0;
+                for (int i = 0; i <= TEST_STEPS; ++i) mz[n++] = maxMZ * i / TEST_STEPS;
+                mz[n++] = -1.0f;
+                mz[n++] = maxMZ * 1.5f;
+                filter.calcUVBatch(mz, n, dc1, dc2, ac);
+
+                for (size_t i = 0; i < n; ++i)
+                {
+                    float x = (mz[i] < 0.0f) ? 0.0f : (mz[i] > maxMZ) ? maxMZ : mz[i];
+                    int32_t refU;
+                    uint32_t refAC;
+                    referenceSetpoint(&filter, x, &refU, &refAC);
+                    long errDC = labs((long)dc1[i] - refU);
+                    long errAC = labs((long)ac[i] - (long)refAC);
+                    if (errDC > maxDC) maxDC = errDC;
+                    if (errAC > maxAC) maxAC = errAC;
+                    CHECK_EQ(dc1[i], -dc2[i]);
+                    ++compared;
+                }
+            }
+        }
+    }
+    printf("setpoints compared = %ld, max error DC %ld mV, AC %ld mV\n", compared, maxDC, maxAC);
+    CHECK(maxDC <= TEST_LSB_DC);
+    CHECK(maxAC <= TEST_LSB_AC);
+}
+
+
+// setMZ() and the integer setters write what calcUVBatch() calculates
+static void testSetters(void)
+{
+    fillCalib(&_rf, 8, 0.3f);
+    fillCalib(&_dc, 8, 0.05f);
+    MSFilterQuad filter(TEST_R0, &_device, &_rf, &_dc);
+    filter.initRFFactor(_freqs[1]);
+
+    float mz = filter.calcMaxMz() * 0.37f;
+    int32_t dc1, dc2;
+    uint32_t ac;
+    filter.calcUVBatch(&mz, 1, &dc1, &dc2, &ac);
+    CHECK(filter.setMZ(mz));
+    CHECK_NEAR(filter.getDC1(), dc1 / 1000.0, 1e-6);
+    CHECK_NEAR(filter.getDC2(), dc2 / 1000.0, 1e-6);
+    CHECK_NEAR(filter.getRFAmp(), ac / 2000.0, 1e-6);
+    CHECK_NEAR(filter.getMZ(), mz, 0.0);
+
+    // clamped m/z is stored clamped
+    CHECK(filter.setMZ(-5.0f));
+    CHECK_NEAR(filter.getMZ(), 0.0, 0.0);
+    CHECK(filter.setMZ(1e6f));
+    CHECK_NEAR(filter.getMZ(), filter.calcMaxMz(), 0.0);
+
+    CHECK(filter.setVoltagesMV(1000, -2000, 3000));
+    CHECK_NEAR(filter.getDC1(), 1.0, 1e-6);
+    CHECK_NEAR(filter.getDC2(), -2.0, 1e-6);
+    CHECK(filter.setVoltagesMV(Q_SOURCE3_MAX_DC + 1, Q_SOURCE3_MIN_DC - 1, Q_SOURCE3_MAX_AC + 1));
+    CHECK_NEAR(filter.getDC1(), Q_SOURCE3_MAX_DC / 1000.0, 1e-6);
+    CHECK_NEAR(filter.getDC2(), Q_SOURCE3_MIN_DC / 1000.0, 1e-6);
+    CHECK_NEAR(filter.getRFAmp(), Q_SOURCE3_MAX_AC / 2000.0, 1e-6);
+
+    // setUVmV() keeps the offset and applies the polarity
+    CHECK(filter.setVoltagesMV(500, 500, 0));
+    CHECK(filter.setUVmV(100, 2000));
+    CHECK_NEAR(filter.getDC1(), 0.6, 1e-6);
+    CHECK_NEAR(filter.getDC2(), 0.4, 1e-6);
+    filter.setRodPolarityPos(false);
+    CHECK(filter.setUVmV(100, 2000));
+    CHECK_NEAR(filter.getDC1(), 0.4, 1e-6);
+    CHECK_NEAR(filter.getDC2(), 0.6, 1e-6);
+
+    // the float setters truncate to mV like the float pipeline
+    CHECK(filter.setVoltages(1.0f, 1.2345f, -0.0019f));
+    CHECK_NEAR(filter.getDC1(), 1.234, 1e-6);
+    CHECK_NEAR(filter.getDC2(), -0.001, 1e-6);
+    CHECK_NEAR(filter.getRFAmp(), 1.0, 1e-6);
+}
+
+
+// the integer table lookup returns the compiled points on the grid
+static void testTable(void)
+{
+    fillCalib(&_rf, 8, 0.3f);
+    fillCalib(&_dc, 8, 0.05f);
+    MSFilterQuad filter(TEST_R0, &_device, &_rf, &_dc);
+    filter.initRFFactor(_freqs[2]);
+    filter.attachSetpointTable(_table, sizeof(_table) / sizeof(_table[0]));
+
+    const float step = 0.25f;
+    float maxMZ = filter.calcMaxMz();
+    size_t n = (size_t)(maxMZ / step);
+    long bad = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        float mz = i * step;
+        int32_t dc1, dc2;
+        uint32_t ac;
+        filter.calcUVBatch(&mz, 1, &dc1, &dc2, &ac);
+        _table[i].u = dc1;  // DC1 at zero offset, kept aside until the table is built
+        _table[i].ac = ac;
+    }
+    static MSFQSetpoint direct[40000];
+    memcpy(direct, _table, n * sizeof(MSFQSetpoint));
+
+    CHECK(filter.buildSetpointTable(step));
+    for (size_t i = 0; i < n; ++i)
+    {
+        MSFQSetpoint sp;
+        CHECK(filter.lookupSetpoint(i * step, &sp));
+        if ((limitDC(sp.u) != direct[i].u) || (sp.ac != direct[i].ac)) ++bad;
+    }
+    CHECK_EQ(bad, 0);
+}
+
+
+int main()
+{
+    _device.writeRSMode(0);
+    _device.setGuardTime(0);
+    _device.setSuppressUnchanged(false);
+
+    testFloatToFixed();
+    testKernels();
+    testOneLsb();
+    testSetters();
+    testTable();
+    return msfqTestResult("test_fixed_point");
+}
@@ -0,0 +1,98 @@
+// holdTelemetry() against blocking callers: a telemetry thread reads the
+// current as fast as it can while the main thread holds telemetry and sends
+// setpoints. The hold begins while a query is on the bus, most likely. No
+// telemetry query reaches the device after that one, the refused calls count
+// as dropped, the setpoints neither fail during the query nor wait for more
+// than about one query. The wait is reported by maxLockWait of
+// Q_SOURCE3_PRIO_REALTIME.
+
+#include "JanasCardQSource3Impl.h"
+#include "msfq_test.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#define TEST_LATENCY_US 2000
+#define TEST_SETPOINTS 200
+
+// QSource3MutexLock of a std::thread build, ticks are ms
+class ThreadLock {
+    std::timed_mutex _mutex;
+    std::mutex _critical;
+public:
+    bool init() { return true; }
+    bool take(uint32_t ticks) { return _mutex.try_lock_for(std::chrono::milliseconds(ticks)); }
+    void give() { _mutex.unlock(); }
+    void sleep(uint32_t) {}
+    void enterCritical() { _critical.lock(); }
+    void exitCritical() { _critical.unlock(); }
+
+    bool initQueue(size_t, size_t) { return false; }
+    bool send(size_t, void*) { return false; }
+    void* receive(uint32_t) { return NULL; }
+    void* self() { return NULL; }
+    void notify(void*) {}
+    void waitNotify(uint32_t) {}
+    uint32_t getTickCount() { return millis(); }
+};
+
+template class JanasCardQSource3T<QSource3LoopbackTransport, ThreadLock>;
+typedef JanasCardQSource3T<QSource3LoopbackTransport, ThreadLock> ThreadDevice;
+
+static QSource3Emulator _emu;
+static ThreadDevice _device(&_emu);
+static std::atomic<bool> _stop(false);
+static std::atomic<long> _reads(0);
+
+
+static void telemetry(void)
+{
+    while (!_stop.load())
+    {
+        if (_device.readCurrent() >= 0) ++_reads;
+        std::this_thread::yield();
+    }
+}
+
+
+int main()
+{
+    QSource3EmulatorConfig config = _emu.getConfig();
+    config.latencyUs = TEST_LATENCY_US;
+    _emu.setConfig(&config);
+    _device.init(1000);
+    CHECK(_device.writeRSMode(0));
+    _device.setGuardTime(0);
+    _device.setSuppressUnchanged(false);
+
+    std::thread t(telemetry);
+    while (_reads.load() < 10) std::this_thread::yield();
+    std::this_thread::sleep_for(std::chrono::microseconds(TEST_LATENCY_US / 2));  // most likely during a query
+
+    _device.resetQueueStats();
+    _device.holdTelemetry();
+    uint32_t unheld = _device.getQueueStats(Q_SOURCE3_PRIO_TELEMETRY).accesses;  // at most the query on the bus
+    for (int32_t i = 0; i < TEST_SETPOINTS; ++i)
+    {
+        CHECK(_device.writeVoltages(i, -i, 1000));
+    }
+    QSource3QueueStats rt = _device.getQueueStats(Q_SOURCE3_PRIO_REALTIME);
+    QSource3QueueStats tm = _device.getQueueStats(Q_SOURCE3_PRIO_TELEMETRY);
+    _device.releaseTelemetry();
+
+    long before = _reads.load();
+    while (_reads.load() < before + 10) std::this_thread::yield();  // telemetry runs again
+    _stop = true;
+    t.join();
+
+    printf("hold: %u setpoints, lock wait max %u us, mean %.1f us; telemetry %u dropped, %u sent while held\n",
+        rt.accesses, rt.maxLockWait, (double)rt.sumLockWait / rt.accesses, tm.dropped, tm.accesses);
+    CHECK(unheld <= 1);
+    CHECK_EQ(tm.accesses, unheld);
+    CHECK(tm.dropped > 0);
+    CHECK_EQ(rt.accesses, TEST_SETPOINTS);
+    CHECK(rt.maxLockWait < 5 * TEST_LATENCY_US);  // about one query, with room for the scheduler
+    CHECK_EQ(_emu.getDC1(), TEST_SETPOINTS - 1);
+    return msfqTestResult("test_hold");
+}
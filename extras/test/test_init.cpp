@@ -0,0 +1,75 @@
+// MSFilterQuad3::init() against QSource3Emulator: RS485 mode, the measured
+// guard time, the stored frequency of every range read into its RF factor and
+// a zero frame in every range, the device left in range 2. A device that does
+// not answer fails the initialisation.
+
+#include "MSFilterQuad.h"
+#include "msfq_test.h"
+
+#define TEST_R0 6e-3
+#define TEST_MZ 100.0f
+
+static QSource3Emulator _emu;
+static JanasCardQSource3 _device(&_emu);
+static StateTuneParRecords _rf[3];
+static StateTuneParRecords _dc[3];
+
+
+static void testInit(MSFilterQuad3* msfq)
+{
+    // voltages left on by a previous run
+    CHECK(_device.writeRSMode(0));
+    CHECK(_device.writeVoltages(1000, -1000, 2000));
+    _device.resetWriteStats();
+    _emu.resetStats();
+
+    CHECK(msfq->init());
+    CHECK(_emu.isRS485());
+    CHECK(_device.getGuardTime() < Q_SOURCE3_GUARD_TIME_US);
+    CHECK_EQ(_emu.getFreqRange(), 2);
+    CHECK_EQ(msfq->getActualFreqRangeIdx(), 2);
+
+    // the RF factors follow the stored frequencies, RF ~ f^2
+    float rf0 = msfq->getMSFilter(0)->calcRF(TEST_MZ);
+    for (int r = 0; r < 3; ++r)
+    {
+        float f = (float)_emu.getStoredFreq(r) / _emu.getStoredFreq(0);
+        CHECK_NEAR(msfq->getMSFilter(r)->calcRF(TEST_MZ) / rf0, f * f, 1e-4);
+        CHECK_EQ(msfq->getMSFilter(r)->getDC1(), 0);
+        CHECK_EQ(msfq->getMSFilter(r)->getDC2(), 0);
+        CHECK_EQ(msfq->getMSFilter(r)->getRFAmp(), 0);
+    }
+    CHECK_EQ(_emu.getDC1(), 0);
+    CHECK_EQ(_emu.getDC2(), 0);
+    CHECK_EQ(_emu.getAC(), 0);
+
+    // the zero frame first, then one per range after its burst
+    CHECK_EQ(_device.getWriteStats().frames, 1 + 3);
+    CHECK_EQ(_device.getWriteStats().framesSkipped, 0);
+    CHECK_EQ(_emu.getStats().rejected, 0);
+}
+
+
+static void testNoDevice(MSFilterQuad3* msfq)
+{
+    static const QSource3EmulatorConfig deaf = {0, 0, 0, 1, 0, 1};  // every byte lost
+    _emu.setConfig(&deaf);
+    CHECK(!msfq->init());
+    CHECK(!msfq->isConnected());
+    _emu.setConfig(NULL);
+}
+
+
+int main()
+{
+    MSFilterQuad3 msfq(TEST_R0, &_device, _rf, _dc);
+    for (int r = 0; r < 3; ++r)
+    {
+        _rf[r]._numberTuneParRecs = 0;
+        _dc[r]._numberTuneParRecs = 0;
+    }
+
+    testInit(&msfq);
+    testNoDevice(&msfq);
+    return msfqTestResult("test_init");
+}
@@ -0,0 +1,168 @@
+// The linear and monotone kernels of MSFilterInterp.h: exact values at the
+// points, the branch-free binary search against a linear scan on tables of
+// every size, no overshoot of the monotone kernel between points (where the
+// natural spline does overshoot) and linear extrapolation at both edges.
+
+#include "MSFilterQuad.h"
+#include "MSFilterInterp.h"
+#include "msfq_test.h"
+
+#define TEST_SWEEP 2000
+
+static StateTuneParRecords _table;
+static MSFQSpline _spline;
+
+// deterministic, the same tables on every run
+static uint32_t _seed = 1;
+
+static float rnd(void)
+{
+    _seed = _seed * 1664525UL + 1013904223UL;
+    return (float)(_seed >> 8) / 16777216.0f;
+}
+
+
+// n sorted points, uneven spacing, random values
+static void randomTable(size_t n)
+{
+    float x = 10.0f;
+    _table._numberTuneParRecs = n;
+    for (size_t k = 0; k < n; ++k)
+    {
+        _table._tuneParMZ[k] = x;
+        _table._tuneParVal[k] = 1.0f + 0.1f * (rnd() - 0.5f);
+        x += 1.0f + 50.0f * rnd();
+    }
+}
+
+
+// the reference: the segment by a linear scan, 0 or n - 2 outside the table
+static float referenceLinear(float mz)
+{
+    const float* x = _table._tuneParMZ;
+    const float* y = _table._tuneParVal;
+    size_t n = _table._numberTuneParRecs;
+    size_t k = 0;
+    while ((k + 2 < n) && (x[k + 1] <= mz)) ++k;
+    return y[k] + (y[k + 1] - y[k]) * (mz - x[k]) / (x[k + 1] - x[k]);
+}
+
+
+static void testLinear(void)
+{
+    // every table size, so the search halves odd and even lengths
+    for (size_t n = 2; n <= MAX_NUMBER_OF_TUNE_PAR_RECORDS; ++n)
+    {
+        randomTable(n);
+        const float* x = _table._tuneParMZ;
+        const float* y = _table._tuneParVal;
+        for (size_t k = 0; k < n; ++k)
+        {
+            CHECK(msfqInterpLinear(&_table, x[k]) == y[k]);
+        }
+        float lo = x[0];
+        float span = x[n - 1] - x[0];
+        int wrong = 0;
+        for (int i = 0; i < TEST_SWEEP; ++i)
+        {
+            float mz = lo + span * rnd();
+            if (msfqInterpLinear(&_table, mz) != referenceLinear(mz)) ++wrong;
+        }
+        CHECK_EQ(wrong, 0);
+
+        // the end segments go on as lines
+        float dl = x[1] - x[0];
+        float dr = x[n - 1] - x[n - 2];
+        CHECK_NEAR(msfqInterpLinear(&_table, x[0] - dl), 2 * y[0] - y[1], 1e-6);
+        CHECK_NEAR(msfqInterpLinear(&_table, x[n - 1] + dr), 2 * y[n - 1] - y[n - 2], 1e-6);
+        CHECK(msfqInterpLinear(&_table, -1e6f) == referenceLinear(-1e6f));
+        CHECK(msfqInterpLinear(&_table, 1e6f) == referenceLinear(1e6f));
+    }
+}
+
+
+// the largest step out of [y[k], y[k + 1]] over the segments, 0 without overshoot
+static float overshoot(float (*interp)(float))
+{
+    const float* x = _table._tuneParMZ;
+    const float* y = _table._tuneParVal;
+    size_t n = _table._numberTuneParRecs;
+    float worst = 0.0f;
+    for (size_t k = 0; k + 1 < n; ++k)
+    {
+        float lo = (y[k] < y[k + 1]) ? y[k] : y[k + 1];
+        float hi = (y[k] < y[k + 1]) ? y[k + 1] : y[k];
+        for (int i = 1; i < 100; ++i)
+        {
+            float v = interp(x[k] + (x[k + 1] - x[k]) * i / 100);
+            if (lo - v > worst) worst = lo - v;
+            if (v - hi > worst) worst = v - hi;
+        }
+    }
+    return worst;
+}
+
+static float monotone(float mz) { return msfqInterpMonotone(&_table, mz); }
+static float spline(float mz) { return msfqInterpSpline(&_table, &_spline, mz); }
+
+
+static void testMonotone(void)
+{
+    // a step, the spline rings around it
+    static const float mz[] = {10, 50, 100, 120, 140, 300, 500};
+    static const float val[] = {1.0f, 1.0f, 1.0f, 1.05f, 1.05f, 1.05f, 1.06f};
+    size_t steps = sizeof(mz) / sizeof(mz[0]);
+    _table._numberTuneParRecs = steps;
+    for (size_t k = 0; k < steps; ++k)
+    {
+        _table._tuneParMZ[k] = mz[k];
+        _table._tuneParVal[k] = val[k];
+    }
+    for (size_t k = 0; k < steps; ++k)
+    {
+        CHECK(msfqInterpMonotone(&_table, mz[k]) == val[k]);
+    }
+    msfqSplineInit(&_table, &_spline);
+    float o = overshoot(spline);
+    CHECK(o > 1e-3);
+    CHECK(overshoot(monotone) <= 1e-6);
+
+    // monotone runs stay monotone
+    float last = monotone(mz[0]);
+    int decreasing = 0;
+    for (int i = 1; i <= TEST_SWEEP; ++i)
+    {
+        float v = monotone(mz[0] + (mz[steps - 1] - mz[0]) * i / TEST_SWEEP);
+        if (v < last - 1e-6f) ++decreasing;
+        last = v;
+    }
+    CHECK_EQ(decreasing, 0);
+    printf("step: overshoot spline %.4f, monotone %.1g\n", o, overshoot(monotone));
+
+    // random tables: exact at the points, bounded by them between
+    for (size_t n = 2; n <= MAX_NUMBER_OF_TUNE_PAR_RECORDS; ++n)
+    {
+        randomTable(n);
+        const float* x = _table._tuneParMZ;
+        const float* y = _table._tuneParVal;
+        for (size_t k = 0; k < n; ++k)
+        {
+            CHECK_NEAR(msfqInterpMonotone(&_table, x[k]), y[k], 1e-6);
+        }
+        CHECK(overshoot(monotone) <= 1e-6);
+
+        // the edges go on by the secant of the end segment
+        float sl = (y[1] - y[0]) / (x[1] - x[0]);
+        float sr = (y[n - 1] - y[n - 2]) / (x[n - 1] - x[n - 2]);
+        CHECK_NEAR(msfqInterpMonotone(&_table, x[0] - 100.0f), y[0] - 100.0f * sl, 1e-5);
+        CHECK_NEAR(msfqInterpMonotone(&_table, x[n - 1] + 100.0f), y[n - 1] + 100.0f * sr, 1e-5);
+    }
+}
+
+
+int main()
+{
+    testLinear();
+    testMonotone();
+    return msfqTestResult("test_interp");
+}
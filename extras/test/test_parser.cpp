@@ -0,0 +1,183 @@
+// QSource3Parser against a reference parser of whole responses, fed with random
+// and typical responses cut into random pieces. Formerly checkParser() of
+// examples/test_speed, run on the board at every start.
+
+#include "QSource3Parser.h"
+#include "msfq_test.h"
+#include <string.h>
+#include <stdlib.h>
+
+// deterministic, the same responses on every run
+static uint32_t _seed = 1;
+
+static uint32_t rnd(uint32_t n)
+{
+    _seed = _seed * 1664525UL + 1013904223UL;
+    return (uint32_t)(((uint64_t)(_seed >> 8) * n) >> 24);
+}
+
+
+// a whole response without '\r', parsed the strict way: "OK" or a decimal
+// integer, leading ' ' and '\n' skipped, nothing after it
+static QSource3Reply referenceReply(const char* frame, QSource3Expect expect, int32_t* value)
+{
+    while ((*frame == ' ') || (*frame == '\n')) ++frame;
+    if (strcmp(frame, "OK") == 0)
+    {
+        return (expect == QSOURCE3_EXPECT_OK) ? QSOURCE3_REPLY_OK : QSOURCE3_REPLY_UNEXPECTED;
+    }
+    const char* digits = (*frame == '-') ? frame + 1 : frame;
+    if ((*digits == '\0') || (strspn(digits, "0123456789") != strlen(digits))) return QSOURCE3_REPLY_MALFORMED;
+    long long x = strtoll(digits, NULL, 10);
+    if (x > 2147483647LL) return QSOURCE3_REPLY_MALFORMED;  // strtoll() saturates
+    *value = (digits != frame) ? -(int32_t)x : (int32_t)x;
+    if (expect == QSOURCE3_EXPECT_OK) return QSOURCE3_REPLY_UNEXPECTED;
+    if ((expect == QSOURCE3_EXPECT_CURRENT) && (*value == QSOURCE3_CURRENT_OVERRANGE)) return QSOURCE3_REPLY_OVERRANGE;
+    return QSOURCE3_REPLY_VALUE;
+}
+
+
+// feeds the frame and its '\r' in random pieces
+static QSource3Reply parsePieces(QSource3Parser* parser, const char* frame, size_t len, size_t* consumed)
+{
+    QSource3Reply got = QSOURCE3_REPLY_PENDING;
+    size_t off = 0;
+    while ((got == QSOURCE3_REPLY_PENDING) && (off < len))
+    {
+        size_t used;
+        size_t piece = 1 + rnd(4);
+        got = parser->parse(frame + off, (piece < len - off) ? piece : len - off, &used);
+        off += used;
+    }
+    *consumed = off;
+    return got;
+}
+
+
+static void testFuzz(void)
+{
+    const char* typical[] = {
+        "OK", "9999", "-9999", " 12", "\n4800", "OKK", "O", "-", "", "2147483647", "2147483648",
+        "00042", "OK ", "12 ", "12x", "-0", "99999999999"
+    };
+    const char alphabet[] = "0123456789OK- \nx";
+    char frame[24];
+    QSource3Parser parser;
+    long n = 0;
+    long bad = 0;
+    for (long i = 0; i < 200000; ++i)
+    {
+        QSource3Expect expect = (QSource3Expect)rnd(3);
+        switch (rnd(3))
+        {
+        case 0:
+            snprintf(frame, sizeof(frame), "%ld", ((long)rnd(4000000000UL) - 2000000000L) >> rnd(31));
+            break;
+        case 1:
+            strcpy(frame, typical[rnd(sizeof(typical) / sizeof(typical[0]))]);
+            break;
+        default:
+            size_t len = rnd(14);
+            for (size_t j = 0; j < len; ++j) frame[j] = alphabet[rnd(sizeof(alphabet) - 1)];
+            frame[len] = '\0';
+        }
+        int32_t value = 0;
+        QSource3Reply want = referenceReply(frame, expect, &value);
+
+        size_t len = strlen(frame);
+        frame[len++] = '\r';
+        parser.begin(expect);
+        size_t consumed;
+        QSource3Reply got = parsePieces(&parser, frame, len, &consumed);
+        bool valueBad = ((want == QSOURCE3_REPLY_VALUE) || (want == QSOURCE3_REPLY_OVERRANGE)) && (parser.value() != value);
+        if ((got != want) || (consumed != len) || valueBad)
+        {
+            frame[len - 1] = '\0';
+            if (++bad <= 10) printf("\"%s\" expect %d: got %d, want %d\n", frame, expect, got, want);
+        }
+        ++n;
+    }
+    printf("parser: responses compared = %ld, mismatches = %ld\n", n, bad);
+    CHECK_EQ(bad, 0);
+}
+
+
+// a response is "OK" or an integer and nothing else; the former prefix check
+// of "OK" and strtol() accepted trailing characters
+static void testStrict(void)
+{
+    struct { const char* frame; QSource3Expect expect; QSource3Reply want; int32_t value; } cases[] = {
+        {"OK\r", QSOURCE3_EXPECT_OK, QSOURCE3_REPLY_OK, 0},
+        {" OK\r", QSOURCE3_EXPECT_OK, QSOURCE3_REPLY_OK, 0},
+        {"OK \r", QSOURCE3_EXPECT_OK, QSOURCE3_REPLY_MALFORMED, 0},
+        {"OKAY\r", QSOURCE3_EXPECT_OK, QSOURCE3_REPLY_MALFORMED, 0},
+        {"OK\r", QSOURCE3_EXPECT_VALUE, QSOURCE3_REPLY_UNEXPECTED, 0},
+        {"4800\r", QSOURCE3_EXPECT_OK, QSOURCE3_REPLY_UNEXPECTED, 4800},
+        {"4800\r", QSOURCE3_EXPECT_VALUE, QSOURCE3_REPLY_VALUE, 4800},
+        {"4800 \r", QSOURCE3_EXPECT_VALUE, QSOURCE3_REPLY_MALFORMED, 0},
+        {"4800kHz\r", QSOURCE3_EXPECT_VALUE, QSOURCE3_REPLY_MALFORMED, 0},
+        {"-12\r", QSOURCE3_EXPECT_VALUE, QSOURCE3_REPLY_VALUE, -12},
+        {"9999\r", QSOURCE3_EXPECT_VALUE, QSOURCE3_REPLY_VALUE, 9999},
+        {"9999\r", QSOURCE3_EXPECT_CURRENT, QSOURCE3_REPLY_OVERRANGE, 9999},
+        {"-9999\r", QSOURCE3_EXPECT_CURRENT, QSOURCE3_REPLY_VALUE, -9999},
+        {"2147483647\r", QSOURCE3_EXPECT_VALUE, QSOURCE3_REPLY_VALUE, 2147483647},
+        {"2147483648\r", QSOURCE3_EXPECT_VALUE, QSOURCE3_REPLY_MALFORMED, 0},
+        {"\r", QSOURCE3_EXPECT_OK, QSOURCE3_REPLY_MALFORMED, 0},
+        {"ERR\r", QSOURCE3_EXPECT_OK, QSOURCE3_REPLY_MALFORMED, 0},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+    {
+        QSource3Parser parser(cases[i].expect);
+        size_t consumed;
+        QSource3Reply got = parser.parse(cases[i].frame, strlen(cases[i].frame), &consumed);
+        CHECK_EQ(got, cases[i].want);
+        CHECK_EQ(consumed, strlen(cases[i].frame));
+        if ((got == QSOURCE3_REPLY_VALUE) || (got == QSOURCE3_REPLY_OVERRANGE))
+        {
+            CHECK_EQ(parser.value(), cases[i].value);
+        }
+    }
+}
+
+
+// back-to-back responses of a burst, the parser is ready again after each terminator
+static void testStream(void)
+{
+    const char stream[] = "OK\r4800\rOK x\r-7\r";
+    QSource3Parser parser(QSOURCE3_EXPECT_OK);
+    size_t off = 0;
+    size_t consumed;
+    CHECK_EQ(parser.parse(stream + off, sizeof(stream) - 1 - off, &consumed), QSOURCE3_REPLY_OK);
+    off += consumed;
+    parser.begin(QSOURCE3_EXPECT_VALUE);
+    CHECK_EQ(parser.parse(stream + off, sizeof(stream) - 1 - off, &consumed), QSOURCE3_REPLY_VALUE);
+    CHECK_EQ(parser.value(), 4800);
+    off += consumed;
+    parser.begin(QSOURCE3_EXPECT_OK);
+    CHECK_EQ(parser.parse(stream + off, sizeof(stream) - 1 - off, &consumed), QSOURCE3_REPLY_MALFORMED);
+    off += consumed;
+    parser.begin(QSOURCE3_EXPECT_VALUE);
+    CHECK_EQ(parser.parse(stream + off, sizeof(stream) - 1 - off, &consumed), QSOURCE3_REPLY_VALUE);
+    CHECK_EQ(parser.value(), -7);
+    off += consumed;
+    CHECK_EQ(off, sizeof(stream) - 1);
+    CHECK_EQ(parser.parse("12", 2, &consumed), QSOURCE3_REPLY_PENDING);
+    CHECK_EQ(consumed, 2);
+
+    QSource3ParseStats stats = {0, 0, 0, 0, 0, 0};
+    qsource3CountReply(&stats, QSOURCE3_REPLY_OK);
+    qsource3CountReply(&stats, QSOURCE3_REPLY_MALFORMED);
+    qsource3CountReply(&stats, QSOURCE3_REPLY_PENDING);
+    CHECK_EQ(stats.ok, 1);
+    CHECK_EQ(stats.malformed, 1);
+    CHECK_EQ(stats.values + stats.overrange + stats.none + stats.unexpected, 0);
+}
+
+
+int main()
+{
+    testFuzz();
+    testStrict();
+    testStream();
+    return msfqTestResult("test_parser");
+}
@@ -0,0 +1,262 @@
+// JanasCardQSource3::pipeline() on a scripted transport: responses matched in
+// order, the strict "OK" check of expectOK commands, sync after a bad response
+// and the cached DA converter codes forgotten by a pipeline. The same
+// responses through QSource3StreamTransport, whose Stream drops the terminator.
+// The callbacks run after the device is released and may use it.
+
+#include "JanasCardQSource3Impl.h"
+#include "msfq_test.h"
+#include <map>
+#include <string>
+
+// the script of the transport: responses of the commands, written bytes
+static std::map<std::string, std::string> _replies;
+static std::string _written;
+
+// answers every written command by its scripted response, none if unknown
+class ScriptTransport {
+    std::string _rx;
+    size_t _pos = 0;
+public:
+    typedef void StreamType;
+
+    ScriptTransport(void*) {}
+
+    bool availableForWrite() { return true; }
+
+    size_t write(const char* buff)
+    {
+        std::string cmd;
+        for (const char* p = buff; *p != '\0'; ++p)
+        {
+            if (*p != '\r')
+            {
+                cmd += *p;
+                continue;
+            }
+            std::map<std::string, std::string>::iterator r = _replies.find(cmd);
+            if (r != _replies.end()) _rx += r->second + "\r";
+            cmd.clear();
+        }
+        _written += buff;
+        return strlen(buff);
+    }
+
+    bool waitTxDone(uint32_t) { return true; }
+    void clear() { _rx.clear(); _pos = 0; }
+    bool waitResponse() { return true; }
+    void startResponse() {}
+    int readByte() { return (_pos < _rx.size()) ? _rx[_pos++] : -1; }
+
+    size_t readBytesUntil(char terminator, char* buffer, size_t length)
+    {
+        size_t n = 0;
+        while (n < length)
+        {
+            int ch = readByte();
+            if (ch < 0) break;
+            buffer[n++] = (char)ch;
+            if (ch == terminator) break;
+        }
+        return n;
+    }
+};
+
+// an Arduino Stream with the emulator on the other side of the line
+class EmulatorStream : public Stream {
+public:
+    QSource3Emulator emulator;
+
+    size_t write(uint8_t c) { emulator.receive((char)c, micros()); return 1; }
+    using Print::write;
+    int availableForWrite() { return 64; }
+    int available() { return emulator.isTransmitting() ? 1 : 0; }
+    int read() { return emulator.transmit(micros()); }
+    int peek() { return -1; }
+};
+
+template class JanasCardQSource3T<ScriptTransport, QSource3NoLock>;
+typedef JanasCardQSource3T<ScriptTransport, QSource3NoLock> ScriptDevice;
+template class JanasCardQSource3T<ScriptTransport, QSource3IrqLock>;
+typedef JanasCardQSource3T<ScriptTransport, QSource3IrqLock> IrqDevice;
+template class JanasCardQSource3T<QSource3StreamTransport, QSource3NoLock>;
+typedef JanasCardQSource3T<QSource3StreamTransport, QSource3NoLock> StreamDevice;
+
+static ScriptDevice _device(NULL);
+
+
+static void setCmd(QSource3Cmd* c, const char* cmd, bool expectOK)
+{
+    c->cmd = cmd;
+    c->expectOK = expectOK;
+    c->callback = NULL;
+    c->ctx = NULL;
+}
+
+
+static void testOrder(void)
+{
+    QSource3Cmd cmds[3];
+    setCmd(&cmds[0], "#Q", true);
+    setCmd(&cmds[1], "#G", false);
+    setCmd(&cmds[2], "#U", false);
+    CHECK(_device.pipeline(cmds, 3));
+    CHECK_EQ(cmds[0].state, Q_SOURCE3_CMD_DONE);
+    CHECK(strcmp(cmds[0].response, "OK") == 0);
+    CHECK(strcmp(cmds[1].response, "10500") == 0);
+    CHECK(strcmp(cmds[2].response, "42") == 0);
+}
+
+
+// a response that only starts with "OK" fails its command, the next ones keep their responses
+static void testStrictOK(void)
+{
+    const char* const bad[] = {"OK ", "OKx", "OK1"};
+    for (size_t b = 0; b < sizeof(bad) / sizeof(bad[0]); ++b)
+    {
+        _replies["#B1"] = bad[b];
+        _device.resetParseStats();
+        QSource3Cmd cmds[3];
+        setCmd(&cmds[0], "#B1", true);
+        setCmd(&cmds[1], "#G", false);
+        setCmd(&cmds[2], "#Q", true);
+        CHECK(!_device.pipeline(cmds, 3));
+        CHECK_EQ(cmds[0].state, Q_SOURCE3_CMD_ERROR);
+        CHECK_EQ(cmds[1].state, Q_SOURCE3_CMD_DONE);
+        CHECK(strcmp(cmds[1].response, "10500") == 0);
+        CHECK_EQ(cmds[2].state, Q_SOURCE3_CMD_DONE);
+        CHECK_EQ(_device.getParseStats().malformed, 1);
+        CHECK_EQ(_device.getParseStats().ok, 1);
+    }
+    _replies["#B1"] = "OK";
+}
+
+
+// a pipelined command may set the outputs, the next voltages are sent again
+static void testCodes(void)
+{
+    _device.resetWriteStats();
+    CHECK(_device.writeVoltages(1000, -1000, 2000));
+    CHECK(_device.writeVoltages(1000, -1000, 2000));
+    CHECK_EQ(_device.getWriteStats().frames, 1);
+    CHECK_EQ(_device.getWriteStats().framesSkipped, 1);
+
+    QSource3Cmd cmds[2];
+    setCmd(&cmds[0], "#DC1 0", true);
+    setCmd(&cmds[1], "#G", false);
+    CHECK(_device.pipeline(cmds, 2));
+
+    _written.clear();
+    CHECK(_device.writeVoltages(1000, -1000, 2000));
+    CHECK_EQ(_device.getWriteStats().frames, 2);
+    CHECK(_written == "#C 1000 -1000 2000\r");
+}
+
+
+// what the callbacks of testCallbacks() saw, in order
+static std::string _calls;
+
+// a query from inside the callback, the IRQ lock fails when it is still taken
+static void onCmd(QSource3Cmd* cmd, void* ctx)
+{
+    IrqDevice* device = (IrqDevice*)ctx;
+    _calls += std::string(cmd->cmd) + (device->readTest() ? " ok;" : " locked;");
+}
+
+
+// the state a callback found
+static void onState(QSource3Cmd* cmd, void*)
+{
+    char buff[32];
+    snprintf(buff, sizeof(buff), "%s %d;", cmd->cmd, (int)cmd->state);
+    _calls += buff;
+}
+
+
+static void testCallbacks(void)
+{
+    IrqDevice device(NULL);
+    CHECK(device.writeRSMode(0));
+    device.setGuardTime(0);
+    QSource3Cmd cmds[3];
+    setCmd(&cmds[0], "#G", false);
+    setCmd(&cmds[1], "#U", false);
+    for (int i = 0; i < 2; ++i)
+    {
+        cmds[i].callback = onCmd;
+        cmds[i].ctx = &device;
+    }
+    _calls.clear();
+    CHECK(device.pipeline(cmds, 2));
+    CHECK(_calls == "#G ok;#U ok;");
+
+    // the callbacks of the sent commands follow a timeout, not those of unsent ones
+    device.setPipelineDepth(2);
+    setCmd(&cmds[1], "#X", false);  // no response
+    setCmd(&cmds[2], "#U", false);
+    for (int i = 0; i < 3; ++i) cmds[i].callback = onState;
+    _calls.clear();
+    CHECK(!device.pipeline(cmds, 3));
+    CHECK_EQ(cmds[2].state, Q_SOURCE3_CMD_IDLE);
+    char expected[64];
+    snprintf(expected, sizeof(expected), "#G %d;#X %d;", (int)Q_SOURCE3_CMD_DONE, (int)Q_SOURCE3_CMD_TIMEOUT);
+    CHECK(_calls == expected);
+}
+
+
+// every transport returns the terminator, the responses are the same
+static void testStreamTransport(void)
+{
+    EmulatorStream stream;
+    stream.setTimeout(50);
+    QSource3StreamTransport transport(&stream);
+    char buff[16];
+    CHECK_EQ(transport.write("#Q\r"), 3);
+    CHECK_EQ(transport.readBytesUntil('\r', buff, sizeof(buff)), 3);
+    CHECK(memcmp(buff, "OK\r", 3) == 0);
+
+    StreamDevice device(&stream);
+    CHECK(device.writeRSMode(0));
+    device.setGuardTime(0);
+
+    char freq[16];
+    snprintf(freq, sizeof(freq), "%d", (int)stream.emulator.getFreq(0));
+    QSource3Cmd cmds[3];
+    setCmd(&cmds[0], "#Q", true);
+    setCmd(&cmds[1], "#G", false);
+    setCmd(&cmds[2], "#B 1", true);
+    CHECK(device.pipeline(cmds, 3));
+    CHECK_EQ(cmds[0].state, Q_SOURCE3_CMD_DONE);
+    CHECK(strcmp(cmds[0].response, "OK") == 0);
+    CHECK_EQ(cmds[1].state, Q_SOURCE3_CMD_DONE);
+    CHECK(strcmp(cmds[1].response, freq) == 0);
+    CHECK_EQ(cmds[2].state, Q_SOURCE3_CMD_DONE);
+    CHECK_EQ(stream.emulator.getFreqRange(), 1);
+    CHECK_EQ(device.getParseStats().ok, 3);  // #R0, #Q, #B 1
+
+    char serialNo[8];
+    CHECK(device.readSerialNo(serialNo, sizeof(serialNo)));
+    CHECK(strcmp(serialNo, "E01") == 0);
+    CHECK(_device.readSerialNo(serialNo, sizeof(serialNo)));
+    CHECK(strcmp(serialNo, "E01") == 0);
+}
+
+
+int main()
+{
+    _replies["#R0"] = "OK";
+    _replies["#Q"] = "OK";
+    _replies["#G"] = "10500";
+    _replies["#U"] = "42";
+    _replies["#DC1 0"] = "OK";
+    _replies["#N"] = "E01";
+    CHECK(_device.writeRSMode(0));
+    _device.setGuardTime(0);
+
+    testOrder();
+    testStrictOK();
+    testCodes();
+    testCallbacks();
+    testStreamTransport();
+    return msfqTestResult("test_pipeline");
+}
@@ -0,0 +1,84 @@
+// Every transport and lock policy of JanasCardQSource3T instantiated in one
+// build. The RTOS parts of the device live in the policies, so the class has
+// the same members with and without USE_RTOS; built with USE_RTOS the RTOS
+// stream and QSource3MutexLock are instantiated as well. The locks without
+// scheduler reject the asynchronous API, the IRQ lock fails a taken lock.
+
+#include "JanasCardQSource3Impl.h"
+#include "linux_stream.h"
+#include "msfq_test.h"
+
+typedef QSource3DeadlineTransport<Linux_Stream> LinuxTransport;
+
+template class JanasCardQSource3T<QSource3StreamTransport, QSource3NoLock>;
+template class JanasCardQSource3T<QSource3StreamTransport, QSource3IrqLock>;
+template class JanasCardQSource3T<LinuxTransport, QSource3NoLock>;
+template class JanasCardQSource3T<LinuxTransport, QSource3IrqLock>;
+template class JanasCardQSource3T<QSource3LoopbackTransport, QSource3NoLock>;
+template class JanasCardQSource3T<QSource3LoopbackTransport, QSource3IrqLock>;
+template class JanasCardQSource3T<QSource3NullTransport, QSource3NoLock>;
+template class JanasCardQSource3T<QSource3NullTransport, QSource3IrqLock>;
+
+#ifdef USE_RTOS
+typedef QSource3DeadlineTransport<RTOS_Stream> RTOSTransport;
+
+template class JanasCardQSource3T<RTOSTransport, QSource3NoLock>;
+template class JanasCardQSource3T<RTOSTransport, QSource3IrqLock>;
+template class JanasCardQSource3T<RTOSTransport, QSource3MutexLock>;
+template class JanasCardQSource3T<QSource3StreamTransport, QSource3MutexLock>;
+template class JanasCardQSource3T<LinuxTransport, QSource3MutexLock>;
+template class JanasCardQSource3T<QSource3LoopbackTransport, QSource3MutexLock>;
+template class JanasCardQSource3T<QSource3NullTransport, QSource3MutexLock>;
+#endif
+
+
+// the blocking API works, the asynchronous one is rejected without queues
+template <class Lock>
+static void testNoQueue(void)
+{
+    JanasCardQSource3T<QSource3NullTransport, Lock> device(NULL);
+    device.init(0);
+    CHECK(device.writeRSMode(0));
+    device.setGuardTime(0);
+    CHECK(device.writeVoltages(1000, -1000, 2000));
+
+    CHECK(!device.initAsync());
+    QSource3Request req;
+    req.callback = NULL;
+    req.ctx = NULL;
+    CHECK(!device.writeVoltagesAsync(&req, 1000, -1000, 2000));
+    CHECK_EQ(req.state, Q_SOURCE3_CMD_ERROR);
+    CHECK(!device.readCurrentAsync(&req));
+    CHECK_EQ(device.getQueueStats(Q_SOURCE3_PRIO_REALTIME).rejected, 1);
+    CHECK_EQ(device.getQueueStats(Q_SOURCE3_PRIO_TELEMETRY).rejected, 1);
+    CHECK(!device.wait(&req, 10));
+    CHECK(!device.workAsync(0));
+
+    device.holdTelemetry();
+    device.holdTelemetry();
+    device.releaseTelemetry();
+    CHECK(device.isTelemetryHeld());
+    device.releaseTelemetry();
+    CHECK(!device.isTelemetryHeld());
+}
+
+
+static void testIrqLock(void)
+{
+    QSource3IrqLock lock;
+    CHECK(lock.init());
+    CHECK(lock.take(0));
+    CHECK(!lock.take(0));  // not waited for
+    lock.give();
+    CHECK(lock.take(0));
+    lock.give();
+}
+
+
+int main()
+{
+    testNoQueue<QSource3NoLock>();
+    testNoQueue<QSource3IrqLock>();
+    testIrqLock();
+    return msfqTestResult("test_policies");
+}
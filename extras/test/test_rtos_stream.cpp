@@ -0,0 +1,153 @@
+// RTOS_Stream with the scheduler running, on the USARTClass of the host build
+// against a QSource3Emulator: a block whose completion interrupt is lost
+// still ends waitTxDone() once workTx() has given up on it, and the next
+// message completes normally. readBytesUntil() returns at its absolute
+// deadline while the bytes keep coming slowly, and two streams on Serial1 and
+// Serial2 keep their receive state apart.
+
+#include "JanasCardQSource3.h"
+#include "msfq_test.h"
+#include <string>
+
+#define TEST_TIMEOUT_MS 20
+#define TEST_DEADLINE_MS 30
+#define TEST_STACK_SIZE (configMINIMAL_STACK_SIZE * 4)
+
+// a response byte every 10 ms, the gaps are shorter than the stream timeout
+static const QSource3EmulatorConfig _slow = {1000, 0, 0, 0, 0, 1};
+
+static QSource3Emulator _emulator1;
+static QSource3Emulator _emulator2(&_slow);
+static RTOS_Stream _stream1(&Serial1, TEST_TIMEOUT_MS);
+static RTOS_Stream _stream2(&Serial2, TEST_TIMEOUT_MS);
+
+
+static void taskTx(void* pvParameters)
+{
+    RTOS_Stream* stream = static_cast<RTOS_Stream*>(pvParameters);
+    for (;;)
+    {
+        stream->workTx(portMAX_DELAY);
+    }
+}
+
+
+// sends the query and returns the response without terminator, "" on timeout
+static std::string query(RTOS_Stream* stream, const char* cmd)
+{
+    char buff[64];
+    if (stream->write(cmd) != strlen(cmd)) return "";
+    size_t n = stream->readBytesUntil('\r', buff, sizeof(buff));
+    if ((n == 0) || (buff[n - 1] != '\r')) return "";
+    return std::string(buff, n - 1);
+}
+
+
+static void testLostTxDone(void)
+{
+    Serial1.loseNextBlockDone();
+    TickType_t t0 = xTaskGetTickCount();
+    CHECK_EQ(_stream1.write("#Q\r"), 3);
+    CHECK(_stream1.waitTxDone(pdMS_TO_TICKS(5 * TEST_TIMEOUT_MS)));
+    TickType_t waited = xTaskGetTickCount() - t0;
+    CHECK(waited >= pdMS_TO_TICKS(TEST_TIMEOUT_MS));  // workTx() waited for the interrupt
+    CHECK(waited < pdMS_TO_TICKS(5 * TEST_TIMEOUT_MS));
+
+    char buff[16];
+    size_t n = _stream1.readBytesUntil('\r', buff, sizeof(buff));
+    CHECK_EQ(n, 3);
+    CHECK(memcmp(buff, "OK\r", 3) == 0);
+
+    // the next message completes with its interrupt
+    t0 = xTaskGetTickCount();
+    CHECK_EQ(_stream1.write("#Q\r"), 3);
+    CHECK(_stream1.waitTxDone(pdMS_TO_TICKS(5 * TEST_TIMEOUT_MS)));
+    CHECK(xTaskGetTickCount() - t0 < pdMS_TO_TICKS(TEST_TIMEOUT_MS));
+    n = _stream1.readBytesUntil('\r', buff, sizeof(buff));
+    CHECK_EQ(n, 3);
+    CHECK(query(&_stream1, "#G\r").size() > 0);
+    printf("rtos stream: lost completion ended after %u ticks\n", (unsigned)waited);
+}
+
+
+// the bytes do not extend the deadline, the rest of the response follows
+static void testSlowDeadline(void)
+{
+    std::string freq = std::to_string(_emulator2.getFreq(_emulator2.getFreqRange()));
+    char buff[32];
+    CHECK_EQ(_stream2.write("#G\r"), 3);
+    TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(TEST_DEADLINE_MS);
+    size_t n = _stream2.readBytesUntil('\r', buff, sizeof(buff), deadline);
+    TickType_t late = xTaskGetTickCount() - deadline;
+    CHECK(late <= pdMS_TO_TICKS(10));  // not before the deadline either
+    CHECK(n > 0);
+    CHECK(n < freq.size());
+    CHECK(buff[n - 1] != '\r');
+
+    size_t m = _stream2.readBytesUntil('\r', buff + n, sizeof(buff) - n,
+        xTaskGetTickCount() + pdMS_TO_TICKS(10 * TEST_DEADLINE_MS));
+    CHECK_EQ(n + m, freq.size() + 1);
+    CHECK(std::string(buff, n + m) == freq + "\r");
+
+    // a deadline already passed reads what is there without waiting
+    CHECK_EQ(_stream2.write("#G\r"), 3);
+    CHECK_EQ(_stream2.readBytesUntil('\r', buff, sizeof(buff), xTaskGetTickCount()), 0);
+    CHECK_EQ(_stream2.readBytesUntil('\r', buff, sizeof(buff), xTaskGetTickCount() + pdMS_TO_TICKS(200)), freq.size() + 1);
+    printf("rtos stream: %u of %u bytes by the deadline, %u ticks late\n",
+        (unsigned)n, (unsigned)(freq.size() + 1), (unsigned)late);
+}
+
+
+// the slow response of Serial2 arrives while Serial1 answers several queries
+static void testTwoStreams(void)
+{
+    _emulator1.setSerialNo("E01");
+    _emulator2.setSerialNo("E02");
+    CHECK_EQ(_stream2.write("#N\r"), 3);
+    for (int i = 0; i < 3; ++i)
+    {
+        CHECK(query(&_stream1, "#N\r") == "E01");
+    }
+    CHECK(_stream2.available() < 4);  // "E02\r" takes 40 ms
+    CHECK(query(&_stream1, "#G\r") == std::to_string(_emulator1.getFreq(_emulator1.getFreqRange())));
+
+    char buff[16];
+    size_t n = _stream2.readBytesUntil('\r', buff, sizeof(buff), xTaskGetTickCount() + pdMS_TO_TICKS(200));
+    CHECK_EQ(n, 4);
+    CHECK(memcmp(buff, "E02\r", 4) == 0);
+    CHECK_EQ(_stream1.available(), 0);
+    CHECK_EQ(_stream2.available(), 0);
+    CHECK_EQ(_stream1.getRxOverflows(), 0);
+    CHECK_EQ(_stream2.getRxOverflows(), 0);
+    CHECK_EQ(_emulator1.getStats().commands, 7);  // #Q, #Q, #G, 3 x #N, #G
+    CHECK_EQ(_emulator2.getStats().commands, 3);  // #G, #G, #N
+}
+
+
+static void taskTest(void* pvParameters)
+{
+    (void)pvParameters;
+    testLostTxDone();
+    testSlowDeadline();
+    testTwoStreams();
+    fflush(stdout);
+    exit(msfqTestResult("test_rtos_stream"));
+}
+
+
+int main()
+{
+    Serial1.begin(Q_SOURCE3_SERIAL_BAUD_RATE);
+    Serial2.begin(Q_SOURCE3_SERIAL_BAUD_RATE);
+    if (!Serial1.connect(&_emulator1) || !_stream1.init() ||
+        !Serial2.connect(&_emulator2) || !_stream2.init())
+    {
+        printf("init failed\n");
+        return 1;
+    }
+    xTaskCreate(taskTx, "tx1", TEST_STACK_SIZE, &_stream1, tskIDLE_PRIORITY + 3, NULL);
+    xTaskCreate(taskTx, "tx2", TEST_STACK_SIZE, &_stream2, tskIDLE_PRIORITY + 3, NULL);
+    xTaskCreate(taskTest, "test", TEST_STACK_SIZE, NULL, tskIDLE_PRIORITY + 1, NULL);
+    vTaskStartScheduler();
+    return 1;
+}
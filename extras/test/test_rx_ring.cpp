@@ -0,0 +1,161 @@
+// RxRing of RTOS_Stream on the host. The wake-up rule of pushNotify(): the
+// terminator, and once per armed level, also after a burst past it or with
+// the ring full. Then a producer thread in place of the USART interrupt
+// pushes responses while the consumer thread reads them like
+// RTOS_Stream::readBytesUntil(), sleeping on a semaphore between the
+// wake-ups: every byte arrives in order and no wake-up is lost.
+
+#include "rx_ring.h"
+#include "msfq_test.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define TEST_FRAMES 20000
+#define TEST_READ_LENGTH 16
+#define TEST_TIMEOUT_MS 1000
+
+// xSemaphoreGiveFromISR() and xSemaphoreTake() of a binary semaphore
+class BinarySemaphore {
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    bool _given = false;
+public:
+    void give()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _given = true;
+        _cv.notify_one();
+    }
+
+    bool take(uint32_t ms)
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (!_cv.wait_for(lock, std::chrono::milliseconds(ms), [this] { return _given; })) return false;
+        _given = false;
+        return true;
+    }
+};
+
+static RxRing _ring;
+static BinarySemaphore _event;
+static std::atomic<uint32_t> _wakeups(0);
+
+// the producer's findings
+static uint32_t _bytesSent = 0;
+
+
+static size_t countNotify(RxRing* ring, char ch, size_t n)
+{
+    size_t k = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (ring->pushNotify(ch, '\r')) ++k;
+    }
+    return k;
+}
+
+
+static void testRule(void)
+{
+    RxRing ring;
+    char buffer[RX_BUFFER_LENGTH];
+    bool found;
+
+    ring.arm(4);
+    CHECK_EQ(countNotify(&ring, 'x', 10), 1);  // a burst past the level wakes once
+    CHECK_EQ(countNotify(&ring, '\r', 2), 2);  // every terminator wakes
+    ring.arm(4);
+    CHECK_EQ(countNotify(&ring, 'x', 1), 1);  // re-armed below the stored bytes
+    CHECK_EQ(ring.read('\r', buffer, sizeof(buffer), &found), 11);
+    CHECK(found);
+
+    // a full ring wakes a reader whose level can not be reached
+    ring.clear();
+    ring.arm(RX_BUFFER_LENGTH + 1);
+    CHECK_EQ(countNotify(&ring, 'x', RX_BUFFER_LENGTH), 0);
+    CHECK_EQ(countNotify(&ring, 'x', 3), 1);
+    CHECK_EQ(ring.getOverflows(), 3);
+    CHECK_EQ(ring.available(), RX_BUFFER_LENGTH);
+}
+
+
+// the byte k of the stream, every 37th byte ends a response
+static char byteOf(uint32_t k)
+{
+    return (k % 37 == 36) ? '\r' : (char)('a' + k % 23);
+}
+
+
+static void producer(void)
+{
+    for (uint32_t k = 0; k < TEST_FRAMES * 37; ++k)
+    {
+        while (_ring.available() >= RX_BUFFER_LENGTH) std::this_thread::yield();  // no overflow here
+        if (_ring.pushNotify(byteOf(k), '\r')) _event.give();
+        if (k % 61 == 0) std::this_thread::yield();  // bursts of various lengths
+    }
+    _bytesSent = TEST_FRAMES * 37;
+}
+
+
+// RTOS_Stream::readBytesUntil() with the semaphore
+static size_t readBytesUntil(char terminator, char* buffer, size_t length, long* timeouts)
+{
+    size_t idx = 0;
+    for (;;)
+    {
+        bool found;
+        idx += _ring.read(terminator, buffer + idx, length - idx, &found);
+        if (found || (idx >= length)) break;
+
+        size_t missing = length - idx;
+        size_t level = missing < RX_NOTIFY_THRESHOLD ? missing : RX_NOTIFY_THRESHOLD;
+        _ring.arm(level);
+        if (_ring.available() >= level) continue;
+        if (!_event.take(TEST_TIMEOUT_MS))
+        {
+            ++*timeouts;
+            break;
+        }
+        ++_wakeups;
+    }
+    return idx;
+}
+
+
+static void testThreads(void)
+{
+    long timeouts = 0;
+    long mismatches = 0;
+    uint32_t k = 0;
+    char buffer[TEST_READ_LENGTH];
+
+    std::thread p(producer);
+    while ((k < TEST_FRAMES * 37) && (timeouts == 0))
+    {
+        size_t n = readBytesUntil('\r', buffer, sizeof(buffer), &timeouts);
+        for (size_t i = 0; i < n; ++i, ++k)
+        {
+            if (buffer[i] != byteOf(k)) ++mismatches;
+        }
+    }
+    p.join();
+
+    printf("rx ring: %u bytes, %u wake-ups, %u overflows\n", k, _wakeups.load(), _ring.getOverflows());
+    CHECK_EQ(timeouts, 0);
+    CHECK_EQ(mismatches, 0);
+    CHECK_EQ(k, _bytesSent);
+    CHECK_EQ(_ring.getOverflows(), 0);
+    CHECK_EQ(_ring.available(), 0);
+}
+
+
+int main()
+{
+    testRule();
+    testThreads();
+    return msfqTestResult("test_rx_ring");
+}
@@ -0,0 +1,190 @@
+// MSFilterScan on MSFQSimTimeSource: the schedule, the overrun policies, the
+// statistics of aborted runs and isPrepared() after changes of the filter.
+
+#include "MSFilterScan.h"
+#include "msfq_test.h"
+
+#define TEST_R0 6e-3
+#define TEST_STEPS 101
+#define TEST_DWELL 100
+
+static JanasCardQSource3 _device(NULL);
+static StateTuneParRecords _rf;
+static StateTuneParRecords _dc;
+static int32_t _dc1[TEST_STEPS];
+static int32_t _dc2[TEST_STEPS];
+static uint32_t _ac[TEST_STEPS];
+static uint32_t _achieved[TEST_STEPS];
+
+// a step taking longer than the dwell
+struct SlowStep {
+    MSFQSimTimeSource* time;
+    size_t step;
+    uint32_t us;
+};
+
+static void slowStep(size_t step, void* ctx)
+{
+    SlowStep* s = (SlowStep*)ctx;
+    if (step == s->step) s->time->advance(s->us);
+}
+
+// a time source that requests the stop while the scan waits for its first step
+class StoppingTimeSource : public MSFQSimTimeSource
+{
+public:
+    MSFilterScan* scan = NULL;
+    void waitUntil(uint32_t t)
+    {
+        scan->stop();
+        MSFQSimTimeSource::waitUntil(t);
+    }
+};
+
+
+static void initFilter(MSFilterQuad* filter)
+{
+    _rf._numberTuneParRecs = 0;
+    _dc._numberTuneParRecs = 0;
+    filter->initRFFactor(480000.0);
+}
+
+
+static void testSchedule(void)
+{
+    MSFilterQuad filter(TEST_R0, &_device, &_rf, &_dc);
+    initFilter(&filter);
+    MSFQSimTimeSource time(1000);
+    MSFilterScan scan(&filter, &time, _dc1, _dc2, _ac, TEST_STEPS);
+
+    CHECK(!scan.isPrepared());
+    CHECK(!scan.prepare(10.0, 5.0, 1.0, TEST_DWELL));
+    CHECK(!scan.prepare(0.0, 200.0, 1.0, TEST_DWELL));  // too many steps
+    CHECK(scan.prepare(0.0, 100.0, 1.0, TEST_DWELL));
+    CHECK_EQ(scan.getLength(), TEST_STEPS);
+    CHECK(scan.isPrepared());
+
+    CHECK(scan.run(_achieved));
+    const MSFQScanStats& s = scan.getStats();
+    CHECK_EQ(s.steps, TEST_STEPS);
+    CHECK_EQ(s.overruns, 0);
+    CHECK_EQ(s.minDwell, TEST_DWELL);
+    CHECK_EQ(s.maxDwell, TEST_DWELL);
+    CHECK_EQ(scan.getMeanDwell(), TEST_DWELL);
+    CHECK_EQ(_achieved[0], TEST_DWELL);
+    CHECK_EQ(_achieved[TEST_STEPS - 1], TEST_DWELL);
+    CHECK_EQ(time.now(), 1000 + TEST_STEPS * TEST_DWELL);
+
+    // the filter is left at the last step
+    CHECK_NEAR(filter.getMZ(), 100.0, 1e-4);
+    CHECK_NEAR(filter.getDC1(), _dc1[TEST_STEPS - 1] / 1000.0, 1e-6);
+    CHECK_NEAR(filter.getRFAmp(), _ac[TEST_STEPS - 1] / 2000.0, 1e-4);
+}
+
+
+static void testOverrun(void)
+{
+    MSFilterQuad filter(TEST_R0, &_device, &_rf, &_dc);
+    initFilter(&filter);
+    MSFQSimTimeSource time;
+    SlowStep slow = {&time, 5, 150};
+    MSFilterScan scan(&filter, &time, _dc1, _dc2, _ac, TEST_STEPS);
+    scan.setStepCallback(slowStep, &slow);
+    CHECK(scan.prepare(0.0, 100.0, 1.0, TEST_DWELL));
+
+    // the following step is shortened, the scan ends on time
+    scan.setOverrunPolicy(MSFQ_OVERRUN_CATCH_UP);
+    uint32_t t0 = time.now();
+    CHECK(scan.run(_achieved));
+    CHECK_EQ(scan.getStats().overruns, 1);
+    CHECK_EQ(scan.getStats().maxLateness, 50);
+    CHECK_EQ(_achieved[5], 150);
+    CHECK_EQ(_achieved[6], 50);
+    CHECK_EQ(_achieved[7], TEST_DWELL);
+    CHECK_EQ(time.now() - t0, TEST_STEPS * TEST_DWELL);
+
+    // the following steps keep full dwell, the scan ends late
+    scan.setOverrunPolicy(MSFQ_OVERRUN_RESYNC);
+    t0 = time.now();
+    CHECK(scan.run(_achieved));
+    CHECK_EQ(_achieved[5], 150);
+    CHECK_EQ(_achieved[6], TEST_DWELL);
+    CHECK_EQ(time.now() - t0, TEST_STEPS * TEST_DWELL + 50);
+
+    // stops after the late step, which is counted
+    scan.setOverrunPolicy(MSFQ_OVERRUN_ABORT);
+    CHECK(!scan.run(_achieved));
+    CHECK_EQ(scan.getStats().steps, 6);
+    CHECK_EQ(scan.getStats().minDwell, TEST_DWELL);
+    CHECK_EQ(scan.getStats().maxDwell, 150);
+
+    slow.step = 0;
+    CHECK(!scan.run());
+    CHECK_EQ(scan.getStats().steps, 1);
+    CHECK_EQ(scan.getStats().minDwell, 150);
+}
+
+
+// runs that write no step leave no sentinel in the statistics
+static void testEmptyRuns(void)
+{
+    MSFilterQuad filter(TEST_R0, &_device, &_rf, &_dc);
+    initFilter(&filter);
+    StoppingTimeSource time;
+    MSFilterScan scan(&filter, &time, _dc1, _dc2, _ac, TEST_STEPS);
+    time.scan = &scan;
+
+    CHECK(!scan.run());  // not prepared
+    CHECK_EQ(scan.getStats().steps, 0);
+    CHECK_EQ(scan.getStats().minDwell, 0);
+    CHECK_EQ(scan.getMeanDwell(), 0);
+
+    CHECK(scan.prepare(0.0, 100.0, 1.0, TEST_DWELL));
+    CHECK(!scan.run());  // stopped before the first step
+    CHECK_EQ(scan.getStats().steps, 0);
+    CHECK_EQ(scan.getStats().minDwell, 0);
+}
+
+
+// the setpoints hold the DC offset, polarity and calibration of prepare()
+static void testPrepared(void)
+{
+    MSFilterQuad filter(TEST_R0, &_device, &_rf, &_dc);
+    initFilter(&filter);
+    MSFQSimTimeSource time;
+    MSFilterScan scan(&filter, &time, _dc1, _dc2, _ac, TEST_STEPS);
+
+    CHECK(scan.prepare(0.0, 100.0, 1.0, TEST_DWELL));
+    CHECK(scan.run());
+    CHECK(scan.isPrepared());  // the run keeps the offset
+
+    CHECK(filter.setDCOffst(5.0));
+    CHECK(!scan.isPrepared());
+    CHECK(!scan.run());
+    CHECK(scan.prepare(0.0, 100.0, 1.0, TEST_DWELL));
+    CHECK(scan.isPrepared());
+    CHECK_EQ((_dc1[50] + _dc2[50]) / 2, 5000);
+    CHECK(scan.run());
+    CHECK_NEAR(filter.getDCOffst(), 5.0, 1e-6);
+
+    CHECK(filter.setRodPolarityPos(false));
+    CHECK(!scan.isPrepared());
+    CHECK(scan.prepare(0.0, 100.0, 1.0, TEST_DWELL));
+
+    CHECK(filter.insertCalibPnt(MSFQ_CALIB_RF, 50.0, 0.01));
+    CHECK(!scan.isPrepared());
+}
+
+
+int main()
+{
+    _device.writeRSMode(0);
+    _device.setGuardTime(0);
+    _device.setSuppressUnchanged(false);
+
+    testSchedule();
+    testOverrun();
+    testEmptyRuns();
+    testPrepared();
+    return msfqTestResult("test_scan");
+}
@@ -0,0 +1,218 @@
+// MSFilterSIM on QSource3Emulator with simulated time: one frame per ion and
+// #B only where the range changes, the recompile after changes of the
+// calibration and the DC offset, overrun and switch statistics and a stop
+// in the middle of a cycle. Every command at the device costs TEST_CMD_US.
+
+#include "MSFilterSIM.h"
+#include "msfq_test.h"
+
+#define TEST_R0 6e-3
+#define TEST_CMD_US 50
+#define TEST_DWELL 1000
+
+static QSource3Emulator _emu;
+static JanasCardQSource3 _device(&_emu);
+static StateTuneParRecords _rf[3];
+static StateTuneParRecords _dc[3];
+
+// ranges 0, 0, 1, 1, 0: #B before the third and the fifth ion, and again
+// before the first ion of the next cycle
+static MSFQSIMIon _ions[] = {
+    {28.0f, TEST_DWELL, 0},
+    {32.0f, TEST_DWELL, 0},
+    {44.0f, TEST_DWELL, 1},
+    {40.0f, TEST_DWELL, 1},
+    {18.0f, TEST_DWELL, 0},
+};
+#define TEST_IONS (sizeof(_ions) / sizeof(_ions[0]))
+#define TEST_RANGE_CHANGES 2
+
+// simulated time, the device commands advance it
+class DeviceTime : public MSFQSimTimeSource
+{
+public:
+    uint32_t now(void) { return MSFQSimTimeSource::now() + TEST_CMD_US * _emu.getStats().commands; }
+
+    void waitUntil(uint32_t t)
+    {
+        int32_t d = (int32_t)(t - now());
+        if (d > 0) advance(d);
+    }
+};
+
+// an ion taking longer than its dwell, or the stop at an ion
+struct IonAction {
+    MSFilterSIM* sim;
+    DeviceTime* time;
+    size_t ion;
+    uint32_t us;
+    bool stop;
+};
+
+static void ionAction(size_t ion, void* ctx)
+{
+    IonAction* a = (IonAction*)ctx;
+    if (ion != a->ion) return;
+    a->time->advance(a->us);
+    if (a->stop) a->sim->stop();
+}
+
+
+// commands executed by the device since the last call
+static uint32_t commands(void)
+{
+    static uint32_t last = 0;
+    uint32_t n = _emu.getStats().commands;
+    uint32_t d = n - last;
+    last = n;
+    return d;
+}
+
+
+static void testCycle(MSFilterQuad3* msfq)
+{
+    DeviceTime time;
+    MSFilterSIM sim(msfq, &_device, &time);
+    sim.setIons(_ions, TEST_IONS);
+    CHECK_EQ(sim.getStats().recompiles, 1);
+    CHECK(_ions[0].frameLen > 0);
+
+    commands();
+    uint32_t t0 = time.now();
+    CHECK(sim.runCycle());
+    CHECK_EQ(commands(), TEST_IONS + TEST_RANGE_CHANGES);
+    CHECK_EQ(_emu.getFreqRange(), 0);
+    CHECK_EQ(_emu.getDC1(), _ions[TEST_IONS - 1].dc1);
+    CHECK_EQ(_emu.getAC(), _ions[TEST_IONS - 1].ac);
+    CHECK_NEAR(msfq->getActualMSFilter()->getDC1(), _ions[TEST_IONS - 1].dc1 / 1000.0, 1e-6);
+
+    // the dwell of every ion includes its switch
+    const MSFQSIMStats& s = sim.getStats();
+    CHECK_EQ(s.cycles, 1);
+    CHECK_EQ(s.lastCycle, TEST_IONS * TEST_DWELL);
+    CHECK_EQ(time.now() - t0, TEST_IONS * TEST_DWELL);
+    CHECK_EQ(s.overruns, 0);
+    CHECK_EQ(s.maxSwitch, 2 * TEST_CMD_US);  // #B and #C
+
+    // the next cycle starts in range 0 as well, no #B
+    CHECK(sim.runCycle());
+    CHECK_EQ(commands(), TEST_IONS + TEST_RANGE_CHANGES);
+    CHECK_EQ(sim.getStats().cycles, 2);
+    CHECK_EQ(sim.getMeanCycle(), TEST_IONS * TEST_DWELL);
+    CHECK_EQ(sim.getStats().recompiles, 1);
+
+    // a range other than the first ion's costs a #B at the start
+    CHECK(msfq->setFreqRangeIdx(2));
+    commands();
+    CHECK(sim.runCycle());
+    CHECK_EQ(commands(), TEST_IONS + TEST_RANGE_CHANGES + 1);
+}
+
+
+static void testRecompile(MSFilterQuad3* msfq)
+{
+    DeviceTime time;
+    MSFilterSIM sim(msfq, &_device, &time);
+    sim.setIons(_ions, TEST_IONS);
+    CHECK(sim.runCycle());
+    CHECK(sim.runCycle());
+    CHECK_EQ(sim.getStats().recompiles, 1);
+
+    // the calibration of range 1
+    int32_t ac = _ions[2].ac;
+    CHECK(msfq->getMSFilter(1)->insertCalibPnt(MSFQ_CALIB_RF, 50.0, 0.05));
+    CHECK(sim.runCycle());
+    CHECK_EQ(sim.getStats().recompiles, 2);
+    CHECK(_ions[2].ac != ac);
+
+    // the DC offset of range 0, the ions of range 0 follow it
+    CHECK(msfq->getMSFilter(0)->setDCOffst(5.0f));
+    CHECK(sim.runCycle());
+    CHECK_EQ(sim.getStats().recompiles, 3);
+    CHECK_EQ((_ions[4].dc1 + _ions[4].dc2) / 2, 5000);
+    CHECK_EQ((_emu.getDC1() + _emu.getDC2()) / 2, 5000);
+    CHECK_EQ(msfq->getMSFilter(0)->getDCOffstMV(), 5000);
+
+    // a cycle keeps the offset, nothing to recompile
+    CHECK(sim.runCycle());
+    CHECK_EQ(sim.getStats().recompiles, 3);
+
+    CHECK(msfq->getMSFilter(0)->setDCOffst(0.0f));
+    CHECK(msfq->getMSFilter(1)->deleteCalibPnt(MSFQ_CALIB_RF, 0));
+}
+
+
+static void testOverrun(MSFilterQuad3* msfq)
+{
+    DeviceTime time;
+    MSFilterSIM sim(msfq, &_device, &time);
+    IonAction slow = {&sim, &time, 1, TEST_DWELL + 300, false};
+    sim.setIons(_ions, TEST_IONS);
+    sim.setIonCallback(ionAction, &slow);
+
+    // the late ion shifts the following ones, they keep their dwell
+    uint32_t t0 = time.now();
+    CHECK(sim.runCycle());
+    CHECK_EQ(sim.getStats().overruns, 1);
+    CHECK_EQ(time.now() - t0, TEST_IONS * TEST_DWELL + 300 + TEST_CMD_US);
+    CHECK_EQ(sim.getStats().maxCycle, TEST_IONS * TEST_DWELL + 300 + TEST_CMD_US);
+
+    slow.ion = TEST_IONS;
+    CHECK(sim.runCycle());
+    CHECK_EQ(sim.getStats().overruns, 1);
+    CHECK_EQ(sim.getStats().minCycle, TEST_IONS * TEST_DWELL);
+
+    sim.resetStats();
+    CHECK_EQ(sim.getStats().cycles, 0);
+    CHECK_EQ(sim.getStats().maxSwitch, 0);
+    CHECK_EQ(sim.getMeanCycle(), 0);
+}
+
+
+static void testStop(MSFilterQuad3* msfq)
+{
+    DeviceTime time;
+    MSFilterSIM sim(msfq, &_device, &time);
+    IonAction stop = {&sim, &time, 2, 0, true};
+    sim.setIons(_ions, TEST_IONS);
+    sim.setIonCallback(ionAction, &stop);
+
+    commands();
+    CHECK(!sim.runCycle());
+    CHECK_EQ(commands(), 3 + 1);  // ions 0 to 2, #B before ion 2
+    CHECK_EQ(_emu.getDC1(), _ions[2].dc1);
+    CHECK_EQ(_emu.getFreqRange(), 1);
+    CHECK_EQ(msfq->getActualFreqRangeIdx(), 1);
+    CHECK_EQ(sim.getStats().cycles, 0);
+
+    // the next cycle runs again
+    stop.ion = TEST_IONS;
+    CHECK(sim.runCycle());
+    CHECK_EQ(sim.getStats().cycles, 1);
+
+    // an empty list
+    sim.setIons(_ions, 0);
+    CHECK(!sim.runCycle());
+}
+
+
+int main()
+{
+    CHECK(_device.writeRSMode(0));
+    _device.setGuardTime(0);
+    _device.setSuppressUnchanged(false);
+    MSFilterQuad3 msfq(TEST_R0, &_device, _rf, _dc);
+    static const float freq[3] = {1050000.0, 480000.0, 240000.0};
+    for (int r = 0; r < 3; ++r)
+    {
+        _rf[r]._numberTuneParRecs = 0;
+        _dc[r]._numberTuneParRecs = 0;
+        msfq.getMSFilter(r)->initRFFactor(freq[r]);
+    }
+
+    testCycle(&msfq);
+    testRecompile(&msfq);
+    testOverrun(&msfq);
+    testStop(&msfq);
+    return msfqTestResult("test_sim");
+}
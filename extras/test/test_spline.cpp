@@ -0,0 +1,168 @@
+// msfqSplineInit() and msfqInterpSpline() against the natural cubic spline of
+// the former CubicSplineInterp library (spline() and splint() of Numerical
+// Recipes with natural end conditions), here in double as the reference.
+// Inside the table both agree within float rounding, at the points exactly,
+// whether m/z ascends (hunt) or comes in random order (binary search).
+// Outside the table the behaviour changed: CubicSplineInterp continued the
+// cubic of the end segment, msfqInterpSpline() continues linearly by the end
+// slope, which is printed against the old value.
+
+#include "MSFilterQuad.h"
+#include "MSFilterInterp.h"
+#include "msfq_test.h"
+
+#define TEST_SWEEP 4000
+#define TEST_TOL 2e-5  // the values are about 1
+
+static StateTuneParRecords _table;
+static MSFQSpline _spline;
+
+// deterministic, the same tables on every run
+static uint32_t _seed = 1;
+
+static float rnd(void)
+{
+    _seed = _seed * 1664525UL + 1013904223UL;
+    return (float)(_seed >> 8) / 16777216.0f;
+}
+
+
+// the reference: second derivatives of the natural spline, CubicSplineInterp::init()
+static void referenceInit(const StateTuneParRecords* t, double* y2)
+{
+    const float* x = t->_tuneParMZ;
+    const float* y = t->_tuneParVal;
+    size_t n = t->_numberTuneParRecs;
+    double u[MAX_NUMBER_OF_TUNE_PAR_RECORDS];
+
+    y2[0] = u[0] = 0.0;
+    for (size_t k = 1; k < n - 1; ++k)
+    {
+        double sig = ((double)x[k] - x[k - 1]) / ((double)x[k + 1] - x[k - 1]);
+        double p = sig * y2[k - 1] + 2.0;
+        y2[k] = (sig - 1.0) / p;
+        u[k] = ((double)y[k + 1] - y[k]) / ((double)x[k + 1] - x[k]) - ((double)y[k] - y[k - 1]) / ((double)x[k] - x[k - 1]);
+        u[k] = (6.0 * u[k] / ((double)x[k + 1] - x[k - 1]) - sig * u[k - 1]) / p;
+    }
+    y2[n - 1] = 0.0;
+    for (size_t k = n - 1; k-- > 0;) y2[k] = y2[k] * y2[k + 1] + u[k];
+}
+
+
+// the reference: the cubic of segment k, CubicSplineInterp::calcHunt(); outside
+// the table the cubic of the end segment goes on
+static double referenceEval(const StateTuneParRecords* t, const double* y2, double mz)
+{
+    const float* x = t->_tuneParMZ;
+    const float* y = t->_tuneParVal;
+    size_t n = t->_numberTuneParRecs;
+    size_t k = 0;
+    while ((k + 2 < n) && (x[k + 1] <= mz)) ++k;
+    double h = (double)x[k + 1] - x[k];
+    double a = (x[k + 1] - mz) / h;
+    double b = 1.0 - a;
+    return a * y[k] + b * y[k + 1] + ((a * a * a - a) * y2[k] + (b * b * b - b) * y2[k + 1]) * (h * h) / 6.0;
+}
+
+
+// the end slopes of the reference
+static double referenceSlope(const StateTuneParRecords* t, const double* y2, bool right)
+{
+    const float* x = t->_tuneParMZ;
+    const float* y = t->_tuneParVal;
+    size_t n = t->_numberTuneParRecs;
+    if (!right)
+    {
+        double h = (double)x[1] - x[0];
+        return ((double)y[1] - y[0]) / h - h * (2.0 * y2[0] + y2[1]) / 6.0;
+    }
+    double h = (double)x[n - 1] - x[n - 2];
+    return ((double)y[n - 1] - y[n - 2]) / h + h * (y2[n - 2] + 2.0 * y2[n - 1]) / 6.0;
+}
+
+
+static void checkTable(const char* name)
+{
+    const float* x = _table._tuneParMZ;
+    const float* y = _table._tuneParVal;
+    size_t n = _table._numberTuneParRecs;
+    double y2[MAX_NUMBER_OF_TUNE_PAR_RECORDS];
+    referenceInit(&_table, y2);
+    msfqSplineInit(&_table, &_spline);
+
+    for (size_t k = 0; k < n; ++k)
+    {
+        CHECK_NEAR(_spline.y2[k], y2[k], 1e-4 * (fabs(y2[k]) + 1e-3));
+        CHECK_NEAR(msfqInterpSpline(&_table, &_spline, x[k]), y[k], 1e-6);
+    }
+
+    // ascending, the hunt walks the segments
+    double maxErr = 0.0;
+    float lo = x[0];
+    float span = x[n - 1] - x[0];
+    for (int i = 0; i <= TEST_SWEEP; ++i)
+    {
+        float mz = lo + span * i / TEST_SWEEP;
+        double err = fabs(msfqInterpSpline(&_table, &_spline, mz) - referenceEval(&_table, y2, mz));
+        if (err > maxErr) maxErr = err;
+    }
+    CHECK(maxErr <= TEST_TOL);
+
+    // random order, binary search
+    for (int i = 0; i < TEST_SWEEP; ++i)
+    {
+        float mz = lo + span * rnd();
+        CHECK_NEAR(msfqInterpSpline(&_table, &_spline, mz), referenceEval(&_table, y2, mz), TEST_TOL);
+    }
+
+    // outside: a line by the end slope of the spline, no longer the end cubic
+    float hl = x[1] - x[0];
+    float hr = x[n - 1] - x[n - 2];
+    double sl = referenceSlope(&_table, y2, false);
+    double sr = referenceSlope(&_table, y2, true);
+    for (int i = 1; i <= 4; ++i)
+    {
+        float dl = hl * i / 2;
+        float dr = hr * i / 2;
+        CHECK_NEAR(msfqInterpSpline(&_table, &_spline, x[0] - dl), y[0] - sl * dl, TEST_TOL * i);
+        CHECK_NEAR(msfqInterpSpline(&_table, &_spline, x[n - 1] + dr), y[n - 1] + sr * dr, TEST_TOL * i);
+    }
+    // just past the ends both still agree, the cubic term is third order
+    CHECK_NEAR(msfqInterpSpline(&_table, &_spline, x[n - 1] + hr * 1e-3f), referenceEval(&_table, y2, x[n - 1] + hr * 1e-3f), TEST_TOL);
+
+    float far = x[n - 1] + hr;
+    printf("%-8s n %2zu  max error %.2g  at m/z %.0f: %.6f, CubicSplineInterp %.6f\n",
+        name, n, maxErr, far, msfqInterpSpline(&_table, &_spline, far), referenceEval(&_table, y2, far));
+}
+
+
+int main()
+{
+    // an RF correction table with uneven spacing
+    static const float mz[] = {10, 28, 69, 131, 219, 350, 502, 614, 1000};
+    static const float val[] = {1.02f, 1.015f, 1.0f, 0.996f, 0.993f, 0.995f, 1.001f, 1.004f, 1.01f};
+    _table._numberTuneParRecs = sizeof(mz) / sizeof(mz[0]);
+    for (size_t k = 0; k < _table._numberTuneParRecs; ++k)
+    {
+        _table._tuneParMZ[k] = mz[k];
+        _table._tuneParVal[k] = val[k];
+    }
+    checkTable("rf");
+
+    // the smallest table of a spline
+    _table._numberTuneParRecs = 3;
+    _table._tuneParMZ[2] = 1000;
+    _table._tuneParVal[2] = 0.99f;
+    checkTable("3");
+
+    // a full table, smooth with noise
+    _table._numberTuneParRecs = MAX_NUMBER_OF_TUNE_PAR_RECORDS;
+    for (size_t k = 0; k < MAX_NUMBER_OF_TUNE_PAR_RECORDS; ++k)
+    {
+        _table._tuneParMZ[k] = 10.0f + 30.0f * k + 20.0f * rnd();
+        _table._tuneParVal[k] = 1.0f + 0.01f * sinf(_table._tuneParMZ[k] / 50.0f) + 0.001f * rnd();
+    }
+    checkTable("full");
+
+    return msfqTestResult("test_spline");
+}
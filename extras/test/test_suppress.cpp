@@ -0,0 +1,96 @@
+// JanasCardQSource3::writeVoltages() skipping frames that do not change the DA
+// converter codes: the counters, a skip returns at once, the next sent frame
+// still waits for the transmit and guard time of the skipped one, and nothing
+// is written or skipped while the device is not connected. Every other command
+// that sets the outputs makes the next frame go out, writeFrame() counts it.
+
+#include "JanasCardQSource3.h"
+#include "msfq_test.h"
+
+#define TEST_GUARD_US 5000
+
+static JanasCardQSource3 _device(NULL);
+
+
+static void testNotConnected(void)
+{
+    CHECK(!_device.isConnected());
+    CHECK(!_device.writeVoltages(1000, -1000, 2000));
+    CHECK(!_device.writeVoltages(1000, -1000, 2000));
+    CHECK_EQ(_device.getWriteStats().frames, 0);
+    CHECK_EQ(_device.getWriteStats().framesSkipped, 0);
+}
+
+
+static void testSkip(void)
+{
+    CHECK(_device.writeRSMode(0));
+    _device.setGuardTime(TEST_GUARD_US);
+    _device.resetWriteStats();
+
+    CHECK(_device.writeVoltages(1000, -1000, 2000));
+    uint32_t t0 = micros();
+    CHECK_EQ(_device.getWriteStats().frames, 1);
+
+    // 1 mV is below one DC code, it waits neither for the guard time of the
+    // previous frame nor for its own transmit time
+    CHECK(_device.writeVoltages(1001, -1000, 2000));
+    uint32_t skip = micros() - t0;
+    CHECK(skip < TEST_GUARD_US / 2);
+    CHECK_EQ(_device.getWriteStats().frames, 1);
+    CHECK_EQ(_device.getWriteStats().framesSkipped, 1);
+    CHECK_EQ(_device.getWriteStats().bytesSkipped, 19);  // "#C 1001 -1000 2000\r"
+
+    // the next frame leaves after both guard times and the skipped frame
+    CHECK(_device.writeVoltages(2000, -1000, 2000));
+    uint32_t sent = micros() - t0;
+    CHECK(sent >= 2 * TEST_GUARD_US);
+    CHECK_EQ(_device.getWriteStats().frames, 2);
+
+    // suppression off sends every frame
+    _device.setGuardTime(0);
+    _device.setSuppressUnchanged(false);
+    CHECK(_device.writeVoltages(2000, -1000, 2000));
+    CHECK_EQ(_device.getWriteStats().frames, 3);
+    // switching it on forgets the codes, the first frame is sent
+    _device.setSuppressUnchanged(true);
+    CHECK(_device.writeVoltages(2000, -1000, 2000));
+    CHECK(_device.writeVoltages(2000, -1000, 2000));
+    CHECK_EQ(_device.getWriteStats().frames, 4);
+    CHECK_EQ(_device.getWriteStats().framesSkipped, 2);
+    printf("suppress: skip %u us, next frame after %u us\n", skip, sent);
+}
+
+
+// the codes are invalidated under the lock by the command itself
+static void testInvalidate(void)
+{
+    static const char frame[] = "#C 2000 -1000 2000\r";
+    _device.resetWriteStats();
+    CHECK(_device.writeVoltages(2000, -1000, 2000));
+    CHECK_EQ(_device.getWriteStats().framesSkipped, 1);
+
+    CHECK(_device.writeDC(1, 0));
+    CHECK(_device.writeVoltages(2000, -1000, 2000));
+    CHECK(_device.writeAC(0));
+    CHECK(_device.writeVoltages(2000, -1000, 2000));
+    CHECK(_device.writeFreqRange(1));
+    CHECK(_device.writeVoltages(2000, -1000, 2000));
+    CHECK(_device.writeFrame(frame, sizeof(frame) - 1));
+    CHECK(_device.writeVoltages(2000, -1000, 2000));
+    _device.forceNextWrite();
+    CHECK(_device.writeVoltages(2000, -1000, 2000));
+    CHECK(_device.writeVoltages(2000, -1000, 2000));
+    CHECK_EQ(_device.getWriteStats().frames, 6);
+    CHECK_EQ(_device.getWriteStats().bytes, 6 * (sizeof(frame) - 1));
+    CHECK_EQ(_device.getWriteStats().framesSkipped, 2);
+}
+
+
+int main()
+{
+    testNotConnected();
+    testSkip();
+    testInvalidate();
+    return msfqTestResult("test_suppress");
+}
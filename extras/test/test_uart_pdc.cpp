@@ -0,0 +1,203 @@
+// UARTClass of the modified DUE core (Arduino core modification/) on the
+// register mock of extras/host/sam/chip.h: the real IrqHandler() runs the PDC
+// block through ENDTX and TXEMPTY. The block leaves as one transfer, done()
+// is called after the last stop bit, a byte written during the block follows
+// it without touching THR, the interrupt mask is restored afterwards and a
+// character received meanwhile reaches the callback. The interrupts and
+// register accesses of a block and of a buffered frame are printed.
+
+#include "UARTClass.h"
+#include "msfq_test.h"
+
+#define TEST_MAX_TICKS 1000
+#define TEST_RX_MASK (UART_IMR_RXRDY | UART_IER_OVRE | UART_IER_FRAME)
+
+static Uart _uart;
+static RingBuffer _rxBuffer;
+static RingBuffer _txBuffer;
+static UARTClass _serial(&_uart, UART_IRQn, ID_UART, &_rxBuffer, &_txBuffer);
+
+static const char _frame[] = "#C 1000 -1000 2000\r";
+#define TEST_FRAME_LEN (sizeof(_frame) - 1)
+
+static uint32_t _irqs = 0;
+static uint32_t _storms = 0;      // handler calls that left the interrupt pending
+static int _txEmptyArmedAt = -1;  // characters sent when TXEMPTY was enabled
+
+// what done() found
+static uint32_t _done = 0;
+static size_t _doneLine = 0;
+static uint32_t _doneStatus = 0;
+
+static uint8_t _rxCh = 0;
+static void* _rxCtx = NULL;
+
+
+static void onDone(void* ctx)
+{
+    ++*(uint32_t*)ctx;
+    _doneLine = _uart.line.size();
+    _doneStatus = _uart.status();
+}
+
+
+static void onRx(uint8_t ch, void* ctx)
+{
+    _rxCh = ch;
+    _rxCtx = ctx;
+}
+
+
+// the level interrupt, called until nothing unmasked is pending
+static void service(void)
+{
+    for (int n = 0; _uart.irq(); ++n)
+    {
+        if (n == 4)
+        {
+            ++_storms;
+            return;
+        }
+        _serial.IrqHandler();
+        ++_irqs;
+        if ((_txEmptyArmedAt < 0) && (_uart.imr & UART_IMR_TXEMPTY)) _txEmptyArmedAt = (int)_uart.line.size();
+    }
+}
+
+
+static bool busy(void)
+{
+    return _serial.isBlockBusy() || !_uart.idle() || (_txBuffer._iHead != _txBuffer._iTail);
+}
+
+
+// clocks the transmitter until everything is sent
+static void run(void)
+{
+    service();
+    for (int i = 0; (i < TEST_MAX_TICKS) && busy(); ++i)
+    {
+        _uart.tick();
+        service();
+    }
+    CHECK(!busy());
+}
+
+
+static void reset(void)
+{
+    _uart.line.clear();
+    _irqs = 0;
+    _done = 0;
+    _txEmptyArmedAt = -1;
+    _uart.accesses = 0;
+}
+
+
+static void testBlock(void)
+{
+    reset();
+    CHECK(_serial.writeBlock((const uint8_t*)_frame, TEST_FRAME_LEN, onDone, &_done));
+    CHECK(_serial.isBlockBusy());
+    CHECK_EQ(_uart.tcr, TEST_FRAME_LEN - 1);  // the first character is in THR already
+    CHECK_EQ(_uart.tpr, (uint32_t)(uintptr_t)_frame + 1);
+    CHECK(!_serial.writeBlock((const uint8_t*)_frame, TEST_FRAME_LEN, onDone, &_done));  // one block at a time
+
+    run();
+    CHECK(_uart.line == _frame);
+    CHECK_EQ(_done, 1);
+    CHECK(!_uart.pdcEnabled);
+    CHECK_EQ(_uart.imr, TEST_RX_MASK);
+    CHECK_EQ(_uart.thrOverruns, 0);
+    CHECK_EQ(_storms, 0);
+    CHECK(_irqs <= 3);  // ENDTX, TXEMPTY
+    printf("uart pdc: block of %u bytes, %u interrupts, %u register accesses\n",
+        (unsigned)TEST_FRAME_LEN, _irqs, _uart.accesses);
+}
+
+
+static void testCompletion(void)
+{
+    reset();
+    CHECK(_serial.writeBlock((const uint8_t*)_frame, TEST_FRAME_LEN, onDone, &_done));
+    run();
+    // ENDTX armed TXEMPTY with characters in THR and the shift register,
+    // done() came with both of them empty
+    CHECK(_txEmptyArmedAt >= 0);
+    CHECK(_txEmptyArmedAt < (int)TEST_FRAME_LEN);
+    CHECK_EQ(_doneLine, TEST_FRAME_LEN);
+    CHECK(_doneStatus & UART_SR_TXEMPTY);
+    CHECK_EQ(_done, 1);
+}
+
+
+static void testByteDuringBlock(void)
+{
+    reset();
+    CHECK(_serial.writeBlock((const uint8_t*)_frame, TEST_FRAME_LEN, onDone, &_done));
+    _uart.tick();
+    _uart.tick();
+    service();
+    CHECK_EQ(_serial.write('x'), 1);
+    CHECK_EQ(_uart.thrOverruns, 0);  // buffered, the PDC owns THR
+    CHECK(_uart.imr & UART_IMR_TXRDY);
+
+    // a character arrives meanwhile
+    _uart.tick();
+    _uart.receive('K');
+    service();
+    CHECK_EQ(_rxCh, 'K');
+    CHECK(_rxCtx == (void*)&_rxCh);
+    CHECK_EQ(_serial.read(), 'K');
+
+    run();
+    CHECK(_uart.line == std::string(_frame) + "x");
+    CHECK_EQ(_done, 1);
+    CHECK_EQ(_doneLine, TEST_FRAME_LEN);  // done() before the buffered byte
+    CHECK_EQ(_uart.thrOverruns, 0);
+    CHECK_EQ(_storms, 0);
+    CHECK_EQ(_uart.imr, TEST_RX_MASK);  // TXRDY restored for the byte, then masked again
+    CHECK(!(_uart.imr & (UART_IMR_ENDTX | UART_IMR_TXEMPTY)));
+
+    // the buffered byte delays the next block until it has left
+    reset();
+    CHECK_EQ(_serial.write('y'), 1);  // straight to THR
+    CHECK_EQ(_serial.write('z'), 1);  // buffered
+    CHECK(!_serial.writeBlock((const uint8_t*)_frame, TEST_FRAME_LEN, onDone, &_done));
+    run();
+    CHECK(_uart.line == "yz");
+    CHECK(_serial.writeBlock((const uint8_t*)_frame, TEST_FRAME_LEN, onDone, &_done));
+    run();
+    CHECK(_uart.line == std::string("yz") + _frame);
+    CHECK_EQ(_uart.imr, TEST_RX_MASK);
+}
+
+
+// the same frame through the ring buffer, an interrupt per character
+static void testBuffered(void)
+{
+    reset();
+    CHECK_EQ(_serial.write((const uint8_t*)_frame, TEST_FRAME_LEN), TEST_FRAME_LEN);
+    run();
+    CHECK(_uart.line == _frame);
+    CHECK(_irqs >= TEST_FRAME_LEN - 1);
+    CHECK_EQ(_uart.imr, TEST_RX_MASK);
+    printf("uart pdc: buffered %u bytes, %u interrupts, %u register accesses\n",
+        (unsigned)TEST_FRAME_LEN, _irqs, _uart.accesses);
+}
+
+
+int main()
+{
+    _uart.setAddressSpace(_frame);
+    _serial.begin(1500000);
+    _serial.setRxIrqCallback(onRx, &_rxCh);
+    CHECK_EQ(_uart.imr, TEST_RX_MASK);
+    CHECK(_uart.txEnabled);
+
+    testBlock();
+    testCompletion();
+    testByteDuringBlock();
+    testBuffered();
+    return msfqTestResult("test_uart_pdc");
+}
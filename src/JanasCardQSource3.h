@@ -10,32 +10,195 @@
 #define JanasCardQSource3_H_
 
 #include <Arduino.h>
+#include "QSource3Parser.h"
 
+// FreeRTOS is available, the device is used by several tasks; comment out
+// or define Q_SOURCE3_BARE for a bare-metal sketch
+#if !defined(USE_RTOS) && !defined(Q_SOURCE3_BARE)
 #define USE_RTOS
+#endif
+
+// a PC with a USB-RS485 adapter instead of the DUE, the FreeRTOS POSIX port
+// provides the kernel; with Q_SOURCE3_BARE a single thread drives the device
+// without kernel; defined by the host build
+// #define USE_LINUX_STREAM
+
+// JanasCardQSource3 talks to a QSource3Emulator in memory, see QSource3LoopbackTransport
+// #define Q_SOURCE3_LOOPBACK
+
+// JanasCardQSource3 without device, see QSource3NullTransport
+// #define Q_SOURCE3_NULL
 
-#ifdef USE_RTOS
+#include "QSource3Transport.h"
+#include "QSource3Lock.h"
+
+#if defined(USE_LINUX_STREAM)
+#include "linux_stream.h"
+typedef Linux_Stream QSource3Stream;
+#elif defined(USE_RTOS)
 #include "rtos_stream.h"
-#include <FreeRTOS.h>
-#include <semphr.h>
+typedef RTOS_Stream QSource3Stream;
 #endif
 
-// #define TEST_Q_SOURCE3
+// policies of JanasCardQSource3, other combinations are instantiated by
+// including JanasCardQSource3Impl.h, e.g. in a host benchmark
+#if defined(Q_SOURCE3_LOOPBACK)
+typedef QSource3LoopbackTransport QSource3DefaultTransport;
+typedef QSource3NoLock QSource3DefaultLock;
+#elif defined(Q_SOURCE3_NULL)
+typedef QSource3NullTransport QSource3DefaultTransport;
+typedef QSource3NoLock QSource3DefaultLock;
+#elif defined(USE_RTOS)
+typedef QSource3DeadlineTransport<QSource3Stream> QSource3DefaultTransport;
+typedef QSource3MutexLock QSource3DefaultLock;
+#elif defined(USE_LINUX_STREAM)
+typedef QSource3DeadlineTransport<QSource3Stream> QSource3DefaultTransport;
+typedef QSource3NoLock QSource3DefaultLock;
+#else
+typedef QSource3StreamTransport QSource3DefaultTransport;
+typedef QSource3IrqLock QSource3DefaultLock;
+#endif
 
-#define QSOURCE3_DWELL_TIME (pdMS_TO_TICKS(5))
+// Time the device needs to process a command without response, measured
+// by JanasCardQSource3::measureGuardTime(); this default is used until then.
+#define Q_SOURCE3_GUARD_TIME_US 5000
+#define Q_SOURCE3_GUARD_MEASUREMENTS 8
 
 #define Q_SOURCE3_QUERY_BUFFER_SIZE 128
+#define Q_SOURCE3_RESPONSE_SIZE 16
+
+// commands sent back-to-back by JanasCardQSource3::pipeline() in RS422 mode
+#define Q_SOURCE3_PIPELINE_DEPTH 4
+// requests waiting for the device-owner task, see JanasCardQSource3::initAsync()
+#define Q_SOURCE3_ASYNC_QUEUE_LENGTH 8
 #define Q_SOURCE3_MIN_STACK_SIZE (Q_SOURCE3_QUERY_BUFFER_SIZE + 128)
 
 #define Q_SOURCE3_SERIAL_BAUD_RATE 1500000
 
+// "#C -75000 -75000 650000\r" and terminal zero
+#define Q_SOURCE3_FRAME_SIZE 32
+
 #define Q_SOURCE3_MAX_DC 75000
 #define Q_SOURCE3_MIN_DC -75000
 #define Q_SOURCE3_MAX_AC 650000
 #define Q_SOURCE3_MAX_FREQ 28000
 #define Q_SOURCE3_MIN_FREQ 2000
 
+#if !defined(USE_LINUX_STREAM) && !defined(Q_SOURCE3_LOOPBACK) && !defined(Q_SOURCE3_NULL)
+// Serial2 (USART1)
 void initCommJanasCardQSource3(uint32_t interrupt_priority);
 
+/// <summary>
+/// Configures a serial port for QSource3: 1.5 Mbaud, RS485 with RTS driving the transceiver.
+/// Every port can serve its own supply, e.g. a pre-filter on Serial1 and an analyser on Serial2.
+/// </summary>
+/// <param name="serial"> - Serial1 or Serial2</param>
+/// <param name="usart"> - USART0 for Serial1 (RTS0 on pin 2), USART1 for Serial2 (RTS1 on pin 23)</param>
+void initCommJanasCardQSource3(USARTClass* serial, Usart* usart, uint32_t interrupt_priority);
+#endif
+
+enum QSource3CmdState {
+    Q_SOURCE3_CMD_IDLE,     // not sent
+    Q_SOURCE3_CMD_DONE,     // response received
+    Q_SOURCE3_CMD_ERROR,    // write error or response other than "OK" to expectOK command
+    Q_SOURCE3_CMD_TIMEOUT,  // no response
+    Q_SOURCE3_CMD_PENDING,  // queued for the device-owner task, see QSource3Request
+    Q_SOURCE3_CMD_DROPPED   // telemetry not sent while held, see JanasCardQSource3::holdTelemetry()
+};
+
+/// <summary>
+/// A command of <see cref="JanasCardQSource3::pipeline()"/>, holds its result as well.
+/// The first four members are set by the caller, e.g. {"#G", false}; the
+/// constructor initialises every member.
+/// </summary>
+struct QSource3Cmd {
+    const char* cmd;  // command without '\r', e.g. "#G"
+    bool expectOK;    // the command is answered by "OK"
+    void (*callback)(QSource3Cmd* cmd, void* ctx);  // called by pipeline() after the burst, without the lock, may be NULL
+    void* ctx;
+
+    QSource3CmdState state;
+    char response[Q_SOURCE3_RESPONSE_SIZE];  // without '\r'
+
+    QSource3Cmd(const char* c = NULL, bool ok = false, void (*clbk)(QSource3Cmd* cmd, void* ctx) = NULL, void* context = NULL)
+    :cmd(c), expectOK(ok), callback(clbk), ctx(context), state(Q_SOURCE3_CMD_IDLE)
+    {
+        response[0] = '\0';
+    }
+};
+
+enum QSource3Op {
+    Q_SOURCE3_OP_VOLTAGES,      // writeVoltages(arg[0], arg[1], arg[2])
+    Q_SOURCE3_OP_DC,            // writeDC(arg[0], arg[1])
+    Q_SOURCE3_OP_AC,            // writeAC(arg[0])
+    Q_SOURCE3_OP_FREQ_RANGE,    // writeFreqRange(arg[0])
+    Q_SOURCE3_OP_FREQ,          // writeFreq(arg[0])
+    Q_SOURCE3_OP_STORE_FREQ,    // storeFreq()
+    Q_SOURCE3_OP_READ_FREQ,     // value = readFreq()
+    Q_SOURCE3_OP_READ_CURRENT,  // value = readCurrent()
+    Q_SOURCE3_OP_TEST,          // readTest()
+    Q_SOURCE3_OP_SERIAL_NO      // readSerialNo(response)
+};
+
+// Priority classes of asynchronous requests, the device-owner task always
+// executes the oldest request of the highest non-empty class.
+enum QSource3Priority {
+    Q_SOURCE3_PRIO_REALTIME,   // voltage setpoints
+    Q_SOURCE3_PRIO_CONTROL,    // frequency, range, test and serial number
+    Q_SOURCE3_PRIO_TELEMETRY,  // frequency and current readout, dropped while held
+    Q_SOURCE3_PRIO_COUNT
+};
+
+static_assert(Q_SOURCE3_PRIO_COUNT <= Q_SOURCE3_QUEUE_CLASSES, "a queue of the lock for every priority class");
+
+/// <summary>
+/// Statistics of one priority class. Blocking calls count in the class
+/// of their command, e.g. writeVoltages() in Q_SOURCE3_PRIO_REALTIME.
+/// </summary>
+struct QSource3QueueStats {
+    uint32_t requests;     // executed requests
+    uint32_t dropped;      // telemetry requests and blocking calls dropped while held
+    uint32_t rejected;     // requests not queued, the queue was full
+    uint32_t maxDelay;     // us from submit to start of execution
+    uint64_t sumDelay;     // us, of executed and dropped requests
+    uint32_t accesses;     // times the device was taken, by blocking calls and executed requests
+    uint32_t maxLockWait;  // us an access waited for the device, e.g. behind a query of another task
+    uint64_t sumLockWait;  // us, of all accesses
+};
+
+/// <summary>
+/// Asynchronous command, the handle returned by the ...Async() methods of
+/// <see cref="JanasCardQSource3"/>. Caller-provided, it must be kept until completed.
+/// The callback members are set by the caller, the rest by the ...Async() method
+/// and by the device-owner task.
+/// </summary>
+struct QSource3Request {
+    void (*callback)(QSource3Request* req, void* ctx);  // called by the device-owner task on completion, may be NULL
+    void* ctx;
+
+    QSource3Op op;
+    QSource3Priority priority;
+    int32_t arg[3];
+    void* owner;          // submitting task, notified on completion, see QSource3Lock.h
+
+    volatile QSource3CmdState state;  // Q_SOURCE3_CMD_DONE or Q_SOURCE3_CMD_ERROR when completed
+    int32_t value;        // result of reads, -1 on error
+    char response[Q_SOURCE3_RESPONSE_SIZE];  // serial number
+    uint32_t queuedTS;    // micros() when submitted
+    uint32_t startTS;     // micros() when taken by the device-owner task
+    uint32_t doneTS;      // micros() when completed
+};
+
+/// <summary>
+/// Statistics of voltage frames, see <see cref="JanasCardQSource3::writeVoltages()"/>.
+/// </summary>
+struct QSource3WriteStats {
+    uint32_t frames;         // frames sent
+    uint32_t bytes;          // bytes of sent frames
+    uint32_t framesSkipped;  // frames not sent because the DA converter codes did not change
+    uint32_t bytesSkipped;   // bytes of skipped frames
+};
+
 /// <summary>
 /// A low-level class for communication with QSsource3 (JanasCard).
 ///
@@ -46,37 +209,64 @@ void initCommJanasCardQSource3(uint32_t interrupt_priority);
 /// 3, 4  A, B  transmitter RS422
 /// 5  ground  unnecessary if control equipment is also galvanically connected to ground.
 /// </summary>
-class JanasCardQSource3 {
+template <class Transport, class Lock>
+class JanasCardQSource3T {
     private:
-#ifdef USE_RTOS
-        RTOS_Stream* _comm; // e.g. Serial2
-        SemaphoreHandle_t _xMutex = NULL;
-        TickType_t _xTicksToWait;
-#else
-        Stream* _comm;
-        volatile bool _comm_busy = false;
-#endif
+        Transport _transport;  // e.g. Serial2
+        Lock _lock;
+        uint32_t _ticksToWait = 0;  // for the lock and the end of transmission
+        volatile uint32_t _telemetryHold = 0;
+        QSource3QueueStats _queueStats[Q_SOURCE3_PRIO_COUNT];
         bool _connected = false;
+        bool _rs485 = false;
+        size_t _pipelineDepth = Q_SOURCE3_PIPELINE_DEPTH;
         unsigned long _lastWriteTS = 0;
 
+        uint32_t _guardTime = Q_SOURCE3_GUARD_TIME_US;  // us
+        uint32_t _txDoneTS = 0;      // micros() when the last command left the USART
+        bool _guardPending = false;  // the last command has no response
+        uint32_t _responseTime = 0;  // us from the end of the last query to its response
+
         int32_t _lastCurrent = -1;
 
+        // DA converter codes of the last voltage frame
+        bool _suppressUnchanged = true;
+        bool _codesValid = false;      // written under the lock only
+        volatile bool _forceWrite = false;  // invalidates the codes at the next writeVoltages()
+        uint32_t _codeDC1;
+        uint32_t _codeDC2;
+        uint32_t _codeAC;
+        QSource3WriteStats _writeStats = {0, 0, 0, 0};
+        QSource3ParseStats _parseStats = {0, 0, 0, 0, 0, 0};
+
         size_t __write(const char* buff);
-        size_t _write(const char* buff);
+        void _waitReady(void);
+        bool _take(QSource3Priority cls, bool outputs = false);
+        bool _beginQuery(const char* query, QSource3Priority cls, bool outputs = false);
+        void _endQuery(bool responded);
         bool _query(const char* query, char* buffer, size_t buff_len);
-        bool _queryOK(const char* query);
-        void _clearBuffer(void);
+        QSource3Reply _queryReply(const char* query, QSource3Expect expect, int32_t* value,
+            QSource3Priority cls = Q_SOURCE3_PRIO_CONTROL, bool outputs = false);
+        bool _queryOK(const char* query, QSource3Priority cls = Q_SOURCE3_PRIO_CONTROL, bool outputs = false);
+        QSource3Reply _parseResponse(QSource3Parser* parser);
+        size_t _pipelineWindow(QSource3Cmd* cmds, size_t n);
+        bool _submit(QSource3Request* req, QSource3Op op, int32_t arg0 = 0, int32_t arg1 = 0, int32_t arg2 = 0);
+        bool _execute(QSource3Request* req);
 
     public:
+        typedef typename Transport::StreamType StreamType;
+
         /// <summary>
         /// Constructor.
         /// </summary>
-#ifdef USE_RTOS
-        JanasCardQSource3(RTOS_Stream* comm);
-        void init(const TickType_t xTicksToWait);
-#else
-        JanasCardQSource3(Stream* comm);
-#endif
+        /// <param name="comm"> - e.g. Serial2, an RTOS_Stream or a QSource3Emulator, see QSource3Transport.h</param>
+        JanasCardQSource3T(StreamType* comm);
+
+        /// <summary>
+        /// Creates the lock, call before the first command when the lock needs it (QSource3MutexLock).
+        /// </summary>
+        /// <param name="xTicksToWait"> - for the lock and the end of transmission</param>
+        void init(uint32_t xTicksToWait);
 
         bool isConnected() const {return _connected;}
 
@@ -84,6 +274,52 @@ class JanasCardQSource3 {
 
         int32_t lastCurrent() const {return _lastCurrent;}
 
+        /// <summary>
+        /// Sets the time the device needs to process a command without response.
+        /// A write returns as soon as the command has left the USART, the next
+        /// command is delayed until the guard time has elapsed.
+        /// </summary>
+        /// <param name="us"> - guard time in us</param>
+        void setGuardTime(uint32_t us) {_guardTime = us;}
+
+        uint32_t getGuardTime() const {return _guardTime;}
+
+        /// <summary>
+        /// Measures the guard time as the longest response time of n test queries (#Q)
+        /// and sets it, see <see cref="setGuardTime()"/>.
+        /// </summary>
+        /// <param name="n"> - number of queries</param>
+        /// <returns>true if succeeded, otherwise the guard time is kept</returns>
+        bool measureGuardTime(size_t n = Q_SOURCE3_GUARD_MEASUREMENTS);
+
+        /// <summary>
+        /// Executes commands with response in a burst. Up to the pipeline depth
+        /// commands are sent back-to-back, their responses are matched in order.
+        /// Every command is completed by its state. After a timeout the
+        /// responses of the rest of the burst are discarded, so later commands stay
+        /// in sync, and the remaining commands are not sent (Q_SOURCE3_CMD_IDLE).
+        /// The callbacks of the sent commands are called in order once the device
+        /// is released, so they may call the device themselves.
+        ///
+        /// In RS485 mode the device would answer while the next command is being sent,
+        /// so the depth is 1 there; the burst still saves the per-query overhead.
+        ///
+        /// "OK" of an expectOK command is checked as strictly as by the other methods.
+        /// The commands may set the outputs, so the next <see cref="writeVoltages()"/>
+        /// is always sent.
+        /// </summary>
+        /// <param name="cmds"> - commands, kept until return</param>
+        /// <param name="n"> - number of commands</param>
+        /// <returns>true if all commands are Q_SOURCE3_CMD_DONE</returns>
+        bool pipeline(QSource3Cmd* cmds, size_t n);
+
+        /// <summary>
+        /// Sets the number of commands sent back-to-back in RS422 mode.
+        /// </summary>
+        void setPipelineDepth(size_t n) {_pipelineDepth = n > 0 ? n : 1;}
+
+        size_t getPipelineDepth() const {return _rs485 ? 1 : _pipelineDepth;}
+
         /// <summary>
         /// Communication test.
         /// </summary>
@@ -94,7 +330,7 @@ class JanasCardQSource3 {
         /// <summary>
         /// Reads serial number of QSource3, returns three character string.
         /// </summary>
-        /// <param name="buffer"> - three character string</param>
+        /// <param name="buffer"> - three character string, without '\r' on every transport</param>
         /// <returns>true if succeeded</returns>
         bool readSerialNo(char* buffer, size_t buff_len);
 
@@ -130,7 +366,12 @@ class JanasCardQSource3 {
         bool writeAC(uint32_t value);
 
         /// <summary>
-        /// Set both DC voltages and AC voltage together
+        /// Set both DC voltages and AC voltage together.
+        ///
+        /// A frame that would not change any DA converter code of the last frame
+        /// (2.3 mV DC, 9.4 mV AC) is not sent, see <see cref="setSuppressUnchanged()"/>.
+        /// The call returns at once, but the next command waits for the transmit and
+        /// guard time of the skipped frame, so the timing at the device does not change.
         /// </summary>
         /// <param name="dc1"> - output 1 DC voltage</param>
         /// <param name="dc2"> - output 2 DC voltage</param>
@@ -138,6 +379,48 @@ class JanasCardQSource3 {
         /// <returns>true if succeeded</returns>
         bool writeVoltages(int32_t dc1, int32_t dc2, uint32_t ac);
 
+        /// <summary>
+        /// Formats the command of <see cref="writeVoltages()"/> including the terminating '\r'.
+        /// Values are limited to the device range.
+        /// </summary>
+        /// <param name="buffer"> - output, at least Q_SOURCE3_FRAME_SIZE characters</param>
+        /// <returns>length of the command without the terminal zero</returns>
+        static size_t formatVoltages(char* buffer, size_t buff_len, int32_t dc1, int32_t dc2, uint32_t ac);
+
+        /// <summary>
+        /// Writes a command prepared in advance, e.g. by <see cref="formatVoltages()"/>.
+        /// Like <see cref="writeVoltages()"/> it does not wait for a response.
+        /// </summary>
+        /// <param name="frame"> - zero terminated command including '\r'</param>
+        /// <param name="len"> - length of the command</param>
+        /// <returns>true if succeeded</returns>
+        bool writeFrame(const char* frame, size_t len);
+
+        /// <summary>
+        /// Enables skipping of voltage frames which do not change the output (default).
+        /// </summary>
+        void setSuppressUnchanged(bool v) { _suppressUnchanged = v; _forceWrite = true; }
+
+        bool isSuppressUnchanged(void) const { return _suppressUnchanged; }
+
+        /// <summary>
+        /// Forces the next <see cref="writeVoltages()"/> to be sent,
+        /// e.g. after the device was reset.
+        /// </summary>
+        void forceNextWrite(void) { _forceWrite = true; }
+
+        const QSource3WriteStats& getWriteStats(void) const { return _writeStats; }
+
+        void resetWriteStats(void) { memset(&_writeStats, 0, sizeof(_writeStats)); }
+
+        /// <summary>
+        /// Counts of the responses to "OK" and value queries by result,
+        /// malformed and unexpected responses point to a noisy line.
+        /// </summary>
+        const QSource3ParseStats& getParseStats(void) const { return _parseStats; }
+
+        void resetParseStats(void) { memset(&_parseStats, 0, sizeof(_parseStats)); }
+
         /// <summary>
         /// Changes resonant frequency and corresponding mass measurement range of the
         /// quadrupole.
@@ -175,9 +458,123 @@ class JanasCardQSource3 {
         /// <param name=""></param>
         /// <returns>value of current. A valid value is in the range 0 to 3300.
         /// The real value of the excitation current in mA is I = val / 10.
-        /// If the current is out of range, val is 9999.
+        /// If the current is out of range, val is 9999 (QSOURCE3_CURRENT_OVERRANGE).
         /// In case of communication error -1 is returned.</returns>
         int32_t readCurrent(void);
+
+        // Asynchronous API
+        //
+        // The ...Async() methods queue a request and return at once. A single
+        // device-owner task executes the requests by the blocking methods above,
+        // so voltage suppression, guard time and statistics apply as well.
+        // Requests are executed in order within a priority class, a queued
+        // setpoint overtakes queued control commands and telemetry:
+        //
+        //     for(;;) { qSource3.workAsync(portMAX_DELAY); }
+        //
+        // The caller polls the request state, waits for it by wait() or gets
+        // the request callback. Blocking calls of other tasks stay possible,
+        // the mutex keeps them apart from the device-owner task.
+        //
+        // The queues belong to the lock, only QSource3MutexLock has them; with
+        // the other locks initAsync() fails and every request is rejected.
+
+        /// <summary>
+        /// Creates the request queues, call after <see cref="init()"/>.
+        /// </summary>
+        /// <param name="length"> - maximum number of queued requests of each priority class</param>
+        /// <returns>true if succeeded, false if the lock has no queues</returns>
+        bool initAsync(size_t length = Q_SOURCE3_ASYNC_QUEUE_LENGTH);
+
+        /// <summary>
+        /// Executes one queued request, the body of the device-owner task.
+        /// The request is completed, its callback is called and the submitting
+        /// task is notified. A request with callback belongs to the device-owner
+        /// task until the callback returns.
+        /// </summary>
+        /// <param name="xTicksToWait"> - time to wait for a request</param>
+        /// <returns>true if a request was executed</returns>
+        bool workAsync(uint32_t xTicksToWait);
+
+        /// <summary>
+        /// Waits for completion of a request. Must be called by the task which submitted it,
+        /// the device-owner task notifies that task by the task notification.
+        /// </summary>
+        /// <param name="req"> - submitted request</param>
+        /// <param name="xTicksToWait"> - timeout</param>
+        /// <returns>true if the request is Q_SOURCE3_CMD_DONE</returns>
+        bool wait(QSource3Request* req, uint32_t xTicksToWait);
+
+        static bool isDone(const QSource3Request* req) {return req->state != Q_SOURCE3_CMD_PENDING;}
+
+        /// <summary>
+        /// Holds back telemetry while the bus is needed for setpoints, e.g. during a scan.
+        /// Telemetry requests taken while held are completed as Q_SOURCE3_CMD_DROPPED
+        /// without being sent, blocking <see cref="readFreq()"/> and <see cref="readCurrent()"/>
+        /// return -1, also when they were waiting for the device as the hold began.
+        /// Both count as dropped. Holds nest, every call must be paired by
+        /// <see cref="releaseTelemetry()"/>.
+        ///
+        /// A query already on the bus is not cut off: the first setpoint after
+        /// the hold may wait for its response, see maxLockWait of Q_SOURCE3_PRIO_REALTIME
+        /// in <see cref="getQueueStats()"/>.
+        /// </summary>
+        void holdTelemetry(void) {_lock.enterCritical(); ++_telemetryHold; _lock.exitCritical();}
+
+        void releaseTelemetry(void) {_lock.enterCritical(); if (_telemetryHold > 0) --_telemetryHold; _lock.exitCritical();}
+
+        bool isTelemetryHeld(void) const {return _telemetryHold > 0;}
+
+        /// <summary>
+        /// A copy of the queueing statistics, taken in a critical section of the lock:
+        /// submitting tasks and the device-owner task update them concurrently.
+        /// </summary>
+        QSource3QueueStats getQueueStats(QSource3Priority priority)
+        {
+            _lock.enterCritical();
+            QSource3QueueStats stats = _queueStats[priority];
+            _lock.exitCritical();
+            return stats;
+        }
+
+        void resetQueueStats(void) {_lock.enterCritical(); memset(_queueStats, 0, sizeof(_queueStats)); _lock.exitCritical();}
+
+        /// <summary>
+        /// Queues <see cref="writeVoltages()"/>. The same for the other ...Async() methods.
+        /// </summary>
+        /// <param name="req"> - request, Q_SOURCE3_CMD_PENDING until completed</param>
+        /// <returns>true if queued, false if the queue is full</returns>
+        bool writeVoltagesAsync(QSource3Request* req, int32_t dc1, int32_t dc2, uint32_t ac);
+        bool writeDCAsync(QSource3Request* req, uint32_t output, int32_t value);
+        bool writeACAsync(QSource3Request* req, uint32_t value);
+        bool writeFreqRangeAsync(QSource3Request* req, uint32_t range);
+        bool writeFreqAsync(QSource3Request* req, uint32_t value);
+        bool storeFreqAsync(QSource3Request* req);
+        bool readFreqAsync(QSource3Request* req);      // frequency in req->value
+        bool readCurrentAsync(QSource3Request* req);   // current in req->value
+        bool readTestAsync(QSource3Request* req);
+        bool readSerialNoAsync(QSource3Request* req);  // serial number in req->response
+};
+
+// the policies chosen by the build, defined in JanasCardQSource3.cpp
+extern template class JanasCardQSource3T<QSource3DefaultTransport, QSource3DefaultLock>;
+typedef JanasCardQSource3T<QSource3DefaultTransport, QSource3DefaultLock> JanasCardQSource3;
+
+#ifndef Q_SOURCE3_LOOPBACK
+// a device without port, e.g. for testing a sketch without the supply
+extern template class JanasCardQSource3T<QSource3LoopbackTransport, QSource3NoLock>;
+#endif
+typedef JanasCardQSource3T<QSource3LoopbackTransport, QSource3NoLock> JanasCardQSource3Loopback;
+
+/// <summary>
+/// Holds back telemetry of a device for the scope of a block, see
+/// <see cref="JanasCardQSource3::holdTelemetry()"/>.
+/// </summary>
+class QSource3TelemetryHold {
+    JanasCardQSource3* _device;
+public:
+    QSource3TelemetryHold(JanasCardQSource3* device): _device(device) { _device->holdTelemetry(); }
+    ~QSource3TelemetryHold() { _device->releaseTelemetry(); }
 };
 
 
@@ -0,0 +1,925 @@
+/*****************************************************************//**
+ * \file   JanasCardQSource3Impl.h
+ * \brief  Definitions of JanasCardQSource3T.
+ *
+ * Included by JanasCardQSource3.cpp for the policies of the build. A host
+ * build or benchmark includes it to instantiate other combinations:
+ *
+ *     template class JanasCardQSource3T<QSource3DeadlineTransport<Linux_Stream>, QSource3NoLock>;
+ *
+ * \author jasik
+ * \date   October 2026
+ *********************************************************************/
+
+#ifndef JanasCardQSource3Impl_H_
+#define JanasCardQSource3Impl_H_
+
+#include "JanasCardQSource3.h"
+#include "QSource3Encoder.h"
+#include <stdio.h>
+
+
+// #define TRACE_QSOURCE3(x_) printf("%d ms -> JanasCardQSource3: ", millis()); x_
+// #define TRACE_QSOURCE3(x_) printf("%d ms -> %s(%d): ", millis(), __FILE__, __LINE__); x_
+#define TRACE_QSOURCE3(x_)
+
+
+static inline int32_t _limit(int32_t x, int32_t max, int32_t min)
+{
+    if (x > max) return max;
+    if (x < min) return min;
+    return x;
+}
+
+// DA converter codes of limited values: DC 64000 LSB over 150 V (2.34 mV), AC 9.4 mV LSB
+static inline uint32_t _dcCode(int32_t mV)
+{
+    return ((uint32_t)(mV - Q_SOURCE3_MIN_DC) * 32 + 37) / 75;
+}
+
+static inline uint32_t _acCode(uint32_t mV)
+{
+    return (mV * 10 + 47) / 94;
+}
+
+// transmit time of len bytes in us, 8N1
+static inline uint32_t _txTime(size_t len)
+{
+    return len * 10 * 1000000UL / Q_SOURCE3_SERIAL_BAUD_RATE;
+}
+
+
+template <class Transport, class Lock>
+JanasCardQSource3T<Transport, Lock>::JanasCardQSource3T(StreamType *comm)
+    :_transport(comm)
+{
+    resetQueueStats();
+}
+
+
+template <class Transport, class Lock>
+void JanasCardQSource3T<Transport, Lock>::init(uint32_t xTicksToWait)
+{
+    _ticksToWait = xTicksToWait;
+    _lock.init();
+}
+
+
+// waits until the device has processed the last command without response,
+// _txDoneTS may lie ahead after a skipped frame
+template <class Transport, class Lock>
+void JanasCardQSource3T<Transport, Lock>::_waitReady()
+{
+    if (!_guardPending) return;
+    uint32_t ready = _txDoneTS + _guardTime;
+    int32_t remaining = (int32_t)(ready - micros());
+    if (remaining > 0)
+    {
+        _lock.sleep(remaining);
+        while ((int32_t)(ready - micros()) > 0);
+    }
+    _guardPending = false;
+}
+
+
+// the caller holds the lock
+template <class Transport, class Lock>
+size_t JanasCardQSource3T<Transport, Lock>::__write(const char* buff)
+{
+    TRACE_QSOURCE3( printf("__write(\"%s\") ... \r\n", buff); )
+
+    _waitReady();
+    _transport.clear();
+    TRACE_QSOURCE3( printf("..._clearBuffer() pass\r\n"); )
+
+    if(!_transport.availableForWrite())
+    {
+        _connected = false;
+        TRACE_QSOURCE3( printf("... _comm not available for write\r\n"); )
+        return 0;
+    }
+    size_t bytesSent = _transport.write(buff);
+    TRACE_QSOURCE3( printf("... _comm->write(buff): %d bytes sent\r\n", bytesSent); )
+    if ((bytesSent > 0) && !_transport.waitTxDone(_ticksToWait))
+    {
+        TRACE_QSOURCE3( printf("... transmit timeout\r\n"); )
+        bytesSent = 0;
+    }
+    _txDoneTS = micros();
+    _guardPending = true;  // cleared by a response
+
+    _lastWriteTS = millis();
+    return bytesSent;
+}
+
+
+// takes the device for a command of the class, telemetry gives way to a hold
+// also after waiting for the lock. A command that sets the outputs invalidates
+// the codes of the last voltage frame under the lock, see writeVoltages().
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::_take(QSource3Priority cls, bool outputs)
+{
+    uint32_t start = micros();
+    bool telemetry = (cls == Q_SOURCE3_PRIO_TELEMETRY);
+    if (!(telemetry && isTelemetryHeld()))
+    {
+        if (!_lock.take(_ticksToWait))
+        {
+            return false;
+        }
+        if (!(telemetry && isTelemetryHeld()))
+        {
+            uint32_t wait = micros() - start;
+            _lock.enterCritical();
+            QSource3QueueStats* stats = &(_queueStats[cls]);
+            ++stats->accesses;
+            if (wait > stats->maxLockWait) stats->maxLockWait = wait;
+            stats->sumLockWait += wait;
+            _lock.exitCritical();
+            if (outputs) _codesValid = false;
+            return true;
+        }
+        _lock.give();
+    }
+    TRACE_QSOURCE3( printf("_take() ... telemetry dropped\r\n"); )
+    _lock.enterCritical();
+    ++_queueStats[cls].dropped;
+    _lock.exitCritical();
+    return false;
+}
+
+
+// sends the query and keeps the device until _endQuery()
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::_beginQuery(const char* query, QSource3Priority cls, bool outputs)
+{
+    TRACE_QSOURCE3( printf("_query(\"%s\")\r\n", query); )
+    if(!_connected)
+    {
+        TRACE_QSOURCE3( printf("... not connected.\r\n"); )
+        return false;
+    }
+    char buff[Q_SOURCE3_FRAME_SIZE];
+    size_t len = strlen(query);
+    if (len + 2 > Q_SOURCE3_FRAME_SIZE)  // '\r' and terminal zero
+    {
+        TRACE_QSOURCE3( printf("... query too long.\r\n"); )
+        return false;
+    }
+    memcpy(buff, query, len);
+    buff[len++] = '\r';
+    buff[len] = '\0';
+    
+    if(!_take(cls, outputs))
+    {
+        TRACE_QSOURCE3( printf("... lock blocked.\r\n"); )
+        return false;
+    }
+    size_t bytesSent = __write(buff);
+    if(len != bytesSent)
+    {
+        TRACE_QSOURCE3( printf("... _write() ERROR. strlen(buff)=%u, bytesSent=%u\r\n", len, bytesSent); )
+        _lock.give();
+        return false;
+    }
+    TRACE_QSOURCE3( printf("... _write() pass\r\n"); )
+
+    if(!_transport.waitResponse())
+    {
+        TRACE_QSOURCE3( printf("... no response from device\r\n"); )
+        _lock.give();
+        _connected = false;
+        return false;
+    }
+
+    // _connected is set by _endQuery() under the lock, a setpoint of another
+    // task waits for the lock instead of failing while the query runs
+    _transport.startResponse();
+    return true;
+}
+
+
+template <class Transport, class Lock>
+void JanasCardQSource3T<Transport, Lock>::_endQuery(bool responded)
+{
+    if (responded)
+    {
+        _responseTime = micros() - _txDoneTS;
+        _guardPending = false;  // the device has processed the query
+    }
+    _connected = responded;  // true after successful reading
+    _lock.give();
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::_query(const char* query, char* buffer, size_t buff_len)
+{
+    if (!_beginQuery(query, Q_SOURCE3_PRIO_CONTROL))
+    {
+        return false;
+    }
+    size_t n = _transport.readBytesUntil('\r', buffer, buff_len);
+    bool responded = (n > 0);
+    if (responded && (buffer[n - 1] == '\r')) --n;
+    if (n < buff_len) buffer[n] = '\0';  /* add terminal zero */
+
+    TRACE_QSOURCE3(
+        printf("...readBytesUntil(): %d bytes read, buffer = \"%s\"\r\n", n, buffer);
+    )
+    _endQuery(responded);
+    return responded;
+}
+
+
+template <class Transport, class Lock>
+QSource3Reply JanasCardQSource3T<Transport, Lock>::_queryReply(const char* query, QSource3Expect expect, int32_t* value,
+    QSource3Priority cls, bool outputs)
+{
+    if (!_beginQuery(query, cls, outputs))
+    {
+        return QSOURCE3_REPLY_NONE;
+    }
+    QSource3Parser parser(expect);
+    QSource3Reply reply = _parseResponse(&parser);
+    _endQuery(reply != QSOURCE3_REPLY_NONE);
+
+    qsource3CountReply(&_parseStats, reply);
+    if (value != NULL)
+    {
+        *value = parser.value();
+    }
+    TRACE_QSOURCE3( printf("... reply %d, value %d\r\n", reply, parser.value()); )
+    return reply;
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::_queryOK(const char* query, QSource3Priority cls, bool outputs)
+{
+    return _queryReply(query, QSOURCE3_EXPECT_OK, NULL, cls, outputs) == QSOURCE3_REPLY_OK;
+}
+
+
+// feeds the received bytes to the parser straight from the receive buffer
+template <class Transport, class Lock>
+QSource3Reply JanasCardQSource3T<Transport, Lock>::_parseResponse(QSource3Parser* parser)
+{
+    for(;;)
+    {
+        int ch = _transport.readByte();
+        if (ch < 0) return QSOURCE3_REPLY_NONE;  // the response deadline
+        QSource3Reply reply = parser->feed((char)ch);
+        if (reply != QSOURCE3_REPLY_PENDING) return reply;
+    }
+}
+
+
+// sends one burst and matches its responses, returns the number of sent commands
+// or 0 when the rest must not be sent; the caller holds the lock and calls the
+// callbacks after releasing it
+template <class Transport, class Lock>
+size_t JanasCardQSource3T<Transport, Lock>::_pipelineWindow(QSource3Cmd* cmds, size_t n)
+{
+    char buff[Q_SOURCE3_QUERY_BUFFER_SIZE];
+    size_t len = 0;
+    size_t w = 0;
+    size_t depth = getPipelineDepth();
+    while ((w < n) && (w < depth))
+    {
+        size_t l = strlen(cmds[w].cmd);
+        if (len + l + 2 > Q_SOURCE3_QUERY_BUFFER_SIZE) break;  // '\r' and terminal zero
+        memcpy(buff + len, cmds[w].cmd, l);
+        len += l;
+        buff[len++] = '\r';
+        ++w;
+    }
+    buff[len] = '\0';
+    if (w == 0)
+    {
+        TRACE_QSOURCE3( printf("... command too long: \"%s\"\r\n", cmds[0].cmd); )
+        cmds[0].state = Q_SOURCE3_CMD_ERROR;
+        return 1;
+    }
+
+    if (__write(buff) != len)
+    {
+        TRACE_QSOURCE3( printf("... _write() ERROR\r\n"); )
+        for (size_t i = 0; i < w; ++i)
+        {
+            cmds[i].state = Q_SOURCE3_CMD_ERROR;
+        }
+        return 0;
+    }
+
+    _connected = false;  // make _connected true after successful reading
+    char discard[Q_SOURCE3_RESPONSE_SIZE];
+    size_t i = 0;
+    _transport.startResponse();  // one deadline for all responses of the burst
+    for (; i < w; ++i)
+    {
+        QSource3Cmd* c = &(cmds[i]);
+        size_t m = _transport.readBytesUntil('\r', c->response, Q_SOURCE3_RESPONSE_SIZE - 1);
+        if (m == 0)
+        {
+            break;
+        }
+        QSource3CmdState state = Q_SOURCE3_CMD_DONE;
+        if (c->response[m - 1] == '\r')
+        {
+            --m;
+        }
+        else if (m == Q_SOURCE3_RESPONSE_SIZE - 1)
+        {
+            // too long, skip the rest of the line
+            _transport.readBytesUntil('\r', discard, Q_SOURCE3_RESPONSE_SIZE);
+            state = Q_SOURCE3_CMD_ERROR;
+        }
+        c->response[m] = '\0';
+        if (c->expectOK && (state == Q_SOURCE3_CMD_DONE))
+        {
+            // the same strict check as _queryOK(), "OK " or "OKx" are not "OK"
+            QSource3Parser parser(QSOURCE3_EXPECT_OK);
+            size_t consumed;
+            QSource3Reply reply = parser.parse(c->response, m, &consumed);
+            if (reply == QSOURCE3_REPLY_PENDING) reply = parser.feed('\r');
+            qsource3CountReply(&_parseStats, reply);
+            if (reply != QSOURCE3_REPLY_OK) state = Q_SOURCE3_CMD_ERROR;
+        }
+        TRACE_QSOURCE3( printf("... \"%s\" -> \"%s\"\r\n", c->cmd, c->response); )
+        c->state = state;
+    }
+    bool timeout = (i < w);
+    if (timeout)
+    {
+        TRACE_QSOURCE3( printf("... no response to \"%s\"\r\n", cmds[i].cmd); )
+        _transport.startResponse();  // at most one more timeout for the late responses
+        for (; i < w; ++i)
+        {
+            // a late response would be taken for the response of the next command
+            _transport.readBytesUntil('\r', discard, Q_SOURCE3_RESPONSE_SIZE);
+            cmds[i].state = Q_SOURCE3_CMD_TIMEOUT;
+        }
+    }
+    else
+    {
+        _connected = true;
+        _responseTime = micros() - _txDoneTS;
+        _guardPending = false;
+    }
+    return timeout ? 0 : w;
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::pipeline(QSource3Cmd* cmds, size_t n)
+{
+    TRACE_QSOURCE3( printf("pipeline(n=%u)\r\n", n); )
+    for (size_t i = 0; i < n; ++i)
+    {
+        cmds[i].state = Q_SOURCE3_CMD_IDLE;
+        cmds[i].response[0] = '\0';
+    }
+    if(!_connected)
+    {
+        TRACE_QSOURCE3( printf("... not connected.\r\n"); )
+        return false;
+    }
+    if(!_take(Q_SOURCE3_PRIO_CONTROL, true))  // the commands may set the outputs, e.g. #C or #DC1
+    {
+        TRACE_QSOURCE3( printf("... lock blocked.\r\n"); )
+        return false;
+    }
+    for (size_t i = 0; i < n;)
+    {
+        size_t k = _pipelineWindow(&(cmds[i]), n - i);
+        if (k == 0)
+        {
+            break;
+        }
+        i += k;
+    }
+    _lock.give();
+
+    // without the lock, a callback may use the device
+    bool done = true;
+    for (size_t i = 0; i < n; ++i)
+    {
+        QSource3CmdState state = cmds[i].state;
+        if ((state != Q_SOURCE3_CMD_IDLE) && (cmds[i].callback != NULL))
+        {
+            cmds[i].callback(&(cmds[i]), cmds[i].ctx);
+        }
+        if (state != Q_SOURCE3_CMD_DONE) done = false;
+    }
+    return done;
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::readTest(void)
+{
+    return _queryOK("#Q");
+}
+
+
+// the response time of a query bounds the processing time of a command
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::measureGuardTime(size_t n)
+{
+    TRACE_QSOURCE3( printf("measureGuardTime(%u)\r\n", n); )
+    uint32_t t = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (!readTest())
+        {
+            TRACE_QSOURCE3( printf("... no response\r\n"); )
+            return false;
+        }
+        if (_responseTime > t) t = _responseTime;
+    }
+    TRACE_QSOURCE3( printf("... %u us\r\n", t); )
+    _guardTime = t;
+    return true;
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::readSerialNo(char* buffer, size_t buff_len)
+{
+    return _query("#N", buffer, buff_len);
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::writeRSMode(uint32_t value)
+{
+    _connected = true; // this should be the first command of QSource3 initialization. _connected must be set to pass over _queryOK()
+    _connected = _queryOK(value ? "#R1":"#R0", Q_SOURCE3_PRIO_CONTROL, true);
+    if (_connected)
+    {
+        _rs485 = (value != 0);
+    }
+    return _connected;
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::writeDC(uint32_t output, int32_t value)
+{
+    value = _limit(value, Q_SOURCE3_MAX_DC, Q_SOURCE3_MIN_DC);
+    char buff[QSOURCE3_ENCODE_SIZE];
+    if ((qsource3EncodeDC(buff, output, value) > 0) && _queryOK(buff, Q_SOURCE3_PRIO_REALTIME, true))
+    {
+        return true;
+    }
+    return false;
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::writeAC(uint32_t value)
+{
+    value = value > Q_SOURCE3_MAX_AC ? Q_SOURCE3_MAX_AC : value;
+    char buff[QSOURCE3_ENCODE_SIZE];
+
+    qsource3EncodeAC(buff, value);
+    if (_queryOK(buff, Q_SOURCE3_PRIO_REALTIME, true))
+    {
+        return true;
+    }
+
+    return false;
+}
+
+
+// fast writing without connection checking
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::writeVoltages(int32_t dc1, int32_t dc2, uint32_t ac)
+{
+    char buff[QSOURCE3_ENCODE_SIZE];
+
+    dc1 = _limit(dc1, Q_SOURCE3_MAX_DC, Q_SOURCE3_MIN_DC);
+    dc2 = _limit(dc2, Q_SOURCE3_MAX_DC, Q_SOURCE3_MIN_DC);
+    ac = ac > Q_SOURCE3_MAX_AC ? Q_SOURCE3_MAX_AC : ac;
+
+    uint32_t codeDC1 = _dcCode(dc1);
+    uint32_t codeDC2 = _dcCode(dc2);
+    uint32_t codeAC = _acCode(ac);
+
+    if(!_connected)
+    {
+        TRACE_QSOURCE3( printf("writeVoltages() ... not connected.\r\n"); )
+        return false;
+    }
+    if(!_take(Q_SOURCE3_PRIO_REALTIME))
+    {
+        TRACE_QSOURCE3( printf("writeVoltages() ... lock blocked.\r\n"); )
+        return false;
+    }
+    if (_forceWrite)
+    {
+        _forceWrite = false;
+        _codesValid = false;
+    }
+
+    if (_suppressUnchanged && _codesValid &&
+        (codeDC1 == _codeDC1) && (codeDC2 == _codeDC2) && (codeAC == _codeAC))
+    {
+        TRACE_QSOURCE3( printf("writeVoltages(%d, %d, %u) ... unchanged\r\n", dc1, dc2, ac); )
+        ++_writeStats.framesSkipped;
+        size_t len = 6 + qsource3IntLength(dc1) + qsource3IntLength(dc2) + qsource3IntLength(ac);  // "#C   \r"
+        _writeStats.bytesSkipped += len;
+        // not waited for here: the frame is booked as if it left the USART after
+        // the pending guard time, the next command waits for it in _waitReady()
+        uint32_t start = micros();
+        if (_guardPending && ((int32_t)(_txDoneTS + _guardTime - start) > 0))
+        {
+            start = _txDoneTS + _guardTime;
+        }
+        _txDoneTS = start + _txTime(len);
+        _guardPending = true;
+        _lock.give();
+        return true;
+    }
+
+    size_t len = qsource3EncodeVoltages(buff, dc1, dc2, ac);
+
+    _codesValid = false;
+    bool rc = (__write(buff) == len);
+    if (rc)
+    {
+        _codeDC1 = codeDC1;
+        _codeDC2 = codeDC2;
+        _codeAC = codeAC;
+        _codesValid = true;
+        ++_writeStats.frames;
+        _writeStats.bytes += len;
+    }
+    _lock.give();
+    return rc;
+}
+
+
+template <class Transport, class Lock>
+size_t JanasCardQSource3T<Transport, Lock>::formatVoltages(char* buffer, size_t buff_len, int32_t dc1, int32_t dc2, uint32_t ac)
+{
+    dc1 = _limit(dc1, Q_SOURCE3_MAX_DC, Q_SOURCE3_MIN_DC);
+    dc2 = _limit(dc2, Q_SOURCE3_MAX_DC, Q_SOURCE3_MIN_DC);
+    ac = ac > Q_SOURCE3_MAX_AC ? Q_SOURCE3_MAX_AC : ac;
+
+    if (buff_len < Q_SOURCE3_FRAME_SIZE)
+    {
+        if (buff_len > 0) buffer[0] = '\0';
+        return 0;
+    }
+    return qsource3EncodeVoltages(buffer, dc1, dc2, ac);
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::writeFrame(const char* frame, size_t len)
+{
+    TRACE_QSOURCE3( printf("writeFrame(\"%s\")\r\n", frame); )
+    if(!_connected)
+    {
+        TRACE_QSOURCE3( printf("... not connected.\r\n"); )
+        return false;
+    }
+    if(!_take(Q_SOURCE3_PRIO_REALTIME, true))  // codes of the frame are not known
+    {
+        TRACE_QSOURCE3( printf("... lock blocked.\r\n"); )
+        return false;
+    }
+    bool rc = (__write(frame) == len);
+    if (rc)
+    {
+        ++_writeStats.frames;
+        _writeStats.bytes += len;
+    }
+    _lock.give();
+    return rc;
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::writeFreqRange(uint32_t range)
+{
+    switch (range)
+    {
+    case 0:
+        if (_queryOK("#B 0", Q_SOURCE3_PRIO_CONTROL, true))
+        {
+            return true;
+        }
+        break;
+    case 1:
+        if (_queryOK("#B 1", Q_SOURCE3_PRIO_CONTROL, true))
+        {
+            return true;
+        }
+        break;
+    case 2:
+        if (_queryOK("#B 2", Q_SOURCE3_PRIO_CONTROL, true))
+        {
+            return true;
+        }
+        break;
+    }
+    return false;
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::writeFreq(uint32_t value)
+{
+    value = _limit(value, Q_SOURCE3_MAX_FREQ, Q_SOURCE3_MIN_FREQ);
+    char buff[QSOURCE3_ENCODE_SIZE];
+
+    qsource3EncodeFreq(buff, value);
+    if (_queryOK(buff))
+    {
+        return true;
+    }
+
+    return false;
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::storeFreq(void)
+{
+    return _queryOK("#S");
+}
+
+
+template <class Transport, class Lock>
+int32_t JanasCardQSource3T<Transport, Lock>::readFreq(void)
+{
+    int32_t value;
+    if (_queryReply("#G", QSOURCE3_EXPECT_VALUE, &value, Q_SOURCE3_PRIO_TELEMETRY) == QSOURCE3_REPLY_VALUE)
+    {
+        return value;
+    }
+
+    return -1;
+}
+
+
+template <class Transport, class Lock>
+int32_t JanasCardQSource3T<Transport, Lock>::readCurrent(void)
+{
+    int32_t value;
+    
+    _lastCurrent = -1;
+    switch (_queryReply("#U", QSOURCE3_EXPECT_CURRENT, &value, Q_SOURCE3_PRIO_TELEMETRY))
+    {
+    case QSOURCE3_REPLY_VALUE:
+    case QSOURCE3_REPLY_OVERRANGE:
+        _lastCurrent = value;
+        break;
+    default:
+        break;
+    }
+
+    return _lastCurrent;
+}
+
+
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::initAsync(size_t length)
+{
+    return _lock.initQueue(Q_SOURCE3_PRIO_COUNT, length);
+}
+
+
+static inline QSource3Priority _priority(QSource3Op op)
+{
+    switch (op)
+    {
+    case Q_SOURCE3_OP_VOLTAGES:
+    case Q_SOURCE3_OP_DC:
+    case Q_SOURCE3_OP_AC:
+        return Q_SOURCE3_PRIO_REALTIME;
+    case Q_SOURCE3_OP_READ_FREQ:
+    case Q_SOURCE3_OP_READ_CURRENT:
+        return Q_SOURCE3_PRIO_TELEMETRY;
+    default:
+        return Q_SOURCE3_PRIO_CONTROL;
+    }
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::_submit(QSource3Request* req, QSource3Op op, int32_t arg0, int32_t arg1, int32_t arg2)
+{
+    req->op = op;
+    req->priority = _priority(op);
+    req->arg[0] = arg0;
+    req->arg[1] = arg1;
+    req->arg[2] = arg2;
+    req->owner = _lock.self();
+    req->value = -1;
+    req->response[0] = '\0';
+    req->queuedTS = micros();
+    req->state = Q_SOURCE3_CMD_PENDING;
+
+    if (!_lock.send(req->priority, req))
+    {
+        TRACE_QSOURCE3( printf("_submit(%d) ... queue full\r\n", op); )
+        _lock.enterCritical();  // submitting tasks race here
+        ++_queueStats[req->priority].rejected;
+        _lock.exitCritical();
+        req->state = Q_SOURCE3_CMD_ERROR;
+        return false;
+    }
+    return true;
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::workAsync(uint32_t xTicksToWait)
+{
+    // the highest class is taken first
+    QSource3Request* req = static_cast<QSource3Request*>(_lock.receive(xTicksToWait));
+    if (req == NULL)
+    {
+        return false;
+    }
+
+    req->startTS = micros();
+    uint32_t delay = req->startTS - req->queuedTS;
+    bool dropped = (req->priority == Q_SOURCE3_PRIO_TELEMETRY) && isTelemetryHeld();
+
+    _lock.enterCritical();
+    QSource3QueueStats* stats = &(_queueStats[req->priority]);
+    if (delay > stats->maxDelay) stats->maxDelay = delay;
+    stats->sumDelay += delay;
+    if (dropped) ++stats->dropped;
+    else ++stats->requests;
+    _lock.exitCritical();
+
+    QSource3CmdState state;
+    if (dropped)
+    {
+        TRACE_QSOURCE3( printf("workAsync() ... telemetry dropped\r\n"); )
+        state = Q_SOURCE3_CMD_DROPPED;
+    }
+    else
+    {
+        state = _execute(req) ? Q_SOURCE3_CMD_DONE : Q_SOURCE3_CMD_ERROR;
+    }
+    req->doneTS = micros();
+
+    // a polled request may be reused as soon as its state is set,
+    // nothing of it is read afterwards
+    void* owner = req->owner;
+    void (*callback)(QSource3Request* req, void* ctx) = req->callback;
+    void* ctx = req->ctx;
+    req->state = state;
+    if (callback != NULL)
+    {
+        callback(req, ctx);
+    }
+    if (owner != NULL)
+    {
+        _lock.notify(owner);
+    }
+    return true;
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::_execute(QSource3Request* req)
+{
+    bool ok = false;
+    switch (req->op)
+    {
+    case Q_SOURCE3_OP_VOLTAGES:
+        ok = writeVoltages(req->arg[0], req->arg[1], req->arg[2]);
+        break;
+    case Q_SOURCE3_OP_DC:
+        ok = writeDC(req->arg[0], req->arg[1]);
+        break;
+    case Q_SOURCE3_OP_AC:
+        ok = writeAC(req->arg[0]);
+        break;
+    case Q_SOURCE3_OP_FREQ_RANGE:
+        ok = writeFreqRange(req->arg[0]);
+        break;
+    case Q_SOURCE3_OP_FREQ:
+        ok = writeFreq(req->arg[0]);
+        break;
+    case Q_SOURCE3_OP_STORE_FREQ:
+        ok = storeFreq();
+        break;
+    case Q_SOURCE3_OP_READ_FREQ:
+        req->value = readFreq();
+        ok = req->value >= 0;
+        break;
+    case Q_SOURCE3_OP_READ_CURRENT:
+        req->value = readCurrent();
+        ok = req->value >= 0;
+        break;
+    case Q_SOURCE3_OP_TEST:
+        ok = readTest();
+        break;
+    case Q_SOURCE3_OP_SERIAL_NO:
+        ok = readSerialNo(req->response, Q_SOURCE3_RESPONSE_SIZE);
+        break;
+    }
+    return ok;
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::wait(QSource3Request* req, uint32_t xTicksToWait)
+{
+    uint32_t start = _lock.getTickCount();
+    while (req->state == Q_SOURCE3_CMD_PENDING)
+    {
+        uint32_t elapsed = _lock.getTickCount() - start;
+        if (elapsed >= xTicksToWait)
+        {
+            return false;
+        }
+        // a notification left by an earlier request only repeats the check
+        _lock.waitNotify(xTicksToWait - elapsed);
+    }
+    return req->state == Q_SOURCE3_CMD_DONE;
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::writeVoltagesAsync(QSource3Request* req, int32_t dc1, int32_t dc2, uint32_t ac)
+{
+    return _submit(req, Q_SOURCE3_OP_VOLTAGES, dc1, dc2, ac);
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::writeDCAsync(QSource3Request* req, uint32_t output, int32_t value)
+{
+    return _submit(req, Q_SOURCE3_OP_DC, output, value);
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::writeACAsync(QSource3Request* req, uint32_t value)
+{
+    return _submit(req, Q_SOURCE3_OP_AC, value);
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::writeFreqRangeAsync(QSource3Request* req, uint32_t range)
+{
+    return _submit(req, Q_SOURCE3_OP_FREQ_RANGE, range);
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::writeFreqAsync(QSource3Request* req, uint32_t value)
+{
+    return _submit(req, Q_SOURCE3_OP_FREQ, value);
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::storeFreqAsync(QSource3Request* req)
+{
+    return _submit(req, Q_SOURCE3_OP_STORE_FREQ);
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::readFreqAsync(QSource3Request* req)
+{
+    return _submit(req, Q_SOURCE3_OP_READ_FREQ);
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::readCurrentAsync(QSource3Request* req)
+{
+    return _submit(req, Q_SOURCE3_OP_READ_CURRENT);
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::readTestAsync(QSource3Request* req)
+{
+    return _submit(req, Q_SOURCE3_OP_TEST);
+}
+
+
+template <class Transport, class Lock>
+bool JanasCardQSource3T<Transport, Lock>::readSerialNoAsync(QSource3Request* req)
+{
+    return _submit(req, Q_SOURCE3_OP_SERIAL_NO);
+}
+
+
+#endif /* JanasCardQSource3Impl_H_ */
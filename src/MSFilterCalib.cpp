@@ -0,0 +1,84 @@
+#include "MSFilterCalib.h"
+#include "MSFilterInterp.h"
+
+// #define TRACE_MSFC(x_) printf("%d ms -> MSFQCalibBuffer: ", millis()); x_
+#define TRACE_MSFC(x_)
+
+// full memory barrier, orders the buffer index accesses against the data accesses
+#define MSFC_BARRIER() __sync_synchronize()
+
+
+MSFQCalibBuffer::MSFQCalibBuffer(
+    const StateTuneParRecords* calibPntsRF,
+    const StateTuneParRecords* calibPntsDC
+)
+{
+    _slot[0].rf = *calibPntsRF;
+    _slot[0].dc = *calibPntsDC;
+    _slot[0].version = _version;
+    _init(&(_slot[0]));
+    _slot[1].version = 0;
+}
+
+
+void MSFQCalibBuffer::_init(MSFQCalibSnapshot* s)
+{
+    msfqSplineInit(&(s->rf), &(s->splineRF));
+    msfqSplineInit(&(s->dc), &(s->splineDC));
+}
+
+
+MSFQCalibSnapshot* MSFQCalibBuffer::beginUpdate(void)
+{
+    uint8_t back = 1 - _front;
+    MSFC_BARRIER();
+    if (_inUse == back)
+    {
+        TRACE_MSFC( printf("beginUpdate() ... back buffer in use\r\n"); )
+        return NULL;
+    }
+
+    const MSFQCalibSnapshot* front = &(_slot[_front]);
+    _slot[back].rf = front->rf;
+    _slot[back].dc = front->dc;
+    _back = back;
+    return &(_slot[back]);
+}
+
+
+bool MSFQCalibBuffer::publish(void)
+{
+    if (_back == NONE)
+    {
+        return false;
+    }
+
+    _init(&(_slot[_back]));
+    _slot[_back].version = ++_version;
+    MSFC_BARRIER();
+    _front = _back;  // single byte store, atomic
+    _back = NONE;
+    TRACE_MSFC( printf("publish() ... version %u\r\n", _version); )
+    return true;
+}
+
+
+MSFQCalibSnapshot* MSFQCalibBuffer::acquire(void)
+{
+    uint8_t s;
+    do {
+        // announce the buffer, then check it was not replaced meanwhile;
+        // the writer checks the announcement before touching a buffer
+        s = _front;
+        _inUse = s;
+        MSFC_BARRIER();
+    } while (s != _front);
+    return &(_slot[s]);
+}
+
+
+void MSFQCalibBuffer::release(void)
+{
+    MSFC_BARRIER();
+    _inUse = NONE;
+}
@@ -0,0 +1,83 @@
+#ifndef MSFilterCalib_h
+#define MSFilterCalib_h
+
+#include <Arduino.h>
+#include "MSFilterQuad.h"
+
+
+/// <summary>
+/// Calibration of one mass filter: RF and DC tables with their splines.
+/// </summary>
+struct MSFQCalibSnapshot {
+    StateTuneParRecords rf;
+    StateTuneParRecords dc;
+    MSFQSpline splineRF;
+    MSFQSpline splineDC;
+    uint32_t version;
+};
+
+
+/// <summary>
+/// Double-buffered calibration. A writer (console, tuning task) prepares a new
+/// calibration in the back buffer and publishes it at once; the reader (the task
+/// calling MSFilterQuad::setMZ()) picks up the published version at the next
+/// step without taking a lock and without ever seeing a half-written table.
+///
+/// Supports one reader and one writer. The reader announces the buffer it uses,
+/// so the writer cannot start overwriting it; <see cref="beginUpdate"></see> then
+/// returns NULL and the writer retries after the reader's next step.
+/// </summary>
+class MSFQCalibBuffer
+{
+private:
+    static const uint8_t NONE = 2;
+
+    MSFQCalibSnapshot _slot[2];
+    volatile uint8_t _front = 0;
+    volatile uint8_t _inUse = NONE;
+    uint8_t _back = NONE;
+    uint32_t _version = 1;
+
+    void _init(MSFQCalibSnapshot* s);
+
+public:
+    /// <summary>
+    /// Constructor. Publishes a copy of the given tables.
+    /// </summary>
+    /// <param name="calibPntsRF">- initial RF amplitude calibration table</param>
+    /// <param name="calibPntsDC">- initial DC difference calibration table</param>
+    MSFQCalibBuffer(
+        const StateTuneParRecords* calibPntsRF,
+        const StateTuneParRecords* calibPntsDC
+    );
+
+    // writer methods
+
+    /// <summary>
+    /// Starts preparing a new calibration. The returned tables are a copy
+    /// of the published ones and may be edited until <see cref="publish"></see>.
+    /// </summary>
+    /// <returns>back buffer or NULL when the reader still uses it</returns>
+    MSFQCalibSnapshot* beginUpdate(void);
+
+    /// <summary>
+    /// Recalculates the splines of the back buffer and publishes it.
+    /// </summary>
+    /// <returns>false without a preceding successful <see cref="beginUpdate"></see></returns>
+    bool publish(void);
+
+    /// <returns>version of the published calibration</returns>
+    uint32_t getVersion(void) const { return _slot[_front].version; }
+
+    // reader methods
+
+    /// <summary>
+    /// Gets the published calibration and marks it as used until <see cref="release"></see>.
+    /// </summary>
+    MSFQCalibSnapshot* acquire(void);
+
+    void release(void);
+};
+
+
+#endif
@@ -0,0 +1,292 @@
+#include "MSFilterInterp.h"
+
+
+// index of the segment [x[k], x[k + 1]] holding mz, 0 or n - 2 outside the table
+template <typename T>
+inline size_t _findSegment(const T* x, size_t n, T mz) {
+    size_t k = 0;
+    size_t len = n - 1;
+    while (len > 1) {
+        size_t half = len / 2;
+        k = (x[k + half] <= mz) ? k + half : k;  // conditional move, no branch
+        len -= half;
+    }
+    return k;
+}
+
+
+float msfqInterpLinear(const StateTuneParRecords* records, float mz) {
+    const float* x = records->_tuneParMZ;
+    const float* y = records->_tuneParVal;
+    size_t k = _findSegment(x, records->_numberTuneParRecs, mz);
+
+    float h = x[k + 1] - x[k];
+    if (!(h > 0.0f))
+        return y[k];
+    return y[k] + (y[k + 1] - y[k]) * (mz - x[k]) / h;
+}
+
+
+// tangent at point k
+float _monotoneTangent(const float* x, const float* y, size_t n, size_t k) {
+    if (k == 0)
+        k = 1;
+    else if (k < n - 1) {
+        float h0 = x[k] - x[k - 1];
+        float h1 = x[k + 1] - x[k];
+        if (!(h0 > 0.0f) || !(h1 > 0.0f))
+            return 0.0f;
+        float d0 = (y[k] - y[k - 1]) / h0;
+        float d1 = (y[k + 1] - y[k]) / h1;
+        if (!(d0 * d1 > 0.0f)) // local extreme
+            return 0.0f;
+        // weighted harmonic mean of the secants
+        return 3.0f * (h0 + h1) / ((2.0f * h1 + h0) / d0 + (h1 + 2.0f * h0) / d1);
+    }
+    // end points use the secant of the end segment
+    float h = x[k] - x[k - 1];
+    return (h > 0.0f) ? (y[k] - y[k - 1]) / h : 0.0f;
+}
+
+
+float msfqInterpMonotone(const StateTuneParRecords* records, float mz) {
+    const float* x = records->_tuneParMZ;
+    const float* y = records->_tuneParVal;
+    size_t n = records->_numberTuneParRecs;
+
+    if (mz <= x[0])
+        return y[0] + _monotoneTangent(x, y, n, 0) * (mz - x[0]);
+    if (mz >= x[n - 1])
+        return y[n - 1] + _monotoneTangent(x, y, n, n - 1) * (mz - x[n - 1]);
+
+    size_t k = _findSegment(x, n, mz);
+    float h = x[k + 1] - x[k];
+    if (!(h > 0.0f))
+        return y[k];
+    float t = (mz - x[k]) / h;
+    float m0 = _monotoneTangent(x, y, n, k) * h;
+    float m1 = _monotoneTangent(x, y, n, k + 1) * h;
+
+    // cubic Hermite in Horner form
+    float dy = y[k + 1] - y[k];
+    float c2 = 3.0f * dy - 2.0f * m0 - m1;
+    float c3 = m0 + m1 - 2.0f * dy;
+    return y[k] + t * (m0 + t * (c2 + t * c3));
+}
+
+
+void msfqSplineInit(const StateTuneParRecords* records, MSFQSpline* spline) {
+    const float* x = records->_tuneParMZ;
+    const float* y = records->_tuneParVal;
+    size_t n = records->_numberTuneParRecs;
+    float* y2 = spline->y2;
+    float u[MAX_NUMBER_OF_TUNE_PAR_RECORDS];
+
+    spline->hunt = 0;
+    for (size_t k = 0; k < n; ++k)
+        y2[k] = 0.0f;
+    if (n < 3)
+        return;
+    for (size_t k = 0; k + 1 < n; ++k) {
+        if (!(x[k + 1] > x[k]))  // not sorted, the spline is piecewise linear
+            return;
+    }
+
+    // forward elimination of the tridiagonal system, natural end conditions
+    u[0] = 0.0f;
+    for (size_t k = 1; k < n - 1; ++k) {
+        float sig = (x[k] - x[k - 1]) / (x[k + 1] - x[k - 1]);
+        float p = sig * y2[k - 1] + 2.0f;
+        y2[k] = (sig - 1.0f) / p;
+        u[k] = (y[k + 1] - y[k]) / (x[k + 1] - x[k]) - (y[k] - y[k - 1]) / (x[k] - x[k - 1]);
+        u[k] = (6.0f * u[k] / (x[k + 1] - x[k - 1]) - sig * u[k - 1]) / p;
+    }
+    // back substitution
+    y2[n - 1] = 0.0f;
+    for (size_t k = n - 1; k-- > 0;)
+        y2[k] = y2[k] * y2[k + 1] + u[k];
+}
+
+
+float msfqInterpSpline(const StateTuneParRecords* records, MSFQSpline* spline, float mz) {
+    const float* x = records->_tuneParMZ;
+    const float* y = records->_tuneParVal;
+    const float* y2 = spline->y2;
+    size_t n = records->_numberTuneParRecs;
+
+    if (mz <= x[0]) {
+        float h = x[1] - x[0];
+        float slope = (h > 0.0f) ? (y[1] - y[0]) / h - h * (2.0f * y2[0] + y2[1]) / 6.0f : 0.0f;
+        return y[0] + slope * (mz - x[0]);
+    }
+    if (mz >= x[n - 1]) {
+        float h = x[n - 1] - x[n - 2];
+        float slope = (h > 0.0f) ? (y[n - 1] - y[n - 2]) / h + h * (y2[n - 2] + 2.0f * y2[n - 1]) / 6.0f : 0.0f;
+        return y[n - 1] + slope * (mz - x[n - 1]);
+    }
+
+    // hunt from the last segment: the same or the next one, binary search otherwise
+    size_t k = spline->hunt;
+    if ((k + 1 >= n) || !(x[k] <= mz)) {
+        k = _findSegment(x, n, mz);
+    }
+    else if (!(mz < x[k + 1])) {
+        k = ((k + 2 < n) && (mz < x[k + 2])) ? k + 1 : _findSegment(x, n, mz);
+    }
+    spline->hunt = k;
+
+    float h = x[k + 1] - x[k];
+    if (!(h > 0.0f))
+        return y[k];
+    float a = (x[k + 1] - mz) / h;
+    float b = 1.0f - a;
+    return a * y[k] + b * y[k + 1] + ((a * a * a - a) * y2[k] + (b * b * b - b) * y2[k + 1]) * (h * h) / 6.0f;
+}
+
+
+int32_t msfqFloatToFixed(float v, uint32_t mul, int shift) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    int e = (int)((bits >> 23) & 0xFF);
+    if (e == 0)  // zero or denormal
+        return 0;
+    if (e == 0xFF) {  // infinity or NaN
+        if (bits & 0x7FFFFF)
+            return 0;
+        return (bits & 0x80000000UL) ? INT32_MIN : INT32_MAX;
+    }
+
+    // v = m * 2^(e - 150), the product with mul is exact in 64 bits
+    uint64_t p = (uint64_t)((bits & 0x7FFFFF) | 0x800000) * mul;
+    int s = e - 150 + shift;
+    if (s >= 0) {
+        if ((s > 31) || (p > ((uint64_t)INT32_MAX >> s)))
+            p = (uint64_t)INT32_MAX + 1;
+        else
+            p <<= s;
+    }
+    else {
+        p = (s > -64) ? (p >> -s) : 0;
+    }
+
+    if (bits & 0x80000000UL)
+        return (p > (uint64_t)INT32_MAX) ? INT32_MIN : -(int32_t)p;
+    return (p > (uint64_t)INT32_MAX) ? INT32_MAX : (int32_t)p;
+}
+
+
+// float to Q24, rounded and saturated, used while compiling tables only
+int32_t _toQ24(float v) {
+    float f = v * (float)MSFQ_Q24_ONE;
+    if (!(f > -2147483520.0f))
+        return (f < 0.0f) ? INT32_MIN : 0;
+    if (f >= 2147483520.0f)
+        return INT32_MAX;
+    return (int32_t)floorf(f + 0.5f);
+}
+
+
+// cubic segment k from its end values and end tangents scaled by the width
+void _setHermite(MSFQCalibQ* q, size_t k, float y0, float y1, float m0, float m1) {
+    float dy = y1 - y0;
+    q->a[k] = _toQ24(y0);
+    q->b[k] = _toQ24(m0);
+    q->c[k] = _toQ24(3.0f * dy - 2.0f * m0 - m1);
+    q->d[k] = _toQ24(m0 + m1 - 2.0f * dy);
+}
+
+
+void msfqCalibQInit(const StateTuneParRecords* records, const MSFQSpline* spline, MSFQInterp interp, MSFQCalibQ* q) {
+    const float* x = records->_tuneParMZ;
+    const float* y = records->_tuneParVal;
+    size_t n = records->_numberTuneParRecs;
+
+    q->n = n;
+    q->hunt = 0;
+    q->slope0 = 0;
+    q->slopeN = 0;
+    if (n < 1)
+        return;
+    q->x[0] = msfqFloatToFixed(x[0], 1, 16);
+    q->a[0] = _toQ24(y[0]);
+    if (n < 2)  // constant
+        return;
+    if (n < 3)  // tables with 2 points are linear for all kernels
+        interp = MSFQ_INTERP_LINEAR;
+
+    for (size_t k = 0; k + 1 < n; ++k) {
+        float h = x[k + 1] - x[k];
+        q->x[k + 1] = msfqFloatToFixed(x[k + 1], 1, 16);
+        int32_t hQ = q->x[k + 1] - q->x[k];
+        q->invH[k] = (hQ > 0) ? ((uint64_t)1 << 48) / (uint32_t)hQ : 0;
+        if (!(h > 0.0f) || (hQ <= 0)) {  // the float kernels return y[k]
+            _setHermite(q, k, y[k], y[k], 0.0f, 0.0f);
+            continue;
+        }
+
+        float dy = y[k + 1] - y[k];
+        switch (interp) {
+        case MSFQ_INTERP_LINEAR:
+            _setHermite(q, k, y[k], y[k + 1], dy, dy);
+            break;
+        case MSFQ_INTERP_MONOTONE:
+            _setHermite(q, k, y[k], y[k + 1], _monotoneTangent(x, y, n, k) * h, _monotoneTangent(x, y, n, k + 1) * h);
+            break;
+        default: {
+            // (1 - t) y0 + t y1 + h^2 / 6 (((1 - t)^3 - (1 - t)) y2[k] + (t^3 - t) y2[k + 1]) in powers of t
+            const float* y2 = spline->y2;
+            float h26 = h * h / 6.0f;
+            q->a[k] = _toQ24(y[k]);
+            q->b[k] = _toQ24(dy - h26 * (2.0f * y2[k] + y2[k + 1]));
+            q->c[k] = _toQ24(3.0f * h26 * y2[k]);
+            q->d[k] = _toQ24(h26 * (y2[k + 1] - y2[k]));
+        }
+        }
+    }
+    q->a[n - 1] = _toQ24(y[n - 1]);
+
+    // the end slopes of the float kernels
+    float h0 = x[1] - x[0];
+    float hN = x[n - 1] - x[n - 2];
+    float slope0 = (h0 > 0.0f) ? (y[1] - y[0]) / h0 : 0.0f;
+    float slopeN = (hN > 0.0f) ? (y[n - 1] - y[n - 2]) / hN : 0.0f;
+    if ((interp == MSFQ_INTERP_SPLINE) && (h0 > 0.0f) && (hN > 0.0f)) {
+        const float* y2 = spline->y2;
+        slope0 -= h0 * (2.0f * y2[0] + y2[1]) / 6.0f;
+        slopeN += hN * (y2[n - 2] + 2.0f * y2[n - 1]) / 6.0f;
+    }
+    q->slope0 = _toQ24(slope0);
+    q->slopeN = _toQ24(slopeN);
+}
+
+
+int32_t msfqInterpQ(MSFQCalibQ* q, int32_t mzQ) {
+    const int32_t* x = q->x;
+    size_t n = q->n;
+
+    if (n < 1)
+        return 0;
+    if (n < 2)
+        return q->a[0];
+    if (mzQ <= x[0])
+        return q->a[0] + (int32_t)(((int64_t)q->slope0 * ((int64_t)mzQ - x[0])) >> 16);
+    if (mzQ >= x[n - 1])
+        return q->a[n - 1] + (int32_t)(((int64_t)q->slopeN * ((int64_t)mzQ - x[n - 1])) >> 16);
+
+    // hunt from the last segment: the same or the next one, binary search otherwise
+    size_t k = q->hunt;
+    if ((k + 1 >= n) || (mzQ < x[k])) {
+        k = _findSegment(x, n, mzQ);
+    }
+    else if (mzQ >= x[k + 1]) {
+        k = ((k + 2 < n) && (mzQ < x[k + 2])) ? k + 1 : _findSegment(x, n, mzQ);
+    }
+    q->hunt = k;
+
+    // position in the segment, Q24, and the cubic in Horner form
+    int64_t t = (int64_t)(((uint64_t)(uint32_t)(mzQ - x[k]) * q->invH[k]) >> 24);
+    int64_t r = q->d[k];
+    r = q->c[k] + ((r * t) >> 24);
+    r = q->b[k] + ((r * t) >> 24);
+    return (int32_t)(q->a[k] + ((r * t) >> 24));
+}
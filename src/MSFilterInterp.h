@@ -0,0 +1,88 @@
+#ifndef MSFilterInterp_h
+#define MSFilterInterp_h
+
+#include <Arduino.h>
+#include "MSFilterQuad.h"
+
+
+// Interpolation kernels of calibration tables, see MSFQInterp.
+// The tables must be sorted by m/z and hold at least 2 points.
+// Outside the table all kernels extrapolate linearly from the end point.
+
+/// <summary>
+/// Piecewise linear interpolation. The segment is found by branch-free binary search.
+/// </summary>
+/// <param name="records">- calibration table</param>
+/// <param name="mz">- m/z</param>
+/// <returns>interpolated value</returns>
+float msfqInterpLinear(const StateTuneParRecords* records, float mz);
+
+/// <summary>
+/// Monotone piecewise cubic Hermite interpolation (Fritsch-Butland tangents).
+/// Does not overshoot between points, keeps monotone runs of the table monotone.
+/// Tangents are calculated from the neighbouring points, no preparation is needed.
+/// </summary>
+/// <param name="records">- calibration table</param>
+/// <param name="mz">- m/z</param>
+/// <returns>interpolated value</returns>
+float msfqInterpMonotone(const StateTuneParRecords* records, float mz);
+
+/// <summary>
+/// Calculates the natural cubic spline of a table (zero second derivative at the
+/// end points) in O(n) by the tridiagonal algorithm. Must be called after every
+/// change of the table. Tables with less than 3 points need no spline.
+/// </summary>
+/// <param name="records">- calibration table</param>
+/// <param name="spline">- output spline</param>
+void msfqSplineInit(const StateTuneParRecords* records, MSFQSpline* spline);
+
+/// <summary>
+/// Natural cubic spline interpolation. The segment search starts at the segment
+/// of the previous call, so ascending m/z walks the segments in O(1) per call;
+/// other orders are found by binary search. Outside the table the spline is
+/// continued linearly by its end slope.
+/// </summary>
+/// <param name="records">- calibration table</param>
+/// <param name="spline">- spline of the table, keeps the segment of this call</param>
+/// <param name="mz">- m/z</param>
+/// <returns>interpolated value</returns>
+float msfqInterpSpline(const StateTuneParRecords* records, MSFQSpline* spline, float mz);
+
+
+// Integer counterparts for MSFQ_FIXED_POINT, m/z in Q16 and values in Q24.
+
+#define MSFQ_Q24_ONE 16777216L
+
+/// <summary>
+/// Converts v * mul * 2^shift to an integer, rounded toward zero like a cast of
+/// the float product. Works on the bits of the float, no floating point operation
+/// is needed. Saturates to the range of int32_t, NaN is 0.
+/// </summary>
+/// <param name="v">- value</param>
+/// <param name="mul">- integer scale, e.g. 1000 for V to mV</param>
+/// <param name="shift">- binary scale, e.g. 16 for Q16</param>
+/// <returns>scaled value</returns>
+int32_t msfqFloatToFixed(float v, uint32_t mul, int shift);
+
+/// <summary>
+/// Compiles a calibration table for msfqInterpQ(). The result matches the float
+/// kernel interp (calculateCalib() for tables with less than 3 points), so it
+/// must be compiled again after every change of the table, its spline or the kernel.
+/// </summary>
+/// <param name="records">- calibration table</param>
+/// <param name="spline">- spline of the table, used by MSFQ_INTERP_SPLINE only</param>
+/// <param name="interp">- interpolation kernel</param>
+/// <param name="q">- output table</param>
+void msfqCalibQInit(const StateTuneParRecords* records, const MSFQSpline* spline, MSFQInterp interp, MSFQCalibQ* q);
+
+/// <summary>
+/// Evaluates a compiled calibration table in integer arithmetic. Like the spline,
+/// the segment search starts at the segment of the previous call.
+/// </summary>
+/// <param name="q">- compiled table, keeps the segment of this call</param>
+/// <param name="mzQ">- m/z, Q16</param>
+/// <returns>interpolated value, Q24</returns>
+int32_t msfqInterpQ(MSFQCalibQ* q, int32_t mzQ);
+
+
+#endif
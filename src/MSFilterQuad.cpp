@@ -1,33 +1,87 @@
 #include "MSFilterQuad.h"
+#include "MSFilterCalib.h"
+#include "MSFilterInterp.h"
 
 // #define TRACE_MSFQ(x_) printf("%d ms -> MSFilterQuad: ", millis()); x_
 #define TRACE_MSFQ(x_)
 
-void _initSpline(const StateTuneParRecords* records, CubicSplineInterp* spline) {
-    if (records->_numberTuneParRecs > 2)
-        spline->init(records->_tuneParMZ, records->_tuneParVal, records->_numberTuneParRecs);
+void _initSpline(const StateTuneParRecords* records, MSFQSpline* spline) {
+    msfqSplineInit(records, spline);
 }
 
+// tables with 3 or more points
+inline float _interpolate(
+    float mz,
+    const StateTuneParRecords* records,
+    MSFQSpline* spline,
+    MSFQInterp interp
+) {
+    switch (interp) {
+    case MSFQ_INTERP_LINEAR:
+        return msfqInterpLinear(records, mz);
+    case MSFQ_INTERP_MONOTONE:
+        return msfqInterpMonotone(records, mz);
+    default:
+        return msfqInterpSpline(records, spline, mz);
+    }
+}
+
+
+inline int32_t _limitDC(int32_t v) {
+    if (v < Q_SOURCE3_MIN_DC) return Q_SOURCE3_MIN_DC;
+    if (v > Q_SOURCE3_MAX_DC) return Q_SOURCE3_MAX_DC;
+    return v;
+}
+
+
+// float mV to the integer mV of the device, rounded to the nearest
+inline int32_t _roundMV(float mV) {
+    return (int32_t)lroundf(mV);
+}
+
+
+// holds the published calibration for the scope of a public method
+class MSFQCalibGuard {
+    MSFilterQuad* _filter;
+public:
+    MSFQCalibGuard(MSFilterQuad* filter): _filter(filter) { _filter->_acquireCalib(); }
+    ~MSFQCalibGuard() { _filter->_releaseCalib(); }
+};
+
 
 MSFilterQuad::MSFilterQuad(
     float r0,
     JanasCardQSource3* device,
     StateTuneParRecords* calibPntsRF,
     StateTuneParRecords* calibPntsDC
-): _r0(r0)
+)
+{
+    _init(r0, device, calibPntsRF, calibPntsDC);
+}
+
+
+void MSFilterQuad::_init(
+    float r0,
+    JanasCardQSource3* device,
+    StateTuneParRecords* calibPntsRF,
+    StateTuneParRecords* calibPntsDC
+)
 {
     // _dcFactor = 0.16784; // 1/2 * a0/q0 - theoretical value for infinity resolution
 
+    _r0 = r0;
     _device = device;
 
     _calibPntsRF = calibPntsRF;
-    _splineRF = new CubicSplineInterp();
-
     _calibPntsDC = calibPntsDC;
-    _splineDC = new CubicSplineInterp();
 
-    _initSpline(_calibPntsRF, _splineRF);
-    _initSpline(_calibPntsDC, _splineDC);
+    _initSpline(_calibPntsRF, &_splineRF);
+    _initSpline(_calibPntsDC, &_splineDC);
+#ifdef MSFQ_FIXED_POINT
+    _initCalibQ(MSFQ_CALIB_RF);
+    _initCalibQ(MSFQ_CALIB_DC);
+#endif
+    _setpointChanged();
 }
 
 
@@ -38,16 +92,210 @@ void MSFilterQuad::initRFFactor(float frequency) {
     _rfFactor = 7.22176e-8 * (_r0 * _r0 * frequency * frequency); // SI units
     _dcFactor = 0.16784 * _rfFactor;  // 1/2 * a0/q0 - theoretical value for infinity resolution
     _MAX_MZ = MAX_RF_AMP / _rfFactor;
+#ifdef MSFQ_FIXED_POINT
+    _rfFactorQ = (uint32_t)(_rfFactor * 2000 * 65536.0 + 0.5);  // V(0-p) -> mV(p-p)
+    _dcFactorQ = (uint32_t)(_dcFactor * 1000 * 65536.0 + 0.5);  // V -> mV
+    _maxMzQ = msfqFloatToFixed(_MAX_MZ, 1, 16);
+#endif
+    _setpointChanged();
 }
 
 
 void MSFilterQuad::initSplineRF() {
-    _initSpline(_calibPntsRF, _splineRF);
+    if (_calibBuffer != NULL) return;  // splines are calculated by MSFQCalibBuffer::publish()
+    _initSpline(_calibPntsRF, &_splineRF);
+#ifdef MSFQ_FIXED_POINT
+    _initCalibQ(MSFQ_CALIB_RF);
+#endif
+    _setpointChanged();
 }
 
 
 void MSFilterQuad::initSplineDC() {
-    _initSpline(_calibPntsDC, _splineDC);
+    if (_calibBuffer != NULL) return;
+    _initSpline(_calibPntsDC, &_splineDC);
+#ifdef MSFQ_FIXED_POINT
+    _initCalibQ(MSFQ_CALIB_DC);
+#endif
+    _setpointChanged();
+}
+
+
+void MSFilterQuad::setInterpolation(MSFQInterp interp) {
+    TRACE_MSFQ( printf("setInterpolation(%d)\r\n", interp); )
+    if (interp == _interp) return;
+    MSFQCalibGuard guard(this);
+    bool rebuildTable = isSetpointTableValid();
+    _interp = interp;
+#ifdef MSFQ_FIXED_POINT
+    _initCalibQ(MSFQ_CALIB_RF);
+    _initCalibQ(MSFQ_CALIB_DC);
+#endif
+    _setpointChanged();
+    if (rebuildTable) {
+        buildSetpointTable(_tableStep, _tableInterp);
+    }
+}
+
+
+void MSFilterQuad::_setpointChanged() {
+    ++_setpointVersion;  // invalidates the setpoint table
+}
+
+
+void MSFilterQuad::attachCalibBuffer(MSFQCalibBuffer* buffer) {
+    _calibBuffer = buffer;
+    _calibSnapshot = NULL;
+    _calibBufferVersion = 0;  // switch to the buffer at the next acquire
+}
+
+
+StateTuneParRecords* MSFilterQuad::_records(MSFQCalib calib) {
+    if (_calibSnapshot != NULL)
+        return (calib == MSFQ_CALIB_RF) ? &(_calibSnapshot->rf) : &(_calibSnapshot->dc);
+    return (calib == MSFQ_CALIB_RF) ? _calibPntsRF : _calibPntsDC;
+}
+
+
+MSFQSpline* MSFilterQuad::_spline(MSFQCalib calib) {
+    if (_calibSnapshot != NULL)
+        return (calib == MSFQ_CALIB_RF) ? &(_calibSnapshot->splineRF) : &(_calibSnapshot->splineDC);
+    return (calib == MSFQ_CALIB_RF) ? &_splineRF : &_splineDC;
+}
+
+
+// copies under the guard, the snapshot may be reused by the writer after the release
+void MSFilterQuad::getCalibPntsRF(StateTuneParRecords* out) {
+    MSFQCalibGuard guard(this);
+    *out = *_records(MSFQ_CALIB_RF);
+}
+
+
+void MSFilterQuad::getCalibPntsDC(StateTuneParRecords* out) {
+    MSFQCalibGuard guard(this);
+    *out = *_records(MSFQ_CALIB_DC);
+}
+
+
+void MSFilterQuad::_acquireCalib() {
+    if ((_calibBuffer == NULL) || (_calibDepth++ > 0)) return;
+
+    MSFQCalibSnapshot* s = _calibBuffer->acquire();
+    _calibSnapshot = s;
+    if (s->version != _calibBufferVersion) {
+        TRACE_MSFQ( printf("... calibration version %u\r\n", s->version); )
+        _calibBufferVersion = s->version;
+#ifdef MSFQ_FIXED_POINT
+        _initCalibQ(MSFQ_CALIB_RF);
+        _initCalibQ(MSFQ_CALIB_DC);
+#endif
+        _setpointChanged();
+    }
+}
+
+
+void MSFilterQuad::_releaseCalib() {
+    if ((_calibBuffer == NULL) || (--_calibDepth > 0)) return;
+    _calibBuffer->release();
+}
+
+
+void MSFilterQuad::_calibPntsChanged(MSFQCalib calib) {
+    bool rebuildTable = isSetpointTableValid();
+    if (calib == MSFQ_CALIB_RF) {
+        initSplineRF();
+    }
+    else {
+        initSplineDC();
+    }
+    if (rebuildTable) {
+        buildSetpointTable(_tableStep, _tableInterp);
+    }
+}
+
+
+bool MSFilterQuad::insertCalibPnt(MSFQCalib calib, float mz, float val) {
+    TRACE_MSFQ( printf("insertCalibPnt(%d, %d, %d)\r\n", calib, (int)(mz * 1000), (int)(val * 1000)); )
+    if (_calibBuffer != NULL) return false;
+    StateTuneParRecords* r = (calib == MSFQ_CALIB_RF) ? _calibPntsRF : _calibPntsDC;
+    size_t n = r->_numberTuneParRecs;
+
+    size_t i = 0;
+    while ((i < n) && (r->_tuneParMZ[i] < mz)) ++i;
+
+    if ((i < n) && (r->_tuneParMZ[i] == mz)) {
+        r->_tuneParVal[i] = val;
+    }
+    else {
+        if (n >= MAX_NUMBER_OF_TUNE_PAR_RECORDS) return false;
+        for (size_t j = n; j > i; --j) {
+            r->_tuneParMZ[j] = r->_tuneParMZ[j - 1];
+            r->_tuneParVal[j] = r->_tuneParVal[j - 1];
+        }
+        r->_tuneParMZ[i] = mz;
+        r->_tuneParVal[i] = val;
+        r->_numberTuneParRecs = n + 1;
+    }
+
+    _calibPntsChanged(calib);
+    return true;
+}
+
+
+bool MSFilterQuad::deleteCalibPnt(MSFQCalib calib, size_t idx) {
+    TRACE_MSFQ( printf("deleteCalibPnt(%d, %u)\r\n", calib, idx); )
+    if (_calibBuffer != NULL) return false;
+    StateTuneParRecords* r = (calib == MSFQ_CALIB_RF) ? _calibPntsRF : _calibPntsDC;
+    size_t n = r->_numberTuneParRecs;
+    if (idx >= n) return false;
+
+    for (size_t j = idx + 1; j < n; ++j) {
+        r->_tuneParMZ[j - 1] = r->_tuneParMZ[j];
+        r->_tuneParVal[j - 1] = r->_tuneParVal[j];
+    }
+    r->_numberTuneParRecs = n - 1;
+
+    _calibPntsChanged(calib);
+    return true;
+}
+
+
+bool MSFilterQuad::moveCalibPnt(MSFQCalib calib, size_t idx, float mz, float val) {
+    TRACE_MSFQ( printf("moveCalibPnt(%d, %u, %d, %d)\r\n", calib, idx, (int)(mz * 1000), (int)(val * 1000)); )
+    if (_calibBuffer != NULL) return false;
+    StateTuneParRecords* r = (calib == MSFQ_CALIB_RF) ? _calibPntsRF : _calibPntsDC;
+    size_t n = r->_numberTuneParRecs;
+    if (idx >= n) return false;
+
+    // shift the point to its sorted position
+    size_t i = idx;
+    while ((i > 0) && (r->_tuneParMZ[i - 1] > mz)) {
+        r->_tuneParMZ[i] = r->_tuneParMZ[i - 1];
+        r->_tuneParVal[i] = r->_tuneParVal[i - 1];
+        --i;
+    }
+    while ((i + 1 < n) && (r->_tuneParMZ[i + 1] < mz)) {
+        r->_tuneParMZ[i] = r->_tuneParMZ[i + 1];
+        r->_tuneParVal[i] = r->_tuneParVal[i + 1];
+        ++i;
+    }
+    r->_tuneParMZ[i] = mz;
+    r->_tuneParVal[i] = val;
+
+    // a point moved onto another one replaces it
+    size_t dup = n;
+    if ((i > 0) && (r->_tuneParMZ[i - 1] == mz)) dup = i - 1;
+    else if ((i + 1 < n) && (r->_tuneParMZ[i + 1] == mz)) dup = i + 1;
+    if (dup < n) {
+        for (size_t j = dup + 1; j < n; ++j) {
+            r->_tuneParMZ[j - 1] = r->_tuneParMZ[j];
+            r->_tuneParVal[j - 1] = r->_tuneParVal[j];
+        }
+        r->_numberTuneParRecs = n - 1;
+    }
+
+    _calibPntsChanged(calib);
+    return true;
 }
 
 bool MSFilterQuad::resetMZ() {
@@ -59,7 +307,8 @@ bool MSFilterQuad::resetMZ() {
 float calculateCalib(
     float mz,
     const StateTuneParRecords* records,
-    CubicSplineInterp* spline // can not be const because calcHunt change internal state
+    MSFQSpline* spline, // can not be const, the spline keeps the segment of the last call
+    MSFQInterp interp
 ) {
     if ( (records->_numberTuneParRecs) < 1 ) // none
         return 0;
@@ -75,17 +324,16 @@ float calculateCalib(
         return records->_tuneParVal[0];
     }
 
-    return spline->calcHunt(mz); // spline interpolation
+    return _interpolate(mz, records, spline, interp);
 }
 
 
 bool MSFilterQuad::setDCOffst(float v)
 {
     TRACE_MSFQ( printf("setDCOffst(%d)\r\n", (int)(v * 1000)); )
-
-    float diff = getDCDiff();
-
-    return (setDC1(v + diff) && setDC2(v - diff));
+    MSFQTransaction t(this);
+    t.setDCOffst(v);
+    return t.commit();
 }
 
 
@@ -93,11 +341,9 @@ bool MSFilterQuad::setRodPolarityPos(bool v)
 {
     TRACE_MSFQ( printf("setRodPolarityPos(%d)\r\n", v); )
     if (_polarity != v) {
-        if(setDCDiff(-getDCDiff()))
-        {
-            _polarity = v;
-            return true;
-        }
+        MSFQTransaction t(this);
+        t.setRodPolarityPos(v);
+        return t.commit();
     }
     return false;
 }
@@ -106,7 +352,10 @@ bool MSFilterQuad::setRodPolarityPos(bool v)
 bool MSFilterQuad::setDCOn(bool v)
 {
     TRACE_MSFQ( printf("setDCOn(%d)\r\n", v); )
-    _dcOn = v;
+    if (_dcOn != v) {
+        _dcOn = v;
+        _setpointChanged();
+    }
     return setMZ(_mz);
 }
 
@@ -122,9 +371,10 @@ bool MSFilterQuad::setDC1(float v)
     {
         v = MAX_DC;
     }
-    if (_device->writeDC(1, (int32_t)(v * 1000)))  // convert V to mV
+    int32_t mV = _roundMV(v * 1000);  // convert V to mV
+    if (_device->writeDC(1, mV))
     {
-        _dc1 = v;
+        _dc1 = mV;
         return true;
     }
     return false;
@@ -142,9 +392,10 @@ bool MSFilterQuad::setDC2(float v)
     {
         v = MAX_DC;
     }
-    if (_device->writeDC(2, (int32_t)(v * 1000)))  // convert V to mV
+    int32_t mV = _roundMV(v * 1000);  // convert V to mV
+    if (_device->writeDC(2, mV))
     {
-        _dc2 = v;
+        _dc2 = mV;
         return true;
     }
     return false;
@@ -157,16 +408,33 @@ float MSFilterQuad::calcMaxMz(void) const {
 
 
 float MSFilterQuad::calcRF(float mz) {
-    return _rfFactor * (1.0 + calculateCalib(mz, _calibPntsRF, _splineRF)) * mz;
+    MSFQCalibGuard guard(this);
+    return _rfFactor * (1.0 + calculateCalib(mz, _records(MSFQ_CALIB_RF), _spline(MSFQ_CALIB_RF), _interp)) * mz;
 }
 
 float MSFilterQuad::calcDC(float mz) {
-    return _dcFactor * (1.0 + calculateCalib(mz, _calibPntsDC, _splineDC)) * mz;
+    MSFQCalibGuard guard(this);
+    return _dcFactor * (1.0 + calculateCalib(mz, _records(MSFQ_CALIB_DC), _spline(MSFQ_CALIB_DC), _interp)) * mz;
 }
 
-// cca 240 us (w/o splines calculation)
+// cca 240 us on the DUE (w/o splines calculation), see extras/host/setmz_bench.cpp
 bool MSFilterQuad::setMZ(float mz) {
     TRACE_MSFQ( printf("setMZ(%d)\r\n", (int)(mz * 1000)); )
+    MSFQCalibGuard guard(this);
+    MSFQSetpoint sp;
+#ifdef MSFQ_FIXED_POINT
+    // no floating point operation from here on, the float is only stored
+    int32_t mzQ = msfqFloatToFixed(mz, 1, 16);
+    int32_t limited = _limitMzQ(mzQ);
+    if (limited != mzQ)
+    {
+        mz = (mzQ < 0) ? 0.0f : _MAX_MZ;
+    }
+    if (!_lookupSetpointQ(limited, &sp))
+    {
+        _calcSetpointQ(limited, &sp);
+    }
+#else
     if(mz < 0.0)
     {
         mz = 0.0;
@@ -175,9 +443,13 @@ bool MSFilterQuad::setMZ(float mz) {
     {
         mz = _MAX_MZ;
     }
-    float V = calcRF(mz); // RF amplitude
-    float U = calcDC(mz); // DC difference
-    if (setUV(U, V))
+    // in mV like calcUVBatch(), the offset is kept exactly
+    if (!lookupSetpoint(mz, &sp))
+    {
+        _calcSetpoint(mz, &sp);
+    }
+#endif
+    if (_setUVmV(sp.u, sp.ac))
     {
         _mz = mz;
         return true;
@@ -189,8 +461,9 @@ bool MSFilterQuad::setMZ(float mz) {
 bool MSFilterQuad::setDCDiff(float v)
 {
     TRACE_MSFQ( printf("setDCDiff(%d)\r\n", (int)(v * 1000)); )
-    float ofst = getDCOffst();
-    return (setDC1(ofst + v) && setDC2(ofst - v));
+    MSFQTransaction t(this);
+    t.setDCDiff(v);
+    return t.commit();
 }
 
 
@@ -205,9 +478,10 @@ bool MSFilterQuad::setRFAmp(float v)
     {
         v = MAX_RF_AMP;
     }
-    if (_device->writeAC((uint32_t)(v * 2000)))  // convert V(0-p) to mV(p-p)
+    uint32_t mV = (uint32_t)_roundMV(v * 2000);  // convert V(0-p) to mV(p-p)
+    if (_device->writeAC(mV))
     {
-        _rfAmp = v;
+        _rfAmp = mV;
         return true;
     }
     return false;
@@ -217,6 +491,10 @@ bool MSFilterQuad::setRFAmp(float v)
 bool MSFilterQuad::setVoltages(float rf, float dc1, float dc2)
 {
     TRACE_MSFQ( printf("setVoltages(%d, %d, %d)\r\n", (int)(rf * 1000), (int)(dc1 * 1000), (int)(dc2 * 1000)); )
+#ifdef MSFQ_FIXED_POINT
+    int32_t rfmV = msfqFloatToFixed(rf, 2000, 0);  // convert V(0-p) to mV(p-p)
+    return setVoltagesMV(msfqFloatToFixed(dc1, 1000, 0), msfqFloatToFixed(dc2, 1000, 0), (rfmV > 0) ? (uint32_t)rfmV : 0);
+#else
     if(rf < 0.0)
     {
         rf = 0.0;
@@ -244,23 +522,326 @@ bool MSFilterQuad::setVoltages(float rf, float dc1, float dc2)
         dc2 = MAX_DC;
     }
 
-    bool rc = _device->writeVoltages(
-        (int32_t)(dc1 * 1000),  // convert V to mV
-        (int32_t)(dc2 * 1000),  // convert V to mV
-        (uint32_t)(rf * 2000)  // convert V(0-p) to mV(p-p)
-    );
+    int32_t dc1mV = _roundMV(dc1 * 1000);  // convert V to mV
+    int32_t dc2mV = _roundMV(dc2 * 1000);  // convert V to mV
+    uint32_t rfmV = (uint32_t)_roundMV(rf * 2000);  // convert V(0-p) to mV(p-p)
+
+    bool rc = _device->writeVoltages(dc1mV, dc2mV, rfmV);
     if (rc) {
+        _dc1 = dc1mV;
+        _dc2 = dc2mV;
+        _rfAmp = rfmV;
+        return true;
+    }
+    return false;
+#endif
+}
+
+
+bool MSFilterQuad::setVoltagesMV(int32_t dc1, int32_t dc2, uint32_t ac)
+{
+    TRACE_MSFQ( printf("setVoltagesMV(%d, %d, %u)\r\n", dc1, dc2, ac); )
+    if (ac > Q_SOURCE3_MAX_AC)
+    {
+        ac = Q_SOURCE3_MAX_AC;
+    }
+    return _setVoltagesMV(_limitDC(dc1), _limitDC(dc2), ac);
+}
+
+
+bool MSFilterQuad::setUVmV(int32_t u, uint32_t ac)
+{
+    TRACE_MSFQ( printf("setUVmV(%d, %u)\r\n", u, ac); )
+    if (!_dcOn)
+    {
+        u = 0;
+    }
+    else if (!_polarity)
+    {
+        u = -u;
+    }
+    return _setUVmV(u, ac);
+}
+
+
+// integer counterpart of setUV(), u and ac in device units
+bool MSFilterQuad::_setUVmV(int32_t u, uint32_t ac)
+{
+    TRACE_MSFQ( printf("_setUVmV(%d, %u)\r\n", u, ac); )
+    int32_t dcOffst = getDCOffstMV();
+    if (ac > Q_SOURCE3_MAX_AC)
+    {
+        ac = Q_SOURCE3_MAX_AC;
+    }
+    return _setVoltagesMV(_limitDC(dcOffst + u), _limitDC(dcOffst - u), ac);
+}
+
+
+// integer counterpart of setVoltages(), values already limited
+bool MSFilterQuad::_setVoltagesMV(int32_t dc1, int32_t dc2, uint32_t ac)
+{
+    if (_device->writeVoltages(dc1, dc2, ac)) {
         _dc1 = dc1;
         _dc2 = dc2;
-        _rfAmp = rf;
+        _rfAmp = ac;
         return true;
     }
     return false;
 }
 
 
+#ifdef MSFQ_FIXED_POINT
+void MSFilterQuad::_initCalibQ(MSFQCalib calib)
+{
+    msfqCalibQInit(_records(calib), _spline(calib), _interp, (calib == MSFQ_CALIB_RF) ? &_calibQRF : &_calibQDC);
+}
+
+
+int32_t MSFilterQuad::_limitMzQ(int32_t mzQ) const
+{
+    if (mzQ < 0) return 0;
+    if (mzQ > _maxMzQ) return _maxMzQ;
+    return mzQ;
+}
+
+
+void MSFilterQuad::_calcSetpoint(float mz, MSFQSetpoint* sp)
+{
+    _calcSetpointQ(msfqFloatToFixed(mz, 1, 16), sp);
+}
+
+
+void MSFilterQuad::_calcSetpointQ(int32_t mzQ, MSFQSetpoint* sp)
+{
+    // factor * m/z is reduced to mV in Q8 so that the product
+    // with (1 + correction) in Q24 fits into 64 bits
+    int64_t v = ((int64_t)_rfFactorQ * mzQ) >> 24;
+    v = (v * (MSFQ_Q24_ONE + msfqInterpQ(&_calibQRF, mzQ))) >> 32;
+    if (v < 0)
+    {
+        v = 0;
+    }
+    else if (v > Q_SOURCE3_MAX_AC)
+    {
+        v = Q_SOURCE3_MAX_AC;
+    }
+    sp->ac = (uint32_t)v;
+
+    if (!_dcOn)
+    {
+        sp->u = 0;
+        return;
+    }
+    int64_t u = ((int64_t)_dcFactorQ * mzQ) >> 24;
+    u = (u * (MSFQ_Q24_ONE + msfqInterpQ(&_calibQDC, mzQ))) >> 32;
+    sp->u = _polarity ? (int32_t)u : -(int32_t)u;
+}
+#else
+void MSFilterQuad::_calcSetpoint(float mz, MSFQSetpoint* sp)
+{
+    float v = calcRF(mz);
+    if (v < 0.0)
+    {
+        v = 0.0;
+    }
+    else if (v > MAX_RF_AMP)
+    {
+        v = MAX_RF_AMP;
+    }
+    sp->ac = (uint32_t)_roundMV(v * 2000);  // convert V(0-p) to mV(p-p)
+
+    if (!_dcOn)
+    {
+        sp->u = 0;
+        return;
+    }
+    int32_t u = _roundMV(calcDC(mz) * 1000);  // convert V to mV
+    sp->u = _polarity ? u : -u;
+}
+#endif
+
+
+void MSFilterQuad::calcUVBatch(const float* mz, size_t n, int32_t* dc1, int32_t* dc2, uint32_t* ac)
+{
+    TRACE_MSFQ( printf("calcUVBatch(n=%u)\r\n", n); )
+    MSFQCalibGuard guard(this);
+    int32_t dcOffst = getDCOffstMV();
+    bool useTable = isSetpointTableValid();
+    MSFQSetpoint sp;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+#ifdef MSFQ_FIXED_POINT
+        int32_t x = _limitMzQ(msfqFloatToFixed(mz[i], 1, 16));
+        if (!(useTable && _lookupSetpointQ(x, &sp)))
+        {
+            _calcSetpointQ(x, &sp);
+        }
+#else
+        float x = mz[i];
+        if (x < 0.0)
+        {
+            x = 0.0;
+        }
+        else if (x > _MAX_MZ)
+        {
+            x = _MAX_MZ;
+        }
+
+        if (useTable)
+        {
+            lookupSetpoint(x, &sp);
+        }
+        else
+        {
+            _calcSetpoint(x, &sp);
+        }
+#endif
+
+        dc1[i] = _limitDC(dcOffst + sp.u);
+        dc2[i] = _limitDC(dcOffst - sp.u);
+        ac[i] = sp.ac;
+    }
+}
+
+
+void MSFilterQuad::attachSetpointTable(MSFQSetpoint* table, size_t capacity)
+{
+    _table = table;
+    _tableCapacity = (table == NULL) ? 0 : capacity;
+    _tableLen = 0;
+    _tableBuilt = false;
+}
+
+
+// cca N x (calcRF + calcDC), call it outside of the scan
+bool MSFilterQuad::buildSetpointTable(float mzStep, bool interpolate)
+{
+    TRACE_MSFQ( printf("buildSetpointTable(%d)\r\n", (int)(mzStep * 1000)); )
+    MSFQCalibGuard guard(this);
+    _tableBuilt = false;
+    if ((_table == NULL) || !(mzStep > 0.0))
+    {
+        return false;
+    }
+
+#ifdef MSFQ_FIXED_POINT
+    // the points lie on the Q16 grid, so that the integer lookup finds them exactly
+    int32_t stepQ = msfqFloatToFixed(mzStep, 1, 16);
+    if (stepQ <= 0)
+    {
+        return false;
+    }
+    size_t n = (size_t)(_maxMzQ / stepQ) + 2;  // the last point lies beyond max m/z
+#else
+    size_t n = (size_t)(_MAX_MZ / mzStep) + 2;  // the last point lies beyond max m/z
+#endif
+    if (n > _tableCapacity)
+    {
+        TRACE_MSFQ( printf("... table too small, %u points needed\r\n", n); )
+        return false;
+    }
+
+    // ascending m/z keeps the spline search in neighbouring segments
+    for (size_t i = 0; i < n; ++i)
+    {
+#ifdef MSFQ_FIXED_POINT
+        _calcSetpointQ((int32_t)i * stepQ, &(_table[i]));
+#else
+        _calcSetpoint(i * mzStep, &(_table[i]));
+#endif
+    }
+
+#ifdef MSFQ_FIXED_POINT
+    _tableStepQ = stepQ;
+    _tableInvStepQ = ((uint64_t)1 << 48) / (uint32_t)stepQ;
+#endif
+
+    _tableLen = n;
+    _tableStep = mzStep;
+    _tableInvStep = 1.0 / mzStep;
+    _tableInterp = interpolate;
+    _tableVersion = _setpointVersion;
+    _tableBuilt = true;
+    return true;
+}
+
+
+// linear blend of neighbouring entries, f is the 16 bit fraction of the grid step
+inline void _blendSetpoint(const MSFQSetpoint& a, const MSFQSetpoint& b, int32_t f, MSFQSetpoint* sp)
+{
+    sp->u = a.u + (int32_t)(((int64_t)(b.u - a.u) * f) >> 16);
+    sp->ac = (uint32_t)((int32_t)a.ac + (int32_t)(((int64_t)((int32_t)b.ac - (int32_t)a.ac) * f) >> 16));
+}
+
+
+bool MSFilterQuad::lookupSetpoint(float mz, MSFQSetpoint* sp) const
+{
+#ifdef MSFQ_FIXED_POINT
+    return _lookupSetpointQ(msfqFloatToFixed(mz, 1, 16), sp);
+#else
+    if (!isSetpointTableValid())
+    {
+        return false;
+    }
+
+    float pos = (mz > 0.0 ? mz : 0.0) * _tableInvStep;
+    size_t i = (size_t)pos;
+    if (i >= _tableLen - 1)
+    {
+        *sp = _table[_tableLen - 1];
+        return true;
+    }
+
+    float frac = pos - (float)i;
+    if (!_tableInterp)
+    {
+        *sp = _table[frac < 0.5 ? i : i + 1];
+        return true;
+    }
+
+    _blendSetpoint(_table[i], _table[i + 1], (int32_t)(frac * 65536), sp);
+    return true;
+#endif
+}
+
+
+#ifdef MSFQ_FIXED_POINT
+bool MSFilterQuad::_lookupSetpointQ(int32_t mzQ, MSFQSetpoint* sp) const
+{
+    if (!isSetpointTableValid())
+    {
+        return false;
+    }
+
+    uint32_t x = (mzQ > 0) ? (uint32_t)mzQ : 0;
+    size_t i = x / (uint32_t)_tableStepQ;
+    if (i >= _tableLen - 1)
+    {
+        *sp = _table[_tableLen - 1];
+        return true;
+    }
+
+    // the remainder is less than the step, so the product fits into 48 bits
+    uint32_t rem = x - (uint32_t)i * (uint32_t)_tableStepQ;
+    int32_t f = (int32_t)(((uint64_t)rem * _tableInvStepQ) >> 32);
+    if (!_tableInterp)
+    {
+        *sp = _table[f < 32768 ? i : i + 1];
+        return true;
+    }
+    _blendSetpoint(_table[i], _table[i + 1], f, sp);
+    return true;
+}
+#endif
+
+
 bool MSFilterQuad::setUV(float u, float v) {
     TRACE_MSFQ( printf("setUV(%d, %d)\r\n", (int)(u * 1000), (int)(v * 1000)); )
+#ifdef MSFQ_FIXED_POINT
+    int32_t ac = msfqFloatToFixed(v, 2000, 0);  // convert V(0-p) to mV(p-p)
+    return setUVmV(msfqFloatToFixed(u, 1000, 0), (ac > 0) ? (uint32_t)ac : 0);
+#else
     float dcOffst = getDCOffst();
     float dc1 = dcOffst;
     float dc2 = dcOffst;
@@ -276,6 +857,7 @@ bool MSFilterQuad::setUV(float u, float v) {
         }
     }
     return setVoltages(v, dc1, dc2);
+#endif
 }
 
 
@@ -299,6 +881,142 @@ bool MSFilterQuad::setFreq(float v)
 }
 
 
+// V -> mV, limited to the device range
+inline int32_t _toDCmV(float v) {
+    if (v < MIN_DC) return Q_SOURCE3_MIN_DC;
+    if (v > MAX_DC) return Q_SOURCE3_MAX_DC;
+    return _roundMV(v * 1000);
+}
+
+
+MSFQTransaction::MSFQTransaction(MSFilterQuad* filter): _filter(filter)
+{
+    begin();
+}
+
+
+void MSFQTransaction::begin()
+{
+    _dc1 = _filter->_dc1;
+    _dc2 = _filter->_dc2;
+    _ac = _filter->_rfAmp;
+    _polarity = _filter->_polarity;
+    _dcOn = _filter->_dcOn;
+    _recalc = false;
+}
+
+
+void MSFQTransaction::setDC1(float v)
+{
+    _dc1 = _toDCmV(v);
+}
+
+
+void MSFQTransaction::setDC2(float v)
+{
+    _dc2 = _toDCmV(v);
+}
+
+
+void MSFQTransaction::setDCOffst(float v)
+{
+    int32_t ofst = _toDCmV(v);
+    // an odd difference puts its extra mV on DC1, see msfqFloorHalf()
+    int32_t diff = _dc1 - _dc2;
+    int32_t half = msfqFloorHalf(diff);
+    _dc1 = _limitDC(ofst + diff - half);
+    _dc2 = _limitDC(ofst - half);
+}
+
+
+void MSFQTransaction::setDCDiff(float v)
+{
+    int32_t ofst = msfqFloorHalf(_dc1 + _dc2);
+    int32_t diff = _toDCmV(v);
+    _dc1 = _limitDC(ofst + diff);
+    _dc2 = _limitDC(ofst - diff);
+}
+
+
+void MSFQTransaction::setRFAmp(float v)
+{
+    if(v < 0.0)
+    {
+        v = 0.0;
+    }
+    else if(v > MAX_RF_AMP)
+    {
+        v = MAX_RF_AMP;
+    }
+    _ac = (uint32_t)_roundMV(v * 2000);  // convert V(0-p) to mV(p-p)
+}
+
+
+void MSFQTransaction::setRodPolarityPos(bool v)
+{
+    if (_polarity != v)
+    {
+        // mirror the DC difference around the offset
+        int32_t dc1 = _dc1;
+        _dc1 = _dc2;
+        _dc2 = dc1;
+        _polarity = v;
+    }
+}
+
+
+void MSFQTransaction::setDCOn(bool v)
+{
+    _dcOn = v;
+    _recalc = true;
+}
+
+
+bool MSFQTransaction::commit()
+{
+    TRACE_MSFQ( printf("MSFQTransaction::commit()\r\n"); )
+    MSFilterQuad* f = _filter;
+    bool polarity = f->_polarity;
+    bool dcOn = f->_dcOn;
+    bool changed = (_polarity != polarity) || (_dcOn != dcOn);
+
+    int32_t dc1 = _dc1;
+    int32_t dc2 = _dc2;
+    uint32_t ac = _ac;
+    if (_recalc)
+    {
+        MSFQCalibGuard guard(f);
+        MSFQSetpoint sp;
+        f->_polarity = _polarity;
+        f->_dcOn = _dcOn;
+        // the setpoint table is compiled for the old flags
+        if (changed || !f->lookupSetpoint(f->_mz, &sp))
+        {
+            f->_calcSetpoint(f->_mz, &sp);
+        }
+        int32_t ofst = msfqFloorHalf(dc1 + dc2);
+        dc1 = _limitDC(ofst + sp.u);
+        dc2 = _limitDC(ofst - sp.u);
+        ac = sp.ac;
+    }
+
+    if (!f->_setVoltagesMV(dc1, dc2, ac))
+    {
+        f->_polarity = polarity;
+        f->_dcOn = dcOn;
+        return false;
+    }
+    f->_polarity = _polarity;
+    f->_dcOn = _dcOn;
+    if (changed)
+    {
+        f->_setpointChanged();
+    }
+    begin();
+    return true;
+}
+
+
 MSFilterQuad3::MSFilterQuad3(
     float r0,
     JanasCardQSource3* device,
@@ -310,7 +1028,7 @@ MSFilterQuad3::MSFilterQuad3(
 
     for(int i = 0; i < 3; ++i)
     {
-        _msfq[i] = MSFilterQuad(
+        _msfq[i]._init(
             r0,
             device,
             &(calibPntsRF[i]),
@@ -323,7 +1041,6 @@ bool MSFilterQuad3::init()
 {
     TRACE_MSFQ( printf("init()\r\n"); )
     int delay_ms = 10;
-    int delay_ms2 = 10;
 
     // Activate RS485 mode
     TRACE_MSFQ( printf("... activate RS485 mode...\r\n"); )
@@ -334,6 +1051,13 @@ bool MSFilterQuad3::init()
     }
     delay(delay_ms);
 
+    // a device that does not answer fails below, the guard time is then kept
+    TRACE_MSFQ( printf("... measure guard time...\r\n"); )
+    if (!_device->measureGuardTime())
+    {
+        TRACE_MSFQ( printf("... no response, guard time %u us\r\n", _device->getGuardTime()); )
+    }
+
     //turn off RF and DC
     TRACE_MSFQ( printf("... turn off RF and DC...\r\n"); )
     if (!_device->writeVoltages(0, 0, 0))
@@ -341,40 +1065,35 @@ bool MSFilterQuad3::init()
         TRACE_MSFQ( printf("... ERROR\r\n"); )
         return false;
     }
-    delay(delay_ms);
 
-    // read frequencies of all 3 ranges stored in the device n
+    // read frequencies of all 3 ranges stored in the device
     // and calculate RF calibration factor
+    static const char* const ranges[3] = {"#B 0", "#B 1", "#B 2"};
     for(int i = 0; i < 3; ++i)
     {
-        TRACE_MSFQ( printf("... set freq range %d ...\r\n", i); )
-        if (!_device->writeFreqRange(i))
+        // the range and its stored frequency in one burst
+        TRACE_MSFQ( printf("... [%d]: read stored freq ...\r\n", i); )
+        QSource3Cmd cmds[2] = {{ranges[i], true}, {"#G", false}};
+        if (!_device->pipeline(cmds, 2))
         {
             TRACE_MSFQ( printf("... ERROR\r\n"); )
             return false;
         }
-        delay(delay_ms2);
 
-        TRACE_MSFQ( printf("... [%d]: read stored freq ...\r\n", i); )
-        int32_t f = _device->readFreq();
-        delay(delay_ms);
-
-        if (f < 0)
+        int32_t f = strtol(cmds[1].response, NULL, 10);
+        if (f <= 0)
         {
-            TRACE_MSFQ( printf("... ERROR\r\n"); )
+            TRACE_MSFQ( printf("... [%d]: ERROR, stored freq = \"%s\"\r\n", i, cmds[1].response); )
             return false;
         }
         TRACE_MSFQ( printf("... [%d]: stored freq = %d\r\n", i, f); )
-
-        TRACE_MSFQ( printf("... [%d]: initRFFactor ...\r\n", i); )
         _msfq[i].initRFFactor((float)f * 100.0);
 
+        // zero in this range, the pipeline made the frame go out
         TRACE_MSFQ( printf("... [%d]: setVoltages(0, 0, 0) ...\r\n", i); )
         _msfq[i].setVoltages(0, 0, 0);
         _msfq[i]._mz = 0;
 
-        delay(delay_ms);
-
         TRACE_MSFQ( printf("... [%d]: check if connected ...\r\n", i); )
         if (!isConnected())
         {
@@ -3,19 +3,85 @@
 
 #include <Arduino.h>
 #include <JanasCardQSource3.h>
-#include <CubicSplineInterp.h>
+#include "MSFilterQuadConfig.h"
 
 #define MAX_RF_AMP (Q_SOURCE3_MAX_AC / 1000.0 / 2.0)
 #define MAX_DC (Q_SOURCE3_MAX_DC / 1000.0)
 #define MIN_DC (Q_SOURCE3_MIN_DC / 1000.0)
 
-#define MAX_NUMBER_OF_TUNE_PAR_RECORDS CSI_MAX_TAB_POINTS
+class MSFQCalibBuffer;
+struct MSFQCalibSnapshot;
 
-static struct StateTuneParRecords {
+struct StateTuneParRecords {
     size_t _numberTuneParRecs;
     float _tuneParMZ[MAX_NUMBER_OF_TUNE_PAR_RECORDS];
     float _tuneParVal[MAX_NUMBER_OF_TUNE_PAR_RECORDS];
-} _stateTuneParRecords;
+};
+
+
+/// <summary>
+/// Natural cubic spline of a calibration table, see msfqSplineInit() in MSFilterInterp.h.
+/// Holds the second derivatives at the points only, the points stay in the table.
+/// </summary>
+struct MSFQSpline {
+    float y2[MAX_NUMBER_OF_TUNE_PAR_RECORDS];
+    size_t hunt;  // segment of the last evaluation, the search starts there
+};
+
+
+enum MSFQCalib {
+    MSFQ_CALIB_RF,  // RF amplitude calibration (m/z calibration)
+    MSFQ_CALIB_DC   // DC difference calibration (resolution)
+};
+
+
+/// <summary>
+/// Interpolation of calibration tables with 3 or more points.
+/// Tables with 1 point are constant and with 2 points linear for all kernels.
+/// </summary>
+enum MSFQInterp {
+    MSFQ_INTERP_SPLINE,   // natural cubic spline (MSFQSpline)
+    MSFQ_INTERP_LINEAR,   // piecewise linear, fastest
+    MSFQ_INTERP_MONOTONE  // monotone cubic (PCHIP), no overshoot between points
+};
+
+// kernel used by newly created filters
+#ifndef MSFQ_INTERP_DEFAULT
+#define MSFQ_INTERP_DEFAULT MSFQ_INTERP_SPLINE
+#endif
+
+
+/// <summary>
+/// One entry of the compiled setpoint table, see <see cref="MSFilterQuad::buildSetpointTable"></see>.
+/// Holds device units ready for JanasCardQSource3::writeVoltages(). Polarity and DC on/off
+/// are already applied to u, so DC1 = offset + u and DC2 = offset - u.
+/// </summary>
+struct MSFQSetpoint {
+    int32_t u;   // DC difference in mV
+    uint32_t ac; // RF amplitude in mV (p-p)
+};
+
+// v / 2 rounded down, the DC offset in mV is msfqFloorHalf(DC1 + DC2):
+// DC1 and DC2 with an odd difference keep the offset they were split from
+inline int32_t msfqFloorHalf(int32_t v) { return (v >= 0) ? v / 2 : -((1 - v) / 2); }
+
+/// <summary>
+/// Calibration table compiled for the integer pipeline (MSFQ_FIXED_POINT), see
+/// msfqCalibQInit() in MSFilterInterp.h. Every kernel is held as a piecewise cubic
+/// in the position t (0 to 1) within the segment: a + b*t + c*t^2 + d*t^3.
+/// </summary>
+struct MSFQCalibQ {
+    size_t n;        // number of points, 0 means no correction
+    size_t hunt;     // segment of the last evaluation, the search starts there
+    int32_t slope0;  // extrapolation below the first point, Q24 per m/z
+    int32_t slopeN;  // extrapolation above the last point, Q24 per m/z
+    int32_t x[MAX_NUMBER_OF_TUNE_PAR_RECORDS];     // m/z of the points, Q16
+    uint64_t invH[MAX_NUMBER_OF_TUNE_PAR_RECORDS]; // 2^48 / segment width in Q16
+    int32_t a[MAX_NUMBER_OF_TUNE_PAR_RECORDS];     // coefficients of the segments, Q24
+    int32_t b[MAX_NUMBER_OF_TUNE_PAR_RECORDS];
+    int32_t c[MAX_NUMBER_OF_TUNE_PAR_RECORDS];
+    int32_t d[MAX_NUMBER_OF_TUNE_PAR_RECORDS];
+};
 
 
 /// <summary>
@@ -24,6 +90,9 @@ static struct StateTuneParRecords {
 class MSFilterQuad
 {
     friend class MSFilterQuad3;
+    friend class MSFilterScan;
+    friend class MSFilterSIM;
+    friend class MSFQTransaction;
 
 private:
     float _r0 = 0.0;
@@ -34,21 +103,74 @@ private:
     // bool _connected = false;
 
     float _mz = 0.0;
-    float _dc1 = 0.0;
-    float _dc2 = 0.0;
-    float _rfAmp = 0.0;
+    int32_t _dc1 = 0;    // mV, as written to the device
+    int32_t _dc2 = 0;    // mV, as written to the device
+    uint32_t _rfAmp = 0; // mV (p-p), as written to the device
     bool _polarity = true;
     bool _dcOn = true;
 
     float _MAX_MZ = 0.0;
 
+    // incremented on every change of the m/z -> voltage mapping
+    uint32_t _setpointVersion = 0;
+
+    MSFQSetpoint* _table = NULL;
+    size_t _tableCapacity = 0;
+    size_t _tableLen = 0;
+    float _tableStep = 0.0;
+    float _tableInvStep = 0.0;
+    bool _tableInterp = true;
+    uint32_t _tableVersion = 0;
+    bool _tableBuilt = false;
+
     JanasCardQSource3* _device;
 
     StateTuneParRecords* _calibPntsRF;
     StateTuneParRecords* _calibPntsDC;
 
-    CubicSplineInterp* _splineRF;
-    CubicSplineInterp* _splineDC;
+    // spline state is held by value, a filter needs no heap
+    MSFQSpline _splineRF;
+    MSFQSpline _splineDC;
+    MSFQInterp _interp = MSFQ_INTERP_DEFAULT;
+
+    MSFQCalibBuffer* _calibBuffer = NULL;
+    MSFQCalibSnapshot* _calibSnapshot = NULL;  // last acquired from _calibBuffer
+    uint32_t _calibBufferVersion = 0;
+    uint8_t _calibDepth = 0;
+
+#ifdef MSFQ_FIXED_POINT
+    uint32_t _rfFactorQ; // mV (p-p) per m/z, Q16
+    uint32_t _dcFactorQ; // mV per m/z, Q16
+    int32_t _maxMzQ = 0; // Q16
+    int32_t _tableStepQ = 0;   // Q16
+    uint64_t _tableInvStepQ = 0; // 2^48 / _tableStepQ
+    MSFQCalibQ _calibQRF;
+    MSFQCalibQ _calibQDC;
+
+    void _initCalibQ(MSFQCalib calib);
+    int32_t _limitMzQ(int32_t mzQ) const;
+    void _calcSetpointQ(int32_t mzQ, MSFQSetpoint* sp);
+    bool _lookupSetpointQ(int32_t mzQ, MSFQSetpoint* sp) const;
+#endif
+
+    void _init(
+        float r0,
+        JanasCardQSource3* device,
+        StateTuneParRecords* calibPntsRF,
+        StateTuneParRecords* calibPntsDC
+    );
+    StateTuneParRecords* _records(MSFQCalib calib);
+    MSFQSpline* _spline(MSFQCalib calib);
+
+    void _setpointChanged(void);
+    void _calibPntsChanged(MSFQCalib calib);
+
+    friend class MSFQCalibGuard;
+    void _acquireCalib(void);
+    void _releaseCalib(void);
+    void _calcSetpoint(float mz, MSFQSetpoint* sp);
+    bool _setUVmV(int32_t u, uint32_t ac);
+    bool _setVoltagesMV(int32_t dc1, int32_t dc2, uint32_t ac);
 
 public:
     MSFilterQuad() = default;
@@ -90,7 +212,7 @@ public:
     /// </summary>
     /// <param name=""></param>
     /// <returns>a casched value of DC voltage</returns>
-    float getDC1(void) const { return _dc1; }
+    float getDC1(void) const { return _dc1 / 1000.0; }
 
     /// <summary>
     /// Sets DC voltage of quadrupole rods 2.
@@ -104,12 +226,12 @@ public:
     /// </summary>
     /// <param name=""></param>
     /// <returns>a casched value of DC voltage</returns>
-    float getDC2(void) const { return _dc2; }
+    float getDC2(void) const { return _dc2 / 1000.0; }
 
     /// <summary>
     /// Sets DC differential voltage of the quadrupole rods referenced to
     /// the offset of the quadrupole (quadrupole field axis).
-    /// Keeps the offset.
+    /// Keeps the offset. Both DC voltages are written in one frame.
     ///
     /// DC1 = offset + v,
     /// DC2 = offset - v.
@@ -124,7 +246,7 @@ public:
     /// </summary>
     /// <param name=""></param>
     /// <returns>(DC1 - DC2) / 2</returns>
-    float getDCDiff(void) const { return (_dc1 - _dc2) / 2; }
+    float getDCDiff(void) const { return (_dc1 - _dc2) / 2000.0; }
 
     /// <summary>
     /// Sets RF amplitude.
@@ -138,7 +260,7 @@ public:
     /// </summary>
     /// <param name=""></param>
     /// <returns>RF amplitude, 0 to Vpp.</returns>
-    float getRFAmp(void) const { return _rfAmp; }
+    float getRFAmp(void) const { return _rfAmp / 2000.0; }
 
     /// <summary>
     /// Sets DC and RF voltages.
@@ -149,9 +271,20 @@ public:
     /// <returns>true if last communication was successfull</returns>
     bool setVoltages(float rf, float dc1, float dc2);
 
+    /// <summary>
+    /// Sets DC and RF voltages in device units, the integer counterpart of
+    /// <see cref="setVoltages"></see>. The values are limited to the ranges of the device.
+    /// </summary>
+    /// <param name="dc1">- DC1 voltage in mV</param>
+    /// <param name="dc2">- DC2 voltage in mV</param>
+    /// <param name="ac">- RF amplitude in mV (p-p)</param>
+    /// <returns>true if last communication was successfull</returns>
+    bool setVoltagesMV(int32_t dc1, int32_t dc2, uint32_t ac);
+
     /// <summary>
     /// Sets DC offset (field axis of the quadrupole).
-    /// Keeps DC difference.
+    /// Keeps DC difference, also an odd DC1 - DC2 in mV. Both DC voltages are
+    /// written in one frame.
     /// </summary>
     /// <param name="v">- DC offset value in Volts.</param>
     /// <returns>true if last communication was successfull</returns>
@@ -162,7 +295,11 @@ public:
     /// </summary>
     /// <param name=""></param>
     /// <returns>DC offset on Volts.</returns>
-    float getDCOffst(void) const { return (_dc1 + _dc2) / 2; }
+    float getDCOffst(void) const { return (_dc1 + _dc2) / 2000.0; }
+
+    /// <returns>DC offset in mV, as applied by setMZ() and calcUVBatch(),
+    /// rounded down when DC1 - DC2 is odd</returns>
+    int32_t getDCOffstMV(void) const { return msfqFloorHalf(_dc1 + _dc2); }
 
     /// <summary>
     /// Sets rod polarity.
@@ -192,6 +329,15 @@ public:
     /// <returns>true if last communication was successfull</returns>
     bool setUV(float u, float v);
 
+    /// <summary>
+    /// Sets DC difference and RF amplitude in device units, the integer counterpart
+    /// of <see cref="setUV"></see>. Keeps DC offset, applies polarity and DC on/off.
+    /// </summary>
+    /// <param name="u">- DC difference in mV</param>
+    /// <param name="ac">- RF amplitude in mV (p-p)</param>
+    /// <returns>true if last communication was successfull</returns>
+    bool setUVmV(int32_t u, uint32_t ac);
+
     /// <summary>
     /// Recalculates spline calibration for RF amplitude (m/z calibration).
     /// Must be invoked after each change in <see cref="recordsRF"></see>.
@@ -206,8 +352,19 @@ public:
     /// <param name=""></param>
     void initSplineDC(void);
 
+    /// <summary>
+    /// Selects the interpolation kernel of both calibration tables.
+    /// The default is MSFQ_INTERP_DEFAULT.
+    /// </summary>
+    /// <param name="interp">- interpolation kernel</param>
+    void setInterpolation(MSFQInterp interp);
+
+    MSFQInterp getInterpolation(void) const { return _interp; }
+
     /// <summary>
     /// Sets m/z.
+    /// With MSFQ_FIXED_POINT the m/z is converted to Q16 without floating point
+    /// operations and the voltages are calculated by the integer pipeline.
     /// </summary>
     /// <param name="v"></param>
     /// <returns>true if last communication was successfull</returns>
@@ -237,15 +394,206 @@ public:
     /// <returns>true when DC on, false otherwise.</returns>
     bool isDCOn(void) const { return _dcOn; }
 
+    // RF amplitude (V, 0-p) and DC difference (V) of m/z in floating point, also
+    // with MSFQ_FIXED_POINT, where they are the reference of the integer pipeline
     float calcRF(float);
 
     float calcDC(float);
 
     float calcMaxMz(void) const;
 
-    const StateTuneParRecords* getCalibPntsRF(void) const { return _calibPntsRF; }
+    /// <summary>
+    /// Copies the RF calibration points. With a calibration buffer attached the copy
+    /// is taken from one published calibration, never from a half-written one.
+    /// </summary>
+    /// <param name="out">- receives the points</param>
+    void getCalibPntsRF(StateTuneParRecords* out);
+
+    /// <summary>
+    /// Copies the DC calibration points, see <see cref="getCalibPntsRF"></see>.
+    /// </summary>
+    /// <param name="out">- receives the points</param>
+    void getCalibPntsDC(StateTuneParRecords* out);
+
+    /// <summary>
+    /// Takes the calibration from a double buffer instead of the tables passed to the
+    /// constructor. setMZ(), calcRF(), calcDC(), calcUVBatch() and buildSetpointTable()
+    /// pick up a newly published calibration when they start, so a scan running in one
+    /// task can be recalibrated from another one. Calibration point editing methods
+    /// and initSplineRF()/initSplineDC() are disabled, edit through
+    /// <see cref="MSFQCalibBuffer::beginUpdate"></see>.
+    /// </summary>
+    /// <param name="buffer">- calibration buffer, this filter is its only reader</param>
+    void attachCalibBuffer(MSFQCalibBuffer* buffer);
+
+    // calibration point editing
+    //
+    // The points are kept sorted by m/z. After each edit only the spline of the
+    // edited calibration is recalculated (it is global, one point influences all
+    // segments) and the setpoint table, if it was valid, is rebuilt on the same grid.
+
+    /// <summary>
+    /// Inserts a calibration point. Replaces the value if a point with the same m/z exists.
+    /// </summary>
+    /// <param name="calib">- RF or DC calibration</param>
+    /// <param name="mz">- m/z of the point</param>
+    /// <param name="val">- relative correction at the point</param>
+    /// <returns>false if the table is full</returns>
+    bool insertCalibPnt(MSFQCalib calib, float mz, float val);
+
+    /// <summary>
+    /// Moves a calibration point to new m/z and value.
+    /// </summary>
+    /// <param name="calib">- RF or DC calibration</param>
+    /// <param name="idx">- index of the point</param>
+    /// <param name="mz">- new m/z of the point</param>
+    /// <param name="val">- new relative correction at the point</param>
+    /// <returns>false for invalid index</returns>
+    bool moveCalibPnt(MSFQCalib calib, size_t idx, float mz, float val);
+
+    /// <summary>
+    /// Deletes a calibration point.
+    /// </summary>
+    /// <param name="calib">- RF or DC calibration</param>
+    /// <param name="idx">- index of the point</param>
+    /// <returns>false for invalid index</returns>
+    bool deleteCalibPnt(MSFQCalib calib, size_t idx);
+
+    /// <summary>
+    /// Gets a counter that is incremented whenever the m/z to voltage mapping changes
+    /// (calibration, frequency, rod polarity or DC on/off).
+    /// Precompiled setpoints are valid only for the version they were built with.
+    /// </summary>
+    uint32_t getSetpointVersion(void) const { return _setpointVersion; }
+
+    // setpoint table methods
+
+    /// <summary>
+    /// Attaches a caller-provided storage for the compiled setpoint table.
+    /// The table is empty until <see cref="buildSetpointTable"></see> is called.
+    /// </summary>
+    /// <param name="table">- storage, NULL detaches the table</param>
+    /// <param name="capacity">- number of entries in the storage</param>
+    void attachSetpointTable(MSFQSetpoint* table, size_t capacity);
+
+    /// <summary>
+    /// Compiles the calibration into a dense table on the m/z grid 0, step, 2*step, ... max m/z.
+    /// While the table is valid, setMZ() uses a table lookup instead of the spline calibration.
+    /// The table is invalidated by initRFFactor(), initSplineRF(), initSplineDC(),
+    /// setRodPolarityPos() and setDCOn(); call this method again afterwards.
+    /// </summary>
+    /// <param name="mzStep">- m/z step of the grid</param>
+    /// <param name="interpolate">- true to blend linearly between grid points,
+    /// false to take the nearest grid point</param>
+    /// <returns>false if no storage is attached or it is too small for the grid</returns>
+    bool buildSetpointTable(float mzStep, bool interpolate = true);
+
+    /// <summary>
+    /// Checks whether the setpoint table matches the actual calibration.
+    /// </summary>
+    /// <returns>true if setMZ() uses the setpoint table</returns>
+    bool isSetpointTableValid(void) const { return _tableBuilt && (_tableVersion == _setpointVersion); }
+
+    /// <summary>
+    /// Looks up the setpoint for given m/z in the setpoint table.
+    /// </summary>
+    /// <param name="mz">- m/z, clamped to the table range</param>
+    /// <param name="sp">- output setpoint</param>
+    /// <returns>false if the table is not valid</returns>
+    bool lookupSetpoint(float mz, MSFQSetpoint* sp) const;
+
+    /// <summary>
+    /// Calculates device voltages for an array of m/z values, e.g. to prepare a scan method.
+    /// Uses the setpoint table when valid, the calibration otherwise.
+    /// Precondition of the speed: m/z must be ascending. The segment of a calibration
+    /// table is then the one of the previous point or the next one, found in O(1).
+    /// Any other order gives the same voltages, but every point outside these two
+    /// segments costs a binary search (see extras/host/setmz_bench.cpp).
+    /// The voltages are those written by <see cref="setMZ"></see> with the actual DC offset,
+    /// rod polarity and DC on/off.
+    /// </summary>
+    /// <param name="mz">- m/z values, ascending, clamped to 0 to max m/z</param>
+    /// <param name="n">- number of m/z values</param>
+    /// <param name="dc1">- output DC1 voltages in mV</param>
+    /// <param name="dc2">- output DC2 voltages in mV</param>
+    /// <param name="ac">- output RF amplitudes in mV (p-p)</param>
+    void calcUVBatch(const float* mz, size_t n, int32_t* dc1, int32_t* dc2, uint32_t* ac);
+};
+
+
+/// <summary>
+/// Collects changes of DC1, DC2, RF amplitude, rod polarity and DC on/off of one
+/// mass filter and writes them in a single frame (#C) by <see cref="commit"></see>.
+/// Nothing is sent before the commit, so the rods never pass through an intermediate
+/// state and the whole change costs one write.
+///
+///     MSFQTransaction t(msfq.getActualMSFilter());
+///     t.setDCOffst(5.0);
+///     t.setRodPolarityPos(false);
+///     t.commit();
+/// </summary>
+class MSFQTransaction
+{
+private:
+    MSFilterQuad* _filter;
+    int32_t _dc1;    // mV
+    int32_t _dc2;    // mV
+    uint32_t _ac;    // mV (p-p)
+    bool _polarity;
+    bool _dcOn;
+    bool _recalc;    // recalculate DC difference and RF amplitude of the actual m/z
+
+public:
+    /// <summary>
+    /// Constructor. Begins a transaction.
+    /// </summary>
+    /// <param name="filter">- mass filter to be changed</param>
+    MSFQTransaction(MSFilterQuad* filter);
 
-    const StateTuneParRecords* getCalibPntsDC(void) const { return _calibPntsDC; }
+    /// <summary>
+    /// Discards pending changes and starts from the actual values of the filter.
+    /// </summary>
+    void begin(void);
+
+    /// <param name="v">- DC voltage of rods 1 in Volts</param>
+    void setDC1(float v);
+
+    /// <param name="v">- DC voltage of rods 2 in Volts</param>
+    void setDC2(float v);
+
+    /// <summary>
+    /// Sets DC offset, keeps the pending DC difference.
+    /// </summary>
+    /// <param name="v">- DC offset in Volts</param>
+    void setDCOffst(float v);
+
+    /// <summary>
+    /// Sets DC difference, keeps the pending DC offset. See <see cref="MSFilterQuad::setDCDiff"></see>.
+    /// </summary>
+    /// <param name="v">- DC difference in Volts</param>
+    void setDCDiff(float v);
+
+    /// <param name="v">- RF amplitude, 0 to Vp.</param>
+    void setRFAmp(float v);
+
+    /// <summary>
+    /// Sets rod polarity. A change swaps the pending DC1 and DC2.
+    /// </summary>
+    void setRodPolarityPos(bool v);
+
+    /// <summary>
+    /// Switches DC difference on or off. Like <see cref="MSFilterQuad::setDCOn"></see>,
+    /// the commit recalculates DC difference and RF amplitude of the actual m/z,
+    /// DC difference and RF amplitude set in this transaction are ignored.
+    /// </summary>
+    void setDCOn(bool v);
+
+    /// <summary>
+    /// Writes all pending changes in one frame. The filter is unchanged on failure.
+    /// The transaction begins again after a successful commit.
+    /// </summary>
+    /// <returns>true if communication was successfull</returns>
+    bool commit(void);
 };
 
 
@@ -273,6 +621,10 @@ public:
     /// <summary>
     /// Initialize basic RF calibration of quadrupole MS filters using r0 and RF frequencies
     /// stored in JanasCardQSource3 hardware device.
+    /// Measures the guard time of the device (JanasCardQSource3::measureGuardTime()),
+    /// a failed measurement keeps the default. Every range is selected, its stored
+    /// frequency read in one burst and its voltages set to zero; the device is left
+    /// in range 2.
     /// </summary>
     /// <returns>true if succeeded</returns>
     bool init();
@@ -0,0 +1,36 @@
+/*****************************************************************//**
+ * \file   MSFilterQuadConfig.h
+ * \brief  Compile-time configuration of the MSFilterQuad library.
+ *
+ * The options change the layout of library classes, so the library sources
+ * and every sketch must be built with the same values. Edit them here or
+ * pass them as build flags of the whole build (e.g. build_flags of PlatformIO,
+ * target_compile_definitions of the host build), never by a #define in
+ * a sketch before the #include.
+ *
+ * \author jasik
+ * \date   October 2026
+ *********************************************************************/
+
+#ifndef MSFilterQuadConfig_h
+#define MSFilterQuadConfig_h
+
+// Capacity of calibration tables in points. RAM of a filter grows by 12 bytes
+// per point and table: 8 of the table (StateTuneParRecords), 4 of its spline.
+// See extras/host/footprint.cpp for the footprint of a build.
+// The spline is sized by this value, so it no longer follows CSI_MAX_TAB_POINTS
+// of the former CubicSplineInterp dependency and has no upper bound.
+#ifndef MAX_NUMBER_OF_TUNE_PAR_RECORDS
+#define MAX_NUMBER_OF_TUNE_PAR_RECORDS 32
+#endif
+
+static_assert(MAX_NUMBER_OF_TUNE_PAR_RECORDS >= 3, "MAX_NUMBER_OF_TUNE_PAR_RECORDS must be at least 3");
+
+// Integer (Q-format) m/z -> mV pipeline of setMZ() for targets without FPU.
+// m/z is Q16, calibration corrections are Q24, voltages are integer mV.
+// Adds the Q tables of the calibration (MSFQCalibQ) to every filter,
+// 28 bytes per point and table.
+// #define MSFQ_FIXED_POINT
+
+
+#endif
@@ -0,0 +1,141 @@
+#include "MSFilterSIM.h"
+
+// #define TRACE_MSFSIM(x_) printf("%d ms -> MSFilterSIM: ", millis()); x_
+#define TRACE_MSFSIM(x_)
+
+
+MSFilterSIM::MSFilterSIM(MSFilterQuad3* msfq, JanasCardQSource3* device, MSFQTimeSource* time):
+    _msfq(msfq),
+    _device(device),
+    _time(time)
+{
+    resetStats();
+}
+
+
+void MSFilterSIM::resetStats(void)
+{
+    memset(&_stats, 0, sizeof(_stats));
+    _stats.minCycle = 0xFFFFFFFF;
+}
+
+
+void MSFilterSIM::setIons(MSFQSIMIon* ions, size_t n)
+{
+    _ions = ions;
+    _n = n;
+    compile();
+}
+
+
+void MSFilterSIM::compile(void)
+{
+    TRACE_MSFSIM( printf("compile()\r\n"); )
+    for (size_t i = 0; i < _n; ++i)
+    {
+        MSFQSIMIon* ion = &(_ions[i]);
+        if (ion->freqRange > 2)
+        {
+            ion->freqRange = 2;
+        }
+        _msfq->getMSFilter(ion->freqRange)->calcUVBatch(&(ion->mz), 1, &(ion->dc1), &(ion->dc2), &(ion->ac));
+        ion->frameLen = JanasCardQSource3::formatVoltages(
+            ion->frame, Q_SOURCE3_FRAME_SIZE, ion->dc1, ion->dc2, ion->ac
+        );
+    }
+
+    for (int r = 0; r < 3; ++r)
+    {
+        _version[r] = _msfq->getMSFilter(r)->getSetpointVersion();
+        _dcOffst[r] = _msfq->getMSFilter(r)->getDCOffstMV();
+    }
+    _compiled = true;
+    ++_stats.recompiles;
+}
+
+
+bool MSFilterSIM::_isUpToDate(void)
+{
+    if (!_compiled) return false;
+    for (int r = 0; r < 3; ++r)
+    {
+        const MSFilterQuad* filter = _msfq->getMSFilter(r);
+        if (_version[r] != filter->getSetpointVersion()) return false;
+        if (_dcOffst[r] != filter->getDCOffstMV()) return false;
+    }
+    return true;
+}
+
+
+bool MSFilterSIM::runCycle(void)
+{
+    _stop = false;
+    if (_n == 0)
+    {
+        return false;
+    }
+    if (!_isUpToDate())
+    {
+        compile();
+    }
+    QSource3TelemetryHold hold(_device);
+
+    uint32_t t0 = _time->now();
+    uint32_t next = t0;
+    for (size_t i = 0; i < _n; ++i)
+    {
+        const MSFQSIMIon* ion = &(_ions[i]);
+        _time->waitUntil(next);
+        if (_stop)
+        {
+            TRACE_MSFSIM( printf("... stopped at ion %u\r\n", i); )
+            return false;
+        }
+
+        uint32_t t = _time->now();
+        if (ion->freqRange != _msfq->getActualFreqRangeIdx())
+        {
+            if (!_msfq->setFreqRangeIdx(ion->freqRange))
+            {
+                TRACE_MSFSIM( printf("... range ERROR at ion %u\r\n", i); )
+                return false;
+            }
+        }
+        if (!_device->writeFrame(ion->frame, ion->frameLen))
+        {
+            TRACE_MSFSIM( printf("... write ERROR at ion %u\r\n", i); )
+            return false;
+        }
+
+        MSFilterQuad* filter = _msfq->getActualMSFilter();
+        filter->_dc1 = ion->dc1;
+        filter->_dc2 = ion->dc2;
+        filter->_rfAmp = ion->ac;
+        filter->_mz = ion->mz;
+
+        uint32_t dt = _time->now() - t;
+        if (dt > _stats.maxSwitch) _stats.maxSwitch = dt;
+
+        if (_ionCallback != NULL)
+        {
+            _ionCallback(i, _ionCallbackCtx);
+        }
+
+        next += ion->dwell;
+        if ((int32_t)(_time->now() - next) > 0)
+        {
+            // keep dwell of the following ions
+            ++_stats.overruns;
+            next = _time->now();
+        }
+    }
+    _time->waitUntil(next);
+
+    uint32_t cycle = _time->now() - t0;
+    _stats.lastCycle = cycle;
+    if (cycle < _stats.minCycle) _stats.minCycle = cycle;
+    if (cycle > _stats.maxCycle) _stats.maxCycle = cycle;
+    _stats.sumCycle += cycle;
+    ++_stats.cycles;
+    return true;
+}
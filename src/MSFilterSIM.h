@@ -0,0 +1,119 @@
+#ifndef MSFilterSIM_h
+#define MSFilterSIM_h
+
+#include <Arduino.h>
+#include "MSFilterQuad.h"
+#include "MSFilterScan.h"
+
+
+/// <summary>
+/// One ion of the selected-ion monitoring list.
+/// The first three members are set by the user, the rest is filled by
+/// <see cref="MSFilterSIM::compile"></see>.
+/// </summary>
+struct MSFQSIMIon {
+    float mz;
+    uint32_t dwell;     // us
+    uint8_t freqRange;  // 0-2, see MSFilterQuad3::setFreqRangeIdx()
+
+    int32_t dc1;        // mV
+    int32_t dc2;        // mV
+    uint32_t ac;        // mV (p-p)
+    uint8_t frameLen;
+    char frame[Q_SOURCE3_FRAME_SIZE];  // "#C dc1 dc2 ac\r"
+};
+
+
+struct MSFQSIMStats {
+    uint32_t cycles;
+    uint32_t lastCycle;    // us
+    uint32_t minCycle;     // us
+    uint32_t maxCycle;     // us
+    uint64_t sumCycle;     // us
+    uint32_t maxSwitch;    // longest ion switch (range change and write) in us
+    uint32_t overruns;     // ions still switching when their dwell elapsed
+    uint32_t recompiles;
+};
+
+
+/// <summary>
+/// Selected-ion monitoring scheduler. Cycles a list of ions with individual dwell times.
+/// Every ion is compiled once into the final QSource3 command, so a switch costs
+/// one frame write (and a range change when the frequency range differs).
+/// The list is recompiled automatically when the calibration, frequency,
+/// rod polarity, DC on/off or DC offset of any used mass filter changes.
+/// </summary>
+class MSFilterSIM
+{
+private:
+    MSFilterQuad3* _msfq;
+    JanasCardQSource3* _device;
+    MSFQTimeSource* _time;
+
+    MSFQSIMIon* _ions = NULL;
+    size_t _n = 0;
+
+    uint32_t _version[3];
+    int32_t _dcOffst[3];  // mV, held by the compiled frames
+    bool _compiled = false;
+
+    void (*_ionCallback)(size_t ion, void* ctx) = NULL;
+    void* _ionCallbackCtx = NULL;
+
+    volatile bool _stop = false;
+    MSFQSIMStats _stats;
+
+    bool _isUpToDate(void);
+
+public:
+    /// <summary>
+    /// Constructor.
+    /// </summary>
+    /// <param name="msfq">- mass filter with three frequency ranges</param>
+    /// <param name="device">- low-level device used by msfq</param>
+    /// <param name="time">- time source</param>
+    MSFilterSIM(MSFilterQuad3* msfq, JanasCardQSource3* device, MSFQTimeSource* time);
+
+    /// <summary>
+    /// Sets the ion list and compiles it.
+    /// </summary>
+    /// <param name="ions">- caller-provided ion list, kept by reference</param>
+    /// <param name="n">- number of ions</param>
+    void setIons(MSFQSIMIon* ions, size_t n);
+
+    /// <summary>
+    /// Compiles all ions into QSource3 commands using the actual calibration and DC offset.
+    /// </summary>
+    void compile(void);
+
+    /// <summary>
+    /// Sets a function called after each ion switch, e.g. to trigger acquisition.
+    /// </summary>
+    void setIonCallback(void (*clbk)(size_t ion, void* ctx), void* ctx)
+    {
+        _ionCallback = clbk;
+        _ionCallbackCtx = ctx;
+    }
+
+    /// <summary>
+    /// Runs one cycle through the ion list. Asynchronous telemetry of the
+    /// device is dropped meanwhile.
+    /// </summary>
+    /// <returns>false on communication error, stop() or empty list</returns>
+    bool runCycle(void);
+
+    /// <summary>
+    /// Requests the running cycle to stop at the next ion.
+    /// </summary>
+    void stop(void) { _stop = true; }
+
+    const MSFQSIMStats& getStats(void) const { return _stats; }
+
+    void resetStats(void);
+
+    /// <returns>mean cycle time in us</returns>
+    uint32_t getMeanCycle(void) const { return _stats.cycles ? (uint32_t)(_stats.sumCycle / _stats.cycles) : 0; }
+};
+
+
+#endif
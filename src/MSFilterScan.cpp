@@ -0,0 +1,239 @@
+#include "MSFilterScan.h"
+
+// #define TRACE_MSFS(x_) printf("%d ms -> MSFilterScan: ", millis()); x_
+#define TRACE_MSFS(x_)
+
+
+void MSFQMicrosTimeSource::waitUntil(uint32_t t)
+{
+#ifdef USE_RTOS
+    // leave at least one tick for spinning, vTaskDelay() may return early by a tick fraction
+    int32_t remaining = (int32_t)(t - micros());
+    if (remaining > 2000)
+    {
+        vTaskDelay(pdMS_TO_TICKS(remaining / 1000 - 1));
+    }
+#endif
+    while ((int32_t)(t - micros()) > 0);
+}
+
+
+#ifdef ARDUINO_ARCH_SAM
+static MSFQTimerTimeSource* _timerTimeSource = NULL;
+
+void MSFQ_SCAN_TC_HANDLER(void)
+{
+    if (_timerTimeSource != NULL)
+    {
+        _timerTimeSource->_isr();
+    }
+}
+
+
+void MSFQTimerTimeSource::begin(void)
+{
+    _timerTimeSource = this;
+    pmc_set_writeprotect(false);
+    pmc_enable_periph_clk(MSFQ_SCAN_TC_ID);
+    // one-shot: counts up to RC and stops
+    TC_Configure(MSFQ_SCAN_TC, MSFQ_SCAN_TC_CHANNEL,
+        TC_CMR_WAVE | TC_CMR_WAVSEL_UP_RC | TC_CMR_CPCSTOP | TC_CMR_TCCLKS_TIMER_CLOCK1);
+    MSFQ_SCAN_TC->TC_CHANNEL[MSFQ_SCAN_TC_CHANNEL].TC_IER = TC_IER_CPCS;
+    MSFQ_SCAN_TC->TC_CHANNEL[MSFQ_SCAN_TC_CHANNEL].TC_IDR = ~TC_IER_CPCS;
+#ifdef USE_RTOS
+    // the handler calls FreeRTOS, so it must not preempt the kernel
+    NVIC_SetPriority(MSFQ_SCAN_TC_IRQn, configMAX_SYSCALL_INTERRUPT_PRIORITY >> (8 - __NVIC_PRIO_BITS));
+#endif
+    NVIC_ClearPendingIRQ(MSFQ_SCAN_TC_IRQn);
+    NVIC_EnableIRQ(MSFQ_SCAN_TC_IRQn);
+}
+
+
+void MSFQTimerTimeSource::waitUntil(uint32_t t)
+{
+    int32_t remaining = (int32_t)(t - micros()) - MSFQ_SCAN_TC_SPIN_US;
+    if (remaining > 0)
+    {
+        _fired = false;
+#ifdef USE_RTOS
+        _task = xTaskGetCurrentTaskHandle();
+        ulTaskNotifyTake(pdTRUE, 0);  // a stale notification would end the wait at once
+#endif
+        TC_SetRC(MSFQ_SCAN_TC, MSFQ_SCAN_TC_CHANNEL, (uint32_t)remaining * (VARIANT_MCK / 2000000));
+        TC_Start(MSFQ_SCAN_TC, MSFQ_SCAN_TC_CHANNEL);
+#ifdef USE_RTOS
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+#else
+        while (!_fired)
+        {
+            __WFI();
+        }
+#endif
+    }
+    while ((int32_t)(t - micros()) > 0);
+}
+
+
+void MSFQTimerTimeSource::_isr(void)
+{
+    TC_GetStatus(MSFQ_SCAN_TC, MSFQ_SCAN_TC_CHANNEL);  // clears the compare flag
+    _fired = true;
+#ifdef USE_RTOS
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(_task, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+#endif
+}
+#endif
+
+
+MSFilterScan::MSFilterScan(
+    MSFilterQuad* filter,
+    MSFQTimeSource* time,
+    int32_t* dc1,
+    int32_t* dc2,
+    uint32_t* ac,
+    size_t capacity
+):
+    _filter(filter),
+    _time(time),
+    _dc1(dc1),
+    _dc2(dc2),
+    _ac(ac),
+    _capacity(capacity)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+
+bool MSFilterScan::prepare(float start, float stop, float step, uint32_t dwell)
+{
+    TRACE_MSFS( printf("prepare(%d, %d, %d, %u)\r\n", (int)(start * 1000), (int)(stop * 1000), (int)(step * 1000), dwell); )
+    _len = 0;
+    _dcOffst = _filter->getDCOffstMV();  // read by calcUVBatch() below
+    if (!(step > 0.0) || (stop < start))
+    {
+        return false;
+    }
+
+    size_t n = (size_t)((stop - start) / step + 0.001) + 1;  // tolerate rounding of stop
+    if (n > _capacity)
+    {
+        TRACE_MSFS( printf("... too many steps: %u\r\n", n); )
+        return false;
+    }
+
+    float mz[MSFQ_SCAN_PREPARE_CHUNK];
+    for (size_t i = 0; i < n; i += MSFQ_SCAN_PREPARE_CHUNK)
+    {
+        size_t chunk = n - i < MSFQ_SCAN_PREPARE_CHUNK ? n - i : MSFQ_SCAN_PREPARE_CHUNK;
+        for (size_t j = 0; j < chunk; ++j)
+        {
+            mz[j] = start + (i + j) * step;
+        }
+        _filter->calcUVBatch(mz, chunk, &(_dc1[i]), &(_dc2[i]), &(_ac[i]));
+    }
+
+    _start = start;
+    _step = step;
+    _dwell = dwell;
+    _version = _filter->getSetpointVersion();
+    _len = n;
+    return true;
+}
+
+
+void MSFilterScan::_recordDwell(size_t i, uint32_t dwell, uint32_t* achieved)
+{
+    if (achieved != NULL)
+    {
+        achieved[i] = dwell;
+    }
+    if (dwell < _stats.minDwell) _stats.minDwell = dwell;
+    if (dwell > _stats.maxDwell) _stats.maxDwell = dwell;
+    _stats.sumDwell += dwell;
+    ++_stats.steps;
+}
+
+
+// the statistics of a run that wrote no step are all zero
+bool MSFilterScan::_finish(bool rc)
+{
+    if (_stats.steps == 0)
+    {
+        _stats.minDwell = 0;
+    }
+    return rc;
+}
+
+
+bool MSFilterScan::run(uint32_t* achievedDwell)
+{
+    TRACE_MSFS( printf("run()\r\n"); )
+    memset(&_stats, 0, sizeof(_stats));
+    _stats.minDwell = 0xFFFFFFFF;
+    _stop = false;
+
+    if (!isPrepared())
+    {
+        TRACE_MSFS( printf("... not prepared\r\n"); )
+        return _finish(false);
+    }
+    QSource3TelemetryHold hold(_filter->_device);
+
+    uint32_t next = _time->now();
+    uint32_t prev = next;
+    for (size_t i = 0; i < _len; ++i)
+    {
+        _time->waitUntil(next);
+        uint32_t t = _time->now();
+        if (i > 0)
+        {
+            _recordDwell(i - 1, t - prev, achievedDwell);
+        }
+        prev = t;
+
+        if (_stop)
+        {
+            TRACE_MSFS( printf("... stopped at step %u\r\n", i); )
+            return _finish(false);
+        }
+
+        if (!_filter->_setVoltagesMV(_dc1[i], _dc2[i], _ac[i]))
+        {
+            TRACE_MSFS( printf("... write ERROR at step %u\r\n", i); )
+            return _finish(false);
+        }
+        _filter->_mz = _start + i * _step;
+
+        if (_stepCallback != NULL)
+        {
+            _stepCallback(i, _stepCallbackCtx);
+        }
+
+        next += _dwell;
+        int32_t late = (int32_t)(_time->now() - next);
+        if (late > 0)
+        {
+            ++_stats.overruns;
+            if ((uint32_t)late > _stats.maxLateness) _stats.maxLateness = late;
+
+            switch (_policy)
+            {
+            case MSFQ_OVERRUN_ABORT:
+                TRACE_MSFS( printf("... overrun at step %u\r\n", i); )
+                _recordDwell(i, _time->now() - prev, achievedDwell);
+                return _finish(false);
+            case MSFQ_OVERRUN_RESYNC:
+                next += late;
+                break;
+            case MSFQ_OVERRUN_CATCH_UP:
+                break;
+            }
+        }
+    }
+
+    _time->waitUntil(next);
+    _recordDwell(_len - 1, _time->now() - prev, achievedDwell);
+    return _finish(true);
+}
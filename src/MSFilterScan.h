@@ -0,0 +1,231 @@
+#ifndef MSFilterScan_h
+#define MSFilterScan_h
+
+#include <Arduino.h>
+#include "MSFilterQuad.h"
+
+#define MSFQ_SCAN_PREPARE_CHUNK 16
+
+
+/// <summary>
+/// Time base of the scan engine. Times are in microseconds and wrap around.
+/// </summary>
+class MSFQTimeSource
+{
+public:
+    /// <returns>actual time in us</returns>
+    virtual uint32_t now(void) = 0;
+
+    /// <summary>
+    /// Blocks until the given time. Returns immediately if the time has already passed.
+    /// </summary>
+    /// <param name="t">- absolute time in us</param>
+    virtual void waitUntil(uint32_t t) = 0;
+};
+
+
+/// <summary>
+/// Time source based on micros(). Sleeps whole RTOS ticks and spins the rest,
+/// so a dwell shorter than a tick keeps the CPU busy. See <see cref="MSFQTimerTimeSource"></see>.
+/// </summary>
+class MSFQMicrosTimeSource : public MSFQTimeSource
+{
+public:
+    uint32_t now(void) { return micros(); }
+    void waitUntil(uint32_t t);
+};
+
+
+/// <summary>
+/// Simulated time for host tests and method validation. waitUntil() moves the
+/// clock forward at once, the time spent by writes or callbacks is modelled by advance().
+/// </summary>
+class MSFQSimTimeSource : public MSFQTimeSource
+{
+private:
+    uint32_t _now;
+
+public:
+    MSFQSimTimeSource(uint32_t start = 0): _now(start) {}
+    uint32_t now(void) { return _now; }
+    void waitUntil(uint32_t t) { if ((int32_t)(t - _now) > 0) _now = t; }
+    void advance(uint32_t us) { _now += us; }
+};
+
+
+#ifdef ARDUINO_ARCH_SAM
+// Timer Counter channel of MSFQTimerTimeSource, TC1 channel 2 (TC5) by default.
+// Change all of them together, the handler is defined by the library.
+#ifndef MSFQ_SCAN_TC
+#define MSFQ_SCAN_TC TC1
+#define MSFQ_SCAN_TC_CHANNEL 2
+#define MSFQ_SCAN_TC_ID ID_TC5
+#define MSFQ_SCAN_TC_IRQn TC5_IRQn
+#define MSFQ_SCAN_TC_HANDLER TC5_Handler
+#endif
+
+// the last us of a wait are spun, they cover the interrupt and wake-up latency
+#ifndef MSFQ_SCAN_TC_SPIN_US
+#define MSFQ_SCAN_TC_SPIN_US 10
+#endif
+
+/// <summary>
+/// Time source that waits for a one-shot compare of a Timer Counter channel
+/// (MCK/2, 42 MHz) instead of spinning on micros(). Under USE_RTOS the waiting
+/// task blocks and lower priority tasks run, otherwise the CPU sleeps (WFI)
+/// until an interrupt. Only the last MSFQ_SCAN_TC_SPIN_US of a wait are spun.
+/// Only one instance may exist, it owns MSFQ_SCAN_TC.
+/// </summary>
+class MSFQTimerTimeSource : public MSFQTimeSource
+{
+private:
+    volatile bool _fired = false;
+#ifdef USE_RTOS
+    TaskHandle_t _task = NULL;
+#endif
+
+public:
+    /// <summary>
+    /// Enables the clock and the interrupt of the timer. Call it in setup().
+    /// </summary>
+    void begin(void);
+
+    uint32_t now(void) { return micros(); }
+    void waitUntil(uint32_t t);
+
+    // called by the interrupt handler of the timer
+    void _isr(void);
+};
+#endif
+
+
+/// <summary>
+/// Behaviour when a step takes longer than the requested dwell.
+/// </summary>
+enum MSFQOverrunPolicy {
+    MSFQ_OVERRUN_CATCH_UP,  // keep the original schedule, the following steps are shortened
+    MSFQ_OVERRUN_RESYNC,    // restart the schedule from the late step, the following steps keep full dwell
+    MSFQ_OVERRUN_ABORT      // stop the scan
+};
+
+
+struct MSFQScanStats {
+    size_t steps;          // steps written
+    size_t overruns;       // steps longer than the requested dwell
+    uint32_t minDwell;     // us
+    uint32_t maxDwell;     // us
+    uint32_t maxLateness;  // us behind the schedule
+    uint64_t sumDwell;     // us
+};
+
+
+/// <summary>
+/// Mass scan engine. Precomputes the setpoints of all scan steps and writes them
+/// on an absolute time schedule, so the step timing does not accumulate the write
+/// and calculation jitter. Works with a single MSFilterQuad, for MSFilterQuad3 use
+/// <see cref="MSFilterQuad3::getActualMSFilter"></see>.
+/// </summary>
+class MSFilterScan
+{
+private:
+    MSFilterQuad* _filter;
+    MSFQTimeSource* _time;
+
+    int32_t* _dc1;
+    int32_t* _dc2;
+    uint32_t* _ac;
+    size_t _capacity;
+    size_t _len = 0;
+
+    float _start = 0.0;
+    float _step = 0.0;
+    uint32_t _dwell = 0;
+    uint32_t _version = 0;
+    int32_t _dcOffst = 0;  // mV, applied to the setpoints by prepare()
+
+    MSFQOverrunPolicy _policy = MSFQ_OVERRUN_CATCH_UP;
+    void (*_stepCallback)(size_t step, void* ctx) = NULL;
+    void* _stepCallbackCtx = NULL;
+
+    volatile bool _stop = false;
+    MSFQScanStats _stats;
+
+    void _recordDwell(size_t i, uint32_t dwell, uint32_t* achieved);
+    bool _finish(bool rc);
+
+public:
+    /// <summary>
+    /// Constructor.
+    /// </summary>
+    /// <param name="filter">- mass filter</param>
+    /// <param name="time">- time source</param>
+    /// <param name="dc1">- storage of DC1 setpoints</param>
+    /// <param name="dc2">- storage of DC2 setpoints</param>
+    /// <param name="ac">- storage of AC setpoints</param>
+    /// <param name="capacity">- maximum number of steps</param>
+    MSFilterScan(
+        MSFilterQuad* filter,
+        MSFQTimeSource* time,
+        int32_t* dc1,
+        int32_t* dc2,
+        uint32_t* ac,
+        size_t capacity
+    );
+
+    /// <summary>
+    /// Precomputes setpoints of the scan start, start + step, ... stop with the actual
+    /// DC offset, rod polarity and DC on/off of the mass filter.
+    /// Must be called again after a change of any of them or of the calibration,
+    /// see <see cref="isPrepared"></see>.
+    /// </summary>
+    /// <param name="start">- first m/z</param>
+    /// <param name="stop">- last m/z</param>
+    /// <param name="step">- m/z step, must be positive</param>
+    /// <param name="dwell">- dwell time per step in us</param>
+    /// <returns>false for invalid parameters or too many steps</returns>
+    bool prepare(float start, float stop, float step, uint32_t dwell);
+
+    /// <returns>true if the setpoints match the actual calibration and DC offset of the mass filter</returns>
+    bool isPrepared(void) const
+    {
+        return (_len > 0) && (_version == _filter->getSetpointVersion()) && (_dcOffst == _filter->getDCOffstMV());
+    }
+
+    size_t getLength(void) const { return _len; }
+
+    void setOverrunPolicy(MSFQOverrunPolicy policy) { _policy = policy; }
+
+    /// <summary>
+    /// Sets a function called after each setpoint write, e.g. to trigger acquisition.
+    /// Its run time counts into the dwell of the step.
+    /// </summary>
+    void setStepCallback(void (*clbk)(size_t step, void* ctx), void* ctx)
+    {
+        _stepCallback = clbk;
+        _stepCallbackCtx = ctx;
+    }
+
+    /// <summary>
+    /// Runs the prepared scan once. Asynchronous telemetry of the device
+    /// is dropped meanwhile, see JanasCardQSource3::holdTelemetry().
+    /// </summary>
+    /// <param name="achievedDwell">- optional output of achieved dwell per step in us,
+    /// at least <see cref="getLength"></see> items</param>
+    /// <returns>true if all steps were written, false on communication error,
+    /// overrun with MSFQ_OVERRUN_ABORT, stop() or when not prepared</returns>
+    bool run(uint32_t* achievedDwell = NULL);
+
+    /// <summary>
+    /// Requests the running scan to stop at the next step boundary.
+    /// </summary>
+    void stop(void) { _stop = true; }
+
+    /// <returns>timing statistics of the last run, all zero if no step was written</returns>
+    const MSFQScanStats& getStats(void) const { return _stats; }
+
+    /// <returns>mean achieved dwell of the last run in us</returns>
+    uint32_t getMeanDwell(void) const { return _stats.steps ? (uint32_t)(_stats.sumDwell / _stats.steps) : 0; }
+};
+
+
+#endif
@@ -0,0 +1,334 @@
+#include "QSource3Emulator.h"
+#include "QSource3Encoder.h"
+#include <string.h>
+#include <stdio.h>
+
+// #define TRACE_QSOURCE3_EMU(x_) printf("QSource3Emulator: "); x_
+#define TRACE_QSOURCE3_EMU(x_)
+
+// the limits of JanasCardQSource3.h, repeated to keep the emulator free of Arduino.h
+#define EMU_MAX_DC 75000
+#define EMU_MIN_DC -75000
+#define EMU_MAX_AC 650000
+#define EMU_MAX_FREQ 28000
+#define EMU_MIN_FREQ 2000
+#define EMU_MAX_CURRENT 3300
+#define EMU_CURRENT_OVERRANGE 9999
+
+#define EMU_TX_MASK (QSOURCE3_EMULATOR_TX_SIZE - 1)
+
+// power-on frequencies of an unprogrammed device, 1050, 480 and 240 kHz
+static const int32_t _defaultFreq[3] = {10500, 4800, 2400};
+
+static const QSource3EmulatorConfig _defaultConfig = {1500000, 0, 0, 0, 0, 1};
+
+
+// strict decimal integer up to the end of the string or a space
+static const char* _parseInt(const char* p, int32_t* value)
+{
+    bool negative = (*p == '-');
+    if (negative) ++p;
+    if ((*p < '0') || (*p > '9')) return NULL;
+    int32_t x = 0;
+    for (int n = 0; (*p >= '0') && (*p <= '9'); ++p, ++n)
+    {
+        if (n == 9) return NULL;  // far out of every limit
+        x = x * 10 + (*p - '0');
+    }
+    if ((*p != '\0') && (*p != ' ')) return NULL;
+    *value = negative ? -x : x;
+    return p;
+}
+
+
+QSource3Emulator::QSource3Emulator(const QSource3EmulatorConfig* config)
+{
+    setConfig(config);
+    resetStats();
+    for (int r = 0; r < 3; ++r)
+    {
+        _storedFreq[r] = _defaultFreq[r];
+    }
+    powerOn();
+}
+
+
+void QSource3Emulator::setConfig(const QSource3EmulatorConfig* config)
+{
+    _config = (config != NULL) ? *config : _defaultConfig;
+    if (_config.baud == 0) _config.baud = _defaultConfig.baud;
+    _random = (_config.seed != 0) ? _config.seed : 1;
+}
+
+
+void QSource3Emulator::powerOn(void)
+{
+    _rs485 = false;
+    _dc1 = 0;
+    _dc2 = 0;
+    _ac = 0;
+    _range = 0;
+    for (int r = 0; r < 3; ++r)
+    {
+        _freq[r] = _storedFreq[r];
+    }
+    _cmdLen = 0;
+    _cmdOverflow = false;
+    _txTail = _txHead;
+}
+
+
+void QSource3Emulator::resetStats(void)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+
+void QSource3Emulator::setSerialNo(const char* serialNo)
+{
+    strncpy(_serialNo, serialNo, sizeof(_serialNo) - 1);
+    _serialNo[sizeof(_serialNo) - 1] = '\0';
+}
+
+
+int32_t QSource3Emulator::getCurrent(void) const
+{
+    int32_t current = (_current >= 0) ? _current : (int32_t)((int64_t)_ac * EMU_MAX_CURRENT / EMU_MAX_AC);
+    return (current > EMU_MAX_CURRENT) ? EMU_CURRENT_OVERRANGE : current;
+}
+
+
+// xorshift32
+uint32_t QSource3Emulator::_next(void)
+{
+    uint32_t x = _random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    _random = x;
+    return x;
+}
+
+
+// us to send n bytes
+uint32_t QSource3Emulator::_byteTime(size_t n) const
+{
+    return (uint32_t)((uint64_t)n * 10 * 1000000 / _config.baud);
+}
+
+
+void QSource3Emulator::receive(char ch, uint32_t now)
+{
+    if ((_config.dropEvery != 0) && (_next() % _config.dropEvery == 0))
+    {
+        ++_stats.dropped;
+        return;
+    }
+    if (_rs485 && isTransmitting())
+    {
+        // half duplex: the response collides with the received byte
+        ++_stats.collisions;
+        _txTail = _txHead;
+    }
+
+    if (ch != '\r')
+    {
+        if (_cmdLen < QSOURCE3_EMULATOR_CMD_SIZE - 1)
+        {
+            _cmd[_cmdLen++] = ch;
+        }
+        else
+        {
+            _cmdOverflow = true;
+        }
+        return;
+    }
+
+    _cmd[_cmdLen] = '\0';
+    if (_cmdOverflow)
+    {
+        TRACE_QSOURCE3_EMU( printf("command too long\r\n"); )
+        ++_stats.rejected;
+        _reply(QSOURCE3_EMULATOR_ERROR, sizeof(QSOURCE3_EMULATOR_ERROR) - 1, now);
+    }
+    else
+    {
+        _execute(now);
+    }
+    _cmdLen = 0;
+    _cmdOverflow = false;
+}
+
+
+int QSource3Emulator::transmit(uint32_t now)
+{
+    if (!isTransmitting() || ((int32_t)(now - nextDue()) < 0))
+    {
+        return -1;
+    }
+    return (uint8_t)_tx[_txTail++ & EMU_TX_MASK];
+}
+
+
+bool QSource3Emulator::_set(int32_t* target, const char* arg, int32_t min, int32_t max)
+{
+    int32_t value;
+    const char* end = _parseInt(arg, &value);
+    if ((end == NULL) || (*end != '\0') || (value < min) || (value > max))
+    {
+        return false;
+    }
+    *target = value;
+    return true;
+}
+
+
+void QSource3Emulator::_execute(uint32_t now)
+{
+    TRACE_QSOURCE3_EMU( printf("\"%s\"\r\n", _cmd); )
+    ++_stats.commands;
+    if ((int32_t)(now - _busyUntil) < 0)
+    {
+        ++_stats.busy;
+    }
+
+    const char* c = _cmd;
+    char buff[QSOURCE3_ENCODE_SIZE];
+    size_t len = 0;
+    bool ok = false;
+    bool answer = true;
+
+    if (strcmp(c, "#Q") == 0)
+    {
+        ok = true;
+    }
+    else if (strcmp(c, "#N") == 0)
+    {
+        _reply(_serialNo, strlen(_serialNo), now);
+        return;
+    }
+    else if ((strcmp(c, "#R0") == 0) || (strcmp(c, "#R1") == 0))
+    {
+        _rs485 = (c[2] == '1');
+        ok = true;
+    }
+    else if (strncmp(c, "#DC1 ", 5) == 0)
+    {
+        ok = _set(&_dc1, c + 5, EMU_MIN_DC, EMU_MAX_DC);
+    }
+    else if (strncmp(c, "#DC2 ", 5) == 0)
+    {
+        ok = _set(&_dc2, c + 5, EMU_MIN_DC, EMU_MAX_DC);
+    }
+    else if (strncmp(c, "#AC ", 4) == 0)
+    {
+        ok = _set(&_ac, c + 4, 0, EMU_MAX_AC);
+    }
+    else if (strncmp(c, "#C ", 3) == 0)
+    {
+        // no response, the sender keeps the guard time
+        answer = false;
+        int32_t dc1, dc2, ac;
+        const char* p = _parseInt(c + 3, &dc1);
+        if ((p != NULL) && (*p == ' '))
+        {
+            p = _parseInt(p + 1, &dc2);
+        }
+        if ((p != NULL) && (*p == ' '))
+        {
+            p = _parseInt(p + 1, &ac);
+        }
+        if ((p != NULL) && (*p == '\0') &&
+            (dc1 >= EMU_MIN_DC) && (dc1 <= EMU_MAX_DC) &&
+            (dc2 >= EMU_MIN_DC) && (dc2 <= EMU_MAX_DC) &&
+            (ac >= 0) && (ac <= EMU_MAX_AC))
+        {
+            _dc1 = dc1;
+            _dc2 = dc2;
+            _ac = ac;
+            ok = true;
+        }
+    }
+    else if (strncmp(c, "#B ", 3) == 0)
+    {
+        int32_t range;
+        ok = _set(&range, c + 3, 0, 2);
+        if (ok) _range = range;
+    }
+    else if (strncmp(c, "#F ", 3) == 0)
+    {
+        ok = _set(&(_freq[_range]), c + 3, EMU_MIN_FREQ, EMU_MAX_FREQ);
+    }
+    else if (strcmp(c, "#S") == 0)
+    {
+        _storedFreq[_range] = _freq[_range];
+        ok = true;
+    }
+    else if (strcmp(c, "#G") == 0)
+    {
+        len = qsource3EncodeInt(buff, _freq[_range]);
+        ok = true;
+    }
+    else if (strcmp(c, "#U") == 0)
+    {
+        len = qsource3EncodeInt(buff, getCurrent());
+        ok = true;
+    }
+
+    if (!ok)
+    {
+        TRACE_QSOURCE3_EMU( printf("... rejected\r\n"); )
+        ++_stats.rejected;
+        if (!answer) return;
+        strcpy(buff, QSOURCE3_EMULATOR_ERROR);
+        len = sizeof(QSOURCE3_EMULATOR_ERROR) - 1;
+    }
+    else if (!answer)
+    {
+        _busyUntil = now + _config.latencyUs;
+        return;
+    }
+    else if (len == 0)
+    {
+        memcpy(buff, "OK", 2);
+        len = 2;
+    }
+    _reply(buff, len, now);
+}
+
+
+void QSource3Emulator::_reply(const char* text, size_t len, uint32_t now)
+{
+    uint32_t start = now + _config.latencyUs;
+    if (_config.jitterUs != 0)
+    {
+        start += _next() % (_config.jitterUs + 1);
+    }
+    _busyUntil = start;
+    if (isTransmitting() && ((int32_t)(_txFree - start) > 0))
+    {
+        start = _txFree;  // after the previous response
+    }
+
+    size_t garble = len + 1;
+    if ((_config.garbleEvery != 0) && (len > 0) && (_next() % _config.garbleEvery == 0))
+    {
+        ++_stats.garbled;
+        garble = _next() % len;
+    }
+
+    for (size_t i = 0; i <= len; ++i)
+    {
+        if (_txHead - _txTail >= QSOURCE3_EMULATOR_TX_SIZE)
+        {
+            ++_stats.overflows;
+            break;
+        }
+        char ch = (i == len) ? '\r' : text[i];
+        if (i == garble) ch = (ch == 'x') ? 'y' : 'x';
+        _tx[_txHead & EMU_TX_MASK] = ch;
+        _txDue[_txHead & EMU_TX_MASK] = start + _byteTime(i + 1);
+        ++_txHead;
+    }
+    _txFree = start + _byteTime(len + 1);
+}
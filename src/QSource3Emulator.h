@@ -0,0 +1,160 @@
+#ifndef QSource3Emulator_h
+#define QSource3Emulator_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Emulator of the QSource3 (JanasCard) protocol as spoken by JanasCardQSource3.
+// It does not touch any port: the owner passes the received bytes with their
+// time and polls the response bytes when they are due, so the same class runs
+// on a second Arduino board (see examples/emulator) or in a host loopback.
+// Times are in us of any free-running clock, e.g. micros(); they may wrap.
+
+#define QSOURCE3_EMULATOR_CMD_SIZE 40  // longest accepted command
+#define QSOURCE3_EMULATOR_TX_SIZE 64   // pending response bytes, a power of two
+
+static_assert((QSOURCE3_EMULATOR_TX_SIZE & (QSOURCE3_EMULATOR_TX_SIZE - 1)) == 0, "QSOURCE3_EMULATOR_TX_SIZE must be a power of two");
+
+// the real device does not document its answer to a rejected command,
+// the emulator sends this one so that rejections are visible
+#define QSOURCE3_EMULATOR_ERROR "ERR"
+
+
+/// <summary>
+/// Timing and fault model. Zero disables a fault.
+/// </summary>
+struct QSource3EmulatorConfig {
+    uint32_t baud;          // line speed, a byte takes 10 bits
+    uint32_t latencyUs;     // from the terminator of a command to its first response byte
+    uint32_t jitterUs;      // uniformly distributed 0 .. jitterUs added to latencyUs
+    uint32_t dropEvery;     // on average every dropEvery-th received byte is lost
+    uint32_t garbleEvery;   // on average every garbleEvery-th response has one wrong byte
+    uint32_t seed;          // of the fault and jitter generator, the same seed gives the same run
+};
+
+/// <summary>
+/// Counters of the emulator.
+/// </summary>
+struct QSource3EmulatorStats {
+    uint32_t commands;    // executed commands
+    uint32_t rejected;    // unknown commands and values out of the documented limits
+    uint32_t busy;        // commands received before the previous one was processed
+    uint32_t collisions;  // RS485: bytes received while a response was pending, the response is lost
+    uint32_t dropped;     // received bytes dropped by fault injection
+    uint32_t garbled;     // responses garbled by fault injection
+    uint32_t overflows;   // response bytes lost because the transmit queue was full
+};
+
+
+/// <summary>
+/// Emulated device state and protocol: #Q, #N, #R0/#R1, #DC1, #DC2, #AC, #C, #B,
+/// #F, #S, #G and #U with the limits documented in JanasCardQSource3.h.
+/// Every frequency range keeps its actual and its stored (flash) frequency;
+/// the stored ones survive <see cref="powerOn()"/>.
+/// </summary>
+class QSource3Emulator
+{
+private:
+    QSource3EmulatorConfig _config;
+    QSource3EmulatorStats _stats;
+    uint32_t _random;
+
+    // device state
+    bool _rs485;
+    int32_t _dc1;
+    int32_t _dc2;
+    int32_t _ac;
+    uint32_t _range;
+    int32_t _freq[3];
+    int32_t _storedFreq[3];
+    int32_t _current = -1;  // forced by setCurrent(), -1 follows the AC voltage
+    char _serialNo[4] = "E01";
+
+    // receiver
+    char _cmd[QSOURCE3_EMULATOR_CMD_SIZE];
+    size_t _cmdLen = 0;
+    bool _cmdOverflow = false;
+    uint32_t _busyUntil = 0;
+
+    // transmitter, every byte with the time it is due
+    char _tx[QSOURCE3_EMULATOR_TX_SIZE];
+    uint32_t _txDue[QSOURCE3_EMULATOR_TX_SIZE];
+    uint32_t _txHead = 0;
+    uint32_t _txTail = 0;
+    uint32_t _txFree = 0;  // when the transmitter finishes the queued bytes
+
+    uint32_t _next(void);
+    uint32_t _byteTime(size_t n) const;
+    void _execute(uint32_t now);
+    void _reply(const char* text, size_t len, uint32_t now);
+    bool _set(int32_t* target, const char* arg, int32_t min, int32_t max);
+
+public:
+    /// <summary>
+    /// Constructor, the device is powered on with the default stored frequencies.
+    /// </summary>
+    /// <param name="config"> - timing and faults, NULL is 1.5 Mbaud without latency and faults</param>
+    QSource3Emulator(const QSource3EmulatorConfig* config = NULL);
+
+    void setConfig(const QSource3EmulatorConfig* config);
+
+    const QSource3EmulatorConfig& getConfig(void) const { return _config; }
+
+    /// <summary>
+    /// Power cycle: RS422 mode, zero voltages, range 0 and the stored frequencies.
+    /// Pending bytes are lost.
+    /// </summary>
+    void powerOn(void);
+
+    // line side
+
+    /// <summary>
+    /// Receives one byte. A command is executed at its terminator '\r'.
+    /// </summary>
+    /// <param name="now"> - time when the byte was received</param>
+    void receive(char ch, uint32_t now);
+
+    /// <summary>
+    /// Takes the next response byte if it is due.
+    /// </summary>
+    /// <returns>the byte or -1 if none is due at now</returns>
+    int transmit(uint32_t now);
+
+    /// <returns>true if a response byte is waiting</returns>
+    bool isTransmitting(void) const { return _txHead != _txTail; }
+
+    /// <returns>time when the next response byte is due, valid if isTransmitting()</returns>
+    uint32_t nextDue(void) const { return _txDue[_txTail & (QSOURCE3_EMULATOR_TX_SIZE - 1)]; }
+
+    // device side
+
+    bool isRS485(void) const { return _rs485; }
+    int32_t getDC1(void) const { return _dc1; }
+    int32_t getDC2(void) const { return _dc2; }
+    int32_t getAC(void) const { return _ac; }
+    uint32_t getFreqRange(void) const { return _range; }
+    int32_t getFreq(uint32_t range) const { return _freq[range % 3]; }
+    int32_t getStoredFreq(uint32_t range) const { return _storedFreq[range % 3]; }
+
+    /// <summary>
+    /// Forces the excitation current answered to #U, in 0.1 mA. Values above
+    /// 3300 are answered by 9999 (out of range), -1 returns to the default
+    /// model proportional to the AC voltage.
+    /// </summary>
+    void setCurrent(int32_t value) { _current = value; }
+
+    /// <returns>the answer to #U</returns>
+    int32_t getCurrent(void) const;
+
+    /// <summary>
+    /// Sets the serial number answered to #N, three characters.
+    /// </summary>
+    void setSerialNo(const char* serialNo);
+
+    const QSource3EmulatorStats& getStats(void) const { return _stats; }
+
+    void resetStats(void);
+};
+
+
+#endif
@@ -0,0 +1,132 @@
+#include "QSource3Encoder.h"
+#include <string.h>
+
+// two digits per division
+static const char _digitPairs[201] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+
+static inline size_t _uintLength(uint32_t x)
+{
+    size_t n = 1;
+    while (x >= 100)
+    {
+        x /= 100;
+        n += 2;
+    }
+    return (x >= 10) ? n + 1 : n;
+}
+
+
+static inline size_t _encodeUint(char* p, uint32_t x)
+{
+    size_t n = _uintLength(x);
+    char* q = p + n;
+    while (x >= 100)
+    {
+        uint32_t i = (x % 100) * 2;
+        x /= 100;
+        *--q = _digitPairs[i + 1];
+        *--q = _digitPairs[i];
+    }
+    if (x >= 10)
+    {
+        *--q = _digitPairs[x * 2 + 1];
+        *--q = _digitPairs[x * 2];
+    }
+    else
+    {
+        *--q = (char)('0' + x);
+    }
+    return n;
+}
+
+
+size_t qsource3IntLength(int32_t value)
+{
+    if (value < 0)
+    {
+        return 1 + _uintLength(0U - (uint32_t)value);
+    }
+    return _uintLength((uint32_t)value);
+}
+
+
+size_t qsource3EncodeInt(char* p, int32_t value)
+{
+    if (value < 0)
+    {
+        *p = '-';
+        return 1 + _encodeUint(p + 1, 0U - (uint32_t)value);
+    }
+    return _encodeUint(p, (uint32_t)value);
+}
+
+
+// command name followed by a space and an unsigned value
+static size_t _encodeCmd(char* buffer, const char* cmd, size_t cmdLen, uint32_t value)
+{
+    memcpy(buffer, cmd, cmdLen);
+    size_t n = cmdLen + _encodeUint(buffer + cmdLen, value);
+    buffer[n] = '\0';
+    return n;
+}
+
+
+size_t qsource3EncodeVoltages(char* buffer, int32_t dc1, int32_t dc2, uint32_t ac)
+{
+    char* p = buffer;
+    *p++ = '#';
+    *p++ = 'C';
+    *p++ = ' ';
+    p += qsource3EncodeInt(p, dc1);
+    *p++ = ' ';
+    p += qsource3EncodeInt(p, dc2);
+    *p++ = ' ';
+    p += _encodeUint(p, ac);
+    *p++ = '\r';
+    *p = '\0';
+    return p - buffer;
+}
+
+
+size_t qsource3EncodeDC(char* buffer, uint32_t output, int32_t value)
+{
+    if ((output != 1) && (output != 2))
+    {
+        buffer[0] = '\0';
+        return 0;
+    }
+    memcpy(buffer, "#DC1 ", 5);
+    buffer[3] = (char)('0' + output);
+    size_t n = 5 + qsource3EncodeInt(buffer + 5, value);
+    buffer[n] = '\0';
+    return n;
+}
+
+
+size_t qsource3EncodeAC(char* buffer, uint32_t value)
+{
+    return _encodeCmd(buffer, "#AC ", 4, value);
+}
+
+
+size_t qsource3EncodeFreq(char* buffer, uint32_t value)
+{
+    return _encodeCmd(buffer, "#F ", 3, value);
+}
+
+
+size_t qsource3EncodeFreqRange(char* buffer, uint32_t range)
+{
+    return _encodeCmd(buffer, "#B ", 3, range);
+}
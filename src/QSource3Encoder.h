@@ -0,0 +1,55 @@
+#ifndef QSource3Encoder_h
+#define QSource3Encoder_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Command encoder of QSource3 (JanasCard). Writes the command bytes into
+// caller-provided storage without formatted IO and without static state,
+// so every task can encode its commands concurrently.
+// The buffers must have at least QSOURCE3_ENCODE_SIZE characters, values are
+// written as given, limiting them to the device range is up to the caller.
+
+// "#C -2147483648 -2147483648 4294967295\r" and terminal zero
+#define QSOURCE3_ENCODE_SIZE 40
+
+
+/// <summary>
+/// Writes a decimal integer.
+/// </summary>
+/// <returns>number of characters, no terminal zero is written</returns>
+size_t qsource3EncodeInt(char* p, int32_t value);
+
+/// <returns>number of characters of the decimal integer</returns>
+size_t qsource3IntLength(int32_t value);
+
+/// <summary>
+/// "#C dc1 dc2 ac\r", see <see cref="JanasCardQSource3::writeVoltages()"/>.
+/// </summary>
+/// <returns>length without the terminal zero</returns>
+size_t qsource3EncodeVoltages(char* buffer, int32_t dc1, int32_t dc2, uint32_t ac);
+
+/// <summary>
+/// "#DC1 value" or "#DC2 value", without '\r' as the queries add it.
+/// </summary>
+/// <param name="output"> - 1 or 2</param>
+/// <returns>length without the terminal zero, 0 for other outputs</returns>
+size_t qsource3EncodeDC(char* buffer, uint32_t output, int32_t value);
+
+/// <summary>
+/// "#AC value"
+/// </summary>
+size_t qsource3EncodeAC(char* buffer, uint32_t value);
+
+/// <summary>
+/// "#F value"
+/// </summary>
+size_t qsource3EncodeFreq(char* buffer, uint32_t value);
+
+/// <summary>
+/// "#B range"
+/// </summary>
+size_t qsource3EncodeFreqRange(char* buffer, uint32_t range);
+
+
+#endif
@@ -0,0 +1,180 @@
+/*****************************************************************//**
+ * \file   QSource3Lock.h
+ * \brief  Locking policies of JanasCardQSource3T.
+ *
+ * A lock keeps the commands of one device apart, it is held from a write
+ * to the last response of a query or burst:
+ *
+ *     bool init();
+ *     bool take(uint32_t ticks);
+ *     void give();
+ *     void sleep(uint32_t us);   // lets others run for most of us, the caller spins the rest
+ *     void enterCritical();      // short sections on counters of the device
+ *     void exitCritical();
+ *
+ * It also provides what the asynchronous API of JanasCardQSource3T needs
+ * from the scheduler. Locks without scheduler fail initQueue(), so the
+ * ...Async() methods are rejected, and the device class has the same
+ * members whatever the build:
+ *
+ *     bool initQueue(size_t classes, size_t length);
+ *     bool send(size_t cls, void* item);   // does not wait, false if full
+ *     void* receive(uint32_t ticks);       // oldest item of the lowest class, NULL after ticks
+ *     void* self();                        // the calling task
+ *     void notify(void* task);
+ *     void waitNotify(uint32_t ticks);
+ *     uint32_t getTickCount();
+ *
+ * \author jasik
+ * \date   October 2026
+ *********************************************************************/
+
+#ifndef QSource3Lock_H_
+#define QSource3Lock_H_
+
+#include <Arduino.h>
+
+#ifdef USE_RTOS
+#include <FreeRTOS.h>
+#include <semphr.h>
+#include <queue.h>
+#include <task.h>
+#endif
+
+// priority classes of queued items, see QSource3MutexLock::initQueue()
+#define Q_SOURCE3_QUEUE_CLASSES 3
+
+
+/// <summary>
+/// A single caller, e.g. a host benchmark.
+/// </summary>
+class QSource3NoLock {
+public:
+    bool init() { return true; }
+    bool take(uint32_t) { return true; }
+    void give() {}
+    void sleep(uint32_t) {}
+    void enterCritical() {}
+    void exitCritical() {}
+
+    bool initQueue(size_t, size_t) { return false; }
+    bool send(size_t, void*) { return false; }
+    void* receive(uint32_t) { return NULL; }
+    void* self() { return NULL; }
+    void notify(void*) {}
+    void waitNotify(uint32_t) {}
+    uint32_t getTickCount() { return millis(); }
+};
+
+
+/// <summary>
+/// Bare-metal: a busy flag, so a command from the USB console interrupt can not
+/// cut into a running one. The USB interrupt is disabled only while the flag is
+/// tested and set, a taken lock is not waited for, take() fails at once.
+/// </summary>
+class QSource3IrqLock {
+    volatile bool _busy = false;
+public:
+    bool init() { return true; }
+
+    bool take(uint32_t)
+    {
+        NVIC_DisableIRQ( UOTGHS_IRQn );  // disable USB interrupt
+        bool taken = !_busy;
+        _busy = true;
+        NVIC_EnableIRQ( UOTGHS_IRQn );  // enable USB interrupt
+        return taken;
+    }
+
+    void give() { _busy = false; }
+
+    void sleep(uint32_t) {}
+
+    void enterCritical() { NVIC_DisableIRQ( UOTGHS_IRQn ); }
+    void exitCritical() { NVIC_EnableIRQ( UOTGHS_IRQn ); }
+
+    bool initQueue(size_t, size_t) { return false; }
+    bool send(size_t, void*) { return false; }
+    void* receive(uint32_t) { return NULL; }
+    void* self() { return NULL; }
+    void notify(void*) {}
+    void waitNotify(uint32_t) {}
+    uint32_t getTickCount() { return millis(); }
+};
+
+
+#ifdef USE_RTOS
+/// <summary>
+/// FreeRTOS mutex, created by init(). The queues of the asynchronous API are
+/// FreeRTOS queues, one per class, and a counting semaphore of all queued items.
+/// </summary>
+class QSource3MutexLock {
+    SemaphoreHandle_t _xMutex = NULL;
+    QueueHandle_t _xQueue[Q_SOURCE3_QUEUE_CLASSES] = {NULL, NULL, NULL};
+    SemaphoreHandle_t _xPending = NULL;  // counts queued items of all classes
+    size_t _classes = 0;
+public:
+    bool init()
+    {
+        if (_xMutex == NULL) _xMutex = xSemaphoreCreateMutex();
+        return _xMutex != NULL;
+    }
+
+    bool take(uint32_t ticks) { return (_xMutex != NULL) && xSemaphoreTake(_xMutex, ticks); }
+
+    void give() { xSemaphoreGive(_xMutex); }
+
+    void sleep(uint32_t us)
+    {
+        if ((us > 2000) && !xPortIsInsideInterrupt())
+        {
+            vTaskDelay(pdMS_TO_TICKS(us / 1000 - 1));  // leave the rest for spinning
+        }
+    }
+
+    void enterCritical() { taskENTER_CRITICAL(); }
+    void exitCritical() { taskEXIT_CRITICAL(); }
+
+    bool initQueue(size_t classes, size_t length)
+    {
+        if (classes > Q_SOURCE3_QUEUE_CLASSES) return false;
+        for (size_t i = 0; i < classes; ++i)
+        {
+            _xQueue[i] = xQueueCreate(length, sizeof(void*));
+            if (_xQueue[i] == NULL) return false;
+        }
+        _xPending = xSemaphoreCreateCounting(classes * length, 0);
+        if (_xPending == NULL) return false;
+        _classes = classes;
+        return true;
+    }
+
+    bool send(size_t cls, void* item)
+    {
+        if ((cls >= _classes) || (xQueueSend(_xQueue[cls], &item, 0) != pdTRUE)) return false;
+        xSemaphoreGive(_xPending);
+        return true;
+    }
+
+    void* receive(uint32_t ticks)
+    {
+        if ((_xPending == NULL) || (xSemaphoreTake(_xPending, ticks) != pdTRUE)) return NULL;
+
+        // every given count has its item, the lowest class is taken first
+        void* item = NULL;
+        for (size_t i = 0; i < _classes; ++i)
+        {
+            if (xQueueReceive(_xQueue[i], &item, 0) == pdTRUE) break;
+        }
+        return item;
+    }
+
+    void* self() { return xTaskGetCurrentTaskHandle(); }
+    void notify(void* task) { xTaskNotifyGive((TaskHandle_t)task); }
+    void waitNotify(uint32_t ticks) { ulTaskNotifyTake(pdTRUE, ticks); }
+    uint32_t getTickCount() { return xTaskGetTickCount(); }
+};
+#endif
+
+
+#endif /* QSource3Lock_H_ */
@@ -0,0 +1,124 @@
+#include "QSource3Parser.h"
+
+#define QSOURCE3_MAX_MAGNITUDE 2147483647u
+
+
+QSource3Reply QSource3Parser::feed(char ch)
+{
+    if (ch == '\r')
+    {
+        return _finish();
+    }
+
+    switch (_state)
+    {
+    case START:
+        if ((ch == ' ') || (ch == '\n'))
+        {
+            break;
+        }
+        _negative = false;
+        _value = 0;
+        if (ch == 'O')
+        {
+            _state = O;
+        }
+        else if (ch == '-')
+        {
+            _negative = true;
+            _state = SIGN;
+        }
+        else if ((ch >= '0') && (ch <= '9'))
+        {
+            _value = ch - '0';
+            _state = DIGITS;
+        }
+        else
+        {
+            _state = BAD;
+        }
+        break;
+    case O:
+        _state = (ch == 'K') ? OK : BAD;
+        break;
+    case SIGN:
+    case DIGITS:
+        if ((ch >= '0') && (ch <= '9'))
+        {
+            uint32_t d = ch - '0';
+            if (_value > (QSOURCE3_MAX_MAGNITUDE - d) / 10)
+            {
+                _state = BAD;
+                break;
+            }
+            _value = _value * 10 + d;
+            _state = DIGITS;
+        }
+        else
+        {
+            _state = BAD;
+        }
+        break;
+    case OK:
+    case BAD:
+        // the rest of the response up to the terminator is skipped
+        _state = BAD;
+        break;
+    }
+    return QSOURCE3_REPLY_PENDING;
+}
+
+
+QSource3Reply QSource3Parser::_finish(void)
+{
+    State state = _state;
+    _state = START;
+    switch (state)
+    {
+    case OK:
+        return (_expect == QSOURCE3_EXPECT_OK) ? QSOURCE3_REPLY_OK : QSOURCE3_REPLY_UNEXPECTED;
+    case DIGITS:
+        if (_expect == QSOURCE3_EXPECT_OK)
+        {
+            return QSOURCE3_REPLY_UNEXPECTED;
+        }
+        if ((_expect == QSOURCE3_EXPECT_CURRENT) && !_negative && (_value == QSOURCE3_CURRENT_OVERRANGE))
+        {
+            return QSOURCE3_REPLY_OVERRANGE;
+        }
+        return QSOURCE3_REPLY_VALUE;
+    default:
+        return QSOURCE3_REPLY_MALFORMED;
+    }
+}
+
+
+QSource3Reply QSource3Parser::parse(const char* data, size_t len, size_t* consumed)
+{
+    for (size_t i = 0; i < len; ++i)
+    {
+        QSource3Reply r = feed(data[i]);
+        if (r != QSOURCE3_REPLY_PENDING)
+        {
+            *consumed = i + 1;
+            return r;
+        }
+    }
+    *consumed = len;
+    return QSOURCE3_REPLY_PENDING;
+}
+
+
+void qsource3CountReply(QSource3ParseStats* stats, QSource3Reply reply)
+{
+    switch (reply)
+    {
+    case QSOURCE3_REPLY_OK:         ++stats->ok; break;
+    case QSOURCE3_REPLY_VALUE:      ++stats->values; break;
+    case QSOURCE3_REPLY_OVERRANGE:  ++stats->overrange; break;
+    case QSOURCE3_REPLY_NONE:       ++stats->none; break;
+    case QSOURCE3_REPLY_UNEXPECTED: ++stats->unexpected; break;
+    case QSOURCE3_REPLY_MALFORMED:  ++stats->malformed; break;
+    default: break;
+    }
+}
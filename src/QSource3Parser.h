@@ -0,0 +1,108 @@
+#ifndef QSource3Parser_h
+#define QSource3Parser_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Response parser of QSource3 (JanasCard). Consumes the received bytes one by
+// one as they are taken from the receive buffer, so a response is never
+// copied. A response is "OK" or a decimal integer terminated by '\r'.
+
+// the device answers #U with this value when the current is out of range
+#define QSOURCE3_CURRENT_OVERRANGE 9999
+
+
+/// <summary>
+/// Kind of response the query expects.
+/// </summary>
+enum QSource3Expect {
+    QSOURCE3_EXPECT_OK,       // "OK"
+    QSOURCE3_EXPECT_VALUE,    // integer, e.g. #G
+    QSOURCE3_EXPECT_CURRENT   // integer or QSOURCE3_CURRENT_OVERRANGE, #U
+};
+
+/// <summary>
+/// Result of parsing one response.
+/// </summary>
+enum QSource3Reply {
+    QSOURCE3_REPLY_PENDING,     // no terminator yet
+    QSOURCE3_REPLY_NONE,        // no response until the deadline, set by the reader
+    QSOURCE3_REPLY_OK,
+    QSOURCE3_REPLY_VALUE,
+    QSOURCE3_REPLY_OVERRANGE,   // QSOURCE3_CURRENT_OVERRANGE to QSOURCE3_EXPECT_CURRENT
+    QSOURCE3_REPLY_UNEXPECTED,  // well formed, but "OK" instead of a value or vice versa
+    QSOURCE3_REPLY_MALFORMED    // empty, other characters or the integer overflows
+};
+
+/// <summary>
+/// Counts of parsed responses, see <see cref="JanasCardQSource3::getParseStats()"/>.
+/// </summary>
+struct QSource3ParseStats {
+    uint32_t ok;
+    uint32_t values;
+    uint32_t overrange;
+    uint32_t none;        // timeouts
+    uint32_t unexpected;
+    uint32_t malformed;
+};
+
+
+/// <summary>
+/// Incremental parser of the responses. Keeps no more than the integer being
+/// accumulated; after the terminator it is ready for the next response.
+/// Leading ' ' and '\n' are skipped like strtol() did. Unlike the former check
+/// of the first two characters and strtol(), nothing may follow "OK" or the integer:
+/// "OK " or "4800kHz" are QSOURCE3_REPLY_MALFORMED. The device never sends them,
+/// on a noisy line they are counted instead of taken for a valid response.
+/// </summary>
+class QSource3Parser
+{
+private:
+    enum State : uint8_t {START, O, OK, SIGN, DIGITS, BAD};
+
+    QSource3Expect _expect;
+    State _state;
+    bool _negative;
+    uint32_t _value;
+
+    QSource3Reply _finish(void);
+
+public:
+    QSource3Parser(QSource3Expect expect = QSOURCE3_EXPECT_OK) { begin(expect); }
+
+    /// <summary>
+    /// Starts a new response.
+    /// </summary>
+    void begin(QSource3Expect expect)
+    {
+        _expect = expect;
+        _state = START;
+        _negative = false;
+        _value = 0;
+    }
+
+    /// <summary>
+    /// Consumes one received byte.
+    /// </summary>
+    /// <returns>QSOURCE3_REPLY_PENDING until the terminator, then the result</returns>
+    QSource3Reply feed(char ch);
+
+    /// <summary>
+    /// Consumes bytes up to and including the first terminator.
+    /// </summary>
+    /// <param name="consumed"> - output, number of consumed bytes</param>
+    /// <returns>QSOURCE3_REPLY_PENDING if all bytes were consumed without terminator</returns>
+    QSource3Reply parse(const char* data, size_t len, size_t* consumed);
+
+    /// <returns>value of the last QSOURCE3_REPLY_VALUE or QSOURCE3_REPLY_OVERRANGE</returns>
+    int32_t value(void) const { return _negative ? -(int32_t)_value : (int32_t)_value; }
+};
+
+
+/// <summary>
+/// Counts a result into the statistics, QSOURCE3_REPLY_PENDING is not counted.
+/// </summary>
+void qsource3CountReply(QSource3ParseStats* stats, QSource3Reply reply);
+
+
+#endif
@@ -0,0 +1,232 @@
+/*****************************************************************//**
+ * \file   QSource3Transport.h
+ * \brief  Transport policies of JanasCardQSource3T.
+ *
+ * A transport moves the bytes of one QSource3 and bounds the wait for its
+ * responses. JanasCardQSource3T calls it directly, there is no virtual call:
+ *
+ *     typedef ... StreamType;               // what the constructor takes
+ *     Transport(StreamType* comm);
+ *     bool availableForWrite();
+ *     size_t write(const char* buff);       // a whole command or burst
+ *     bool waitTxDone(uint32_t ticks);      // until the bytes have left
+ *     void clear();                         // drops received bytes
+ *     bool waitResponse();                  // false if the device does not answer at all
+ *     void startResponse();                 // starts the response deadline
+ *     int readByte();                       // next response byte, -1 after the deadline
+ *     size_t readBytesUntil(char terminator, char* buffer, size_t length);
+ *                                           // bytes including the terminator, as readByte()
+ *
+ * \author jasik
+ * \date   October 2026
+ *********************************************************************/
+
+#ifndef QSource3Transport_H_
+#define QSource3Transport_H_
+
+#include <Arduino.h>
+#include "QSource3Emulator.h"
+
+// polls of QSource3StreamTransport::waitResponse(), the timeout of the stream
+// does not work inside an interrupt. Tens of ms on the DUE, a host polls faster.
+#ifndef Q_SOURCE3_STREAM_RESPONSE_POLLS
+#define Q_SOURCE3_STREAM_RESPONSE_POLLS 655350
+#endif
+
+/// <summary>
+/// Arduino Stream, e.g. Serial2 without RTOS. Waits by polling, so the device
+/// may be driven from an interrupt; responses are bounded by the timeout of the stream.
+/// </summary>
+class QSource3StreamTransport {
+    Stream* _comm;
+public:
+    typedef Stream StreamType;
+
+    QSource3StreamTransport(Stream* comm): _comm(comm) {}
+
+    bool availableForWrite() { return _comm->availableForWrite() > 0; }
+    size_t write(const char* buff) { return _comm->write(buff); }
+    bool waitTxDone(uint32_t) { _comm->flush(); return true; }
+    void clear() { while (_comm->available() > 0) _comm->read(); }
+
+    bool waitResponse()
+    {
+        for (int i = 0; i < Q_SOURCE3_STREAM_RESPONSE_POLLS; ++i)
+        {
+            if (_comm->available()) return true;
+        }
+        return false;
+    }
+
+    void startResponse() {}
+
+    int readByte()
+    {
+        char ch;
+        return (_comm->readBytes(&ch, 1) == 0) ? -1 : (uint8_t)ch;
+    }
+
+    // Stream::readBytesUntil() drops the terminator, the other transports keep it
+    size_t readBytesUntil(char terminator, char* buffer, size_t length)
+    {
+        size_t n = 0;
+        while (n < length)
+        {
+            int ch = readByte();
+            if (ch < 0) break;
+            buffer[n++] = (char)ch;
+            if (ch == terminator) break;
+        }
+        return n;
+    }
+};
+
+
+/// <summary>
+/// A stream with response deadlines: RTOS_Stream or Linux_Stream. The reader
+/// sleeps in the stream until the bytes come, all responses of a query or burst
+/// share one deadline of the stream timeout.
+/// </summary>
+template <class S>
+class QSource3DeadlineTransport {
+    S* _comm;
+    uint32_t _deadline = 0;  // getTickCount() of the stream
+public:
+    typedef S StreamType;
+
+    QSource3DeadlineTransport(S* comm): _comm(comm) {}
+
+    bool availableForWrite() { return _comm->availableForWrite(); }
+    size_t write(const char* buff) { return _comm->write(buff); }
+    bool waitTxDone(uint32_t ticks) { return _comm->waitTxDone(ticks); }
+    void clear() { while (_comm->available() > 0) _comm->read(); }
+    bool waitResponse() { return true; }  // the deadline bounds the response
+    void startResponse() { _deadline = _comm->getTickCount() + _comm->getTimeout(); }
+
+    int readByte()
+    {
+        int ch;
+        while ((ch = _comm->read()) < 0)
+        {
+            if (!_comm->waitRx('\r', _deadline)) return -1;
+        }
+        return ch;
+    }
+
+    size_t readBytesUntil(char terminator, char* buffer, size_t length)
+    {
+        return _comm->readBytesUntil(terminator, buffer, length, _deadline);
+    }
+};
+
+
+/// <summary>
+/// In-memory loopback to a QSource3Emulator, no port is touched. Written bytes
+/// reach the emulator at their line times, responses are taken when due by
+/// micros(). Replaces the former TEST_Q_SOURCE3 mode and runs the whole
+/// protocol path on any board or on the host.
+/// </summary>
+class QSource3LoopbackTransport {
+    QSource3Emulator* _emulator;
+    uint32_t _timeout;        // us
+    uint32_t _txDone = 0;     // micros() when the last written byte has left
+    bool _txActive = false;   // _txDone is valid until waitTxDone(), micros() may be far from it later
+    uint32_t _deadline = 0;   // micros()
+
+    uint32_t _byteTime() const { return 10 * 1000000UL / _emulator->getConfig().baud; }
+public:
+    typedef QSource3Emulator StreamType;
+
+    /// <param name="timeout"> - response timeout in us</param>
+    QSource3LoopbackTransport(QSource3Emulator* emulator, uint32_t timeout = 100000):
+        _emulator(emulator), _timeout(timeout) {}
+
+    void setTimeout(uint32_t us) { _timeout = us; }
+
+    bool availableForWrite() { return true; }
+
+    size_t write(const char* buff)
+    {
+        uint32_t t = micros();
+        if (_txActive && ((int32_t)(_txDone - t) > 0)) t = _txDone;  // behind the previous bytes
+        uint32_t byteTime = _byteTime();
+        size_t n = 0;
+        for (; buff[n] != '\0'; ++n)
+        {
+            t += byteTime;
+            _emulator->receive(buff[n], t);
+        }
+        _txDone = t;
+        _txActive = true;
+        return n;
+    }
+
+    bool waitTxDone(uint32_t)
+    {
+        while (_txActive && ((int32_t)(_txDone - micros()) > 0));
+        _txActive = false;
+        return true;
+    }
+    void clear() { while (_emulator->transmit(micros()) >= 0); }
+    bool waitResponse() { return true; }
+    void startResponse() { _deadline = micros() + _timeout; }
+
+    int readByte()
+    {
+        for (;;)
+        {
+            uint32_t now = micros();
+            int ch = _emulator->transmit(now);
+            if (ch >= 0) return ch;
+            if ((int32_t)(now - _deadline) >= 0) return -1;
+        }
+    }
+
+    size_t readBytesUntil(char terminator, char* buffer, size_t length)
+    {
+        size_t n = 0;
+        while (n < length)
+        {
+            int ch = readByte();
+            if (ch < 0) break;
+            buffer[n++] = (char)ch;
+            if (ch == terminator) break;
+        }
+        return n;
+    }
+};
+
+
+/// <summary>
+/// No device: writes are taken at once, every query is answered by "OK".
+/// For timing the computation above the device, e.g. MSFilterQuad::setMZ().
+/// </summary>
+class QSource3NullTransport {
+    const char* _reply = "";
+public:
+    typedef void StreamType;
+
+    QSource3NullTransport(void*) {}
+
+    bool availableForWrite() { return true; }
+    size_t write(const char* buff) { _reply = "OK\r"; return strlen(buff); }
+    bool waitTxDone(uint32_t) { return true; }
+    void clear() { _reply = ""; }
+    bool waitResponse() { return true; }
+    void startResponse() {}
+    int readByte() { return (*_reply != '\0') ? *_reply++ : -1; }
+
+    size_t readBytesUntil(char terminator, char* buffer, size_t length)
+    {
+        size_t n = 0;
+        while ((n < length) && (*_reply != '\0'))
+        {
+            buffer[n] = *_reply++;
+            if (buffer[n++] == terminator) break;
+        }
+        return n;
+    }
+};
+
+
+#endif /* QSource3Transport_H_ */
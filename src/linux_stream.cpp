@@ -0,0 +1,237 @@
+#ifdef __linux__
+
+#include "linux_stream.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+
+// #define TRACE_LINUX_STREAM(x_) printf("%u ms -> Linux_Stream: ", getTickCount()); x_
+#define TRACE_LINUX_STREAM(x_)
+
+
+static speed_t _speed(uint32_t baud)
+{
+    switch (baud)
+    {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+    case 1000000: return B1000000;
+    case 1500000: return B1500000;
+    case 2000000: return B2000000;
+    default: return B0;
+    }
+}
+
+
+static bool _setRaw(int fd, speed_t speed)
+{
+    struct termios tio;
+    if (tcgetattr(fd, &tio) != 0) return false;
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if ((speed != B0) && (cfsetspeed(&tio, speed) != 0)) return false;
+    return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+
+Linux_Stream::Linux_Stream(const char* device, int timeout, uint32_t baud)
+:_device(device), _baud(baud), _timeout(timeout), _ownFd(true)
+{
+}
+
+Linux_Stream::Linux_Stream(int fd, int timeout)
+:_device(NULL), _baud(0), _timeout(timeout), _fd(fd), _ownFd(false)
+{
+}
+
+Linux_Stream::~Linux_Stream()
+{
+    if (_epoll >= 0) close(_epoll);
+    if (_ownFd && (_fd >= 0)) close(_fd);
+}
+
+bool Linux_Stream::init()
+{
+    TRACE_LINUX_STREAM( printf("init() ... %s\r\n", _device ? _device : "fd"); )
+    if (_fd < 0)
+    {
+        if ((_device == NULL) || (_speed(_baud) == B0)) return false;
+        _fd = open(_device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if (_fd < 0) return false;
+        if (!_setRaw(_fd, _speed(_baud))) return false;
+    }
+    else
+    {
+        int flags = fcntl(_fd, F_GETFL);
+        if ((flags < 0) || (fcntl(_fd, F_SETFL, flags | O_NONBLOCK) != 0)) return false;
+    }
+
+    if (_epoll < 0)
+    {
+        _epoll = epoll_create1(EPOLL_CLOEXEC);
+        if (_epoll < 0) return false;
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = _fd;
+        if (epoll_ctl(_epoll, EPOLL_CTL_ADD, _fd, &ev) != 0) return false;
+    }
+    return true;
+}
+
+uint32_t Linux_Stream::getTickCount() const
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+// waits for the events until the deadline, false when it has passed
+bool Linux_Stream::_wait(uint32_t events, uint32_t deadline)
+{
+    if (_epoll < 0) return false;
+
+    // wrap-around safe
+    uint32_t remaining = deadline - getTickCount();
+    if ((remaining == 0) || (remaining > UINT32_MAX / 2)) return false;
+
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.fd = _fd;
+    if (epoll_ctl(_epoll, EPOLL_CTL_MOD, _fd, &ev) != 0) return false;
+
+    int n;
+    do {
+        n = epoll_wait(_epoll, &ev, 1, (int)remaining);
+    } while ((n < 0) && (errno == EINTR));
+    return n >= 0;
+}
+
+// takes what the driver has, does not wait
+bool Linux_Stream::_fill(void)
+{
+    if (_rxPos < _rxLen) return true;
+    _rxPos = 0;
+    _rxLen = 0;
+    if (_fd < 0) return false;
+
+    ssize_t n = ::read(_fd, _rxBuffer, sizeof(_rxBuffer));
+    if (n <= 0) return false;  // EAGAIN: nothing received
+    _rxLen = n;
+    return true;
+}
+
+size_t Linux_Stream::write(const char* str)
+{
+    TRACE_LINUX_STREAM( printf("write(\"%s\")\r\n", str); )
+    if ((str == NULL) || (_fd < 0)) return 0;
+
+    size_t len = strlen(str);
+    size_t sent = 0;
+    uint32_t deadline = getTickCount() + _timeout;
+    while (sent < len)
+    {
+        ssize_t n = ::write(_fd, str + sent, len - sent);
+        if (n > 0)
+        {
+            sent += n;
+        }
+        else if ((n < 0) && (errno != EAGAIN) && (errno != EINTR))
+        {
+            break;
+        }
+        else if (!_wait(EPOLLOUT, deadline))
+        {
+            TRACE_LINUX_STREAM( printf("... write timeout\r\n"); )
+            break;
+        }
+    }
+    return sent;
+}
+
+int Linux_Stream::available()
+{
+    int n = 0;
+    if ((_fd >= 0) && (ioctl(_fd, FIONREAD, &n) != 0)) n = 0;
+    return (int)(_rxLen - _rxPos) + n;
+}
+
+int Linux_Stream::read()
+{
+    if (!_fill()) return -1;
+    return _rxBuffer[_rxPos++];
+}
+
+bool Linux_Stream::waitRx( char terminator, uint32_t deadline)
+{
+    (void)terminator;  // woken by any byte, the reader checks
+    if (_rxPos < _rxLen) return true;
+    return _wait(EPOLLIN, deadline);
+}
+
+size_t Linux_Stream::readBytesUntil( char terminator, char *buffer, size_t length)
+{
+    return readBytesUntil(terminator, buffer, length, getTickCount() + _timeout);
+}
+
+size_t Linux_Stream::readBytesUntil( char terminator, char *buffer, size_t length, uint32_t deadline)
+{
+    size_t idx = 0;
+    while (idx < length)
+    {
+        if (!_fill())
+        {
+            if (!_wait(EPOLLIN, deadline)) break;
+            continue;
+        }
+        char ch = _rxBuffer[_rxPos++];
+        buffer[idx++] = ch;
+        if (ch == terminator) break;
+    }
+    TRACE_LINUX_STREAM( printf("readBytesUntil() ... %u bytes\r\n", idx); )
+    return idx;
+}
+
+bool Linux_Stream::waitTxDone(const uint32_t xTicksToWait)
+{
+    (void)xTicksToWait;  // tcdrain() has no timeout
+    return (_fd >= 0) && (tcdrain(_fd) == 0);
+}
+
+bool Linux_Stream::openPty(int* master, int* slave)
+{
+    int m = posix_openpt(O_RDWR | O_NOCTTY);
+    if (m < 0) return false;
+    if ((grantpt(m) != 0) || (unlockpt(m) != 0))
+    {
+        close(m);
+        return false;
+    }
+    int s = open(ptsname(m), O_RDWR | O_NOCTTY);
+    if ((s < 0) || !_setRaw(s, B0))
+    {
+        if (s >= 0) close(s);
+        close(m);
+        return false;
+    }
+    *master = m;
+    *slave = s;
+    return true;
+}
+
+#endif  /* __linux__ */
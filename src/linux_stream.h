@@ -0,0 +1,102 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define LINUX_RX_BUFFER_LENGTH 256
+
+/// <summary>
+/// Stream over a Linux serial device, e.g. a USB-RS485 adapter, with the interface
+/// of RTOS_Stream, so JanasCardQSource3 drives the QSource3 from a PC.
+/// The descriptor is non-blocking, a reader waits in epoll until bytes come or
+/// its deadline passes. Ticks are milliseconds of CLOCK_MONOTONIC.
+/// </summary>
+class Linux_Stream
+{
+private:
+    const char* _device;
+    uint32_t _baud;
+    uint32_t _timeout;
+    int _fd = -1;
+    int _epoll = -1;
+    bool _ownFd;
+
+    uint8_t _rxBuffer[LINUX_RX_BUFFER_LENGTH];
+    size_t _rxPos = 0;
+    size_t _rxLen = 0;
+
+    bool _fill(void);
+    bool _wait(uint32_t events, uint32_t deadline);
+
+public:
+    /// <summary>
+    /// Constructor, the device is opened by init().
+    /// </summary>
+    /// <param name="device"> - e.g. "/dev/ttyUSB0"</param>
+    /// <param name="timeout"> - ms</param>
+    Linux_Stream(const char* device, int timeout, uint32_t baud = 1500000);
+
+    /// <summary>
+    /// Constructor for an open descriptor, e.g. the slave of a pty.
+    /// The descriptor is made non-blocking, it is not closed.
+    /// </summary>
+    Linux_Stream(int fd, int timeout);
+
+    ~Linux_Stream();
+
+    /// <summary>
+    /// Opens the device in raw mode, 8 bits, no parity, 1 stop bit.
+    /// </summary>
+    bool init();
+
+    /// <summary>
+    /// Writes the string, waits while the driver buffer is full.
+    /// </summary>
+    /// <returns>number of written bytes</returns>
+    size_t write(const char* str);
+
+    int available();
+
+    /// <summary>
+    /// Reads a received byte, does not wait.
+    /// </summary>
+    /// <returns>the byte or -1 if none was received</returns>
+    int read();
+
+    /// <summary>
+    /// Waits until bytes are received or the deadline, see RTOS_Stream::waitRx().
+    /// </summary>
+    /// <param name="deadline"> - tick count (getTickCount()) when to give up</param>
+    /// <returns>false when the deadline has passed</returns>
+    bool waitRx( char terminator, uint32_t deadline);
+
+    /// <summary>
+    /// Reads bytes until the terminator, length bytes or the deadline.
+    /// </summary>
+    /// <returns>number of bytes including the terminator</returns>
+    size_t readBytesUntil( char terminator, char *buffer, size_t length, uint32_t deadline);
+
+    size_t readBytesUntil( char terminator, char *buffer, size_t length);
+
+    /// <returns>timeout of the stream in ticks</returns>
+    uint32_t getTimeout() const {return _timeout;}
+
+    /// <returns>ms of CLOCK_MONOTONIC, the time base of the deadlines</returns>
+    uint32_t getTickCount() const;
+
+    /// <summary>
+    /// Waits until the driver has sent the written bytes (tcdrain).
+    /// </summary>
+    bool waitTxDone(const uint32_t xTicksToWait);
+
+    bool availableForWrite() const {return _fd >= 0;}
+
+    /// <summary>
+    /// Opens a pseudo terminal pair in raw mode, e.g. for an emulator on the master side.
+    /// </summary>
+    static bool openPty(int* master, int* slave);
+};
+
+#endif  /* __linux__ */
@@ -1,12 +1,9 @@
 #include "rtos_stream.h"
 #include <task.h>
-#include <queue.h>
 
 // #define TRACE_RTOS_STREAM(x_) printf("%d ms -> RTOS_Stream: ", millis()); x_
 #define TRACE_RTOS_STREAM(x_)
 
-QueueHandle_t _xQueueRx = NULL;
-
 RTOS_Stream::RTOS_Stream(USARTClass *usart, int timeout)
 :_usart(usart)
 {
@@ -15,7 +12,7 @@ RTOS_Stream::RTOS_Stream(USARTClass *usart, int timeout)
 
 bool RTOS_Stream::init()
 {
-    TRACE_RTOS_STREAM( printf("init() ... _xMessageBufferTx=%p, _xQueueRx=%p\r\n", _xMessageBufferTx, _xQueueRx); )
+    TRACE_RTOS_STREAM( printf("init() ... _xMessageBufferTx=%p, _xRxEvent=%p\r\n", _xMessageBufferTx, _xRxEvent); )
     if (_xMessageBufferTx == NULL)
     {
         TRACE_RTOS_STREAM( printf("... create _xMessageBufferTx...\r\n"); )
@@ -24,15 +21,19 @@ bool RTOS_Stream::init()
     if (_xMessageBufferTx == NULL) return false;
     }
 
-    if (_xQueueRx == NULL)
+    if (_xTxDone == NULL)
+    {
+        _xTxDone = xSemaphoreCreateBinary();
+        if (_xTxDone == NULL) return false;
+    }
+
+    if (_xRxEvent == NULL)
     {
-        TRACE_RTOS_STREAM( printf("... create _xQueueRx...\r\n"); )
-        _xQueueRx = xQueueCreate( RX_BUFFER_LENGTH, sizeof(uint8_t) );
-        TRACE_RTOS_STREAM( printf("... _xQueueRx=%p\r\n", _xQueueRx); )
-        if (_xQueueRx == NULL) return false;
+        _xRxEvent = xSemaphoreCreateBinary();
+        if (_xRxEvent == NULL) return false;
     }
 
-    _usart->setRxIrqCallback(&usartRxIrqCallback);
+    _usart->setRxIrqCallback(&_rxIrq, this);
 
     return true;
 }
@@ -62,6 +63,8 @@ size_t RTOS_Stream::write(const char* str)
         return xBytesSent;
     }
 
+    // forget completions of messages nobody waited for
+    xSemaphoreTake( _xTxDone, 0 );
     xBytesSent = xMessageBufferSend( _xMessageBufferTx,
                                ( void * ) str,
                                strlen( str ),
@@ -72,78 +75,62 @@ size_t RTOS_Stream::write(const char* str)
 
 int RTOS_Stream::available()
 {
-    if (_xQueueRx == NULL) return false;
-    if( xPortIsInsideInterrupt() )
-    {
-        return uxQueueMessagesWaitingFromISR( _xQueueRx );
-    }
-    return uxQueueMessagesWaiting( _xQueueRx );
+    return _rxRing.available();
 }
 
 int RTOS_Stream::read()
 {
-    if (_xQueueRx == NULL) return 0;
+    return _rxRing.pop();
+}
 
-    uint8_t ch;
-    BaseType_t rc;
+bool RTOS_Stream::waitRx( char terminator, TickType_t deadline)
+{
+    if ((_xRxEvent == NULL) || xPortIsInsideInterrupt()) return false;
 
-    if( xPortIsInsideInterrupt() )
-    {
-        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-        rc = xQueueReceiveFromISR(
-            _xQueueRx,
-            ( void * ) &ch,
-            &xHigherPriorityTaskWoken
-        );
-        portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
-        return (pdTRUE == rc ? 1 : 0);
-    }
+    _rxTerminator = terminator;
+    _rxRing.arm(RX_NOTIFY_THRESHOLD);
 
-    return (pdTRUE == xQueueReceive( _xQueueRx, ( void * ) &ch, _timeout ) ? 1 : 0);
+    // wrap-around safe
+    TickType_t remaining = deadline - xTaskGetTickCount();
+    if ((remaining == 0) || (remaining > portMAX_DELAY / 2)) return false;
+    xSemaphoreTake( _xRxEvent, remaining );
+    return true;
 }
 
 size_t RTOS_Stream::readBytesUntil( char terminator, char *buffer, size_t length)
 {
-    TRACE_RTOS_STREAM( printf("readBytesUntil(terminator=0x%02x, buffer=%p, length=%u)\r\n", reinterpret_cast<uint32_t*>(terminator), static_cast<void*>(buffer), length); )
+    TickType_t deadline = xPortIsInsideInterrupt() ? 0 : xTaskGetTickCount() + _timeout;
+    return readBytesUntil(terminator, buffer, length, deadline);
+}
 
-    TRACE_RTOS_STREAM( printf("... _xQueueRx=%p.\r\n", _xQueueRx); )
-    if (_xQueueRx == NULL) return 0;
+size_t RTOS_Stream::readBytesUntil( char terminator, char *buffer, size_t length, TickType_t deadline)
+{
+    TRACE_RTOS_STREAM( printf("readBytesUntil(terminator=0x%02x, buffer=%p, length=%u, deadline=%u)\r\n", reinterpret_cast<uint32_t*>(terminator), static_cast<void*>(buffer), length, deadline); )
 
-    size_t idx;
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    TRACE_RTOS_STREAM( printf("... _xRxEvent=%p.\r\n", _xRxEvent); )
+    if (_xRxEvent == NULL) return 0;
 
     bool insideITR = xPortIsInsideInterrupt();
+    _rxTerminator = terminator;
 
-    for(idx=0; (idx < length) && (idx < RX_BUFFER_LENGTH);)
+    size_t idx = 0;
+    for(;;)
     {
-        if( insideITR )
-        {
-            if( xQueueReceiveFromISR(
-                    _xQueueRx,
-                    ( void * ) (buffer + idx),
-                    &xHigherPriorityTaskWoken
-            ))
-            {
-                TRACE_RTOS_STREAM( printf("... %c received from ISR.\r\n", buffer[idx]); )
-                ++idx;
-            }
-            else break;
-        }
-        else
-        {
-            if( xQueueReceive(
-                    _xQueueRx,
-                    ( void * ) (buffer + idx),
-                    _timeout
-            ))
-            {
-                TRACE_RTOS_STREAM( printf("... %c received.\r\n", buffer[idx]); )
-                ++idx;
-            }
-            else break;
-        }
-
-        if( (idx > 0) && (buffer[idx - 1] == terminator) ) break;
+        bool found;
+        idx += _rxRing.read(terminator, buffer + idx, length - idx, &found);
+        if (found || (idx >= length) || insideITR) break;
+
+        // sleep until the interrupt has the terminator or the missing bytes,
+        // a left-over event of an earlier response only repeats the check
+        size_t missing = length - idx;
+        size_t level = missing < RX_NOTIFY_THRESHOLD ? missing : RX_NOTIFY_THRESHOLD;
+        _rxRing.arm(level);
+        if (_rxRing.available() >= level) continue;
+
+        // wrap-around safe
+        TickType_t remaining = deadline - xTaskGetTickCount();
+        if ((remaining == 0) || (remaining > portMAX_DELAY / 2)) break;
+        xSemaphoreTake( _xRxEvent, remaining );
     }
 
     TRACE_RTOS_STREAM( printf("... %u bytes received in total.\r\n", idx); )
@@ -155,34 +142,71 @@ void RTOS_Stream::workTx(const TickType_t xTicksToWaitBufferReceive)
 {
     if (_xMessageBufferTx == NULL) return;
 
-    uint8_t ucRxData[ TX_BUFFER_LENGTH ];
     size_t xReceivedBytes;
 
     TRACE_RTOS_STREAM( printf("RTOS_Stream::workTx() waiting for message ...\r\n"); )
     // wait indefinitely (without timing out), provided INCLUDE_vTaskSuspend is set to 1
     xReceivedBytes = xMessageBufferReceive( _xMessageBufferTx,
-                                            ( void * ) ucRxData,
-                                            sizeof( ucRxData ),
+                                            ( void * ) _txBlock,
+                                            sizeof( _txBlock ),
                                             xTicksToWaitBufferReceive  );
-    TRACE_RTOS_STREAM( printf("RTOS_Stream::workTx() ... %u bytes received. Writing to usart: \r\n", xReceivedBytes); )
-    for(size_t i = 0; i < xReceivedBytes; ++i)
+    if (xReceivedBytes == 0) return;
+
+    TRACE_RTOS_STREAM( printf("RTOS_Stream::workTx() ... %u bytes received. Writing to usart\r\n", xReceivedBytes); )
+    _txTask = xTaskGetCurrentTaskHandle();
+    if (_usart->writeBlock(_txBlock, xReceivedBytes, &_txBlockDone, this))
     {
-        // TRACE_RTOS_STREAM( printf("%c\r\n", ucRxData[i]); )
-        _usart->write(ucRxData[i]);
+        // _txBlockDone() gives _xTxDone
+        if (!ulTaskNotifyTake(pdTRUE, _timeout))
+        {
+            // lost interrupt, _txBlock must not be overwritten while the PDC reads it
+            TRACE_RTOS_STREAM( printf("RTOS_Stream::workTx() ... block timeout\r\n"); )
+            _usart->flush();
+            // the bytes have left, the writer must not wait for the lost
+            // completion; a late one is forgotten by the next write()
+            xSemaphoreGive( _xTxDone );
+        }
+    }
+    else
+    {
+        // the transmitter is still busy with characters written directly
+        for(size_t i = 0; i < xReceivedBytes; ++i)
+        {
+            _usart->write(_txBlock[i]);
+        }
+        _usart->flush();  // wait until the bytes have left the USART
+        xSemaphoreGive( _xTxDone );
     }
     TRACE_RTOS_STREAM( printf("RTOS_Stream::workTx() Writing to usart done\r\n"); )
 }
 
-void usartRxIrqCallback(uint8_t ch)
+void RTOS_Stream::_txBlockDone(void* ctx)
 {
-    // TRACE_RTOS_STREAM( printf("RTOS_Stream::usartRxIrqCallback(ch=%c)\r\n"); )
-    if(_xQueueRx != NULL)
+    // called from the USART interrupt after the last stop bit
+    RTOS_Stream* stream = static_cast<RTOS_Stream*>(ctx);
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    xSemaphoreGiveFromISR( stream->_xTxDone, &xHigherPriorityTaskWoken );
+    vTaskNotifyGiveFromISR( stream->_txTask, &xHigherPriorityTaskWoken );
+    portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+}
+
+bool RTOS_Stream::waitTxDone(const TickType_t xTicksToWait)
+{
+    if (_xTxDone == NULL) return false;
+    if (xPortIsInsideInterrupt()) return true;  // can not block here
+    return (pdTRUE == xSemaphoreTake( _xTxDone, xTicksToWait ));
+}
+
+void RTOS_Stream::_rxIrq(uint8_t ch, void* ctx)
+{
+    // called from the USART interrupt of this stream
+    RTOS_Stream* stream = static_cast<RTOS_Stream*>(ctx);
+    // one kernel call per response instead of one per byte, a burst past
+    // the level of the reader wakes it once
+    if (stream->_rxRing.pushNotify(ch, stream->_rxTerminator))
     {
-        BaseType_t xHigherPriorityTaskWoken;
-        xQueueSendFromISR( _xQueueRx, &ch, &xHigherPriorityTaskWoken );
-        if( xHigherPriorityTaskWoken )
-        {
-            portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
-        }
+        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+        xSemaphoreGiveFromISR( stream->_xRxEvent, &xHigherPriorityTaskWoken );
+        portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
     }
-}
\ No newline at end of file
+}
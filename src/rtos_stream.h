@@ -3,12 +3,17 @@
 #include <Arduino.h>
 #include <FreeRTOS.h>
 #include <message_buffer.h>
+#include <semphr.h>
+#include <task.h>
+#include "rx_ring.h"
 
-#define RX_BUFFER_LENGTH 128
 #define TX_BUFFER_LENGTH 128
 
-void usartRxIrqCallback(uint8_t ch);
-
+/// <summary>
+/// FreeRTOS stream over one USART. All receive state belongs to the instance,
+/// so every serial port can have its own stream, e.g. two QSource3 supplies
+/// on Serial1 and Serial2.
+/// </summary>
 class RTOS_Stream
 {
 private:
@@ -16,18 +21,79 @@ private:
     TickType_t _timeout;
 
     MessageBufferHandle_t _xMessageBufferTx = NULL;
-    
-    char _rxBuffer[RX_BUFFER_LENGTH];
-    size_t _rxIdx = 0;
+    SemaphoreHandle_t _xTxDone = NULL;  // given when a message has left the USART
+
+    uint8_t _txBlock[TX_BUFFER_LENGTH];  // message being sent by the PDC
+    TaskHandle_t _txTask = NULL;         // task running workTx()
+    static void _txBlockDone(void* ctx);
+
+    RxRing _rxRing;
+    SemaphoreHandle_t _xRxEvent = NULL;  // given by the interrupt on a terminator or enough bytes
+    volatile char _rxTerminator = '\r';
+
+    static void _rxIrq(uint8_t ch, void* ctx);
 
 public:
     RTOS_Stream(USARTClass* stream, int timeout);
     bool init();
     size_t write(const char* str);
     int available();
+
+    /// <summary>
+    /// Reads a received byte, does not wait.
+    /// </summary>
+    /// <returns>the byte or -1 if none was received</returns>
     int read();
+
+    /// <summary>
+    /// Waits until the interrupt has received the terminator or RX_NOTIFY_THRESHOLD
+    /// bytes, for readers that take the bytes one by one with read().
+    /// May return early because of an event left over from an earlier response,
+    /// the caller reads what is available and waits again.
+    /// </summary>
+    /// <param name="deadline"> - tick count (xTaskGetTickCount()) when to give up</param>
+    /// <returns>false when the deadline has passed</returns>
+    bool waitRx( char terminator, TickType_t deadline);
+
+    /// <summary>
+    /// Reads bytes until the terminator, length bytes or the deadline.
+    /// The reading task sleeps until the interrupt has received the terminator or
+    /// the missing bytes (at most RX_NOTIFY_THRESHOLD), it is not woken per byte.
+    /// </summary>
+    /// <param name="deadline"> - tick count (xTaskGetTickCount()) when to give up,
+    /// the whole call is bounded by it however slowly the bytes come</param>
+    /// <returns>number of bytes including the terminator</returns>
+    size_t readBytesUntil( char terminator, char *buffer, size_t length, TickType_t deadline);
+
+    /// <summary>
+    /// Reads bytes until the terminator, length bytes or the timeout of the stream
+    /// counted from the call.
+    /// </summary>
     size_t readBytesUntil( char terminator, char *buffer, size_t length);
+
+    /// <returns>timeout of the stream in ticks</returns>
+    TickType_t getTimeout() const {return _timeout;}
+
+    /// <returns>the time base of the deadlines, xTaskGetTickCount()</returns>
+    TickType_t getTickCount() const {return xTaskGetTickCount();}
+
+    /// <returns>number of received bytes dropped because nobody read them in time</returns>
+    uint32_t getRxOverflows() const {return _rxRing.getOverflows();}
+
+
+    /// <summary>
+    /// Sends one written message, the body of the transmitting task.
+    /// The message is handed to the PDC of the USART as one block, the task
+    /// sleeps until the interrupt reports that the last stop bit has left.
+    /// </summary>
     void workTx(const TickType_t xTicksToWaitBufferReceive);
+
+    /// <summary>
+    /// Waits until workTx() has transmitted the last message written by this task.
+    /// Returns immediately when called from an interrupt.
+    /// </summary>
+    /// <returns>false on timeout</returns>
+    bool waitTxDone(const TickType_t xTicksToWait);
     
     bool availableForWrite() const {return _usart->availableForWrite();}
 };
@@ -0,0 +1,153 @@
+#ifndef RxRing_h
+#define RxRing_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef RX_BUFFER_LENGTH
+#define RX_BUFFER_LENGTH 128
+#endif
+
+static_assert((RX_BUFFER_LENGTH & (RX_BUFFER_LENGTH - 1)) == 0, "RX_BUFFER_LENGTH must be a power of two");
+
+// a waiting reader is woken when this many bytes are stored without terminator
+#define RX_NOTIFY_THRESHOLD (RX_BUFFER_LENGTH / 2)
+
+// full memory barrier, orders the index accesses against the data accesses
+#define RX_RING_BARRIER() __sync_synchronize()
+
+
+/// <summary>
+/// Lock-free byte ring for one producer (the USART receive interrupt) and one
+/// consumer (the reading task). The producer writes only _head, the consumer
+/// only _tail, so neither side needs a lock or a kernel call.
+/// The indices run freely, their difference is the number of stored bytes.
+/// Depends on the compiler only, so it runs on a host as well.
+///
+/// The producer wakes a sleeping consumer by pushNotify(): on the terminator,
+/// or once when the stored bytes reach the level armed by the consumer.
+/// </summary>
+class RxRing
+{
+private:
+    static const uint32_t MASK = RX_BUFFER_LENGTH - 1;
+
+    uint8_t _buffer[RX_BUFFER_LENGTH];
+    volatile uint32_t _head = 0;
+    volatile uint32_t _tail = 0;
+    volatile uint32_t _overflows = 0;
+    volatile uint32_t _level = RX_NOTIFY_THRESHOLD;  // written by the consumer
+    volatile bool _notified = false;  // the level was reported, set by the producer, cleared by the consumer
+
+public:
+    // producer methods
+
+    /// <summary>
+    /// Stores a byte, drops it when the ring is full.
+    /// </summary>
+    /// <returns>number of stored bytes, 0 if the byte was dropped</returns>
+    size_t push(uint8_t ch)
+    {
+        uint32_t head = _head;
+        if (head - _tail >= RX_BUFFER_LENGTH)
+        {
+            _overflows = _overflows + 1;
+            return 0;
+        }
+        _buffer[head & MASK] = ch;
+        RX_RING_BARRIER();
+        _head = head + 1;
+        return head + 1 - _tail;
+    }
+
+    /// <summary>
+    /// Stores a byte like push() and tells whether to wake the consumer: on the
+    /// terminator, and once when the stored bytes reach the armed level, also
+    /// when a burst passes it or the ring is full, until the consumer arms again.
+    /// </summary>
+    /// <returns>true if the consumer is to be woken</returns>
+    bool pushNotify(uint8_t ch, char terminator)
+    {
+        size_t n = push(ch);
+        if (ch == (uint8_t)terminator) return true;
+        if (_notified) return false;
+        RX_RING_BARRIER();  // the level armed before _notified was cleared
+        if ((n != 0) && (n < _level)) return false;  // 0: dropped, the ring is full
+        _notified = true;
+        return true;
+    }
+
+    // consumer methods
+
+    size_t available(void) const { return _head - _tail; }
+
+    /// <summary>
+    /// Sets the level of the next wake-up by pushNotify(). The caller checks
+    /// available() afterwards, bytes stored before arming do not wake it.
+    /// </summary>
+    void arm(size_t level)
+    {
+        _level = level;
+        RX_RING_BARRIER();
+        _notified = false;
+        RX_RING_BARRIER();
+    }
+
+    /// <returns>the oldest byte or -1 when empty</returns>
+    int pop(void)
+    {
+        uint32_t tail = _tail;
+        if (tail == _head)
+        {
+            return -1;
+        }
+        RX_RING_BARRIER();
+        uint8_t ch = _buffer[tail & MASK];
+        RX_RING_BARRIER();
+        _tail = tail + 1;
+        return ch;
+    }
+
+    /// <summary>
+    /// Copies the stored bytes up to and including the terminator.
+    /// </summary>
+    /// <param name="terminator">- last byte to copy</param>
+    /// <param name="buffer">- output</param>
+    /// <param name="length">- maximum number of bytes to copy</param>
+    /// <param name="found">- output, true if the terminator was copied</param>
+    /// <returns>number of copied bytes</returns>
+    size_t read(char terminator, char* buffer, size_t length, bool* found)
+    {
+        uint32_t tail = _tail;
+        uint32_t n = _head - tail;
+        RX_RING_BARRIER();
+        if (n > length) n = length;
+
+        size_t i = 0;
+        *found = false;
+        while (i < n)
+        {
+            char ch = _buffer[(tail + i) & MASK];
+            buffer[i++] = ch;
+            if (ch == terminator)
+            {
+                *found = true;
+                break;
+            }
+        }
+        RX_RING_BARRIER();
+        _tail = tail + i;
+        return i;
+    }
+
+    /// <summary>
+    /// Drops all stored bytes.
+    /// </summary>
+    void clear(void) { _tail = _head; }
+
+    /// <returns>number of bytes dropped because the ring was full</returns>
+    uint32_t getOverflows(void) const { return _overflows; }
+};
+
+
+#endif